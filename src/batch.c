@@ -0,0 +1,185 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Implements the `batch` operation
+///
+/// Each line read is a command, the operation and its options as they would
+/// be given on the command line, which is run in-process with a context of its
+/// own, between a `command:` and a `result:` line written to stdout so that
+/// the output of each can be told apart. The data directory, parent process,
+/// verbose and trace options of the `batch` operation are passed on to each
+/// command unless the line overrides them. Housekeeping is done once, for the
+/// whole batch, and not by each command.
+
+#include "operations.h"
+#include "params.h"
+#include "procctrl.h"
+#ifdef _WIN32
+# define snprintf _snprintf
+#else /* ifdef _WIN32 */
+# include <errno.h>
+#endif /* ifdef _WIN32 */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// @brief The number of arguments passed on to each command, with the program name
+#define BATCH_INHERITED 9
+
+/// @brief Reads a line, without the trailing newline
+///
+/// @return the line, which is valid until the next call, or NULL at the end
+///         of the input
+static char *read_line (
+    FILE *in, ///<the stream to read from>
+    char **buffer, ///<the buffer, grown as necessary>
+    size_t *size ///<the size of the buffer>
+    ) {
+    size_t len = 0;
+    if (!*buffer) {
+        *size = 256;
+        *buffer = (char*)malloc (*size);
+        if (!*buffer) abort ();
+    }
+    while (fgets (*buffer + len, (int)(*size - len), in)) {
+        len += strlen (*buffer + len);
+        if (len && ((*buffer)[len - 1] == '\n')) {
+            (*buffer)[--len] = 0;
+            if (len && ((*buffer)[len - 1] == '\r')) (*buffer)[--len] = 0;
+            return *buffer;
+        }
+        if (len + 1 < *size) break;
+        *size *= 2;
+        *buffer = (char*)realloc (*buffer, *size);
+        if (!*buffer) abort ();
+    }
+    return len ? *buffer : NULL;
+}
+
+/// @brief Splits a line into arguments, in place
+///
+/// Arguments are separated by whitespace. Double quotes group whitespace into
+/// an argument, and a backslash escapes the character following it.
+///
+/// @return the number of arguments
+static int split_line (
+    char *line, ///<the line, which is modified>
+    char ***argv, ///<the argument array, grown as necessary>
+    int *size, ///<the number of elements in the argument array>
+    int first ///<the index of the first argument to write>
+    ) {
+    char *in = line, *out = line;
+    int argc = first;
+    while (1) {
+        int quoted = 0;
+        while (isspace ((unsigned char)*in)) in++;
+        if (!*in) break;
+        if (argc + 1 >= *size) {
+            *size *= 2;
+            *argv = (char**)realloc (*argv, *size * sizeof (char*));
+            if (!*argv) abort ();
+        }
+        (*argv)[argc++] = out;
+        while (*in && (quoted || !isspace ((unsigned char)*in))) {
+            if (*in == '\"') {
+                quoted = !quoted;
+                in++;
+            } else {
+                if ((*in == '\\') && in[1]) in++;
+                *out++ = *in++;
+            }
+        }
+        if (*in) in++;
+        *out++ = 0;
+    }
+    (*argv)[argc] = NULL;
+    return argc - first;
+}
+
+/// @brief Runs a single command from the batch
+///
+/// @return the result of the command
+static int run_command (
+    int argc, ///<the number of arguments, including the inherited ones>
+    char **argv ///<the arguments>
+    ) {
+    struct procctrl_context *context, *previous = params_current;
+    const char *name;
+    int e;
+    if ((e = procctrl_create (argc, argv, &context)) != 0) return e;
+    params_current = context;
+    name = PARAM (operation);
+    params_current = previous;
+    if (name && !strcmp (name, "batch")) {
+        fprintf (stderr, "Batches can't be nested\n");
+        e = _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL);
+    } else {
+        e = procctrl_run (context);
+    }
+    procctrl_free (context);
+    return e;
+}
+
+/// @brief Implementation of operation_batch()
+///
+/// This is separated out for use by unit tests.
+///
+/// @return zero if the input was read, otherwise a non-zero error code
+int _operation_batch (
+    FILE *in, ///<the stream to read commands from>
+    FILE *out ///<the stream to write results to>
+    ) {
+    char parent[16];
+    char *buffer = NULL, *line;
+    char **argv;
+    size_t buffer_size = 0;
+    int argv_size = BATCH_INHERITED + 16, inherited = 0, argc, commands = 0, e;
+    argv = (char**)malloc (argv_size * sizeof (char*));
+    if (!argv) abort ();
+    snprintf (parent, sizeof (parent), "%u", _WIN32_OR_POSIX (GetProcessId (PARAM (parent_process)), PARAM (parent_process)));
+    argv[inherited++] = "procctrl";
+    argv[inherited++] = "-d";
+    argv[inherited++] = (char*)PARAM (data_dir);
+    argv[inherited++] = "-P";
+    argv[inherited++] = parent;
+    argv[inherited++] = "-H";
+    argv[inherited++] = "0";
+    if (PARAM (verbose)) argv[inherited++] = "-v";
+    if (PARAM (trace_enabled)) argv[inherited++] = "-X";
+    while ((line = read_line (in, &buffer, &buffer_size)) != NULL) {
+        argc = split_line (line, &argv, &argv_size, inherited);
+        if (!argc || (argv[inherited][0] == '#')) continue;
+        // The command's own output is framed by these lines, so that it
+        // can be told apart from the results
+        fprintf (out, "command: %d\n", ++commands);
+        fflush (out);
+        if (PARAM (verbose)) fprintf (stdout, "Running batch command %d\n", commands);
+        e = run_command (inherited + argc, argv);
+        fflush (stdout);
+        fprintf (out, "result: %d %d\n", commands, e);
+        fflush (out);
+    }
+    e = ferror (in) ? _WIN32_OR_POSIX (ERROR_READ_FAULT, EIO) : 0;
+    free (buffer);
+    free (argv);
+    return e;
+}
+
+/// @brief Runs commands read from stdin
+///
+/// Each line is an operation with its options, as for the command line. Its
+/// output to stdout is framed by a line `command: ` followed by the number of
+/// the command before it runs, and a line `result: ` followed by the number
+/// and the result of the operation once it completes. Blank lines, and lines
+/// starting with `#`, are ignored and not numbered.
+///
+/// @return zero if the input was read, otherwise a non-zero error code
+int operation_batch () {
+    return _operation_batch (stdin, stdout);
+}
@@ -0,0 +1,531 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Microbenchmarks for the hot paths
+///
+/// Built and run with `make bench`. Each benchmark repeats an operation a
+/// fixed number of times and reports the median and 99th percentile latency
+/// with the number of system calls made per operation.
+///
+/// System calls are counted with the `raw_syscalls:sys_enter` tracepoint if
+/// the kernel allows it. Otherwise only the read and write calls reported by
+/// `/proc/self/io` are counted.
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#include "kill.h"
+#include "operations.h"
+#include "params.h"
+#include "process.h"
+#include "procfs.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/// @brief The command line of the long running process used by the benchmarks
+#define BENCH_SLEEP         "600"
+
+/// @brief A long argument, to give verify_pid a long command line to match
+///
+/// `sleep` adds its arguments together so this doesn't change the duration.
+#define BENCH_LONG_ARG      "0.0000000000000000000000000000000000000000000000000000000000" \
+                            "0000000000000000000000000000000000000000000000000000000000000" \
+                            "0000000000000000000000000000000000000000000000000000000000000"
+
+/// @brief The number of queries made by each concurrent client
+#define BENCH_QUERIES       200
+
+/// @brief The first identifier in a synthetic process table
+///
+/// This is above the kernel's limit, so nothing in the real process table can
+/// be confused with a synthetic process.
+#define BENCH_SYNTHETIC_PID 5000000
+
+/// @brief The temporary data directory
+static char _data_dir[16];
+
+/// @brief The performance counter for system calls, or -1 to use /proc/self/io
+static int _syscalls = -1;
+
+/// @brief Reads the monotonic clock
+///
+/// @return the time in microseconds from an arbitrary origin
+static double now_us () {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+/// @brief Opens the system call counter
+///
+/// The counter is inherited by child processes so it includes the calls made
+/// by concurrent clients.
+static void syscalls_open () {
+    static const char *ids[] = {
+        "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+        "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+        NULL
+    };
+    struct perf_event_attr attr;
+    int i;
+    for (i = 0; ids[i]; i++) {
+        FILE *in = fopen (ids[i], "rt");
+        unsigned long long id;
+        if (!in) continue;
+        if (fscanf (in, "%llu", &id) == 1) {
+            memset (&attr, 0, sizeof (attr));
+            attr.type = PERF_TYPE_TRACEPOINT;
+            attr.size = sizeof (attr);
+            attr.config = id;
+            attr.inherit = 1;
+            _syscalls = (int)syscall (SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        }
+        fclose (in);
+        if (_syscalls >= 0) break;
+    }
+}
+
+/// @brief Reads the system call counter
+///
+/// @return the number of system calls made so far
+static unsigned long long syscalls_read () {
+    unsigned long long count = 0, value;
+    char key[32];
+    FILE *in;
+    if (_syscalls >= 0) {
+        uint64_t total;
+        if (read (_syscalls, &total, sizeof (total)) == sizeof (total)) return total;
+        return 0;
+    }
+    in = fopen ("/proc/self/io", "rt");
+    if (!in) return 0;
+    while (fscanf (in, "%31s %llu", key, &value) == 2) {
+        if (!strcmp (key, "syscr:") || !strcmp (key, "syscw:")) count += value;
+    }
+    fclose (in);
+    return count;
+}
+
+/// @brief Comparison function for qsort
+static int compare_double (const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/// @brief Writes the result of a benchmark
+static void report (
+    const char *name, ///<the benchmark name>
+    double *samples, ///<the latency of each operation in microseconds, sorted by this function>
+    int count, ///<the number of samples>
+    unsigned long long syscalls ///<the number of system calls made by all of the operations>
+    ) {
+    int p99 = (count * 99) / 100;
+    if (p99 >= count) p99 = count - 1;
+    qsort (samples, count, sizeof (double), compare_double);
+    fprintf (stdout, "%-36s %6d %12.1f %12.1f %12.1f\n",
+        name, count, samples[count / 2], samples[p99], (double)syscalls / count);
+    fflush (stdout);
+}
+
+/// @brief Reaps any terminated children
+static void reap () {
+    int status;
+    while (waitpid (-1, &status, WNOHANG) > 0);
+}
+
+/// @brief Spawns a long running process
+///
+/// @return the process
+static pid_t spawn_sleep (
+    const char *arg ///<an additional argument to `sleep`, or NULL for none>
+    ) {
+    pid_t child = fork ();
+    if (child == 0) {
+        execlp ("sleep", "sleep", BENCH_SLEEP, arg, (char*)NULL);
+        _exit (errno);
+    }
+    // Give the child time to exec
+    usleep (100000);
+    return child;
+}
+
+/// @brief Sets the parameters for a benchmark
+///
+/// The parameters are command line arguments, followed by NULL, that are
+/// passed after the common ones.
+static void bench_params (
+    const char *arg, ///<the first argument>
+    ... ///<further arguments, terminated by NULL>
+    ) {
+    char *argv[16];
+    char scope[16];
+    int argc = 0;
+    va_list args;
+    snprintf (scope, sizeof (scope), "%u", getpid ());
+    argv[argc++] = "bench";
+    argv[argc++] = "-d";
+    argv[argc++] = _data_dir;
+    argv[argc++] = "-P";
+    argv[argc++] = scope;
+    va_start (args, arg);
+    for (; arg && (argc < 15); arg = va_arg (args, const char*)) {
+        argv[argc++] = (char*)arg;
+    }
+    va_end (args);
+    argv[argc] = NULL;
+    if (params (argc, argv)) {
+        fprintf (stderr, "Bad benchmark parameters\n");
+        exit (1);
+    }
+}
+
+/// @brief Creates a node of a synthetic process tree
+///
+/// Each node forks its children, which wait to be signalled, and then writes
+/// a byte to the pipe.
+static void tree_node (
+    int depth, ///<the number of levels below this node>
+    int fanout, ///<the number of children of each node>
+    int ready ///<the pipe to write to once the children have been created>
+    ) {
+    int i;
+    for (i = 0; (depth > 0) && (i < fanout); i++) {
+        if (fork () == 0) {
+            tree_node (depth - 1, fanout, ready);
+            while (1) pause ();
+        }
+    }
+    if (write (ready, "n", 1) != 1) _exit (1);
+}
+
+/// @brief Benchmarks signal_tree (through kill_process) on a process tree
+static void bench_signal_tree (
+    const char *name, ///<the benchmark name>
+    int depth, ///<the number of levels below the root>
+    int fanout, ///<the number of children of each node>
+    int runs ///<the number of repetitions>
+    ) {
+    double *samples = (double*)malloc (runs * sizeof (double));
+    unsigned long long syscalls = 0, before;
+    int nodes = 1, level = 1, run, i, ready[2], status;
+    char c;
+    for (i = 0; i < depth; i++) nodes += (level *= fanout);
+    for (run = 0; run < runs; run++) {
+        pid_t root;
+        double start;
+        if (pipe (ready)) abort ();
+        root = fork ();
+        if (root == 0) {
+            close (ready[0]);
+            tree_node (depth, fanout, ready[1]);
+            while (1) pause ();
+        }
+        close (ready[1]);
+        for (i = 0; (i < nodes) && (read (ready[0], &c, 1) == 1); i++);
+        close (ready[0]);
+        before = syscalls_read ();
+        start = now_us ();
+        kill_process (root);
+        samples[run] = now_us () - start;
+        syscalls += syscalls_read () - before;
+        // The orphaned nodes are re-parented to this process, the subreaper
+        for (i = 0; i < nodes; i++) {
+            if (waitpid (-1, &status, 0) < 0) break;
+        }
+    }
+    report (name, samples, runs, syscalls);
+    free (samples);
+}
+
+/// @brief Benchmarks verify_pid (through process_find) on a command line
+static void bench_verify_pid (
+    const char *name, ///<the benchmark name>
+    const char *arg, ///<an additional argument to `sleep`, or NULL for none>
+    int runs ///<the number of repetitions>
+    ) {
+    double *samples = (double*)malloc (runs * sizeof (double));
+    unsigned long long before;
+    pid_t child = spawn_sleep (arg);
+    int run;
+    bench_params ("-k", "bench-find", "start", "sleep", BENCH_SLEEP, arg, NULL);
+    if (process_save (child, 0)) {
+        fprintf (stderr, "Couldn't save process information\n");
+        exit (1);
+    }
+    before = syscalls_read ();
+    for (run = 0; run < runs; run++) {
+        double start = now_us ();
+        if (process_find () != child) fprintf (stderr, "Process %u not found\n", child);
+        samples[run] = now_us () - start;
+    }
+    report (name, samples, runs, syscalls_read () - before);
+    kill (child, SIGTERM);
+    waitpid (child, NULL, 0);
+    free (samples);
+}
+
+/// @brief Benchmarks process_housekeep with a number of information files
+///
+/// All of the files describe a running process so they are kept, and every
+/// run does the same work.
+static void bench_housekeep (
+    const char *name, ///<the benchmark name>
+    int entries, ///<the number of information files>
+    int runs ///<the number of repetitions>
+    ) {
+    double *samples = (double*)malloc (runs * sizeof (double));
+    unsigned long long before;
+    struct process_info *info = NULL;
+    pid_t child = spawn_sleep (NULL);
+    char path[64], value[16];
+    int i, run;
+    snprintf (value, sizeof (value), "%u", child);
+    info = process_info_set (info, "pid", value);
+    info = process_info_set (info, "cmd", "sleep " BENCH_SLEEP);
+    snprintf (path, sizeof (path), "%s/%u", _data_dir, getpid ());
+    mkdir (path, 0755);
+    for (i = 0; i < entries; i++) {
+        snprintf (path, sizeof (path), "%s/%u/bench%05d", _data_dir, getpid (), i);
+        if (process_info_write (path, info)) {
+            fprintf (stderr, "Couldn't write %s\n", path);
+            exit (1);
+        }
+    }
+    process_info_free (info);
+    bench_params ("query", NULL);
+    before = syscalls_read ();
+    for (run = 0; run < runs; run++) {
+        double start = now_us ();
+        process_housekeep ();
+        samples[run] = now_us () - start;
+    }
+    report (name, samples, runs, syscalls_read () - before);
+    for (i = 0; i < entries; i++) {
+        snprintf (path, sizeof (path), "%s/%u/bench%05d", _data_dir, getpid (), i);
+        unlink (path);
+    }
+    kill (child, SIGTERM);
+    waitpid (child, NULL, 0);
+    free (samples);
+}
+
+/// @brief Benchmarks the start operation, until the command has been executed
+static void bench_start (
+    const char *name, ///<the benchmark name>
+    int runs ///<the number of repetitions>
+    ) {
+    double *samples = (double*)malloc (runs * sizeof (double));
+    unsigned long long syscalls = 0, before;
+    struct process_info *info;
+    int run;
+    bench_params ("-k", "bench-start", "start", "true", NULL);
+    for (run = 0; run < runs; run++) {
+        double start;
+        before = syscalls_read ();
+        start = now_us ();
+        if (operation_start ()) fprintf (stderr, "Couldn't start process\n");
+        samples[run] = now_us () - start;
+        syscalls += syscalls_read () - before;
+        if (process_wait (5, &info) == 0) process_info_free (info);
+        reap ();
+    }
+    report (name, samples, runs, syscalls);
+    free (samples);
+}
+
+/// @brief Benchmarks the query operation with concurrent clients
+static void bench_query (
+    const char *name, ///<the benchmark name>
+    int clients ///<the number of concurrent clients>
+    ) {
+    int count = clients * BENCH_QUERIES;
+    double *samples = (double*)malloc (count * sizeof (double));
+    unsigned long long before;
+    int results[2], i, received = 0, status;
+    double start, elapsed;
+    pid_t child = spawn_sleep (NULL);
+    char label[64];
+    ssize_t len;
+    bench_params ("-k", "bench-query", "query", "sleep", BENCH_SLEEP, NULL);
+    if (process_save (child, 0)) {
+        fprintf (stderr, "Couldn't save process information\n");
+        exit (1);
+    }
+    if (pipe (results)) abort ();
+    before = syscalls_read ();
+    start = now_us ();
+    for (i = 0; i < clients; i++) {
+        if (fork () == 0) {
+            double latency[BENCH_QUERIES];
+            int q;
+            close (results[0]);
+            for (q = 0; q < BENCH_QUERIES; q++) {
+                double query_start = now_us ();
+                if (operation_query ()) _exit (1);
+                latency[q] = now_us () - query_start;
+            }
+            _exit (write (results[1], latency, sizeof (latency)) == sizeof (latency) ? 0 : 1);
+        }
+    }
+    close (results[1]);
+    while ((received < count) && ((len = read (results[0], samples + received, (count - received) * sizeof (double))) > 0)) {
+        received += (int)(len / sizeof (double));
+    }
+    close (results[0]);
+    for (i = 0; i < clients; i++) {
+        if ((wait (&status) < 0) || !WIFEXITED (status) || WEXITSTATUS (status)) fprintf (stderr, "Query client failed\n");
+    }
+    elapsed = now_us () - start;
+    if (received == count) {
+        snprintf (label, sizeof (label), "%s (%.0f ops/s)", name, count * 1000000.0 / elapsed);
+        report (label, samples, count, syscalls_read () - before);
+    }
+    kill (child, SIGTERM);
+    waitpid (child, NULL, 0);
+    free (samples);
+}
+
+/// @brief Removes a folder and everything in it
+static void remove_dir (
+    const char *path ///<the folder to remove>
+    ) {
+    DIR *dir = opendir (path);
+    struct dirent *ent;
+    struct stat info;
+    if (dir) {
+        while ((ent = readdir (dir)) != NULL) {
+            char *child;
+            if (!strcmp (ent->d_name, ".") || !strcmp (ent->d_name, "..")) continue;
+            child = (char*)malloc (strlen (path) + strlen (ent->d_name) + 2);
+            if (!child) abort ();
+            sprintf (child, "%s/%s", path, ent->d_name);
+            if ((lstat (child, &info) == 0) && S_ISDIR (info.st_mode)) {
+                remove_dir (child);
+            } else {
+                unlink (child);
+            }
+            free (child);
+        }
+        closedir (dir);
+    }
+    rmdir (path);
+}
+
+/// @brief Signal function for a synthetic process table; nothing is sent
+static int synthetic_signal (
+    pid_t process, ///<the process to signal>
+    int signal ///<the signal number>
+    ) {
+    (void)process;
+    (void)signal;
+    return 0;
+}
+
+/// @brief Adds a process to a synthetic process table
+static void synthetic_process (
+    pid_t process, ///<the process identifier>
+    pid_t parent ///<the parent process identifier>
+    ) {
+    char path[PROCFS_PATH];
+    FILE *out;
+    procfs_path (path, sizeof (path), process, NULL);
+    mkdir (path, 0755);
+    procfs_path (path, sizeof (path), process, "status");
+    out = fopen (path, "wt");
+    if (!out) {
+        fprintf (stderr, "Couldn't write %s\n", path);
+        exit (1);
+    }
+    fprintf (out, "Name:\tsleep\nState:\tS (sleeping)\nPid:\t%u\nPPid:\t%u\n", process, parent);
+    fclose (out);
+}
+
+/// @brief Benchmarks signal_tree (through kill_process) on a synthetic table
+///
+/// The table is built on tmpfs, if `/dev/shm` is available, and holds a chain
+/// of processes with every other process a child of `init`. Each level of the
+/// chain scans the whole table, so this shows how the tree walk scales with
+/// the number of processes on the host rather than the size of the tree.
+static void bench_synthetic_tree (
+    const char *name, ///<the benchmark name>
+    int processes, ///<the number of processes in the table>
+    int depth, ///<the number of processes in the chain>
+    int runs ///<the number of repetitions>
+    ) {
+    double *samples = (double*)malloc (runs * sizeof (double));
+    unsigned long long before;
+    char root[32];
+    struct procfs_provider provider = { root, synthetic_signal };
+    int i, run;
+    strcpy (root, "/dev/shm/benchXXXXXX");
+    if (!mkdtemp (root)) {
+        snprintf (root, sizeof (root), "%s/procfs", _data_dir);
+        mkdir (root, 0755);
+    }
+    procfs_set_provider (&provider);
+    for (i = 0; i < processes; i++) {
+        synthetic_process (BENCH_SYNTHETIC_PID + i, ((i > 0) && (i < depth)) ? BENCH_SYNTHETIC_PID + i - 1 : 1);
+    }
+    bench_params ("query", NULL);
+    before = syscalls_read ();
+    for (run = 0; run < runs; run++) {
+        double start = now_us ();
+        kill_process (BENCH_SYNTHETIC_PID);
+        samples[run] = now_us () - start;
+    }
+    report (name, samples, runs, syscalls_read () - before);
+    procfs_set_provider (NULL);
+    remove_dir (root);
+    free (samples);
+}
+
+/// @brief Benchmark entry point
+///
+/// @return zero if the benchmarks ran, otherwise non-zero
+int main () {
+    strcpy (_data_dir, "benchXXXXXX");
+    if (!mkdtemp (_data_dir)) {
+        fprintf (stderr, "Couldn't create data directory\n");
+        return 1;
+    }
+    prctl (PR_SET_CHILD_SUBREAPER, 1);
+    syscalls_open ();
+    fprintf (stdout, "%-36s %6s %12s %12s %12s\n", "benchmark", "runs", "p50 (us)", "p99 (us)",
+        (_syscalls >= 0) ? "syscalls/op" : "rw calls/op");
+    bench_signal_tree ("signal_tree chain, 16 processes", 15, 1, 50);
+    bench_signal_tree ("signal_tree wide, 64 processes", 1, 63, 50);
+    bench_signal_tree ("signal_tree bushy, 85 processes", 3, 4, 50);
+    bench_synthetic_tree ("synthetic 1k processes, 64 deep", 1000, 64, 5);
+    bench_synthetic_tree ("synthetic 100k processes, 4 deep", 100000, 4, 3);
+    bench_verify_pid ("verify_pid short command line", NULL, 2000);
+    bench_verify_pid ("verify_pid long command line", BENCH_LONG_ARG, 2000);
+    bench_housekeep ("housekeep 10 entries", 10, 200);
+    bench_housekeep ("housekeep 1k entries", 1000, 20);
+    bench_housekeep ("housekeep 10k entries", 10000, 5);
+    bench_start ("start to exec", 50);
+    bench_query ("query, 1 client", 1);
+    bench_query ("query, 4 clients", 4);
+    bench_query ("query, 16 clients", 16);
+    reap ();
+    remove_dir (_data_dir);
+    return 0;
+}
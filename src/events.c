@@ -0,0 +1,451 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Implements the `events` operation
+///
+/// Lifecycle events are derived from the process information files in the
+/// data directory. Each event corresponds to a field written by the process
+/// that caused it, so the event carries the exact time it happened rather
+/// than the time it was noticed.
+
+#include "operations.h"
+#include "params.h"
+#include "process.h"
+#include "stats.h"
+#ifndef _WIN32
+# include "watchdog.h"
+# include <dirent.h>
+# include <errno.h>
+# include <poll.h>
+# include <sys/inotify.h>
+# include <sys/stat.h>
+# include <sys/time.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+// From watchdog.c
+int _is_running (pid_t process);
+
+/// @brief Lifecycle events, in the order they are reported for a process
+static const struct {
+    /// @brief The event name
+    const char *name;
+    /// @brief The information file field recording the event time
+    const char *field;
+} _event_types[] = {
+    { "started", "start" },
+    { "ready", "ready" },
+    { "activated", "activated" },
+    { "idle", "idle" },
+    { "killed", "stop" },
+    { "watchdog-fired", "watchdog" },
+    { "restarting", "restart" },
+    { "exited", "end" }
+};
+
+/// @brief The number of entries in _event_types
+#define EVENT_COUNT         (sizeof (_event_types) / sizeof (_event_types[0]))
+/// @brief Bit flag for the exited event in _watched_process::reported
+#define EVENT_EXITED        (1 << (EVENT_COUNT - 1))
+
+/// @brief Linked list of process information files being watched
+struct _watched_process {
+    /// @brief The scope folder name, `GLOBAL` or the parent PID
+    char *scope;
+    /// @brief The information file name
+    char *name;
+    /// @brief The process identifier, as originally specified
+    char *sid;
+    /// @brief The process the information file last described
+    pid_t pid;
+    /// @brief pidfd for the process, or -1 if it is not being watched
+    int pidfd;
+    /// @brief Bit mask of the _event_types already reported
+    unsigned reported;
+    /// @brief The next entry in the list, or NULL if this is the last
+    struct _watched_process *next;
+};
+
+/// @brief Linked list of scope folders being watched
+struct _watched_scope {
+    /// @brief The inotify watch descriptor
+    int wd;
+    /// @brief The scope folder name
+    char *scope;
+    /// @brief The next entry in the list, or NULL if this is the last
+    struct _watched_scope *next;
+};
+
+/// @brief The information files being watched
+static THREAD_LOCAL struct _watched_process *_processes = NULL;
+/// @brief The scope folders being watched
+static THREAD_LOCAL struct _watched_scope *_scopes = NULL;
+/// @brief The inotify descriptor
+static THREAD_LOCAL int _inotify = -1;
+
+/// @brief Writes an event as a line of JSON
+static void emit (
+    FILE *out, ///<the stream to write to>
+    const char *event, ///<the event name>
+    const char *time, ///<the event time, or NULL for now>
+    const struct _watched_process *process, ///<the process the event is for>
+    const struct process_info *info ///<the information file fields, or NULL if not known>
+    ) {
+    char now[32];
+    const char *value;
+    if (!time) {
+        struct timeval tv;
+        gettimeofday (&tv, NULL);
+        snprintf (now, sizeof (now), "%ld.%06ld", (long)tv.tv_sec, (long)tv.tv_usec);
+        time = now;
+    }
+    fprintf (out, "{\"time\":%s,\"event\":", time);
+    stats_json_string (out, event);
+    fprintf (out, ",\"scope\":");
+    stats_json_string (out, process->scope);
+    fprintf (out, ",\"id\":");
+    stats_json_string (out, process->sid ? process->sid : process->name);
+    if (process->pid) fprintf (out, ",\"pid\":%u", process->pid);
+    if (!strcmp (event, "exited")) {
+        if ((value = process_info_get (info, "exit")) != NULL) {
+            fprintf (out, ",\"exit\":%d", atoi (value));
+        } else if ((value = process_info_get (info, "signal")) != NULL) {
+            fprintf (out, ",\"signal\":%d", atoi (value));
+        } else {
+            fprintf (out, ",\"exit\":null");
+        }
+    }
+    fprintf (out, "}\n");
+    fflush (out);
+}
+
+/// @brief Stops watching a process information file
+///
+/// @return the next entry in the list
+static struct _watched_process *forget_process (
+    struct _watched_process **entry ///<the list link referring to the entry>
+    ) {
+    struct _watched_process *process = *entry;
+    *entry = process->next;
+    if (process->pidfd >= 0) close (process->pidfd);
+    free (process->scope);
+    free (process->name);
+    free (process->sid);
+    free (process);
+    return *entry;
+}
+
+/// @brief Reports any new events from a process information file
+///
+/// The file is read and compared with the events already reported for it.
+/// If the file no longer exists then it has been deleted by housekeeping.
+static void scan_process (
+    FILE *out, ///<the stream to write to>
+    const char *scope, ///<the scope folder name>
+    const char *name ///<the information file name>
+    ) {
+    struct _watched_process **entry, *process;
+    struct process_info *info;
+    const char *value;
+    char *path;
+    unsigned i;
+    pid_t pid;
+    path = (char*)malloc (strlen (PARAM (data_dir)) + strlen (scope) + strlen (name) + 3);
+    if (!path) abort ();
+    sprintf (path, "%s/%s/%s", PARAM (data_dir), scope, name);
+    info = process_info_read (path);
+    free (path);
+    for (entry = &_processes; *entry; entry = &(*entry)->next) {
+        if (!strcmp ((*entry)->scope, scope) && !strcmp ((*entry)->name, name)) break;
+    }
+    process = *entry;
+    if (!info) {
+        if (process) {
+            emit (out, "housekept", NULL, process, NULL);
+            forget_process (entry);
+        }
+        return;
+    }
+    if (!process) {
+        process = (struct _watched_process*)malloc (sizeof (struct _watched_process));
+        if (!process) abort ();
+        process->scope = strdup (scope);
+        process->name = strdup (name);
+        if (!process->scope || !process->name) abort ();
+        process->sid = NULL;
+        process->pid = 0;
+        process->pidfd = -1;
+        process->reported = 0;
+        process->next = NULL;
+        *entry = process;
+    }
+    value = process_info_get (info, "pid");
+    pid = value ? (pid_t)strtol (value, NULL, 10) : 0;
+    if (pid != process->pid) {
+        // A new process has been started with the identifier
+        if (process->pidfd >= 0) close (process->pidfd);
+        process->pidfd = -1;
+        process->pid = pid;
+        process->reported = 0;
+    }
+    if ((value = process_info_get (info, "sid")) != NULL) {
+        free (process->sid);
+        process->sid = strdup (value);
+    }
+    for (i = 0; i < EVENT_COUNT; i++) {
+        if (process->reported & (1 << i)) continue;
+        if ((value = process_info_get (info, _event_types[i].field)) == NULL) continue;
+        emit (out, _event_types[i].name, value, process, info);
+        process->reported |= 1 << i;
+    }
+    if (process->reported & EVENT_EXITED) {
+        if (process->pidfd >= 0) close (process->pidfd);
+        process->pidfd = -1;
+    } else if ((process->pidfd < 0) && pid) {
+        process->pidfd = watchdog_open (pid);
+    }
+    process_info_free (info);
+}
+
+/// @brief Tests if a file name is a process information file
+///
+/// @return non-zero if the name is an information file, zero otherwise
+static int is_process_name (
+    const char *name ///<the file name>
+    ) {
+    size_t len = strlen (name);
+    return (name[0] != '.') && len && (name[len - 1] != '~');
+}
+
+/// @brief Starts watching a scope folder
+///
+/// The folder is watched before being read so that no files created in the
+/// meantime are missed.
+static void scan_scope (
+    FILE *out, ///<the stream to write to>
+    const char *scope ///<the scope folder name>
+    ) {
+    struct _watched_scope *entry;
+    struct dirent *ent;
+    DIR *dir;
+    char *path;
+    int wd;
+    if (scope[0] == '.') return;
+    path = (char*)malloc (strlen (PARAM (data_dir)) + strlen (scope) + 2);
+    if (!path) abort ();
+    sprintf (path, "%s/%s", PARAM (data_dir), scope);
+    wd = inotify_add_watch (_inotify, path, IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE | IN_ONLYDIR);
+    if (wd >= 0) {
+        for (entry = _scopes; entry && (entry->wd != wd); entry = entry->next);
+        if (!entry) {
+            if (PARAM (verbose)) fprintf (stderr, "Watching %s for events\n", path);
+            entry = (struct _watched_scope*)malloc (sizeof (struct _watched_scope));
+            if (!entry) abort ();
+            entry->wd = wd;
+            entry->scope = strdup (scope);
+            if (!entry->scope) abort ();
+            entry->next = _scopes;
+            _scopes = entry;
+        }
+        dir = opendir (path);
+        if (dir) {
+            while ((ent = readdir (dir)) != NULL) {
+                if (is_process_name (ent->d_name)) scan_process (out, scope, ent->d_name);
+            }
+            closedir (dir);
+        }
+    }
+    free (path);
+}
+
+/// @brief Stops watching a scope folder that has been deleted
+///
+/// Any information files still being watched in the folder have been deleted
+/// by housekeeping.
+static void forget_scope (
+    FILE *out, ///<the stream to write to>
+    int wd ///<the inotify watch descriptor of the folder>
+    ) {
+    struct _watched_scope **entry, *scope;
+    struct _watched_process **process;
+    for (entry = &_scopes; *entry && ((*entry)->wd != wd); entry = &(*entry)->next);
+    if (!(scope = *entry)) return;
+    *entry = scope->next;
+    process = &_processes;
+    while (*process) {
+        if (!strcmp ((*process)->scope, scope->scope)) {
+            emit (out, "housekept", NULL, *process, NULL);
+            forget_process (process);
+        } else {
+            process = &(*process)->next;
+        }
+    }
+    free (scope->scope);
+    free (scope);
+}
+
+/// @brief Handles the termination of a watched process
+///
+/// The watchdog normally records the termination, which is reported when
+/// the information file changes. If there is no watchdog to do so then the
+/// termination is reported without a status.
+static void process_terminated (
+    FILE *out, ///<the stream to write to>
+    struct _watched_process *process ///<the terminated process>
+    ) {
+    struct process_info *info;
+    const char *wdog;
+    char *path;
+    close (process->pidfd);
+    process->pidfd = -1;
+    path = (char*)malloc (strlen (PARAM (data_dir)) + strlen (process->scope) + strlen (process->name) + 3);
+    if (!path) abort ();
+    sprintf (path, "%s/%s/%s", PARAM (data_dir), process->scope, process->name);
+    info = process_info_read (path);
+    free (path);
+    wdog = process_info_get (info, "wdog");
+    if (!(process->reported & EVENT_EXITED) && !process_info_get (info, "end")
+     && (!wdog || !_is_running ((pid_t)strtol (wdog, NULL, 10)))) {
+        emit (out, "exited", NULL, process, info);
+        process->reported |= EVENT_EXITED;
+    }
+    process_info_free (info);
+}
+
+/// @brief Reads the pending inotify events
+static void read_inotify (
+    FILE *out ///<the stream to write to>
+    ) {
+    char buffer[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    ssize_t len;
+    while ((len = read (_inotify, buffer, sizeof (buffer))) > 0) {
+        char *ptr;
+        for (ptr = buffer; ptr < buffer + len; ptr += sizeof (struct inotify_event) + ((struct inotify_event*)ptr)->len) {
+            const struct inotify_event *event = (const struct inotify_event*)ptr;
+            struct _watched_scope *scope;
+            if (event->mask & IN_IGNORED) {
+                forget_scope (out, event->wd);
+                continue;
+            }
+            if (!event->len) continue;
+            for (scope = _scopes; scope && (scope->wd != event->wd); scope = scope->next);
+            if (scope) {
+                if (is_process_name (event->name)) scan_process (out, scope->scope, event->name);
+            } else if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && (event->mask & IN_ISDIR)) {
+                // A new scope folder in the data directory
+                scan_scope (out, event->name);
+            }
+        }
+    }
+}
+
+/// @brief Implementation of operation_events()
+///
+/// This is separated out for use by the unit tests so that the events can be
+/// written somewhere other than stdout.
+///
+/// @return zero if the time limit elapsed, otherwise a non-zero error code
+int _events (
+    FILE *out ///<the stream to write to>
+    ) {
+    struct pollfd *fds = NULL;
+    struct timeval deadline, now;
+    struct _watched_process *process;
+    struct dirent *ent;
+    DIR *dir;
+    int e = 0;
+    gettimeofday (&deadline, NULL);
+    deadline.tv_sec += PARAM (wait_timeout);
+    mkdir (PARAM (data_dir), 0755);
+    _inotify = inotify_init1 (IN_CLOEXEC | IN_NONBLOCK);
+    if (_inotify < 0) return errno;
+    if (inotify_add_watch (_inotify, PARAM (data_dir), IN_CREATE | IN_MOVED_TO | IN_ONLYDIR) < 0) {
+        e = errno;
+        close (_inotify);
+        return e;
+    }
+    dir = opendir (PARAM (data_dir));
+    if (dir) {
+        while ((ent = readdir (dir)) != NULL) {
+            scan_scope (out, ent->d_name);
+        }
+        closedir (dir);
+    }
+    do {
+        int count, i, wait_ms;
+        for (count = 1, process = _processes; process; process = process->next) count++;
+        fds = (struct pollfd*)realloc (fds, count * sizeof (struct pollfd));
+        if (!fds) abort ();
+        fds[0].fd = _inotify;
+        for (i = 1, process = _processes; process; process = process->next, i++) {
+            fds[i].fd = process->pidfd;
+        }
+        for (i = 0; i < count; i++) {
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        if (PARAM (wait_timeout) < 0) {
+            wait_ms = -1;
+        } else {
+            gettimeofday (&now, NULL);
+            wait_ms = (int)((deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_usec - now.tv_usec) / 1000);
+            if (wait_ms <= 0) break;
+        }
+        if (poll (fds, count, wait_ms) < 0) {
+            if (errno == EINTR) continue;
+            e = errno;
+            break;
+        }
+        // The pidfd order matches the list; it is only changed by inotify
+        for (i = 1, process = _processes; process; process = process->next, i++) {
+            if ((fds[i].revents & POLLIN) && (process->pidfd == fds[i].fd)) process_terminated (out, process);
+        }
+        if (fds[0].revents & POLLIN) read_inotify (out);
+    } while (1);
+    free (fds);
+    while (_processes) forget_process (&_processes);
+    while (_scopes) {
+        struct _watched_scope *next = _scopes->next;
+        free (_scopes->scope);
+        free (_scopes);
+        _scopes = next;
+    }
+    close (_inotify);
+    _inotify = -1;
+    return e;
+}
+
+#endif /* ifndef _WIN32 */
+
+/// @brief Streams lifecycle events for all processes
+///
+/// Writes a line of JSON to stdout for each lifecycle event of every process
+/// in the data directory: started, ready, killed (by the `stop` operation),
+/// watchdog-fired (killed because the parent terminated), restarting (by the
+/// watchdog, after it terminated), exited and housekept (information
+/// deleted). Events already recorded when the
+/// operation starts are written first.
+///
+/// The data directory is watched with `inotify` and the running processes
+/// with `pidfd`s. This continues until the process is killed or for the
+/// time given by the `t` parameter.
+///
+/// @return zero if successful, otherwise a non-zero error code
+int operation_events () {
+#ifdef _WIN32
+	fprintf (stderr, "Events are not supported on this platform\n");
+	return ERROR_NOT_SUPPORTED;
+#else /* ifdef _WIN32 */
+    return _events (stdout);
+#endif /* ifdef _WIN32 */
+}
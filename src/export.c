@@ -0,0 +1,310 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Implements the `export` operation
+///
+/// Writes metrics for every process in the data directory in the OpenMetrics
+/// text format, for example for the `node_exporter` textfile collector. Each
+/// interval makes a single pass over the registry, reading `/proc` only for
+/// the processes that are still running.
+
+#include "operations.h"
+#include "params.h"
+#include "process.h"
+#include "stats.h"
+#ifndef _WIN32
+# include <dirent.h>
+# include <errno.h>
+# include <poll.h>
+# include <sys/time.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// @brief The metrics for a process in the registry
+struct _export_entry {
+    /// @brief The scope folder name, `GLOBAL` or the parent PID
+    char *scope;
+    /// @brief The information file fields
+    struct process_info *info;
+    /// @brief Non-zero if the process is running
+    int up;
+    /// @brief The resources used by the process if it is running
+    struct process_stats stats;
+};
+
+/// @brief The metric families, in the order they are written
+enum _export_metric {
+    METRIC_UP,
+    METRIC_UPTIME,
+    METRIC_RESTARTS,
+    METRIC_CPU,
+    METRIC_RSS,
+    METRIC_READY,
+    METRIC_EXIT,
+    METRIC_COUNT
+};
+
+/// @brief Declarations of the metric families, indexed by _export_metric
+static const char *_metric_headers[METRIC_COUNT] = {
+    "# TYPE procctrl_up gauge\n# HELP procctrl_up Whether the process is running.\n",
+    "# TYPE procctrl_uptime_seconds gauge\n# UNIT procctrl_uptime_seconds seconds\n# HELP procctrl_uptime_seconds Time since the process was started, or that it ran for.\n",
+    "# TYPE procctrl_restarts counter\n# HELP procctrl_restarts Number of times the process has been started again.\n",
+    "# TYPE procctrl_cpu_seconds counter\n# UNIT procctrl_cpu_seconds seconds\n# HELP procctrl_cpu_seconds CPU time used by the process.\n",
+    "# TYPE procctrl_resident_memory_bytes gauge\n# UNIT procctrl_resident_memory_bytes bytes\n# HELP procctrl_resident_memory_bytes Resident set size of the running process.\n",
+    "# TYPE procctrl_ready_seconds gauge\n# UNIT procctrl_ready_seconds seconds\n# HELP procctrl_ready_seconds Time from start until the command was executed.\n",
+    "# TYPE procctrl_exit_status gauge\n# HELP procctrl_exit_status Exit code, or 128 plus the signal number, of the terminated process.\n"
+};
+
+/// @brief Reads a time field from an information file
+///
+/// @return the time in seconds, or a negative value if not present
+static double time_field (
+    const struct process_info *info, ///<the fields to search>
+    const char *key ///<the field name>
+    ) {
+    const char *value = process_info_get (info, key);
+    return value ? strtod (value, NULL) : -1.0;
+}
+
+/// @brief Writes the labels identifying a process
+static void write_labels (
+    FILE *out, ///<the stream to write to>
+    const struct _export_entry *entry ///<the process>
+    ) {
+    const char *sid = process_info_get (entry->info, "sid");
+    fprintf (out, "{scope=\"%s\",id=\"", entry->scope);
+    for (; sid && *sid; sid++) {
+        switch (*sid) {
+            case '\\' : fputs ("\\\\", out); break;
+            case '\"' : fputs ("\\\"", out); break;
+            case '\n' : fputs ("\\n", out); break;
+            default : fputc (*sid, out); break;
+        }
+    }
+    fputs ("\"", out);
+}
+
+/// @brief Writes the sample(s) of a metric family for a process
+static void write_metric (
+    FILE *out, ///<the stream to write to>
+    const struct _export_entry *entry, ///<the process>
+    enum _export_metric metric, ///<the metric family>
+    double now ///<the current time, in seconds>
+    ) {
+    double start = time_field (entry->info, "start");
+    double end = time_field (entry->info, "end");
+    double ready = time_field (entry->info, "ready");
+    const char *value;
+    switch (metric) {
+        case METRIC_UP :
+            fputs ("procctrl_up", out);
+            write_labels (out, entry);
+            fprintf (out, "} %d\n", entry->up);
+            break;
+        case METRIC_UPTIME :
+            if (start < 0) break;
+            fputs ("procctrl_uptime_seconds", out);
+            write_labels (out, entry);
+            fprintf (out, "} %.6f\n", ((end >= 0) ? end : now) - start);
+            break;
+        case METRIC_RESTARTS :
+            value = process_info_get (entry->info, "restarts");
+            fputs ("procctrl_restarts_total", out);
+            write_labels (out, entry);
+            fprintf (out, "} %d\n", value ? atoi (value) : 0);
+            break;
+        case METRIC_CPU :
+            if (entry->up) {
+                fputs ("procctrl_cpu_seconds_total", out);
+                write_labels (out, entry);
+                fprintf (out, ",mode=\"user\"} %.3f\n", entry->stats.utime / 1000.0);
+                fputs ("procctrl_cpu_seconds_total", out);
+                write_labels (out, entry);
+                fprintf (out, ",mode=\"system\"} %.3f\n", entry->stats.stime / 1000.0);
+            } else if (process_info_get (entry->info, "utime")) {
+                fputs ("procctrl_cpu_seconds_total", out);
+                write_labels (out, entry);
+                fprintf (out, ",mode=\"user\"} %.6f\n", time_field (entry->info, "utime"));
+                fputs ("procctrl_cpu_seconds_total", out);
+                write_labels (out, entry);
+                fprintf (out, ",mode=\"system\"} %.6f\n", time_field (entry->info, "stime"));
+            }
+            break;
+        case METRIC_RSS :
+            if (!entry->up) break;
+            fputs ("procctrl_resident_memory_bytes", out);
+            write_labels (out, entry);
+            fprintf (out, "} %llu\n", entry->stats.rss);
+            break;
+        case METRIC_READY :
+            if ((start < 0) || (ready < 0)) break;
+            fputs ("procctrl_ready_seconds", out);
+            write_labels (out, entry);
+            fprintf (out, "} %.6f\n", ready - start);
+            break;
+        case METRIC_EXIT :
+            if ((value = process_info_get (entry->info, "exit")) != NULL) {
+                fputs ("procctrl_exit_status", out);
+                write_labels (out, entry);
+                fprintf (out, "} %d\n", atoi (value));
+            } else if ((value = process_info_get (entry->info, "signal")) != NULL) {
+                fputs ("procctrl_exit_status", out);
+                write_labels (out, entry);
+                fprintf (out, "} %d\n", 128 + atoi (value));
+            }
+            break;
+        default :
+            break;
+    }
+}
+
+/// @brief Reads every process in the registry
+///
+/// @return the processes, to be released with free_entries()
+static struct _export_entry *read_entries (
+    int *count ///<receives the number of processes>
+    ) {
+    struct _export_entry *entries = NULL;
+    DIR *dir, *subdir;
+    struct dirent *ent, *subent;
+    char *path;
+    *count = 0;
+    dir = opendir (PARAM (data_dir));
+    if (!dir) return NULL;
+    while ((ent = readdir (dir)) != NULL) {
+        size_t len;
+        if (ent->d_name[0] == '.') continue;
+        path = (char*)malloc (strlen (PARAM (data_dir)) + strlen (ent->d_name) + NAME_MAX + 3);
+        if (!path) abort ();
+        len = sprintf (path, "%s/%s", PARAM (data_dir), ent->d_name);
+        subdir = opendir (path);
+        if (subdir) {
+            while ((subent = readdir (subdir)) != NULL) {
+                struct _export_entry *entry;
+                struct process_info *info;
+                const char *pid;
+                if ((subent->d_name[0] == '.') || (subent->d_name[strlen (subent->d_name) - 1] == '~')) continue;
+                sprintf (path + len, "/%s", subent->d_name);
+                info = process_info_read (path);
+                path[len] = 0;
+                if (!info) continue;
+                entries = (struct _export_entry*)realloc (entries, (*count + 1) * sizeof (struct _export_entry));
+                if (!entries) abort ();
+                entry = entries + (*count)++;
+                entry->scope = strdup (ent->d_name);
+                if (!entry->scope) abort ();
+                entry->info = info;
+                pid = process_info_get (info, "pid");
+                entry->up = pid && !process_info_get (info, "end")
+                    && (stats_process ((pid_t)strtol (pid, NULL, 10), &entry->stats) == 0);
+            }
+            closedir (subdir);
+        }
+        free (path);
+    }
+    closedir (dir);
+    return entries;
+}
+
+/// @brief Releases the processes read by read_entries()
+static void free_entries (
+    struct _export_entry *entries, ///<the processes>
+    int count ///<the number of processes>
+    ) {
+    int i;
+    for (i = 0; i < count; i++) {
+        free (entries[i].scope);
+        process_info_free (entries[i].info);
+    }
+    free (entries);
+}
+
+/// @brief Writes the metrics file
+///
+/// The metrics are written to a temporary file which then replaces the
+/// original so that a reader never sees a partially written file.
+///
+/// @return zero if successful, otherwise a non-zero error code
+static int write_metrics () {
+    struct _export_entry *entries;
+    struct timeval tv;
+    int count, i, metric, result = 0;
+    char *tmp;
+    FILE *out;
+    entries = read_entries (&count);
+    gettimeofday (&tv, NULL);
+    tmp = (char*)malloc (strlen (PARAM (output_file)) + 2);
+    if (!tmp) abort ();
+    sprintf (tmp, "%s~", PARAM (output_file));
+    out = fopen (tmp, "wt");
+    if (out) {
+        for (metric = 0; metric < METRIC_COUNT; metric++) {
+            fputs (_metric_headers[metric], out);
+            for (i = 0; i < count; i++) {
+                write_metric (out, entries + i, (enum _export_metric)metric, tv.tv_sec + tv.tv_usec / 1000000.0);
+            }
+        }
+        fputs ("# EOF\n", out);
+        if (fclose (out)) result = errno;
+        if (!result && rename (tmp, PARAM (output_file))) result = errno;
+        if (result) unlink (tmp);
+    } else {
+        result = errno;
+    }
+    if (PARAM (verbose)) fprintf (stdout, "Wrote %d processes to %s\n", count, PARAM (output_file));
+    free (tmp);
+    free_entries (entries, count);
+    return result;
+}
+
+#endif /* ifndef _WIN32 */
+
+/// @brief Exports metrics for all processes
+///
+/// Every `i` seconds the file given by the `f` parameter is replaced with
+/// metrics for each process in the data directory; whether it is running,
+/// uptime, restart count, CPU time, resident set size, the time taken to
+/// execute the command and the exit status.
+///
+/// This continues until the process is killed or for the time given by the
+/// `t` parameter.
+///
+/// @return zero if the time limit elapsed, otherwise a non-zero error code
+int operation_export () {
+#ifdef _WIN32
+	fprintf (stderr, "Exporting metrics is not supported on this platform\n");
+	return ERROR_NOT_SUPPORTED;
+#else /* ifdef _WIN32 */
+    struct timeval now;
+    long long next, end, remaining;
+    int e;
+    if (PARAM (verbose)) fprintf (stdout, "Exporting metrics to %s\n", PARAM (output_file));
+    gettimeofday (&now, NULL);
+    next = now.tv_sec * 1000LL + now.tv_usec / 1000;
+    end = next + PARAM (wait_timeout) * 1000LL;
+    do {
+        if ((e = write_metrics ()) != 0) {
+            fprintf (stderr, "Can't write %s\n", PARAM (output_file));
+            break;
+        }
+        next += PARAM (monitor_interval) * 1000;
+        if ((PARAM (wait_timeout) >= 0) && (next > end)) break;
+        // Wait for the next interval
+        do {
+            gettimeofday (&now, NULL);
+            remaining = next - (now.tv_sec * 1000LL + now.tv_usec / 1000);
+        } while ((remaining > 0) && (poll (NULL, 0, (int)remaining) >= 0 || (errno == EINTR)));
+    } while (1);
+    return e;
+#endif /* ifdef _WIN32 */
+}
@@ -0,0 +1,354 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Health checks
+///
+/// A probe is given as `tcp:<em>port</em>` to connect to a port on the loopback
+/// interface, `http:<em>port</em>[/<em>path</em>]` to also send a GET request
+/// and expect a 2xx or 3xx response, or `cmd:<em>command</em>` to run a shell
+/// command and expect it to exit with zero. Every probe has a time limit, so a
+/// process that is hung rather than terminated fails its health checks.
+
+#include "health.h"
+#include "params.h"
+#include "process.h"
+#include "watchdog.h"
+#ifndef _WIN32
+# include <arpa/inet.h>
+# include <errno.h>
+# include <fcntl.h>
+# include <netinet/in.h>
+# include <poll.h>
+# include <signal.h>
+# include <sys/socket.h>
+# include <sys/wait.h>
+# include <time.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// @brief The probe is waiting for its connection to complete
+#define STAGE_CONNECT   1
+/// @brief The probe is waiting for the status line of an HTTP response
+#define STAGE_RESPONSE  2
+/// @brief The probe is waiting for its command to exit
+#define STAGE_COMMAND   3
+
+/// @brief Calculates the time left before a deadline
+///
+/// @return the time left in milliseconds, or zero if the deadline has passed
+static int remaining (
+    const struct timespec *deadline ///<the deadline, from CLOCK_MONOTONIC>
+    ) {
+    struct timespec now;
+    long long ms;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    ms = (deadline->tv_sec - now.tv_sec) * 1000LL + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+    return (ms > 0) ? (int)ms : 0;
+}
+
+/// @brief Parses the port number at the start of a probe argument
+///
+/// @return the port number, or zero if it is not valid
+static unsigned short parse_port (
+    const char *arg, ///<the probe argument>
+    const char **rest ///<receives the text following the port number>
+    ) {
+    char *end;
+    long value = strtol (arg, &end, 10);
+    *rest = end;
+    if ((end == arg) || (value <= 0) || (value > 65535)) return 0;
+    return (unsigned short)value;
+}
+
+/// @brief Ends a probe, recording its result and the time it took
+///
+/// @return the result
+static int finish (
+    struct health_probe *probe, ///<the probe>
+    int result ///<zero if healthy, otherwise a non-zero error code>
+    ) {
+    struct timespec end;
+    if (probe->fd >= 0) close (probe->fd);
+    probe->fd = -1;
+    probe->events = 0;
+    probe->stage = 0;
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    probe->latency = (end.tv_sec - probe->start.tv_sec) + (end.tv_nsec - probe->start.tv_nsec) / 1e9;
+    return result;
+}
+
+/// @brief Starts connecting to a port on the loopback interface
+///
+/// @return EINPROGRESS if the connection was started, otherwise the result
+static int start_connect (
+    struct health_probe *probe, ///<the probe>
+    const char *arg ///<the port number and, for `http:`, optional path>
+    ) {
+    struct sockaddr_in addr;
+    unsigned short port = parse_port (arg, &probe->path);
+    if (!port) return finish (probe, EINVAL);
+    if (probe->http) {
+        if (!*probe->path) probe->path = "/";
+        if ((*probe->path != '/') || (strlen (probe->path) > sizeof (probe->buffer) - 64)) return finish (probe, EINVAL);
+    } else if (*probe->path) {
+        return finish (probe, EINVAL);
+    }
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (port);
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    probe->fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (probe->fd < 0) return finish (probe, errno);
+    if (connect (probe->fd, (struct sockaddr*)&addr, sizeof (addr)) && (errno != EINPROGRESS)) return finish (probe, errno);
+    probe->stage = STAGE_CONNECT;
+    probe->events = POLLOUT;
+    return EINPROGRESS;
+}
+
+/// @brief Continues a `tcp:` or `http:` probe whose connection completed
+///
+/// Only the status line of an HTTP response is read.
+///
+/// @return EINPROGRESS if the probe is still running, otherwise the result;
+///         EPROTO if an HTTP response was not a success or redirect
+static int continue_connect (
+    struct health_probe *probe ///<the probe>
+    ) {
+    socklen_t optlen = sizeof (int);
+    size_t len;
+    ssize_t n;
+    int e, status;
+    if (probe->stage == STAGE_CONNECT) {
+        struct pollfd pfd;
+        pfd.fd = probe->fd;
+        pfd.events = POLLOUT;
+        if (poll (&pfd, 1, 0) == 0) return EINPROGRESS;
+        if (getsockopt (probe->fd, SOL_SOCKET, SO_ERROR, &e, &optlen)) e = errno;
+        if (e || !probe->http) return finish (probe, e);
+        len = snprintf (probe->buffer, sizeof (probe->buffer), "GET %s HTTP/1.0\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n", probe->path);
+        // The request is far smaller than a new socket's send buffer
+        n = send (probe->fd, probe->buffer, len, MSG_NOSIGNAL);
+        if (n != (ssize_t)len) return finish (probe, (n < 0) ? errno : EIO);
+        probe->stage = STAGE_RESPONSE;
+        probe->events = POLLIN;
+        probe->len = 0;
+        return EINPROGRESS;
+    }
+    while ((probe->len < sizeof (probe->buffer) - 1) && !memchr (probe->buffer, '\n', probe->len)) {
+        n = recv (probe->fd, probe->buffer + probe->len, sizeof (probe->buffer) - 1 - probe->len, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return EINPROGRESS;
+            return finish (probe, errno);
+        }
+        if (!n) break;
+        probe->len += n;
+    }
+    probe->buffer[probe->len] = 0;
+    if ((sscanf (probe->buffer, "HTTP/%*d.%*d %d", &status) != 1) || (status < 200) || (status >= 400)) return finish (probe, EPROTO);
+    return finish (probe, 0);
+}
+
+/// @brief Starts a `cmd:` probe
+///
+/// The command is run by the shell in a process group of its own, so that it
+/// can be killed with everything it started if it does not complete in time.
+///
+/// @return EINPROGRESS if the command was started, otherwise the result
+static int start_command (
+    struct health_probe *probe, ///<the probe>
+    const char *arg ///<the shell command>
+    ) {
+    sigset_t signals;
+    probe->child = fork ();
+    if (probe->child == (pid_t)-1) {
+        probe->child = 0;
+        return finish (probe, errno);
+    }
+    if (!probe->child) {
+        sigemptyset (&signals);
+        sigprocmask (SIG_SETMASK, &signals, NULL);
+        setpgid (0, 0);
+        execl ("/bin/sh", "sh", "-c", arg, (char*)NULL);
+        _exit (127);
+    }
+    setpgid (probe->child, probe->child);
+    probe->fd = watchdog_open (probe->child);
+    probe->stage = STAGE_COMMAND;
+    probe->events = (probe->fd >= 0) ? POLLIN : 0;
+    return EINPROGRESS;
+}
+
+/// @brief Continues a `cmd:` probe
+///
+/// @return EINPROGRESS if the command is still running, otherwise the result;
+///         EPROTO if the command exited with a non-zero code
+static int continue_command (
+    struct health_probe *probe ///<the probe>
+    ) {
+    pid_t reaped;
+    int status;
+    while ((reaped = waitpid (probe->child, &status, WNOHANG)) < 0) {
+        if (errno != EINTR) {
+            probe->child = 0;
+            return finish (probe, errno);
+        }
+    }
+    if (!reaped) return EINPROGRESS;
+    probe->child = 0;
+    return finish (probe, (WIFEXITED (status) && !WEXITSTATUS (status)) ? 0 : EPROTO);
+}
+
+/// @brief Starts a health probe
+///
+/// A probe that can't complete at once leaves a descriptor in the `fd` field
+/// to poll for the `events` field, and is continued with health_continue()
+/// when it is ready, or once health_timeout() has passed, until it is done.
+///
+/// @return EINPROGRESS if the probe is running, otherwise the result as for
+///         health_continue()
+int health_start (
+    struct health_probe *probe, ///<receives the probe>
+    const char *spec, ///<the probe, as given by the `c` parameter>
+    int timeout ///<the time limit in milliseconds>
+    ) {
+    memset (probe, 0, sizeof (*probe));
+    probe->fd = -1;
+    clock_gettime (CLOCK_MONOTONIC, &probe->start);
+    probe->deadline.tv_sec = probe->start.tv_sec + timeout / 1000;
+    probe->deadline.tv_nsec = probe->start.tv_nsec + (timeout % 1000) * 1000000L;
+    if (probe->deadline.tv_nsec >= 1000000000L) {
+        probe->deadline.tv_sec++;
+        probe->deadline.tv_nsec -= 1000000000L;
+    }
+    if (!strncmp (spec, "tcp:", 4)) return start_connect (probe, spec + 4);
+    if (!strncmp (spec, "http:", 5)) {
+        probe->http = 1;
+        return start_connect (probe, spec + 5);
+    }
+    if (!strncmp (spec, "cmd:", 4)) return start_command (probe, spec + 4);
+    return finish (probe, EINVAL);
+}
+
+/// @brief Continues a running health probe
+///
+/// This never blocks. A probe still running at its deadline is cancelled.
+///
+/// @return EINPROGRESS if the probe is still running, zero if healthy,
+///         EINVAL if the probe is not recognised, ETIMEDOUT if it did not
+///         complete in time, otherwise a non-zero error code
+int health_continue (
+    struct health_probe *probe ///<the probe>
+    ) {
+    int e;
+    e = (probe->stage == STAGE_COMMAND) ? continue_command (probe) : continue_connect (probe);
+    if ((e == EINPROGRESS) && !remaining (&probe->deadline)) {
+        health_cancel (probe);
+        e = finish (probe, ETIMEDOUT);
+    }
+    return e;
+}
+
+/// @brief Gives the longest time to wait before continuing a running probe
+///
+/// A command probe without a `pidfd` to poll is checked every 10ms.
+///
+/// @return the time in milliseconds
+int health_timeout (
+    const struct health_probe *probe ///<the running probe>
+    ) {
+    int ms = remaining (&probe->deadline);
+    return ((probe->fd < 0) && (ms > 10)) ? 10 : ms;
+}
+
+/// @brief Abandons a running health probe
+///
+/// A command is killed, along with anything it started, and reaped.
+void health_cancel (
+    struct health_probe *probe ///<the probe>
+    ) {
+    int status;
+    if (probe->child) {
+        kill (-probe->child, SIGKILL);
+        while ((waitpid (probe->child, &status, 0) < 0) && (errno == EINTR));
+        probe->child = 0;
+    }
+    if (probe->fd >= 0) close (probe->fd);
+    probe->fd = -1;
+    probe->events = 0;
+    probe->stage = 0;
+}
+
+/// @brief Runs a health probe, waiting for it to complete
+///
+/// @return zero if healthy, otherwise the error from health_continue()
+int health_run (
+    const char *spec, ///<the probe, as given by the `c` parameter>
+    int timeout, ///<the time limit in milliseconds>
+    double *latency ///<receives the time taken in seconds>
+    ) {
+    struct health_probe probe;
+    struct pollfd pfd;
+    int e = health_start (&probe, spec, timeout);
+    while (e == EINPROGRESS) {
+        pfd.fd = probe.fd;
+        pfd.events = probe.events;
+        if ((poll (&pfd, 1, health_timeout (&probe)) < 0) && (errno != EINTR)) {
+            health_cancel (&probe);
+            e = finish (&probe, errno);
+            break;
+        }
+        e = health_continue (&probe);
+    }
+    *latency = probe.latency;
+    return e;
+}
+
+/// @brief Records the result of a health probe for a supervised process
+///
+/// The result of the probe given by the `c` parameter, which has the `C`
+/// parameter as its time limit, is recorded in the information file. A
+/// process that fails as many consecutive probes as the `n` parameter is
+/// unhealthy.
+///
+/// A process that has yet to pass a probe may still be starting up, so while
+/// it is within the grace period given by the `g` parameter its failures are
+/// recorded as `starting` and not counted.
+///
+/// @return non-zero if the process has become unhealthy, zero otherwise
+int health_check (
+    pid_t process, ///<the supervised process>
+    int result, ///<the result of the probe>
+    double latency, ///<the time the probe took, in seconds>
+    int *failures, ///<the number of consecutive failures, updated>
+    int *started, ///<non-zero once the process has passed a probe, updated>
+    int grace ///<non-zero if the process is within its grace period>
+    ) {
+    const char *state;
+    if (result && !*started && grace) {
+        state = "starting";
+        if (PARAM (verbose)) fprintf (stdout, "Health check of %u failed, error %d (starting)\n", process, result);
+    } else if (result) {
+        (*failures)++;
+        state = (*failures >= PARAM (health_threshold)) ? "unhealthy" : "failing";
+        if (PARAM (verbose)) fprintf (stdout, "Health check of %u failed, error %d (%d consecutive)\n", process, result, *failures);
+    } else {
+        *failures = 0;
+        *started = 1;
+        state = "ok";
+    }
+    process_health (process, state, latency, *failures);
+    return result && (*failures >= PARAM (health_threshold));
+}
+
+#endif /* ifndef _WIN32 */
@@ -0,0 +1,60 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifndef __inc_health_h
+#define __inc_health_h
+
+/// @file
+/// @brief Health checks
+///
+/// Header file for the health probes published by health.c, run by the
+/// watchdog against the process it supervises.
+
+#ifndef _WIN32
+
+#include <sys/types.h>
+#include <time.h>
+
+/// @brief A health probe in progress
+///
+/// A probe runs without blocking, so that the watchdog can poll its
+/// descriptor alongside everything else it watches.
+struct health_probe {
+    /// @brief The descriptor to poll, or -1 if there is none
+    int fd;
+    /// @brief The events to poll the descriptor for
+    short events;
+    /// @brief The stage of the probe, or zero once it is done
+    int stage;
+    /// @brief Non-zero for an `http:` probe
+    int http;
+    /// @brief The path requested by an `http:` probe
+    const char *path;
+    /// @brief The shell running a `cmd:` probe, or zero if there is none
+    pid_t child;
+    /// @brief The start of an HTTP response
+    char buffer[256];
+    /// @brief The number of bytes of the response read
+    size_t len;
+    /// @brief When the probe started, from CLOCK_MONOTONIC
+    struct timespec start;
+    /// @brief When the probe times out, from CLOCK_MONOTONIC
+    struct timespec deadline;
+    /// @brief The time the probe took, in seconds, once it is done
+    double latency;
+};
+
+int health_start (struct health_probe *probe, const char *spec, int timeout);
+int health_continue (struct health_probe *probe);
+int health_timeout (const struct health_probe *probe);
+void health_cancel (struct health_probe *probe);
+int health_run (const char *spec, int timeout, double *latency);
+int health_check (pid_t process, int result, double latency, int *failures, int *started, int grace);
+
+#endif /* ifndef _WIN32 */
+
+#endif /* ifndef __inc_health_h */
@@ -11,11 +11,11 @@
 #include "kill.h"
 #include "params.h"
 #include "parent.h"
+#include "procfs.h"
+#include "trace.h"
 #ifdef _WIN32
 # include <TlHelp32.h>
 #else /* ifdef _WIN32 */
-# include <dirent.h>
-# include <ctype.h>
 # include <errno.h>
 # include <signal.h>
 #endif /* ifdef _WIN32 */
@@ -41,11 +41,14 @@ static int terminate_process (
 	DWORD dwProcess = GetProcessId (hProcess);
 	HANDLE hSnapshot;
 	PROCESSENTRY32 pe;
-	if (verbose) fprintf (stdout, "Terminating %u\n", dwProcess);
+	char args[32];
+	if (PARAM (verbose)) fprintf (stdout, "Terminating %u\n", dwProcess);
 	// Terminate the process
 	if (!TerminateProcess (hProcess, ERROR_ALERTED)) {
 		return GetLastError ();
 	}
+	snprintf (args, sizeof (args), "\"target\":%u", dwProcess);
+	trace_instant ("terminate", 0, args);
 	if (WaitForSingleObject (hProcess, 5000) != WAIT_OBJECT_0) {
 		fprintf (stderr, "Process %u not terminated\n", dwProcess);
 	}
@@ -70,14 +73,14 @@ static int terminate_process (
 						if (CompareFileTime (&ftCreateParent, &ftCreateChild) <= 0) {
 							terminate_process (hChild);
 						} else {
-							if (verbose) fprintf (stdout, "Ignoring %u (older than parent)\n", pe.th32ProcessID);
+							if (PARAM (verbose)) fprintf (stdout, "Ignoring %u (older than parent)\n", pe.th32ProcessID);
 						}
 					} else {
-						if (verbose) fprintf (stdout, "Ignoring %u (can't get process times)\n", pe.th32ProcessID);
+						if (PARAM (verbose)) fprintf (stdout, "Ignoring %u (can't get process times)\n", pe.th32ProcessID);
 					}
 					CloseHandle (hChild);
 				} else {
-					if (verbose) fprintf (stdout, "Ignoring %u (can't open)\n", pe.th32ProcessID);
+					if (PARAM (verbose)) fprintf (stdout, "Ignoring %u (can't open)\n", pe.th32ProcessID);
 				}
 			}
 		} while (Process32Next (hSnapshot, &pe));
@@ -88,14 +91,6 @@ static int terminate_process (
 
 #else /* ifdef _WIN32 */
 
-/// @brief Linked list of pid_t values
-struct _pid_t_list {
-    /// @brief The process identifier
-    pid_t pid;
-    /// @brief The next entry in the list, or NULL if this is the last
-    struct _pid_t_list *next;
-};
-
 /// @brief Sends a signal to all processes in a tree
 ///
 /// The signal is sent from bottom to top, with the processes stopped during
@@ -107,41 +102,27 @@ static int signal_tree (
     pid_t process, ///<the process at the head of the tree to signal>
     int signal ///<the signal number to send>
     ) {
-    DIR *dir;
-    struct dirent *ent;
-    struct _pid_t_list *children = NULL;
+    struct pid_list *children;
+    char args[48];
     // Pre-signal
-    if (verbose) fprintf (stdout, "Signalling %u (SIGSTOP)\n", process);
-    if (kill (process, SIGSTOP) != 0) return errno;
+    if (PARAM (verbose)) fprintf (stdout, "Signalling %u (SIGSTOP)\n", process);
+    if (procfs_signal (process, SIGSTOP) != 0) return errno;
     // Find the process' children
-    dir = opendir ("/proc");
-    if (!dir) return ENOENT;
-    while ((ent = readdir (dir)) != NULL) {
-        pid_t proc;
-        if (!isdigit (ent->d_name[0])) continue;
-        proc = (pid_t)strtol (ent->d_name, NULL, 10);
-        if (get_parent (proc) == process) {
-            struct _pid_t_list *entry = (struct _pid_t_list*)malloc (sizeof (struct _pid_t_list));
-            if (entry) {
-                entry->pid = proc;
-                entry->next = children;
-                children = entry;
-            }
-        }
-    }
-    closedir (dir);
+    children = get_children (process);
     // Signal the children
     while (children) {
-        struct _pid_t_list *next = children->next;
+        struct pid_list *next = children->next;
         pid_t proc = children->pid;
         free (children);
         children = next;
         signal_tree (proc, signal);
     }
     // Post-signal
-    if (verbose) fprintf (stdout, "Signalling %u (%d+SIGCONT)\n", process, signal);
-    if (kill (process, signal) != 0) return errno;
-    if (kill (process, SIGCONT) != 0) return errno;
+    if (PARAM (verbose)) fprintf (stdout, "Signalling %u (%d+SIGCONT)\n", process, signal);
+    if (procfs_signal (process, signal) != 0) return errno;
+    snprintf (args, sizeof (args), "\"signal\":%d,\"target\":%u", signal, process);
+    trace_instant ("signal", 0, args);
+    if (procfs_signal (process, SIGCONT) != 0) return errno;
     return 0;
 }
 
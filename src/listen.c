@@ -0,0 +1,169 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Socket activation
+///
+/// The sockets are given as a comma separated list of `[<em>address</em>:]<em>port</em>`
+/// entries, where the address is an IPv4 address and defaults to the loopback
+/// interface. A port of zero binds an ephemeral port; the addresses actually
+/// bound are recorded in the information file. The child is passed the
+/// sockets as descriptors 3 onwards, with the `LISTEN_FDS` and `LISTEN_PID`
+/// environment variables set as for systemd socket activation.
+
+#include "listen.h"
+#include "params.h"
+#ifndef _WIN32
+# include <arpa/inet.h>
+# include <errno.h>
+# include <fcntl.h>
+# include <netinet/in.h>
+# include <sys/socket.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// @brief Binds a listening socket for one entry of the list
+///
+/// @return zero if successful, otherwise a non-zero error code
+static int listen_one (
+    const char *entry, ///<the entry, which is not null terminated>
+    size_t len, ///<the length of the entry>
+    int *fd, ///<receives the listening socket>
+    char *address, ///<receives the address bound, as `address:port`>
+    size_t size ///<the size of the address buffer>
+    ) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof (addr);
+    char buffer[64];
+    char *port, *end;
+    long value;
+    int e, on = 1;
+    if (!len || (len >= sizeof (buffer))) return EINVAL;
+    memcpy (buffer, entry, len);
+    buffer[len] = 0;
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    port = strrchr (buffer, ':');
+    if (port) {
+        *(port++) = 0;
+        if (inet_pton (AF_INET, buffer, &addr.sin_addr) != 1) return EINVAL;
+    } else {
+        port = buffer;
+        addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    }
+    value = strtol (port, &end, 10);
+    if ((end == port) || *end || (value < 0) || (value > 65535)) return EINVAL;
+    addr.sin_port = htons ((unsigned short)value);
+    *fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (*fd < 0) return errno;
+    setsockopt (*fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+    if (bind (*fd, (struct sockaddr*)&addr, sizeof (addr))
+     || listen (*fd, SOMAXCONN)
+     || getsockname (*fd, (struct sockaddr*)&addr, &addr_len)) {
+        e = errno;
+        close (*fd);
+        *fd = -1;
+        return e;
+    }
+    inet_ntop (AF_INET, &addr.sin_addr, buffer, sizeof (buffer));
+    snprintf (address, size, "%s:%u", buffer, ntohs (addr.sin_port));
+    if (PARAM (verbose)) fprintf (stdout, "Listening on %s\n", address);
+    return 0;
+}
+
+/// @brief Binds the listening sockets given by the `s` parameter
+///
+/// The caller must release the sockets with listen_close(), and free the
+/// addresses.
+///
+/// @return zero if successful, EINVAL if an entry is not valid, otherwise a
+///         non-zero error code
+int listen_open (
+    const char *spec, ///<the comma separated list of sockets>
+    int **fds, ///<receives the listening sockets>
+    int *count, ///<receives the number of sockets>
+    char **addresses ///<receives the addresses bound, separated by spaces>
+    ) {
+    const char *entry = spec, *end;
+    size_t len = 0, size = 1;
+    int n = 1, e = 0;
+    while ((end = strchr (entry, ',')) != NULL) {
+        entry = end + 1;
+        n++;
+    }
+    *fds = (int*)malloc (n * sizeof (int));
+    *addresses = (char*)malloc (n * 24);
+    if (!*fds || !*addresses) abort ();
+    **addresses = 0;
+    *count = 0;
+    for (entry = spec; entry; entry = end ? end + 1 : NULL) {
+        end = strchr (entry, ',');
+        if (len) (*addresses)[len++] = ' ';
+        size = n * 24 - len;
+        e = listen_one (entry, end ? (size_t)(end - entry) : strlen (entry), *fds + *count, *addresses + len, size);
+        if (e) break;
+        len += strlen (*addresses + len);
+        (*count)++;
+    }
+    if (e) {
+        listen_close (*fds, *count);
+        free (*addresses);
+        *fds = NULL;
+        *addresses = NULL;
+        *count = 0;
+    }
+    return e;
+}
+
+/// @brief Closes the listening sockets and frees the array
+void listen_close (
+    int *fds, ///<the listening sockets>
+    int count ///<the number of sockets>
+    ) {
+    while (count > 0) close (fds[--count]);
+    free (fds);
+}
+
+/// @brief Passes the listening sockets to the process about to be executed
+///
+/// This is called in the child after it has been forked. The sockets are
+/// moved to descriptors 3 onwards, and left open across execvp, and the
+/// environment variables set. Any other descriptor the child needs is moved
+/// out of the way first.
+void listen_pass (
+    const int *fds, ///<the listening sockets>
+    int count, ///<the number of sockets>
+    int *keep ///<a descriptor which must stay open until execvp, updated>
+    ) {
+    char tmp[16];
+    int *moved = (int*)malloc (count * sizeof (int));
+    int i;
+    if (!moved) abort ();
+    // Each is duplicated above the target range, so none is overwritten
+    // before it has been moved
+    for (i = 0; i < count; i++) {
+        moved[i] = fcntl (fds[i], F_DUPFD_CLOEXEC, 3 + count);
+    }
+    if (*keep >= 0) *keep = fcntl (*keep, F_DUPFD_CLOEXEC, 3 + count);
+    for (i = 0; i < count; i++) {
+        dup2 (moved[i], 3 + i);
+        close (moved[i]);
+    }
+    free (moved);
+    snprintf (tmp, sizeof (tmp), "%d", count);
+    setenv ("LISTEN_FDS", tmp, 1);
+    snprintf (tmp, sizeof (tmp), "%u", getpid ());
+    setenv ("LISTEN_PID", tmp, 1);
+    unsetenv ("LISTEN_FDNAMES");
+}
+
+#endif /* ifndef _WIN32 */
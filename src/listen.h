@@ -0,0 +1,27 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifndef __inc_listen_h
+#define __inc_listen_h
+
+/// @file
+/// @brief Socket activation
+///
+/// Header file for the listening sockets published by listen.c, bound by the
+/// `start` operation and passed to the child by its watchdog.
+
+#ifndef _WIN32
+
+#include <stddef.h>
+
+int listen_open (const char *spec, int **fds, int *count, char **addresses);
+void listen_close (int *fds, int count);
+void listen_pass (const int *fds, int count, int *keep);
+
+#endif /* ifndef _WIN32 */
+
+#endif /* ifndef __inc_listen_h */
@@ -8,9 +8,10 @@
 /// @file
 /// @brief Program entry point
 
-#include "operations.h"
-#include "params.h"
-#include "process.h"
+#include "procctrl.h"
+#ifdef _WIN32
+# include <Windows.h>
+#endif /* ifdef _WIN32 */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,9 +22,8 @@ int _fork_watchdog (DWORD dwChild, DWORD dwParent); // start.c
 
 /// @brief Program entry point
 ///
-/// Proceses the parameters from the command line and dispatches the requested
-/// operation. Housekeeping operations are performed before and/or after the
-/// dispatch as per the housekeep_mode flag.
+/// Creates a context from the command line and dispatches the requested
+/// operation through the library (procctrl.h).
 ///
 /// See the `man` page for documentation of the available parameters and their
 /// behaviour.
@@ -35,6 +35,7 @@ int main (
     int argc, ///<the number of command line arguments>
     char **argv ///<the command line arguments>
     ) {
+    struct procctrl_context *context;
     int e;
 #ifdef _WIN32
 	if ((argc > 2) && !strcmp (argv[1], "fork")) {
@@ -46,19 +47,9 @@ int main (
 		}
 	}
 #endif /* ifdef _WIN32 */
-    if ((e = params (argc, argv)) == 0) {
-        if (housekeep_mode & HOUSEKEEP_BEFORE) process_housekeep ();
-        if ((operation == NULL) || !strcmp (operation, "query")) {
-            e = operation_query ();
-        } else if (!strcmp (operation, "start")) {
-            e = operation_start ();
-        } else if (!strcmp (operation, "stop")) {
-            e = operation_stop ();
-        } else {
-            fprintf (stderr, "Unknown operation '%s'\n", operation);
-            e = 1;
-        }
-        if (!e && (housekeep_mode & HOUSEKEEP_AFTER)) process_housekeep ();
+    if ((e = procctrl_create (argc, argv, &context)) == 0) {
+        e = procctrl_run (context);
+        procctrl_free (context);
     }
     return e;
 }
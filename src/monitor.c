@@ -0,0 +1,512 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Implements the `monitor` operation
+///
+/// The monitor is intended to run continuously, so a refresh must be cheap.
+/// The `/proc` files for each process are opened once and re-read with
+/// `pread`; the process trees are only re-discovered when the registry
+/// changes, a monitored process starts a child or a monitored process
+/// terminates.
+
+#include "operations.h"
+#include "params.h"
+#include "procfs.h"
+#include "process.h"
+#include "stats.h"
+#ifndef _WIN32
+# include <ctype.h>
+# include <dirent.h>
+# include <errno.h>
+# include <fcntl.h>
+# include <poll.h>
+# include <sys/inotify.h>
+# include <sys/time.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// @brief A managed process from the registry, at the head of a tree
+struct _monitor_root {
+    /// @brief The scope folder name, `GLOBAL` or the parent PID
+    char *scope;
+    /// @brief The process identifier, as originally specified
+    char *sid;
+    /// @brief The managed process
+    pid_t pid;
+    /// @brief The number of processes in the tree
+    unsigned processes;
+    /// @brief The number of threads in the tree
+    unsigned threads;
+    /// @brief CPU time used by the tree since the last refresh, in clock ticks
+    unsigned long long ticks;
+    /// @brief Resident set size of the tree, in pages
+    unsigned long long rss;
+};
+
+/// @brief A process in one of the trees
+struct _monitor_process {
+    /// @brief The process
+    pid_t pid;
+    /// @brief Index of the tree in _roots
+    int root;
+    /// @brief Open descriptor for `/proc/<pid>/stat`
+    int stat;
+    /// @brief Open descriptor for `/proc/<pid>/statm`
+    int statm;
+    /// @brief CPU time used at the last refresh, in clock ticks
+    unsigned long long ticks;
+};
+
+/// @brief The managed processes
+static THREAD_LOCAL struct _monitor_root *_roots = NULL;
+/// @brief The number of entries in _roots
+static THREAD_LOCAL int _root_count = 0;
+/// @brief The processes being monitored
+static THREAD_LOCAL struct _monitor_process *_processes = NULL;
+/// @brief The number of entries in _processes
+static THREAD_LOCAL int _process_count = 0;
+/// @brief Buffer for reading `/proc` files
+static THREAD_LOCAL char _buffer[1024];
+
+/// @brief The most processes created between refreshes that are checked
+///        individually before re-discovering every tree
+#define _MONITOR_PROBE_LIMIT 1024
+
+/// @brief Reads a `/proc` file from an open descriptor into _buffer
+///
+/// @return the number of bytes read, or -1 if there was an error
+static ssize_t read_fd (
+    int fd ///<the open descriptor>
+    ) {
+    ssize_t len = pread (fd, _buffer, sizeof (_buffer) - 1, 0);
+    if (len >= 0) _buffer[len] = 0;
+    return len;
+}
+
+/// @brief Parses the content of a `stat` file in _buffer
+///
+/// @return zero if parsed and the process has not terminated, non-zero otherwise
+static int parse_stat (
+    pid_t *ppid, ///<receives the parent process, or NULL if not required>
+    unsigned long long *ticks, ///<receives the CPU time used, or NULL if not required>
+    unsigned *threads ///<receives the number of threads, or NULL if not required>
+    ) {
+    unsigned long long utime, stime;
+    unsigned num_threads;
+    int parent;
+    char state;
+    const char *ptr = strrchr (_buffer, ')');
+    if (!ptr || (sscanf (ptr + 2, "%c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %u", &state, &parent, &utime, &stime, &num_threads) != 5)) return ESRCH;
+    if ((state == 'Z') || (state == 'X')) return ESRCH;
+    if (ppid) *ppid = (pid_t)parent;
+    if (ticks) *ticks = utime + stime;
+    if (threads) *threads = num_threads;
+    return 0;
+}
+
+/// @brief Releases the monitored processes
+static void free_processes () {
+    int i;
+    for (i = 0; i < _process_count; i++) {
+        close (_processes[i].stat);
+        if (_processes[i].statm >= 0) close (_processes[i].statm);
+    }
+    free (_processes);
+    _processes = NULL;
+    _process_count = 0;
+}
+
+/// @brief Releases the managed processes
+static void free_roots () {
+    int i;
+    for (i = 0; i < _root_count; i++) {
+        free (_roots[i].scope);
+        free (_roots[i].sid);
+    }
+    free (_roots);
+    _roots = NULL;
+    _root_count = 0;
+}
+
+/// @brief Reads the registry for the managed processes that are running
+///
+/// Each scope folder is also added to the inotify watch so that changes to the
+/// registry cause the trees to be re-discovered.
+static void discover_roots (
+    int inotify ///<the inotify descriptor>
+    ) {
+    DIR *dir, *subdir;
+    struct dirent *ent, *subent;
+    char *path;
+    free_roots ();
+    dir = opendir (PARAM (data_dir));
+    if (!dir) return;
+    while ((ent = readdir (dir)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        path = (char*)malloc (strlen (PARAM (data_dir)) + strlen (ent->d_name) + NAME_MAX + 3);
+        if (!path) abort ();
+        sprintf (path, "%s/%s", PARAM (data_dir), ent->d_name);
+        inotify_add_watch (inotify, path, IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE | IN_ONLYDIR);
+        subdir = opendir (path);
+        if (subdir) {
+            size_t len = strlen (path);
+            while ((subent = readdir (subdir)) != NULL) {
+                struct process_info *info;
+                const char *pid;
+                if ((subent->d_name[0] == '.') || (subent->d_name[strlen (subent->d_name) - 1] == '~')) continue;
+                sprintf (path + len, "/%s", subent->d_name);
+                info = process_info_read (path);
+                path[len] = 0;
+                if (!info) continue;
+                pid = process_info_get (info, "pid");
+                if (pid && !process_info_get (info, "end")) {
+                    _roots = (struct _monitor_root*)realloc (_roots, (_root_count + 1) * sizeof (struct _monitor_root));
+                    if (!_roots) abort ();
+                    _roots[_root_count].scope = strdup (ent->d_name);
+                    _roots[_root_count].sid = strdup (process_info_get (info, "sid") ? process_info_get (info, "sid") : subent->d_name);
+                    if (!_roots[_root_count].scope || !_roots[_root_count].sid) abort ();
+                    _roots[_root_count].pid = (pid_t)strtol (pid, NULL, 10);
+                    _root_count++;
+                }
+                process_info_free (info);
+            }
+            closedir (subdir);
+        }
+        free (path);
+    }
+    closedir (dir);
+}
+
+/// @brief A process and its parent, from the process table
+struct _monitor_parent {
+    /// @brief The process
+    pid_t pid;
+    /// @brief The parent process
+    pid_t ppid;
+};
+
+/// @brief Orders _monitor_parent entries by process
+///
+/// @return negative, zero or positive as for `qsort`
+static int compare_parent (
+    const void *a, ///<the first entry>
+    const void *b ///<the second entry>
+    ) {
+    pid_t pa = ((const struct _monitor_parent*)a)->pid, pb = ((const struct _monitor_parent*)b)->pid;
+    return (pa < pb) ? -1 : (pa > pb);
+}
+
+/// @brief Finds the tree that a process belongs to
+///
+/// @return the index in _roots, or -1 if the process is not in a tree
+static int find_root (
+    pid_t process, ///<the process to find>
+    const struct _monitor_parent *table, ///<the process table, ordered by process>
+    int count ///<the number of entries in the table>
+    ) {
+    int depth, i;
+    for (depth = 0; (depth < count) && (process > 1); depth++) {
+        struct _monitor_parent key;
+        const struct _monitor_parent *entry;
+        for (i = 0; i < _root_count; i++) {
+            if (_roots[i].pid == process) return i;
+        }
+        key.pid = process;
+        entry = (const struct _monitor_parent*)bsearch (&key, table, count, sizeof (struct _monitor_parent), compare_parent);
+        if (!entry) return -1;
+        process = entry->ppid;
+    }
+    return -1;
+}
+
+/// @brief Re-discovers the processes in each tree
+///
+/// This is a single pass over the process table; the parent of each process
+/// is read and those descended from a managed process are kept. The open
+/// descriptors are retained for any process that was already monitored.
+static void discover_processes () {
+    struct _monitor_process *previous = _processes;
+    int previous_count = _process_count;
+    struct _monitor_parent *table = NULL;
+    int count = 0, size = 0, i, j;
+    DIR *dir;
+    struct dirent *ent;
+    _processes = NULL;
+    _process_count = 0;
+    dir = procfs_opendir (0, NULL);
+    if (dir) {
+        while ((ent = readdir (dir)) != NULL) {
+            pid_t pid, ppid;
+            int fd;
+            if (!isdigit (ent->d_name[0])) continue;
+            pid = (pid_t)strtol (ent->d_name, NULL, 10);
+            fd = procfs_open (pid, "stat");
+            if (fd < 0) continue;
+            if ((read_fd (fd) > 0) && (parse_stat (&ppid, NULL, NULL) == 0)) {
+                if (count == size) {
+                    size = size ? size * 2 : 256;
+                    table = (struct _monitor_parent*)realloc (table, size * sizeof (struct _monitor_parent));
+                    if (!table) abort ();
+                }
+                table[count].pid = pid;
+                table[count++].ppid = ppid;
+            }
+            close (fd);
+        }
+        closedir (dir);
+    }
+    if (count) qsort (table, count, sizeof (struct _monitor_parent), compare_parent);
+    for (i = 0; i < count; i++) {
+        struct _monitor_process *process;
+        int root = find_root (table[i].pid, table, count);
+        if (root < 0) continue;
+        _processes = (struct _monitor_process*)realloc (_processes, (_process_count + 1) * sizeof (struct _monitor_process));
+        if (!_processes) abort ();
+        process = _processes + _process_count;
+        for (j = 0; (j < previous_count) && (previous[j].pid != table[i].pid); j++);
+        if (j < previous_count) {
+            // Keep the descriptors and CPU time from the previous refresh
+            *process = previous[j];
+            previous[j].stat = -1;
+        } else {
+            process->pid = table[i].pid;
+            process->stat = procfs_open (table[i].pid, "stat");
+            if (process->stat < 0) continue;
+            process->statm = procfs_open (table[i].pid, "statm");
+            // Only CPU time used after this point is counted
+            if ((read_fd (process->stat) <= 0) || parse_stat (NULL, &process->ticks, NULL)) process->ticks = 0;
+        }
+        process->root = root;
+        _process_count++;
+    }
+    for (j = 0; j < previous_count; j++) {
+        if (previous[j].stat < 0) continue;
+        close (previous[j].stat);
+        if (previous[j].statm >= 0) close (previous[j].statm);
+    }
+    free (previous);
+    free (table);
+}
+
+/// @brief Reads the current state of every monitored process
+///
+/// @return zero if all processes are still running, non-zero if any have
+///         terminated and the trees must be re-discovered
+static int refresh () {
+    unsigned long long pages, ticks;
+    unsigned threads;
+    int i, terminated = 0;
+    for (i = 0; i < _root_count; i++) {
+        _roots[i].processes = 0;
+        _roots[i].threads = 0;
+        _roots[i].ticks = 0;
+        _roots[i].rss = 0;
+    }
+    for (i = 0; i < _process_count; i++) {
+        struct _monitor_process *process = _processes + i;
+        struct _monitor_root *root = _roots + process->root;
+        if ((read_fd (process->stat) <= 0) || parse_stat (NULL, &ticks, &threads)) {
+            terminated = 1;
+            continue;
+        }
+        root->processes++;
+        root->threads += threads;
+        if (ticks > process->ticks) root->ticks += ticks - process->ticks;
+        process->ticks = ticks;
+        if ((process->statm >= 0) && (read_fd (process->statm) > 0) && (sscanf (_buffer, "%*u %llu", &pages) == 1)) {
+            root->rss += pages;
+        }
+    }
+    return terminated;
+}
+
+/// @brief Writes the state of every tree
+static void report (
+    FILE *out, ///<the stream to write to>
+    double elapsed ///<the time since the previous report, in seconds>
+    ) {
+    long ticks_per_sec = sysconf (_SC_CLK_TCK);
+    long page_size = sysconf (_SC_PAGESIZE);
+    int i;
+    if (PARAM (output_mode) == OUTPUT_JSON) {
+        struct timeval now;
+        gettimeofday (&now, NULL);
+        for (i = 0; i < _root_count; i++) {
+            const struct _monitor_root *root = _roots + i;
+            fprintf (out, "{\"time\":%ld.%06ld,\"scope\":", (long)now.tv_sec, (long)now.tv_usec);
+            stats_json_string (out, root->scope);
+            fprintf (out, ",\"id\":");
+            stats_json_string (out, root->sid);
+            fprintf (out, ",\"pid\":%u,\"processes\":%u,\"threads\":%u,\"cpu\":%.1f,\"rss\":%llu}\n",
+                root->pid, root->processes, root->threads,
+                elapsed > 0 ? 100.0 * root->ticks / ticks_per_sec / elapsed : 0.0, root->rss * page_size);
+        }
+    } else {
+        if (isatty (fileno (out))) fprintf (out, "\033[H\033[J");
+        fprintf (out, "%-8s %-24s %8s %6s %7s %6s %10s\n", "SCOPE", "ID", "PID", "PROCS", "THREADS", "CPU%", "RSS(KiB)");
+        for (i = 0; i < _root_count; i++) {
+            const struct _monitor_root *root = _roots + i;
+            fprintf (out, "%-8s %-24.24s %8u %6u %7u %6.1f %10llu\n",
+                root->scope, root->sid, root->pid, root->processes, root->threads,
+                elapsed > 0 ? 100.0 * root->ticks / ticks_per_sec / elapsed : 0.0, root->rss * page_size / 1024);
+        }
+    }
+    fflush (out);
+}
+
+/// @brief Reads the most recently created process from `/proc/loadavg`
+///
+/// A change indicates that processes have been created, some of which may be
+/// in the monitored trees.
+///
+/// @return the process identifier, or zero if it could not be read
+static pid_t last_pid (
+    int loadavg ///<open descriptor for `/proc/loadavg`>
+    ) {
+    const char *ptr;
+    if ((loadavg < 0) || (read_fd (loadavg) <= 0)) return 0;
+    ptr = strrchr (_buffer, ' ');
+    return ptr ? (pid_t)strtol (ptr + 1, NULL, 10) : 0;
+}
+
+/// @brief Orders _monitor_process entries by process
+///
+/// @return negative, zero or positive as for `qsort`
+static int compare_process (
+    const void *a, ///<the first entry>
+    const void *b ///<the second entry>
+    ) {
+    pid_t pa = ((const struct _monitor_process*)a)->pid, pb = ((const struct _monitor_process*)b)->pid;
+    return (pa < pb) ? -1 : (pa > pb);
+}
+
+/// @brief Tests if any process created since the last refresh is in a tree
+///
+/// Processes are numbered in the order they are created, so only those after
+/// the last one seen need to be checked. A process whose parent is monitored
+/// means the trees must be re-discovered; any other process created elsewhere
+/// on the system does not. If the numbers have wrapped, or too many have been
+/// created to check individually, the trees are assumed to have changed.
+///
+/// @return non-zero if the trees must be re-discovered, zero otherwise
+static int created_in_tree (
+    pid_t from, ///<the most recent process at the last refresh>
+    pid_t to ///<the most recent process now>
+    ) {
+    struct _monitor_process key;
+    pid_t pid, ppid;
+    int fd, found;
+    if ((to < from) || (to - from > _MONITOR_PROBE_LIMIT)) return 1;
+    for (pid = from + 1; pid <= to; pid++) {
+        fd = procfs_open (pid, "stat");
+        if (fd < 0) continue;
+        found = (read_fd (fd) > 0) && !parse_stat (&ppid, NULL, NULL);
+        close (fd);
+        if (!found) continue;
+        // _processes is ordered by process, as the table it was built from
+        key.pid = ppid;
+        if (bsearch (&key, _processes, _process_count, sizeof (struct _monitor_process), compare_process)) return 1;
+    }
+    return 0;
+}
+
+/// @brief Implementation of operation_monitor()
+///
+/// This is separated out for use by the unit tests so that the report can be
+/// written somewhere other than stdout.
+///
+/// @return zero if the time limit elapsed, otherwise a non-zero error code
+int _monitor (
+    FILE *out ///<the stream to write to>
+    ) {
+    struct timeval previous, now;
+    struct pollfd pfd;
+    long long deadline, end;
+    int inotify, loadavg, wait_ms, e = 0, rediscover = 1, registry = 1;
+    pid_t last = 0;
+    if (PARAM (verbose)) fprintf (stderr, "Monitoring processes in %s\n", PARAM (data_dir));
+    inotify = inotify_init1 (IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify < 0) return errno;
+    inotify_add_watch (inotify, PARAM (data_dir), IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_ONLYDIR);
+    loadavg = procfs_open (0, "loadavg");
+    gettimeofday (&previous, NULL);
+    end = previous.tv_sec * 1000LL + previous.tv_usec / 1000 + PARAM (wait_timeout) * 1000LL;
+    do {
+        pid_t pid = last_pid (loadavg);
+        if (pid != last) {
+            if (!rediscover && created_in_tree (last, pid)) rediscover = 1;
+            last = pid;
+        }
+        if (registry) {
+            discover_roots (inotify);
+            registry = 0;
+            rediscover = 1;
+        }
+        if (rediscover) {
+            if (PARAM (verbose)) fprintf (stderr, "Discovering process trees\n");
+            discover_processes ();
+        }
+        rediscover = refresh ();
+        gettimeofday (&now, NULL);
+        report (out, (now.tv_sec - previous.tv_sec) + (now.tv_usec - previous.tv_usec) / 1000000.0);
+        previous = now;
+        // Wait for the next refresh, noting any changes to the registry
+        deadline = now.tv_sec * 1000LL + now.tv_usec / 1000 + PARAM (monitor_interval) * 1000;
+        if ((PARAM (wait_timeout) >= 0) && (deadline > end)) deadline = end;
+        if ((PARAM (wait_timeout) >= 0) && (now.tv_sec * 1000LL + now.tv_usec / 1000 >= end)) break;
+        do {
+            gettimeofday (&now, NULL);
+            wait_ms = (int)(deadline - (now.tv_sec * 1000LL + now.tv_usec / 1000));
+            if (wait_ms < 0) wait_ms = 0;
+            pfd.fd = inotify;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            if (poll (&pfd, 1, wait_ms) < 0) {
+                if (errno == EINTR) continue;
+                e = errno;
+                break;
+            }
+            if (pfd.revents & POLLIN) {
+                while (read (inotify, _buffer, sizeof (_buffer)) > 0);
+                registry = 1;
+            }
+        } while (wait_ms > 0);
+    } while (!e);
+    free_processes ();
+    free_roots ();
+    if (loadavg >= 0) close (loadavg);
+    close (inotify);
+    return e;
+}
+
+#endif /* ifndef _WIN32 */
+
+/// @brief Continuously reports the resources used by all processes
+///
+/// Every `i` seconds writes the number of processes and threads, the CPU
+/// usage and resident set size of each managed process in the data directory
+/// and all of its descendants. This is a table, or a line of JSON for each
+/// process if the `o` parameter is `json`.
+///
+/// This continues until the process is killed or for the time given by the
+/// `t` parameter.
+///
+/// @return zero if the time limit elapsed, otherwise a non-zero error code
+int operation_monitor () {
+#ifdef _WIN32
+	fprintf (stderr, "Monitoring is not supported on this platform\n");
+	return ERROR_NOT_SUPPORTED;
+#else /* ifdef _WIN32 */
+    return _monitor (stdout);
+#endif /* ifdef _WIN32 */
+}
@@ -17,5 +17,13 @@
 int operation_query ();
 int operation_start ();
 int operation_stop ();
+int operation_wait ();
+int operation_events ();
+int operation_monitor ();
+int operation_export ();
+int operation_batch ();
+int operation_pool ();
+int operation_restart ();
+int operation_priority ();
 
 #endif /* ifndef __inc_operations_h */
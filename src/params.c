@@ -8,17 +8,13 @@
 /// @file
 /// @brief Program parameters
 ///
-/// Processes the command line to populate the global variables used to hold
-/// the parameters.
+/// Processes the command line to populate the context used to hold the
+/// parameters.
 
-/// @brief Defines a global variable exported through params.h
-#define MODULE_VAR_EXTERN
-/// @brief Defines a global variable exported through params.h
-#define MODULE_VAR_CONST
 #include "params.h"
-#undef MODULE_VAR_EXTERN
-#undef MODULE_VAR_CONST
 #include "parent.h"
+#include "placement.h"
+#include "priority.h"
 #ifdef _WIN32
 # include <strsafe.h>
 # define snprintf StringCchPrintfA
@@ -26,6 +22,7 @@
 #else /* ifdef _WIN32 */
 # include <ctype.h>
 # include <errno.h>
+# include <pthread.h>
 # include <unistd.h>
 #endif /* ifndef _WIN32 */
 #include <stdarg.h>
@@ -33,6 +30,15 @@
 #include <stdlib.h>
 #include <string.h>
 
+/// @brief The context used by the command line, and by any thread that has not
+///        bound its own
+static struct procctrl_context _params;
+
+THREAD_LOCAL struct procctrl_context *params_current = &_params;
+
+/// @brief Serialises use of `getopt`, which keeps its state in globals
+static _WIN32_OR_POSIX (SRWLOCK, pthread_mutex_t) _getopt_lock = _WIN32_OR_POSIX (SRWLOCK_INIT, PTHREAD_MUTEX_INITIALIZER);
+
 /// @brief Copies the argument strings
 ///
 /// The argument strings might have been allocated on a stack; this will make
@@ -74,19 +80,19 @@ static char **copy_args (
 /// The command line used for the symbolic process identifier if none is
 /// explicitly set with the `k` parameter.
 static void auto_process_identifier () {
-    size_t size = spawn_argc;
+    size_t size = PARAM (spawn_argc);
     int arg;
     char *ptr;
-    for (arg = 0; arg < spawn_argc; arg++) {
-        size += strlen (spawn_argv[arg]);
+    for (arg = 0; arg < PARAM (spawn_argc); arg++) {
+        size += strlen (PARAM (spawn_argv)[arg]);
     }
-    process_identifier = ptr = (char*)malloc (size);
-    if (!process_identifier) abort ();
-    for (arg = 0; arg < spawn_argc; arg++) {
+    PARAM (process_identifier) = ptr = (char*)malloc (size);
+    if (!PARAM (process_identifier)) abort ();
+    for (arg = 0; arg < PARAM (spawn_argc); arg++) {
 		size_t len;
         if (arg) *(ptr++) = ' ';
-        len = strlen (spawn_argv[arg]);
-        memcpy (ptr, spawn_argv[arg], len);
+        len = strlen (PARAM (spawn_argv)[arg]);
+        memcpy (ptr, PARAM (spawn_argv)[arg], len);
         ptr += len;
     }
     *ptr = 0;
@@ -98,7 +104,7 @@ static void auto_process_identifier () {
 /// The parent process is located, if possible, and a handle to it opened. If
 /// the parent cannot be located then the parent handle is set to NULL.
 static void open_parent_process () {
-	parent_process = get_parent (GetCurrentProcess ());
+	PARAM (parent_process) = get_parent (GetCurrentProcess ());
 }
 #endif /* ifdef _WIN32 */
 
@@ -111,37 +117,55 @@ static void expand_home_dir () {
     char *path;
     size_t size;
     if (!home) home = ".";
-    size = strlen (home) + strlen (data_dir);
+    size = strlen (home) + strlen (PARAM (data_dir));
     path = (char*)malloc (size);
     if (!path) abort ();
-    snprintf (path, size, "%s%s", home, data_dir + 1);
-    data_dir = path;
+    snprintf (path, size, "%s%s", home, PARAM (data_dir) + 1);
+    free ((char*)PARAM (data_dir));
+    PARAM (data_dir) = path;
 }
 
-/// @brief Process the command line arguments
-///
-/// The arguments are processed and values set into the global variables
-/// published by params.h that other components can then access. Default
-/// values are set where required for anything. The meaning of each
-/// argument is documented in the `man` page.
-///
-/// Note that this is implemented with `getopt` which can modify the array
-/// passed. If used once in a program this is okay - the parameters to
-/// main(int,char**) can be used. If needed multiple times, for example as
-/// part of the unit tests, use the params_v(int,...) wrapper instead.
+/// @brief Implementation of params(int,char**), called with the getopt lock
 ///
 /// @return zero if the arguments are okay, otherwise a non-zero error code
-int params (
+static int parse_params (
     int argc, ///<the number of arguments, as passed to main(int,char**)
     char **argv ///<the argument values, as passed to main(int,char**)
     ) {
-	data_dir = "~" _WIN32_OR_POSIX ("\\", "/") ".procctrl";
-    global_identifier = 0;
-    process_identifier = NULL;
-    parent_process = _WIN32_OR_POSIX (INVALID_HANDLE_VALUE, getppid ());
-    watch_parent = 0;
-    verbose = 0;
-    housekeep_mode = HOUSEKEEP_FULL;
+	PARAM (data_dir) = strdup ("~" _WIN32_OR_POSIX ("\\", "/") ".procctrl");
+    PARAM (output_file) = strdup ("procctrl.prom");
+    if (!PARAM (data_dir) || !PARAM (output_file)) abort ();
+    PARAM (core_count) = 0;
+    PARAM (cpu_affinity) = NULL;
+    PARAM (probe_timeout) = 1;
+    PARAM (health_probe) = NULL;
+    PARAM (health_grace) = 0;
+    PARAM (health_threshold) = 3;
+    PARAM (idle_timeout) = 0;
+    PARAM (monitor_interval) = 1;
+    PARAM (io_priority) = NULL;
+    PARAM (global_identifier) = 0;
+    PARAM (process_identifier) = NULL;
+    PARAM (shared_lease) = 0;
+    PARAM (memory_policy) = NULL;
+    PARAM (replica_count) = 0;
+    PARAM (replica_index) = -1;
+    PARAM (output_mode) = OUTPUT_STATUS;
+    PARAM (parent_process) = _WIN32_OR_POSIX (INVALID_HANDLE_VALUE, getppid ());
+    PARAM (watch_parent) = 0;
+    PARAM (restart_limit) = -1;
+    PARAM (restart_mode) = RESTART_NO;
+    PARAM (sched_policy) = NULL;
+    PARAM (listen_spec) = NULL;
+    PARAM (timing_mode) = TIMING_NONE;
+    PARAM (trace_enabled) = 0;
+    PARAM (nice_value) = NULL;
+    PARAM (wait_timeout) = -1;
+    PARAM (verbose) = 0;
+    PARAM (pool_size) = 1;
+    PARAM (pool_name) = NULL;
+    PARAM (pool_member) = 0;
+    PARAM (housekeep_mode) = HOUSEKEEP_FULL;
     if (argc > 1) {
         int arg;
         int optind_save = optind;
@@ -150,45 +174,312 @@ int params (
         opterr = 0;
 #endif /* ifndef _WIN32 */
         optind = 1;
-        while ((arg = getopt (argc, argv, "d:H:Kk:P:pv")) != -1) {
+        while ((arg = getopt (argc, argv, "A:a:C:c:d:f:g:H:I:i:j:Kk:Lm:N:n:o:P:pR:r:S:s:T:t:vW:w:Xy:")) != -1) {
             switch (arg) {
+                case 'A' :
+                    PARAM (core_count) = atoi (optarg);
+                    if (PARAM (core_count) < 0) PARAM (core_count) = 0;
+                    break;
+                case 'a' :
+#ifndef _WIN32
+                    {
+                        unsigned long mask[PLACEMENT_WORDS];
+                        if (placement_list (optarg, mask)) {
+                            fprintf (stderr, "Unknown CPU list '%s'\n", optarg);
+                            optind = optind_save;
+                            opterr = opterr_save;
+                            return EINVAL;
+                        }
+                    }
+#endif /* ifndef _WIN32 */
+                    free ((char*)PARAM (cpu_affinity));
+                    PARAM (cpu_affinity) = strdup (optarg);
+                    if (!PARAM (cpu_affinity)) abort ();
+                    break;
+                case 'C' :
+                    PARAM (probe_timeout) = atoi (optarg);
+                    if (PARAM (probe_timeout) < 1) PARAM (probe_timeout) = 1;
+                    break;
+                case 'c' :
+                    if (strncmp (optarg, "tcp:", 4) && strncmp (optarg, "http:", 5) && strncmp (optarg, "cmd:", 4)) {
+                        fprintf (stderr, "Unknown health check '%s'\n", optarg);
+                        optind = optind_save;
+#ifndef _WIN32
+                        opterr = opterr_save;
+#endif /* ifndef _WIN32 */
+                        return _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL);
+                    }
+                    free ((char*)PARAM (health_probe));
+                    PARAM (health_probe) = strdup (optarg);
+                    if (!PARAM (health_probe)) abort ();
+                    break;
                 case 'd' :
-                    data_dir = strdup (optarg);
-                    if (!data_dir) abort ();
+                    free ((char*)PARAM (data_dir));
+                    PARAM (data_dir) = strdup (optarg);
+                    if (!PARAM (data_dir)) abort ();
+                    break;
+                case 'f' :
+                    free ((char*)PARAM (output_file));
+                    PARAM (output_file) = strdup (optarg);
+                    if (!PARAM (output_file)) abort ();
+                    break;
+                case 'g' :
+                    PARAM (health_grace) = atoi (optarg);
+                    if (PARAM (health_grace) < 0) PARAM (health_grace) = 0;
                     break;
                 case 'H' :
-                    housekeep_mode = atoi (optarg);
+                    PARAM (housekeep_mode) = atoi (optarg);
+                    break;
+                case 'I' :
+                    PARAM (idle_timeout) = atoi (optarg);
+                    if (PARAM (idle_timeout) < 0) PARAM (idle_timeout) = 0;
+                    break;
+                case 'i' :
+                    PARAM (monitor_interval) = atoi (optarg);
+                    if (PARAM (monitor_interval) < 1) PARAM (monitor_interval) = 1;
+                    break;
+                case 'j' :
+#ifndef _WIN32
+                    {
+                        int value;
+                        if (priority_io (optarg, &value)) {
+                            fprintf (stderr, "Unknown I/O priority '%s'\n", optarg);
+                            optind = optind_save;
+                            opterr = opterr_save;
+                            return EINVAL;
+                        }
+                    }
+#endif /* ifndef _WIN32 */
+                    free ((char*)PARAM (io_priority));
+                    PARAM (io_priority) = strdup (optarg);
+                    if (!PARAM (io_priority)) abort ();
                     break;
                 case 'K' :
-                    global_identifier = 1;
+                    PARAM (global_identifier) = 1;
                     break;
                 case 'k' :
-                    process_identifier = strdup (optarg);
-                    if (!process_identifier) abort ();
+                    PARAM (process_identifier) = strdup (optarg);
+                    if (!PARAM (process_identifier)) abort ();
+                    break;
+                case 'L' :
+                    PARAM (shared_lease) = 1;
+                    PARAM (global_identifier) = 1;
+                    break;
+                case 'm' :
+#ifndef _WIN32
+                    {
+                        unsigned long mask[PLACEMENT_WORDS];
+                        int mode;
+                        if (placement_memory (optarg, &mode, mask)) {
+                            fprintf (stderr, "Unknown memory policy '%s'\n", optarg);
+                            optind = optind_save;
+                            opterr = opterr_save;
+                            return EINVAL;
+                        }
+                    }
+#endif /* ifndef _WIN32 */
+                    free ((char*)PARAM (memory_policy));
+                    PARAM (memory_policy) = strdup (optarg);
+                    if (!PARAM (memory_policy)) abort ();
+                    break;
+                case 'N' :
+                    PARAM (replica_count) = atoi (optarg);
+                    if (PARAM (replica_count) < 0) PARAM (replica_count) = 0;
+                    break;
+                case 'n' :
+                    PARAM (health_threshold) = atoi (optarg);
+                    if (PARAM (health_threshold) < 1) PARAM (health_threshold) = 1;
+                    break;
+                case 'o' :
+                    if (!strcmp (optarg, "status")) {
+                        PARAM (output_mode) = OUTPUT_STATUS;
+                    } else if (!strcmp (optarg, "stats")) {
+                        PARAM (output_mode) = OUTPUT_STATS;
+                    } else if (!strcmp (optarg, "json")) {
+                        PARAM (output_mode) = OUTPUT_JSON;
+                    } else {
+                        fprintf (stderr, "Unknown output mode '%s'\n", optarg);
+                        optind = optind_save;
+#ifndef _WIN32
+                        opterr = opterr_save;
+#endif /* ifndef _WIN32 */
+                        return _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL);
+                    }
                     break;
 				case 'P' :
-					parent_process = _WIN32_OR_POSIX (OpenProcess (PROCESS_QUERY_INFORMATION, FALSE, atoi (optarg)), atoi (optarg));
+					PARAM (parent_process) = _WIN32_OR_POSIX (OpenProcess (PROCESS_QUERY_INFORMATION, FALSE, atoi (optarg)), atoi (optarg));
                     break;
                 case 'p' :
-                    watch_parent = 1;
+                    PARAM (watch_parent) = 1;
+                    break;
+                case 'R' :
+                    PARAM (restart_limit) = atoi (optarg);
+                    break;
+                case 'r' :
+                    if (!strcmp (optarg, "no")) {
+                        PARAM (restart_mode) = RESTART_NO;
+                    } else if (!strcmp (optarg, "on-failure")) {
+                        PARAM (restart_mode) = RESTART_ON_FAILURE;
+                    } else if (!strcmp (optarg, "always")) {
+                        PARAM (restart_mode) = RESTART_ALWAYS;
+                    } else {
+                        fprintf (stderr, "Unknown restart mode '%s'\n", optarg);
+                        optind = optind_save;
+#ifndef _WIN32
+                        opterr = opterr_save;
+#endif /* ifndef _WIN32 */
+                        return _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL);
+                    }
+                    break;
+                case 'S' :
+#ifndef _WIN32
+                    {
+                        int value;
+                        if (priority_policy (optarg, &value)) {
+                            fprintf (stderr, "Unknown scheduling policy '%s'\n", optarg);
+                            optind = optind_save;
+                            opterr = opterr_save;
+                            return EINVAL;
+                        }
+                    }
+#endif /* ifndef _WIN32 */
+                    free ((char*)PARAM (sched_policy));
+                    PARAM (sched_policy) = strdup (optarg);
+                    if (!PARAM (sched_policy)) abort ();
+                    break;
+                case 's' :
+                    free ((char*)PARAM (listen_spec));
+                    PARAM (listen_spec) = strdup (optarg);
+                    if (!PARAM (listen_spec)) abort ();
+                    break;
+                case 'T' :
+                    if (!strcmp (optarg, "json")) {
+                        PARAM (timing_mode) = TIMING_JSON;
+                    } else if (!strcmp (optarg, "log")) {
+                        PARAM (timing_mode) = TIMING_LOG;
+                    } else {
+                        fprintf (stderr, "Unknown timing mode '%s'\n", optarg);
+                        optind = optind_save;
+#ifndef _WIN32
+                        opterr = opterr_save;
+#endif /* ifndef _WIN32 */
+                        return _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL);
+                    }
+                    break;
+                case 't' :
+                    PARAM (wait_timeout) = atoi (optarg);
                     break;
                 case 'v' :
-                    verbose = 1;
+                    PARAM (verbose) = 1;
+                    break;
+                case 'W' :
+                    PARAM (pool_size) = atoi (optarg);
+                    if (PARAM (pool_size) < 0) PARAM (pool_size) = 0;
+                    break;
+                case 'w' :
+                    free ((char*)PARAM (pool_name));
+                    PARAM (pool_name) = strdup (optarg);
+                    if (!PARAM (pool_name)) abort ();
+                    break;
+                case 'X' :
+                    PARAM (trace_enabled) = 1;
+                    break;
+                case 'y' :
+#ifndef _WIN32
+                    {
+                        int value;
+                        if (priority_nice (optarg, &value)) {
+                            fprintf (stderr, "Unknown nice value '%s'\n", optarg);
+                            optind = optind_save;
+                            opterr = opterr_save;
+                            return EINVAL;
+                        }
+                    }
+#endif /* ifndef _WIN32 */
+                    free ((char*)PARAM (nice_value));
+                    PARAM (nice_value) = strdup (optarg);
+                    if (!PARAM (nice_value)) abort ();
                     break;
                 case '?' :
                     switch (optopt) {
+                        case 'A' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "A requires a number of cores\n");
+                            break;
+                        case 'a' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "a requires a list of CPUs\n");
+                            break;
+                        case 'C' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "C requires a timeout in seconds\n");
+                            break;
+                        case 'c' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "c requires a health check\n");
+                            break;
                         case 'd' :
                             fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "d requires a directory\n");
                             break;
+                        case 'f' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "f requires a file name\n");
+                            break;
+                        case 'g' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "g requires a period in seconds\n");
+                            break;
                         case 'H' :
                             fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "H requires a mode flag\n");
                             break;
+                        case 'I' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "I requires a timeout in seconds\n");
+                            break;
+                        case 'i' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "i requires an interval in seconds\n");
+                            break;
+                        case 'j' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "j requires an I/O priority\n");
+                            break;
                         case 'k' :
                             fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "k requires a process identifier key\n");
                             break;
+                        case 'm' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "m requires a memory policy\n");
+                            break;
+                        case 'N' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "N requires a number of replicas\n");
+                            break;
+                        case 'n' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "n requires a number of failures\n");
+                            break;
+                        case 'o' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "o requires an output mode\n");
+                            break;
                         case 'P' :
                             fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "P requires a process ID\n");
                             break;
+                        case 'R' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "R requires a number of restarts\n");
+                            break;
+                        case 'r' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "r requires a restart mode\n");
+                            break;
+                        case 'S' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "S requires a scheduling policy\n");
+                            break;
+                        case 's' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "s requires a socket address\n");
+                            break;
+                        case 'T' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "T requires a timing mode\n");
+                            break;
+                        case 't' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "t requires a timeout in seconds\n");
+                            break;
+                        case 'W' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "W requires a number of instances\n");
+                            break;
+                        case 'w' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "w requires a pool name\n");
+                            break;
+                        case 'y' :
+                            fprintf (stderr, _WIN32_OR_POSIX ("/", "-") "y requires a nice value\n");
+                            break;
                         default :
                             if (isprint (optopt)) {
                                 fprintf (stderr, "Unknown option " _WIN32_OR_POSIX ("/", "-") "%c\n", optopt);
@@ -207,41 +498,100 @@ int params (
             }
         }
         arg = optind;
-        operation = (arg < argc) ? argv[arg++] : NULL;
-        spawn_argc = argc - arg;
+        if (arg < argc) {
+            PARAM (operation) = strdup (argv[arg++]);
+            if (!PARAM (operation)) abort ();
+        } else {
+            PARAM (operation) = NULL;
+        }
+        PARAM (spawn_argc) = argc - arg;
         argv += arg;
 #ifndef _WIN32
         optind = optind_save;
         opterr = opterr_save;
 #endif /* ifndef _WIN32 */
     } else {
-        operation = NULL;
-        spawn_argc = 0;
+        PARAM (operation) = NULL;
+        PARAM (spawn_argc) = 0;
     }
-    spawn_argv = copy_args (spawn_argc, argv);
-    if (process_identifier == NULL) auto_process_identifier ();
+    PARAM (spawn_argv) = copy_args (PARAM (spawn_argc), argv);
+    if (PARAM (process_identifier) == NULL) auto_process_identifier ();
 #ifdef _WIN32
-	if (parent_process == INVALID_HANDLE_VALUE) open_parent_process ();
+	if (PARAM (parent_process) == INVALID_HANDLE_VALUE) open_parent_process ();
 #endif /* ifdef _WIN32 */
-    if ((data_dir[0] == '~') && (data_dir[1] == _WIN32_OR_POSIX ('\\', '/'))) expand_home_dir ();
-    if (verbose) {
+    if ((PARAM (data_dir)[0] == '~') && (PARAM (data_dir)[1] == _WIN32_OR_POSIX ('\\', '/'))) expand_home_dir ();
+    if (PARAM (verbose)) {
         int arg;
-        fprintf (stdout, "Data directory     : %s\n", data_dir);
-        fprintf (stdout, "Identifier scope   : %s\n", global_identifier ? "Global" : "Local to parent");
-        fprintf (stdout, "Process identifier : %s\n", process_identifier ? process_identifier : "");
-        fprintf (stdout, "Parent PID         : %u\n", _WIN32_OR_POSIX (GetProcessId (parent_process), parent_process));
-        fprintf (stdout, "Watch parent       : %s\n", watch_parent ? "Yes" : "No");
-        fprintf (stdout, "Housekeeping mode  : %d\n", housekeep_mode);
-        fprintf (stdout, "Operation          : %s\n", operation);
+        fprintf (stdout, "Data directory     : %s\n", PARAM (data_dir));
+        fprintf (stdout, "Identifier scope   : %s\n", PARAM (global_identifier) ? "Global" : "Local to parent");
+        fprintf (stdout, "Process identifier : %s\n", PARAM (process_identifier) ? PARAM (process_identifier) : "");
+        fprintf (stdout, "Shared lease       : %s\n", PARAM (shared_lease) ? "Yes" : "No");
+        fprintf (stdout, "Replicas           : %d\n", PARAM (replica_count));
+        fprintf (stdout, "Output mode        : %d\n", PARAM (output_mode));
+        fprintf (stdout, "Parent PID         : %u\n", _WIN32_OR_POSIX (GetProcessId (PARAM (parent_process)), PARAM (parent_process)));
+        fprintf (stdout, "Watch parent       : %s\n", PARAM (watch_parent) ? "Yes" : "No");
+        fprintf (stdout, "Restart mode       : %d\n", PARAM (restart_mode));
+        fprintf (stdout, "Restart limit      : %d\n", PARAM (restart_limit));
+        fprintf (stdout, "Health check       : %s\n", PARAM (health_probe) ? PARAM (health_probe) : "");
+        fprintf (stdout, "Health timeout     : %d\n", PARAM (probe_timeout));
+        fprintf (stdout, "Listen sockets     : %s\n", PARAM (listen_spec) ? PARAM (listen_spec) : "");
+        fprintf (stdout, "CPU affinity       : %s\n", PARAM (cpu_affinity) ? PARAM (cpu_affinity) : "");
+        fprintf (stdout, "Dedicated cores    : %d\n", PARAM (core_count));
+        fprintf (stdout, "Memory policy      : %s\n", PARAM (memory_policy) ? PARAM (memory_policy) : "");
+        fprintf (stdout, "Nice value         : %s\n", PARAM (nice_value) ? PARAM (nice_value) : "");
+        fprintf (stdout, "Scheduling policy  : %s\n", PARAM (sched_policy) ? PARAM (sched_policy) : "");
+        fprintf (stdout, "I/O priority       : %s\n", PARAM (io_priority) ? PARAM (io_priority) : "");
+        fprintf (stdout, "Health threshold   : %d\n", PARAM (health_threshold));
+        fprintf (stdout, "Health grace       : %d\n", PARAM (health_grace));
+        fprintf (stdout, "Timing mode        : %d\n", PARAM (timing_mode));
+        fprintf (stdout, "Trace events       : %s\n", PARAM (trace_enabled) ? "Yes" : "No");
+        fprintf (stdout, "Wait timeout       : %d\n", PARAM (wait_timeout));
+        fprintf (stdout, "Idle timeout       : %d\n", PARAM (idle_timeout));
+        fprintf (stdout, "Monitor interval   : %d\n", PARAM (monitor_interval));
+        fprintf (stdout, "Pool name          : %s\n", PARAM (pool_name) ? PARAM (pool_name) : "");
+        fprintf (stdout, "Pool size          : %d\n", PARAM (pool_size));
+        fprintf (stdout, "Housekeeping mode  : %d\n", PARAM (housekeep_mode));
+        fprintf (stdout, "Output file        : %s\n", PARAM (output_file));
+        fprintf (stdout, "Operation          : %s\n", PARAM (operation));
         fprintf (stdout, "Command line       :");
-        for (arg = 0; arg < spawn_argc; arg++) {
-            fprintf (stdout, " %s", spawn_argv[arg]);
+        for (arg = 0; arg < PARAM (spawn_argc); arg++) {
+            fprintf (stdout, " %s", PARAM (spawn_argv)[arg]);
         }
         fprintf (stdout, "\n");
     }
     return 0;
 }
 
+/// @brief Process the command line arguments
+///
+/// The arguments are processed and values set into the context of the calling
+/// thread, published by params.h, that other components can then access.
+/// Default values are set where required for anything. The meaning of each
+/// argument is documented in the `man` page.
+///
+/// Note that this is implemented with `getopt` which can modify the array
+/// passed. If used once in a program this is okay - the parameters to
+/// main(int,char**) can be used. If needed multiple times, for example as
+/// part of the unit tests, use the params_v(int,...) wrapper instead.
+///
+/// @return zero if the arguments are okay, otherwise a non-zero error code
+int params (
+    int argc, ///<the number of arguments, as passed to main(int,char**)
+    char **argv ///<the argument values, as passed to main(int,char**)
+    ) {
+    int e;
+#ifdef _WIN32
+	AcquireSRWLockExclusive (&_getopt_lock);
+	e = parse_params (argc, argv);
+	ReleaseSRWLockExclusive (&_getopt_lock);
+#else /* ifdef _WIN32 */
+    pthread_mutex_lock (&_getopt_lock);
+    e = parse_params (argc, argv);
+    pthread_mutex_unlock (&_getopt_lock);
+#endif /* ifdef _WIN32 */
+    return e;
+}
+
 /// @brief Vararg wrapper for params(int,char**)
 ///
 /// This will allocate a block of memory with a copy of the parameter strings
@@ -298,7 +648,38 @@ int params_v (
     return i;
 }
 
+/// @brief Releases the values allocated by params(int,char**) in a context
+void params_free (
+    struct procctrl_context *context ///<the context to release the values of>
+    ) {
+    struct procctrl_context *previous = params_current;
+    params_current = context;
+    free ((char*)PARAM (data_dir));
+    free ((char*)PARAM (output_file));
+    free ((char*)PARAM (process_identifier));
+    free ((char*)PARAM (health_probe));
+    free ((char*)PARAM (pool_name));
+    free ((char*)PARAM (listen_spec));
+    free ((char*)PARAM (cpu_affinity));
+    free ((char*)PARAM (memory_policy));
+    free ((char*)PARAM (nice_value));
+    free ((char*)PARAM (sched_policy));
+    free ((char*)PARAM (io_priority));
+    free ((char*)PARAM (operation));
+    free (PARAM (spawn_argv));
+#ifdef _WIN32
+	if ((PARAM (parent_process) != NULL) && (PARAM (parent_process) != INVALID_HANDLE_VALUE)) CloseHandle (PARAM (parent_process));
+#endif /* ifdef _WIN32 */
+    memset (context, 0, sizeof (struct procctrl_context));
+    params_current = previous;
+}
+
 /// @brief Sets verbose mode for unit tests
 void _verbose_test () {
-    verbose = 1;
+    PARAM (verbose) = 1;
+}
+
+/// @brief Clears verbose mode for unit tests
+void _quiet_test () {
+    PARAM (verbose) = 0;
 }
@@ -11,8 +11,8 @@
 /// @file
 /// @brief Program parameters
 ///
-/// Header file for the global variables corresponding to the program
-/// parameters defined in params.c.
+/// Header file for the context holding the program parameters, and the
+/// accessor through which the operations read them, defined in params.c.
 
 #ifdef _WIN32
 
@@ -32,10 +32,9 @@
 /// @brief Declares a reference to a value defined by params.c
 # define MODULE_VAR_EXTERN extern
 #endif /* ifndef MODULE_VAR_EXTERN */
-#ifndef MODULE_VAR_CONST
-/// @brief Declares a read-only reference to a value defined by params.c
-# define MODULE_VAR_CONST const
-#endif /* ifndef MODULE_VAR_CONST */
+
+/// @brief Declares a variable with a separate instance for each thread
+#define THREAD_LOCAL _WIN32_OR_POSIX (__declspec (thread), __thread)
 
 /// @brief Disable houskeeping
 #define HOUSEKEEP_NONE      0
@@ -46,28 +45,132 @@
 /// @brief Run housekeeping actions both before and after the main operation
 #define HOUSEKEEP_FULL      (HOUSEKEEP_BEFORE | HOUSEKEEP_AFTER)
 
-/// @brief The `d` parameter
-MODULE_VAR_EXTERN char const * MODULE_VAR_CONST data_dir;
-/// @brief The `K` parameter
-MODULE_VAR_EXTERN int MODULE_VAR_CONST global_identifier;
-/// @brief The `k` parameter
-MODULE_VAR_EXTERN char const * MODULE_VAR_CONST process_identifier;
-/// @brief The `P` parameter
-MODULE_VAR_EXTERN _WIN32_OR_POSIX (HANDLE, pid_t) MODULE_VAR_CONST parent_process;
-/// @brief The `p` parameter
-MODULE_VAR_EXTERN int MODULE_VAR_CONST watch_parent;
-/// @brief The `v` parameter
-MODULE_VAR_EXTERN int MODULE_VAR_CONST verbose;
-/// @brief The control operation
-MODULE_VAR_EXTERN char const * MODULE_VAR_CONST operation;
-/// @brief The number of spawn arguments (the first is the process to spawn)
-MODULE_VAR_EXTERN int MODULE_VAR_CONST spawn_argc;
-/// @brief The spawn arguments (the first is the process to spawn)
-MODULE_VAR_EXTERN char ** MODULE_VAR_CONST spawn_argv;
-/// @brief The `H` parameter
-MODULE_VAR_EXTERN int MODULE_VAR_CONST housekeep_mode;
+/// @brief Report only the status of the process
+#define OUTPUT_STATUS       0
+/// @brief Also report resource usage of the process tree, human readable
+#define OUTPUT_STATS        1
+/// @brief Also report resource usage of the process tree, as JSON
+#define OUTPUT_JSON         2
+
+/// @brief Don't restart the process when it terminates
+#define RESTART_NO          0
+/// @brief Restart the process if it exits with a non-zero code or is killed
+#define RESTART_ON_FAILURE  1
+/// @brief Restart the process whenever it terminates
+#define RESTART_ALWAYS      2
+
+/// @brief Disable timing instrumentation
+#define TIMING_NONE         0
+/// @brief Write the timing of each phase to stderr
+#define TIMING_JSON         1
+/// @brief Append the timing of each phase to a log in the data folder
+#define TIMING_LOG          2
+
+/// @brief The parameters for an invocation
+///
+/// The operations read their parameters from the context that is current on
+/// the calling thread, through PARAM(name), so that library callers can run
+/// operations with different parameters on different threads.
+struct procctrl_context {
+    /// @brief The `A` parameter
+    int core_count;
+    /// @brief The `a` parameter
+    char const *cpu_affinity;
+    /// @brief The `C` parameter
+    int probe_timeout;
+    /// @brief The `c` parameter
+    char const *health_probe;
+    /// @brief The `d` parameter
+    char const *data_dir;
+    /// @brief The `g` parameter
+    int health_grace;
+    /// @brief The `I` parameter
+    int idle_timeout;
+    /// @brief The `i` parameter
+    int monitor_interval;
+    /// @brief The `j` parameter
+    char const *io_priority;
+    /// @brief The `K` parameter
+    int global_identifier;
+    /// @brief The `k` parameter
+    char const *process_identifier;
+    /// @brief The `L` parameter
+    int shared_lease;
+    /// @brief The `m` parameter
+    char const *memory_policy;
+    /// @brief The `N` parameter
+    int replica_count;
+    /// @brief The `n` parameter
+    int health_threshold;
+    /// @brief The `o` parameter
+    int output_mode;
+    /// @brief The `P` parameter
+    _WIN32_OR_POSIX (HANDLE, pid_t) parent_process;
+    /// @brief The `p` parameter
+    int watch_parent;
+    /// @brief The `R` parameter
+    int restart_limit;
+    /// @brief The `r` parameter
+    int restart_mode;
+    /// @brief The `S` parameter
+    char const *sched_policy;
+    /// @brief The `s` parameter
+    char const *listen_spec;
+    /// @brief The `T` parameter
+    int timing_mode;
+    /// @brief The `t` parameter
+    int wait_timeout;
+    /// @brief The `v` parameter
+    int verbose;
+    /// @brief The `W` parameter
+    int pool_size;
+    /// @brief The `w` parameter
+    char const *pool_name;
+    /// @brief The `X` parameter
+    int trace_enabled;
+    /// @brief The `y` parameter
+    char const *nice_value;
+    /// @brief The control operation
+    char const *operation;
+    /// @brief The number of spawn arguments (the first is the process to spawn)
+    int spawn_argc;
+    /// @brief The spawn arguments (the first is the process to spawn)
+    char **spawn_argv;
+    /// @brief The `f` parameter
+    char const *output_file;
+    /// @brief The `H` parameter
+    int housekeep_mode;
+    /// @brief Non-zero when starting a member of the pool named by `w`
+    int pool_member;
+    /// @brief The index of the replica being operated on, or -1 if none
+    int replica_index;
+    /// @brief Receives the result of the query operation instead of stdout,
+    ///        or NULL
+    struct procctrl_query_result *query_result;
+    /// @brief The operation started by an asynchronous variant that has not
+    ///        been collected, or NULL
+    int (*async_fn) ();
+    /// @brief The descriptor returned by that asynchronous variant
+    int async_fd;
+    /// @brief The result of an asynchronous start or stop, once signalled
+    int async_result;
+    /// @brief When an asynchronous wait times out, or zero for no limit
+    time_t async_deadline;
+};
+
+/// @brief The context of the calling thread
+///
+/// This is the process-wide context used by the command line unless another
+/// has been bound by the library functions in procctrl.c.
+MODULE_VAR_EXTERN THREAD_LOCAL struct procctrl_context *params_current;
+
+/// @brief Reads or writes a parameter in the context of the calling thread
+///
+/// For example `PARAM (verbose)` is the `v` parameter of the current context.
+#define PARAM(name) (params_current->name)
 
 int params (int argc, char **argv);
 int params_v (int argc, ...);
+void params_free (struct procctrl_context *context);
 
 #endif /* ifndef __inc_params_h */
@@ -6,11 +6,16 @@
  */
 
 #include "parent.h"
+#include "procfs.h"
 #ifdef _WIN32
 # include <Tlhelp32.h>
+#else /* ifdef _WIN32 */
+# include <ctype.h>
+# include <dirent.h>
 #endif /* ifdef _WIN32 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /// @brief Gets the parent of a process
 ///
@@ -44,17 +49,63 @@ _WIN32_OR_POSIX (HANDLE, pid_t) get_parent (
 #else /* ifdef _WIN32 */
     char tmp[32];
     FILE *status;
-    if (snprintf (tmp, sizeof (tmp), "/proc/%u/status", process) < 32) {
-        status = fopen (tmp, "rt");
-        if (status) {
-            while (fgets (tmp, sizeof (tmp), status)) {
-                if (!strncmp (tmp, "PPid:\t", 6)) {
-                    parent = (pid_t)strtol (tmp + 6, NULL, 10);
-                }
+    status = procfs_fopen (process, "status");
+    if (status) {
+        while (fgets (tmp, sizeof (tmp), status)) {
+            if (!strncmp (tmp, "PPid:\t", 6)) {
+                parent = (pid_t)strtol (tmp + 6, NULL, 10);
             }
-            fclose (status);
         }
+        fclose (status);
     }
 #endif /* ifdef _WIN32 */
     return parent;
 }
+
+#ifndef _WIN32
+
+/// @brief Gets the children of a process
+///
+/// Scans the process table for any processes with the given parent. The
+/// caller must stop the process first if the list must be complete, as it
+/// might otherwise create more children during the scan.
+///
+/// @return the child processes, NULL if there are none, to be released with
+///         pid_list_free(struct pid_list*)
+struct pid_list *get_children (
+    pid_t process ///<the process to query>
+    ) {
+    DIR *dir;
+    struct dirent *ent;
+    struct pid_list *children = NULL;
+    dir = procfs_opendir (0, NULL);
+    if (!dir) return NULL;
+    while ((ent = readdir (dir)) != NULL) {
+        pid_t proc;
+        if (!isdigit (ent->d_name[0])) continue;
+        proc = (pid_t)strtol (ent->d_name, NULL, 10);
+        if (get_parent (proc) == process) {
+            struct pid_list *entry = (struct pid_list*)malloc (sizeof (struct pid_list));
+            if (entry) {
+                entry->pid = proc;
+                entry->next = children;
+                children = entry;
+            }
+        }
+    }
+    closedir (dir);
+    return children;
+}
+
+/// @brief Releases a list returned by get_children(pid_t)
+void pid_list_free (
+    struct pid_list *list ///<the list to release, or NULL>
+    ) {
+    while (list) {
+        struct pid_list *next = list->next;
+        free (list);
+        list = next;
+    }
+}
+
+#endif /* ifndef _WIN32 */
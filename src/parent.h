@@ -9,7 +9,7 @@
 #define __inc_parent_h
 
 /// @file
-/// @brief Helper functions for finding a process' parent
+/// @brief Helper functions for finding a process' parent and children
 
 #ifdef _WIN32
 
@@ -27,4 +27,19 @@
 
 _WIN32_OR_POSIX (HANDLE, pid_t) get_parent (_WIN32_OR_POSIX (HANDLE, pid_t) process);
 
+#ifndef _WIN32
+
+/// @brief Linked list of pid_t values
+struct pid_list {
+    /// @brief The process identifier
+    pid_t pid;
+    /// @brief The next entry in the list, or NULL if this is the last
+    struct pid_list *next;
+};
+
+struct pid_list *get_children (pid_t process);
+void pid_list_free (struct pid_list *list);
+
+#endif /* ifndef _WIN32 */
+
 #endif /* ifndef __inc_getopt_h */
\ No newline at end of file
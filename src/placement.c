@@ -0,0 +1,389 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief CPU and memory placement
+///
+/// CPUs, and NUMA nodes, are given as a comma separated list of numbers and
+/// `<em>first</em>-<em>last</em>` ranges, as in `/sys/devices/system/cpu`. A
+/// memory policy is given as `preferred:<em>node</em>`,
+/// `bind:<em>nodes</em>` or `interleave:<em>nodes</em>`.
+///
+/// The placement is set with `sched_setaffinity` and `set_mempolicy` in the
+/// child, after it is forked and before it executes the command, so that
+/// nothing else needs to be installed and it is inherited by everything the
+/// command starts.
+///
+/// Dedicated cores for the `A` parameter are chosen from the topology the
+/// kernel describes under `/sys/devices/system`, which can be replaced by a
+/// synthetic folder laid out the same way.
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif /* ifndef _GNU_SOURCE */
+#include "placement.h"
+#include "params.h"
+#ifndef _WIN32
+# include <dirent.h>
+# include <errno.h>
+# include <sched.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// @brief The number of bits in each word of a placement mask
+#define _BITS (8 * sizeof (unsigned long))
+
+/// @brief The default folder describing the CPUs and NUMA nodes
+static const char *_topology_default = "/sys/devices/system";
+
+/// @brief The current folder describing the CPUs and NUMA nodes
+static const char *_topology = "/sys/devices/system";
+
+/// @brief Memory policy modes, as defined by the kernel's `mempolicy.h`
+enum {
+    /// @brief Allocate on the preferred node, falling back to others
+    _MPOL_PREFERRED = 1,
+    /// @brief Allocate only on the given nodes
+    _MPOL_BIND = 2,
+    /// @brief Allocate across the given nodes in turn
+    _MPOL_INTERLEAVE = 3
+};
+
+/// @brief Memory policies that can be given by the `m` parameter
+static const struct {
+    /// @brief The name, before the colon
+    const char *name;
+    /// @brief The mode passed to `set_mempolicy`
+    int mode;
+} _memory_policies[] = {
+    { "preferred", _MPOL_PREFERRED },
+    { "bind", _MPOL_BIND },
+    { "interleave", _MPOL_INTERLEAVE },
+    { NULL, 0 }
+};
+
+/// @brief Parses a number in a list
+///
+/// @return the number, or -1 if it is not valid
+static long parse_number (
+    const char *spec, ///<the text at the number>
+    const char **rest ///<receives the text following the number>
+    ) {
+    char *end;
+    long value;
+    if ((*spec < '0') || (*spec > '9')) return -1;
+    value = strtol (spec, &end, 10);
+    *rest = end;
+    return (value < PLACEMENT_MAX) ? value : -1;
+}
+
+/// @brief Tests if a CPU, or NUMA node, is in a mask
+///
+/// @return non-zero if it is in the mask, zero otherwise
+static int is_set (
+    const unsigned long *mask, ///<the mask>
+    int bit ///<the CPU or node>
+    ) {
+    return (mask[bit / _BITS] & (1UL << (bit % _BITS))) != 0;
+}
+
+/// @brief Adds a CPU, or NUMA node, to a mask
+static void set_bit (
+    unsigned long *mask, ///<the mask>
+    int bit ///<the CPU or node>
+    ) {
+    mask[bit / _BITS] |= 1UL << (bit % _BITS);
+}
+
+/// @brief Parses a list of CPUs or NUMA nodes into a mask
+///
+/// @return zero if successful, EINVAL if the list is not valid or empty
+int placement_list (
+    const char *spec, ///<the list>
+    unsigned long *mask ///<receives the mask, of PLACEMENT_WORDS words>
+    ) {
+    long first, last;
+    memset (mask, 0, PLACEMENT_WORDS * sizeof (unsigned long));
+    for (;;) {
+        if ((first = parse_number (spec, &spec)) < 0) return EINVAL;
+        last = first;
+        if ((*spec == '-') && ((last = parse_number (spec + 1, &spec)) < first)) return EINVAL;
+        for (; first <= last; first++) {
+            set_bit (mask, (int)first);
+        }
+        if (!*spec) return 0;
+        if (*(spec++) != ',') return EINVAL;
+    }
+}
+
+/// @brief Writes a mask as a list of CPUs or NUMA nodes
+///
+/// Consecutive numbers are written as ranges, so the list is in the same
+/// form as those read from `/sys/devices/system/cpu`.
+///
+/// @return zero if successful, ERANGE if the buffer is too small
+int placement_format (
+    const unsigned long *mask, ///<the mask, of PLACEMENT_WORDS words>
+    char *buffer, ///<the buffer to write into, usually PLACEMENT_LIST characters>
+    size_t size ///<the size of the buffer>
+    ) {
+    size_t len = 0;
+    int first, last, n;
+    if (!size) return ERANGE;
+    *buffer = 0;
+    for (first = 0; first < PLACEMENT_MAX; first = last + 1) {
+        last = first;
+        if (!is_set (mask, first)) continue;
+        while ((last + 1 < PLACEMENT_MAX) && is_set (mask, last + 1)) last++;
+        if (first == last) {
+            n = snprintf (buffer + len, size - len, "%s%d", len ? "," : "", first);
+        } else {
+            n = snprintf (buffer + len, size - len, "%s%d-%d", len ? "," : "", first, last);
+        }
+        if ((n < 0) || ((size_t)n >= size - len)) return ERANGE;
+        len += n;
+    }
+    return 0;
+}
+
+/// @brief Parses a memory policy
+///
+/// @return zero if successful, EINVAL if the policy is not valid
+int placement_memory (
+    const char *spec, ///<the policy, as given by the `m` parameter>
+    int *mode, ///<receives the mode passed to `set_mempolicy`>
+    unsigned long *mask ///<receives the nodes, of PLACEMENT_WORDS words>
+    ) {
+    const char *nodes = strchr (spec, ':');
+    int i, count = 0, e;
+    size_t w;
+    if (!nodes) return EINVAL;
+    for (i = 0; _memory_policies[i].name; i++) {
+        if ((strlen (_memory_policies[i].name) == (size_t)(nodes - spec))
+         && !strncmp (spec, _memory_policies[i].name, nodes - spec)) break;
+    }
+    if (!_memory_policies[i].name) return EINVAL;
+    *mode = _memory_policies[i].mode;
+    if ((e = placement_list (nodes + 1, mask)) != 0) return e;
+    for (w = 0; w < PLACEMENT_WORDS; w++) {
+        count += __builtin_popcountl (mask[w]);
+    }
+    // Only one node can be preferred
+    return ((*mode == _MPOL_PREFERRED) && (count != 1)) ? EINVAL : 0;
+}
+
+/// @brief Sets the placement given by the `a` and `m` parameters
+///
+/// This is called in the spawned child before it executes the command. A
+/// kernel without NUMA support has nowhere else to put the memory, so the
+/// policy is then ignored.
+///
+/// @return zero if successful, otherwise a non-zero error code
+int placement_apply () {
+    unsigned long mask[PLACEMENT_WORDS];
+    int mode, i, e;
+    if (PARAM (cpu_affinity)) {
+        cpu_set_t cpus;
+        if ((e = placement_list (PARAM (cpu_affinity), mask)) != 0) return e;
+        CPU_ZERO (&cpus);
+        for (i = 0; (i < PLACEMENT_MAX) && (i < CPU_SETSIZE); i++) {
+            if (is_set (mask, i)) CPU_SET (i, &cpus);
+        }
+        if (sched_setaffinity (0, sizeof (cpus), &cpus)) return errno;
+    }
+    if (PARAM (memory_policy)) {
+        if ((e = placement_memory (PARAM (memory_policy), &mode, mask)) != 0) return e;
+#ifdef SYS_set_mempolicy
+        // The kernel ignores the last bit of the node count it is given
+        if (syscall (SYS_set_mempolicy, mode, mask, (unsigned long)PLACEMENT_MAX + 1) && (errno != ENOSYS)) return errno;
+#endif /* ifdef SYS_set_mempolicy */
+    }
+    return 0;
+}
+
+/// @brief Replaces the folder describing the CPUs and NUMA nodes
+///
+/// The folder is not copied and must remain valid until it is replaced.
+void placement_set_topology (
+    const char *root ///<the folder laid out as `/sys/devices/system`, or NULL for that>
+    ) {
+    _topology = root ? root : _topology_default;
+}
+
+/// @brief Adds the CPUs the calling process cannot run on to a mask
+///
+/// A process started with dedicated cores is kept within the CPUs of the
+/// procctrl that started it, so that a limit set by a container or by
+/// `taskset` is respected.
+void placement_unavailable (
+    unsigned long *mask ///<the mask, of PLACEMENT_WORDS words>
+    ) {
+    cpu_set_t cpus;
+    int i;
+    if (sched_getaffinity (0, sizeof (cpus), &cpus)) return;
+    for (i = 0; (i < PLACEMENT_MAX) && (i < CPU_SETSIZE); i++) {
+        if (!CPU_ISSET (i, &cpus)) set_bit (mask, i);
+    }
+}
+
+/// @brief Reads a list from a file in the topology folder
+///
+/// @return zero if successful, otherwise a non-zero error code
+static int read_list (
+    unsigned long *mask, ///<receives the mask, of PLACEMENT_WORDS words>
+    const char *format, ///<the path of the file, relative to the folder, as a format string>
+    int n ///<the number to substitute into the path>
+    ) {
+    char path[256], buffer[PLACEMENT_LIST];
+    FILE *in;
+    int len = snprintf (path, sizeof (path), "%s/", _topology);
+    snprintf (path + len, sizeof (path) - len, format, n);
+    if (!(in = fopen (path, "r"))) return errno;
+    if (!fgets (buffer, sizeof (buffer), in)) *buffer = 0;
+    fclose (in);
+    buffer[strcspn (buffer, "\n")] = 0;
+    return placement_list (buffer, mask);
+}
+
+/// @brief Finds the lowest CPU, or NUMA node, in a mask
+///
+/// @return the lowest, or -1 if the mask is empty
+static int lowest (
+    const unsigned long *mask ///<the mask, of PLACEMENT_WORDS words>
+    ) {
+    int i;
+    for (i = 0; i < PLACEMENT_MAX; i++) {
+        if (is_set (mask, i)) return i;
+    }
+    return -1;
+}
+
+/// @brief The locality of each online CPU
+struct topology {
+    /// @brief The lowest CPU of the core each CPU is a thread of
+    short core[PLACEMENT_MAX];
+    /// @brief The lowest CPU sharing the last level cache with each CPU
+    short cache[PLACEMENT_MAX];
+    /// @brief The NUMA node of each CPU
+    short node[PLACEMENT_MAX];
+};
+
+/// @brief Reads the locality of each online CPU
+///
+/// Anything the kernel does not describe is treated as shared by every CPU,
+/// so a machine without caches or nodes listed is one domain.
+static void read_topology (
+    const unsigned long *online, ///<the online CPUs>
+    struct topology *topology ///<receives the locality>
+    ) {
+    unsigned long mask[PLACEMENT_WORDS];
+    char path[256];
+    struct dirent *ent;
+    DIR *dir;
+    FILE *in;
+    int cpu, index, level, deepest, n;
+    for (cpu = 0; cpu < PLACEMENT_MAX; cpu++) {
+        topology->core[cpu] = (short)cpu;
+        topology->cache[cpu] = 0;
+        topology->node[cpu] = 0;
+        if (!is_set (online, cpu)) continue;
+        if (!read_list (mask, "cpu/cpu%d/topology/thread_siblings_list", cpu) && (lowest (mask) >= 0)) {
+            topology->core[cpu] = (short)lowest (mask);
+        }
+        // The last level cache is the one with the highest level
+        for (index = 0, deepest = 0; ; index++) {
+            snprintf (path, sizeof (path), "%s/cpu/cpu%d/cache/index%d/level", _topology, cpu, index);
+            if (!(in = fopen (path, "r"))) break;
+            if ((fscanf (in, "%d", &level) == 1) && (level > deepest)) {
+                snprintf (path, sizeof (path), "cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+                if (!read_list (mask, path, 0) && (lowest (mask) >= 0)) {
+                    topology->cache[cpu] = (short)lowest (mask);
+                    deepest = level;
+                }
+            }
+            fclose (in);
+        }
+    }
+    snprintf (path, sizeof (path), "%s/node", _topology);
+    if (!(dir = opendir (path))) return;
+    while ((ent = readdir (dir)) != NULL) {
+        if (strncmp (ent->d_name, "node", 4) || (sscanf (ent->d_name + 4, "%d", &n) != 1)) continue;
+        if ((n < 0) || (n >= PLACEMENT_MAX) || read_list (mask, "node/node%d/cpulist", n)) continue;
+        for (cpu = 0; cpu < PLACEMENT_MAX; cpu++) {
+            if (is_set (mask, cpu)) topology->node[cpu] = (short)n;
+        }
+    }
+    closedir (dir);
+}
+
+/// @brief Chooses the CPUs for a number of dedicated cores
+///
+/// Each core is taken with all of its hardware threads, and is only free if
+/// none of them is unavailable, so that nothing else shares it. The cores
+/// are taken from a single last level cache if one has enough free, or
+/// failing that a single NUMA node. Of the caches, or nodes, with enough
+/// free the one with the fewest is used, keeping the larger blocks for
+/// larger requests.
+///
+/// @return zero if successful, EBUSY if there are not enough free cores,
+///         otherwise a non-zero error code
+int placement_allocate (
+    int count, ///<the number of cores>
+    const unsigned long *unavailable, ///<the CPUs already taken, of PLACEMENT_WORDS words>
+    unsigned long *mask ///<receives the CPUs chosen, of PLACEMENT_WORDS words>
+    ) {
+    struct topology topology;
+    short free_cores[PLACEMENT_MAX];
+    unsigned long online[PLACEMENT_WORDS];
+    short *domain[] = { topology.cache, topology.node, NULL };
+    int cpu, i, best, taken, e;
+    if (count <= 0) return EINVAL;
+    if ((e = read_list (online, "cpu/online", 0)) != 0) return e;
+    read_topology (online, &topology);
+    memset (mask, 0, PLACEMENT_WORDS * sizeof (unsigned long));
+    // A core is free if all of its threads are
+    for (cpu = 0; cpu < PLACEMENT_MAX; cpu++) {
+        free_cores[cpu] = is_set (online, cpu) && (topology.core[cpu] == cpu);
+    }
+    for (cpu = 0; cpu < PLACEMENT_MAX; cpu++) {
+        if (is_set (online, cpu) && is_set (unavailable, cpu)) free_cores[topology.core[cpu]] = 0;
+    }
+    for (i = 0, best = -1; domain[i] && (best < 0); i++) {
+        short counts[PLACEMENT_MAX];
+        memset (counts, 0, sizeof (counts));
+        for (cpu = 0; cpu < PLACEMENT_MAX; cpu++) {
+            if (free_cores[cpu]) counts[domain[i][cpu]]++;
+        }
+        for (cpu = 0; cpu < PLACEMENT_MAX; cpu++) {
+            if ((counts[cpu] >= count) && ((best < 0) || (counts[cpu] < counts[best]))) best = cpu;
+        }
+        if (best < 0) continue;
+        // Only the cores in the chosen domain remain candidates
+        for (cpu = 0; cpu < PLACEMENT_MAX; cpu++) {
+            if (free_cores[cpu] && (domain[i][cpu] != best)) free_cores[cpu] = 0;
+        }
+    }
+    for (cpu = 0, taken = 0; (cpu < PLACEMENT_MAX) && (taken < count); cpu++) {
+        if (free_cores[cpu]) taken++;
+    }
+    if (taken < count) return EBUSY;
+    for (; cpu < PLACEMENT_MAX; cpu++) {
+        free_cores[cpu] = 0;
+    }
+    for (cpu = 0; cpu < PLACEMENT_MAX; cpu++) {
+        if (is_set (online, cpu) && free_cores[topology.core[cpu]]) set_bit (mask, cpu);
+    }
+    return 0;
+}
+
+#endif /* ifndef _WIN32 */
@@ -0,0 +1,38 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifndef __inc_placement_h
+#define __inc_placement_h
+
+/// @file
+/// @brief CPU and memory placement
+///
+/// Header file for the placement functions published by placement.c, applied
+/// to the child by its watchdog between fork and exec.
+
+#ifndef _WIN32
+
+#include <stddef.h>
+
+/// @brief The number of CPUs, or NUMA nodes, that a list can refer to
+#define PLACEMENT_MAX       1024
+/// @brief The number of `unsigned long` words in a placement mask
+#define PLACEMENT_WORDS     (PLACEMENT_MAX / (8 * sizeof (unsigned long)))
+/// @brief The size of the buffer needed for placement_format(const unsigned long*,char*,size_t)
+#define PLACEMENT_LIST      (PLACEMENT_MAX * 5)
+
+int placement_list (const char *spec, unsigned long *mask);
+int placement_format (const unsigned long *mask, char *buffer, size_t size);
+int placement_memory (const char *spec, int *mode, unsigned long *mask);
+int placement_apply ();
+void placement_set_topology (const char *root);
+void placement_unavailable (unsigned long *mask);
+int placement_allocate (int count, const unsigned long *unavailable, unsigned long *mask);
+
+#endif /* ifndef _WIN32 */
+
+#endif /* ifndef __inc_placement_h */
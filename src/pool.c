@@ -0,0 +1,135 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Implements the `pool` operation
+///
+/// A pool is a number of instances of a command started ahead of time, each a
+/// global process with the identifier `pool:<em>name</em>:<em>slot</em>`. The
+/// `start` operation with the `w` parameter claims a ready member in place of
+/// spawning the command, which costs only an update of the data directory, and
+/// starts a replacement so the pool stays the same size.
+
+#include "operations.h"
+#include "params.h"
+#include "pool.h"
+#include "process.h"
+#include "timing.h"
+#include "trace.h"
+#ifndef _WIN32
+# include <errno.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// @brief Starts a member of the pool in a slot, unless the slot is in use
+///
+/// The member is started with the parameters of the calling context, but as
+/// a global process that does not watch the parent.
+///
+/// @return zero if a member was started, EALREADY if an unclaimed member is
+///         running in the slot, EEXIST if a claimed member has not yet left
+///         it, otherwise a non-zero error code
+static int start_member (
+    int slot ///<the slot number>
+    ) {
+    struct procctrl_context member = *params_current, *previous = params_current;
+    struct process_info *info;
+    char *identifier;
+    size_t size = strlen (PARAM (pool_name)) + 18;
+    int e;
+    identifier = (char*)malloc (size);
+    if (!identifier) abort ();
+    snprintf (identifier, size, "pool:%s:%d", PARAM (pool_name), slot);
+    params_current = &member;
+    PARAM (process_identifier) = identifier;
+    PARAM (global_identifier) = 1;
+    PARAM (watch_parent) = 0;
+    PARAM (pool_member) = 1;
+    e = operation_start ();
+    if (e == EALREADY) {
+        info = process_load ();
+        if (process_info_get (info, "claim-sid")) e = EEXIST;
+        process_info_free (info);
+    }
+    params_current = previous;
+    free (identifier);
+    return e;
+}
+
+/// @brief Starts members of the pool in the first free slots
+///
+/// Slots still held by members are skipped, but any other failure to start a
+/// member, such as there being no free cores for it, is returned rather than
+/// tried again in the next slot.
+///
+/// @return zero if successful, otherwise a non-zero error code
+static int add_members (
+    int count, ///<the number of members required>
+    int existing ///<non-zero to count members already running towards the number required>
+    ) {
+    int slot, e;
+    for (slot = 0; count > 0; slot++) {
+        e = start_member (slot);
+        if (!e || (existing && (e == EALREADY))) {
+            count--;
+        } else if ((e != EALREADY) && (e != EEXIST)) {
+            return e;
+        }
+    }
+    return 0;
+}
+
+/// @brief Claims a ready member of the pool named by the `w` parameter
+///
+/// The member becomes the controlled process of the calling context, as if
+/// it had been started by it, and a replacement member is started.
+///
+/// @return zero if a member was claimed, EAGAIN if none was ready, otherwise
+///         a non-zero error code
+int pool_claim () {
+    double phase = timing_now ();
+    double traced = trace_now ();
+    pid_t process;
+    int e;
+    if ((e = process_claim (PARAM (pool_name), &process)) != 0) return e;
+    timing_record ("claim", phase);
+    trace_complete ("claim", process, traced, NULL);
+    if (PARAM (verbose)) fprintf (stdout, "Claimed process %u from pool %s\n", process, PARAM (pool_name));
+    if ((e = add_members (1, 0)) != 0) {
+        fprintf (stderr, "Couldn't replace process in pool %s, error %d\n", PARAM (pool_name), e);
+    }
+    return 0;
+}
+
+#endif /* ifndef _WIN32 */
+
+/// @brief Starts the members of a pool
+///
+/// Members of the pool named by the `w` parameter are started until as many
+/// as the `W` parameter are running and unclaimed. Members are started with
+/// the other parameters given, such as the health check and restart policy,
+/// and can be queried or stopped as global processes.
+///
+/// @return zero if successful, EINVAL if no pool or command was given,
+///         otherwise a non-zero error code
+int operation_pool () {
+#ifdef _WIN32
+	fprintf (stderr, "Pools are not supported on this platform\n");
+	return ERROR_NOT_SUPPORTED;
+#else /* ifdef _WIN32 */
+    if (!PARAM (pool_name) || !PARAM (spawn_argc)) {
+        fprintf (stderr, "A pool needs a name and a command\n");
+        return EINVAL;
+    }
+    if (PARAM (verbose)) fprintf (stdout, "Starting %d processes in pool %s\n", PARAM (pool_size), PARAM (pool_name));
+    return add_members (PARAM (pool_size), 1);
+#endif /* ifdef _WIN32 */
+}
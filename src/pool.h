@@ -0,0 +1,23 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifndef __inc_pool_h
+#define __inc_pool_h
+
+/// @file
+/// @brief Pools of processes started ahead of time
+///
+/// Header file for the pool functions published by pool.c, used by the
+/// `start` operation to claim a process from a pool.
+
+#ifndef _WIN32
+
+int pool_claim ();
+
+#endif /* ifndef _WIN32 */
+
+#endif /* ifndef __inc_pool_h */
@@ -0,0 +1,247 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Scheduling and I/O priority, and the `priority` operation
+///
+/// A nice value is given by the `y` parameter, as for `nice -n`. A
+/// scheduling policy is given by the `S` parameter as `other`, `batch` or
+/// `idle`. An I/O priority is given by the `j` parameter as `idle`,
+/// `best-effort[:<em>level</em>]` or `realtime[:<em>level</em>]`, as for
+/// `ionice`, with a level from 0 (highest) to 7 and 4 if omitted.
+///
+/// All three are inherited by any process the command starts, so setting
+/// them before it executes covers everything it starts later. The `priority`
+/// operation walks the process tree, as kill_process() does, to change them
+/// for processes that are already running.
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif /* ifndef _GNU_SOURCE */
+#include "priority.h"
+#include "operations.h"
+#include "params.h"
+#include "parent.h"
+#include "process.h"
+#include "procfs.h"
+#ifndef _WIN32
+# include <errno.h>
+# include <sched.h>
+# include <sys/resource.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// @brief The `which` argument to `ioprio_set` for a single thread
+#define _IOPRIO_WHO_PROCESS 1
+/// @brief The position of the class in an I/O priority
+#define _IOPRIO_CLASS_SHIFT 13
+
+/// @brief Scheduling policies that can be given by the `S` parameter
+static const struct {
+    /// @brief The name
+    const char *name;
+    /// @brief The policy passed to `sched_setscheduler`
+    int policy;
+} _policies[] = {
+    { "other", SCHED_OTHER },
+    { "batch", SCHED_BATCH },
+    { "idle", SCHED_IDLE },
+    { NULL, 0 }
+};
+
+/// @brief I/O scheduling classes that can be given by the `j` parameter
+static const struct {
+    /// @brief The name, before any colon
+    const char *name;
+    /// @brief The class, as defined by the kernel's `ioprio.h`
+    int ioclass;
+} _io_classes[] = {
+    { "realtime", 1 },
+    { "best-effort", 2 },
+    { "idle", 3 },
+    { NULL, 0 }
+};
+
+/// @brief Parses a nice value
+///
+/// @return zero if successful, EINVAL if the value is not from -20 to 19
+int priority_nice (
+    const char *spec, ///<the value, as given by the `y` parameter>
+    int *nice ///<receives the value>
+    ) {
+    char *end;
+    long value;
+    if (!*spec) return EINVAL;
+    value = strtol (spec, &end, 10);
+    if (*end || (value < -20) || (value > 19)) return EINVAL;
+    *nice = (int)value;
+    return 0;
+}
+
+/// @brief Parses a scheduling policy
+///
+/// @return zero if successful, EINVAL if the policy is not valid
+int priority_policy (
+    const char *spec, ///<the policy, as given by the `S` parameter>
+    int *policy ///<receives the policy passed to `sched_setscheduler`>
+    ) {
+    int i;
+    for (i = 0; _policies[i].name; i++) {
+        if (!strcmp (spec, _policies[i].name)) {
+            *policy = _policies[i].policy;
+            return 0;
+        }
+    }
+    return EINVAL;
+}
+
+/// @brief Parses an I/O priority
+///
+/// The idle class has no levels.
+///
+/// @return zero if successful, EINVAL if the priority is not valid
+int priority_io (
+    const char *spec, ///<the priority, as given by the `j` parameter>
+    int *ioprio ///<receives the priority passed to `ioprio_set`>
+    ) {
+    const char *level = strchr (spec, ':');
+    size_t len = level ? (size_t)(level - spec) : strlen (spec);
+    int i, value = 4;
+    for (i = 0; _io_classes[i].name; i++) {
+        if ((strlen (_io_classes[i].name) == len) && !strncmp (spec, _io_classes[i].name, len)) break;
+    }
+    if (!_io_classes[i].name) return EINVAL;
+    if (_io_classes[i].ioclass == 3) {
+        if (level) return EINVAL;
+        value = 0;
+    } else if (level) {
+        if ((level[1] < '0') || (level[1] > '7') || level[2]) return EINVAL;
+        value = level[1] - '0';
+    }
+    *ioprio = (_io_classes[i].ioclass << _IOPRIO_CLASS_SHIFT) | value;
+    return 0;
+}
+
+/// @brief Sets the priority given by the `y`, `S` and `j` parameters
+///
+/// This is called in the spawned child before it executes the command, and
+/// for each thread of a running process by priority_tree(). The policy is
+/// set before the nice value, which the `batch` policy still uses.
+///
+/// @return zero if successful, otherwise a non-zero error code
+int priority_set (
+    pid_t process ///<the thread to set, or zero for the calling one>
+    ) {
+    struct sched_param param;
+    int value;
+    if (PARAM (sched_policy)) {
+        if (priority_policy (PARAM (sched_policy), &value)) return EINVAL;
+        memset (&param, 0, sizeof (param));
+        if (sched_setscheduler (process, value, &param)) return errno;
+    }
+    if (PARAM (nice_value)) {
+        if (priority_nice (PARAM (nice_value), &value)) return EINVAL;
+        if (setpriority (PRIO_PROCESS, process, value)) return errno;
+    }
+    if (PARAM (io_priority)) {
+        if (priority_io (PARAM (io_priority), &value)) return EINVAL;
+#ifdef SYS_ioprio_set
+        if (syscall (SYS_ioprio_set, _IOPRIO_WHO_PROCESS, process, value)) return errno;
+#else /* ifdef SYS_ioprio_set */
+        return ENOSYS;
+#endif /* ifdef SYS_ioprio_set */
+    }
+    return 0;
+}
+
+/// @brief Sets the priority of every thread of a process
+///
+/// @return zero if successful, otherwise a non-zero error code
+static int set_threads (
+    pid_t process ///<the process>
+    ) {
+    DIR *dir = procfs_opendir (process, "task");
+    struct dirent *ent;
+    int e = 0;
+    if (!dir) return priority_set (process);
+    while (!e && ((ent = readdir (dir)) != NULL)) {
+        if (ent->d_name[0] == '.') continue;
+        e = priority_set ((pid_t)strtol (ent->d_name, NULL, 10));
+        // The thread may have finished since it was listed
+        if (e == ESRCH) e = 0;
+    }
+    closedir (dir);
+    return e;
+}
+
+/// @brief Sets the priority of every process in a tree
+///
+/// Each process is set before its children are found, so that a child it
+/// starts in the meantime inherits the new priority.
+///
+/// @return zero if successful, otherwise a non-zero error code
+int priority_tree (
+    pid_t process ///<the process at the head of the tree>
+    ) {
+    struct pid_list *children;
+    int e;
+    if (PARAM (verbose)) fprintf (stdout, "Setting priority of %u\n", process);
+    if ((e = set_threads (process)) != 0) return e;
+    children = get_children (process);
+    while (children) {
+        struct pid_list *next = children->next;
+        int result = priority_tree (children->pid);
+        // The child may have terminated since it was listed
+        if (!e && (result != ESRCH)) e = result;
+        free (children);
+        children = next;
+    }
+    return e;
+}
+
+#endif /* ifndef _WIN32 */
+
+/// @brief Changes the priority of the child process and its descendants
+///
+/// The nice value, scheduling policy and I/O priority given by the `y`, `S`
+/// and `j` parameters are set for every thread of the process and of every
+/// process it has started, and recorded in its information file. A process
+/// restarted by its watchdog is given the priority it was started with.
+///
+/// @return zero if successful, ESRCH/ERROR_NOT_FOUND if there is no such
+///         process, EINVAL if no priority is given, otherwise a non-zero error
+///         code
+int operation_priority () {
+#ifdef _WIN32
+	if (PARAM (verbose)) fprintf (stdout, "Priority is not supported\n");
+	return ERROR_NOT_SUPPORTED;
+#else /* ifdef _WIN32 */
+    pid_t process;
+    int e;
+    if (!PARAM (nice_value) && !PARAM (sched_policy) && !PARAM (io_priority)) {
+        fprintf (stderr, "No priority given\n");
+        return EINVAL;
+    }
+    if (PARAM (verbose)) fprintf (stdout, "Changing priority of spawned process\n");
+    process = process_find ();
+    if (!process) {
+        if (PARAM (verbose)) fprintf (stdout, "No process to change\n");
+        return ESRCH;
+    }
+    e = priority_tree (process);
+    if (!e && PARAM (nice_value)) e = process_update (process, "nice", PARAM (nice_value));
+    if (!e && PARAM (sched_policy)) e = process_update (process, "sched", PARAM (sched_policy));
+    if (!e && PARAM (io_priority)) e = process_update (process, "ioprio", PARAM (io_priority));
+    return e;
+#endif /* ifdef _WIN32 */
+}
@@ -0,0 +1,30 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifndef __inc_priority_h
+#define __inc_priority_h
+
+/// @file
+/// @brief Scheduling and I/O priority
+///
+/// Header file for the priority functions published by priority.c, applied
+/// to the child by its watchdog between fork and exec, and to a running
+/// process tree by the `priority` operation.
+
+#ifndef _WIN32
+
+#include <sys/types.h>
+
+int priority_nice (const char *spec, int *nice);
+int priority_policy (const char *spec, int *policy);
+int priority_io (const char *spec, int *ioprio);
+int priority_set (pid_t process);
+int priority_tree (pid_t process);
+
+#endif /* ifndef _WIN32 */
+
+#endif /* ifndef __inc_priority_h */
@@ -0,0 +1,443 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Process control library
+///
+/// The operations read their parameters from the context bound to the calling
+/// thread (see params.h). Each function here binds the context it is given for
+/// the duration of the call, and restores the previous binding afterwards, so
+/// the command line and library callers share the same implementation.
+///
+/// The asynchronous start and stop run the operation on a worker thread,
+/// binding the context there instead, and signal an eventfd when it completes
+/// with the result left in the context. The asynchronous wait uses no thread;
+/// it returns a descriptor on the watchdog, or the information file, that is
+/// checked without blocking when it becomes readable.
+
+#include "procctrl.h"
+#include "operations.h"
+#include "params.h"
+#include "process.h"
+#include "replica.h"
+#include "timing.h"
+#include "trace.h"
+#include "watchdog.h"
+#ifdef _WIN32
+# define snprintf _snprintf
+#else /* ifdef _WIN32 */
+# include <errno.h>
+# include <pthread.h>
+# include <signal.h>
+# include <stdint.h>
+# include <sys/eventfd.h>
+# include <time.h>
+# include <unistd.h>
+#endif /* ifdef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// @brief An operation that can be dispatched by name
+struct _procctrl_operation {
+    /// @brief The operation name, as given on the command line
+    const char *name;
+    /// @brief The implementation, from operations.h
+    int (*fn) ();
+    /// @brief Non-zero if the operation acts on each replica given by the `N` parameter
+    int replicated;
+};
+
+/// @brief The operations that can be dispatched by procctrl_run(struct procctrl_context*)
+static const struct _procctrl_operation _operations[] = {
+    { "query", operation_query, 1 },
+    { "start", operation_start, 1 },
+    { "stop", operation_stop, 1 },
+    { "wait", operation_wait, 1 },
+    { "events", operation_events, 0 },
+    { "monitor", operation_monitor, 0 },
+    { "export", operation_export, 0 },
+    { "batch", operation_batch, 0 },
+    { "pool", operation_pool, 0 },
+    { "restart", operation_restart, 1 },
+    { "priority", operation_priority, 1 },
+    { NULL, NULL, 0 }
+};
+
+/// @brief Creates a context from command line arguments
+///
+/// The arguments are as passed to main(int,char**), with the program name
+/// first, and are not modified. The context does not refer to them once this
+/// returns.
+///
+/// @return zero if successful, otherwise a non-zero error code
+int procctrl_create (
+    int argc, ///<the number of arguments>
+    char **argv, ///<the argument values>
+    struct procctrl_context **context ///<receives the context, to be released with procctrl_free(struct procctrl_context*)>
+    ) {
+    struct procctrl_context *previous = params_current;
+    char **args;
+    int e;
+    *context = (struct procctrl_context*)calloc (1, sizeof (struct procctrl_context));
+    // getopt may permute the array, so give it a copy
+    args = (char**)malloc ((argc + 1) * sizeof (char*));
+    if (!*context || !args) {
+        free (*context);
+        free (args);
+        *context = NULL;
+        return _WIN32_OR_POSIX (ERROR_OUTOFMEMORY, ENOMEM);
+    }
+    memcpy (args, argv, argc * sizeof (char*));
+    args[argc] = NULL;
+    params_current = *context;
+    e = params (argc, args);
+    params_current = previous;
+    free (args);
+    if (e) {
+        procctrl_free (*context);
+        *context = NULL;
+    }
+    return e;
+}
+
+/// @brief Releases a context created by procctrl_create(int,char**,struct procctrl_context**)
+void procctrl_free (
+    struct procctrl_context *context ///<the context to release, or NULL>
+    ) {
+    if (!context) return;
+    params_free (context);
+    free (context);
+}
+
+/// @brief Tests if an operation acts on each replica given by the `N` parameter
+///
+/// @return non-zero if it does, zero otherwise
+static int is_replicated (
+    int (*fn) () ///<the operation>
+    ) {
+    int i;
+    for (i = 0; _operations[i].name && (_operations[i].fn != fn); i++);
+    return _operations[i].replicated;
+}
+
+/// @brief Runs an operation with a context bound to the calling thread
+///
+/// Housekeeping actions are performed before and/or after the operation as
+/// per the housekeep_mode flag, and the timing and trace events for the
+/// invocation are written. With the `N` parameter an operation on a single
+/// identifier is run on each replica instead.
+///
+/// @return the result of the operation
+static int run_operation (
+    struct procctrl_context *context, ///<the context to run the operation with>
+    const char *name, ///<the operation name, for timing and trace events>
+    int (*fn) () ///<the operation, or NULL if the name is not recognised>
+    ) {
+    struct procctrl_context *previous = params_current;
+    char args[32];
+    double phase, traced;
+    int e;
+    params_current = context;
+    phase = timing_now ();
+    traced = trace_now ();
+    if (PARAM (housekeep_mode) & HOUSEKEEP_BEFORE) {
+        process_housekeep ();
+        timing_record ("housekeep_before", phase);
+        trace_complete ("housekeep", 0, traced, NULL);
+    }
+    phase = timing_now ();
+    traced = trace_now ();
+    if (fn && PARAM (replica_count) && (PARAM (replica_index) < 0) && is_replicated (fn)) {
+        e = replica_run (fn);
+    } else if (fn) {
+        e = fn ();
+    } else {
+        fprintf (stderr, "Unknown operation '%s'\n", name);
+        e = 1;
+    }
+    timing_record ("operation", phase);
+    snprintf (args, sizeof (args), "\"result\":%d", e);
+    trace_complete (name, 0, traced, args);
+    if (!e && (PARAM (housekeep_mode) & HOUSEKEEP_AFTER)) {
+        phase = timing_now ();
+        traced = trace_now ();
+        process_housekeep ();
+        timing_record ("housekeep_after", phase);
+        trace_complete ("housekeep", 0, traced, NULL);
+    }
+    timing_report (e);
+    params_current = previous;
+    return e;
+}
+
+/// @brief Runs the operation named in a context
+///
+/// See the `man` page for the available operations, and operations.h for the
+/// errors returned from each.
+///
+/// @return zero for success, otherwise a non-zero error code
+int procctrl_run (
+    struct procctrl_context *context ///<the context, naming the operation>
+    ) {
+    struct procctrl_context *previous = params_current;
+    const char *name;
+    int i;
+    params_current = context;
+    name = PARAM (operation) ? PARAM (operation) : "query";
+    params_current = previous;
+    for (i = 0; _operations[i].name && strcmp (_operations[i].name, name); i++);
+    return run_operation (context, name, _operations[i].fn);
+}
+
+/// @brief Runs the query operation
+///
+/// With a result the state of the process, and the resources used by it and
+/// its descendants, are written there whatever the `o` parameter, and nothing
+/// is written to stdout. A result can't be collected for a group of replicas
+/// given by the `N` parameter; query each by its own identifier instead.
+///
+/// @return as operation_query(), or EINVAL/ERROR_INVALID_PARAMETER if a result
+///         is requested for a group of replicas
+int procctrl_query (
+    struct procctrl_context *context, ///<the context to run the operation with>
+    struct procctrl_query_result *result ///<receives the result, or NULL to write to stdout as the command line does>
+    ) {
+    int e;
+    if (result && context->replica_count && (context->replica_index < 0)) {
+        return _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL);
+    }
+    context->query_result = result;
+    e = run_operation (context, "query", operation_query);
+    context->query_result = NULL;
+    return e;
+}
+
+/// @brief Runs the start operation
+///
+/// @return as operation_start()
+int procctrl_start (
+    struct procctrl_context *context ///<the context to run the operation with>
+    ) {
+    return run_operation (context, "start", operation_start);
+}
+
+/// @brief Runs the stop operation
+///
+/// @return as operation_stop()
+int procctrl_stop (
+    struct procctrl_context *context ///<the context to run the operation with>
+    ) {
+    return run_operation (context, "stop", operation_stop);
+}
+
+/// @brief Runs the wait operation
+///
+/// @return as operation_wait()
+int procctrl_wait (
+    struct procctrl_context *context ///<the context to run the operation with>
+    ) {
+    return run_operation (context, "wait", operation_wait);
+}
+
+#ifndef _WIN32
+
+/// @brief Body of the worker thread for an asynchronous start or stop
+///
+/// The result is left in the context, and the eventfd is then signalled.
+static void *run_async (
+    void *arg ///<the context, naming the operation in async_fn>
+    ) {
+    struct procctrl_context *context = (struct procctrl_context*)arg;
+    uint64_t value = 1;
+    const char *name = (context->async_fn == operation_start) ? "start" : "stop";
+    context->async_result = run_operation (context, name, context->async_fn);
+    if (write (context->async_fd, &value, sizeof (value)) != sizeof (value)) {
+        fprintf (stderr, "Couldn't signal completion of %s\n", name);
+    }
+    return NULL;
+}
+
+/// @brief Starts an operation on a worker thread
+///
+/// @return zero if successful, EBUSY if the context has an operation that
+///         has not been collected, otherwise a non-zero error code
+static int start_async (
+    struct procctrl_context *context, ///<the context to run the operation with>
+    int (*fn) (), ///<the operation>
+    int *fd ///<receives the descriptor that becomes readable on completion>
+    ) {
+    pthread_attr_t attr;
+    pthread_t thread;
+    int e;
+    *fd = -1;
+    if (context->async_fn) return EBUSY;
+    context->async_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (context->async_fd < 0) return errno;
+    context->async_fn = fn;
+    pthread_attr_init (&attr);
+    pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+    e = pthread_create (&thread, &attr, run_async, context);
+    pthread_attr_destroy (&attr);
+    if (e) {
+        close (context->async_fd);
+        context->async_fn = NULL;
+        return e;
+    }
+    *fd = context->async_fd;
+    return 0;
+}
+
+/// @brief Starts the start operation on a worker thread
+///
+/// The descriptor becomes readable once the process is running and recorded,
+/// or with the `c` parameter once it is ready, and the result is then as
+/// operation_start().
+///
+/// @return zero if the operation was started, otherwise a non-zero error code
+int procctrl_start_async (
+    struct procctrl_context *context, ///<the context to run the operation with>
+    int *fd ///<receives the descriptor, for procctrl_async_result(struct procctrl_context*,int*)>
+    ) {
+    return start_async (context, operation_start, fd);
+}
+
+/// @brief Starts the stop operation on a worker thread
+///
+/// The descriptor becomes readable once the process has been signalled, and
+/// the result is then as operation_stop().
+///
+/// @return zero if the operation was started, otherwise a non-zero error code
+int procctrl_stop_async (
+    struct procctrl_context *context, ///<the context to run the operation with>
+    int *fd ///<receives the descriptor, for procctrl_async_result(struct procctrl_context*,int*)>
+    ) {
+    return start_async (context, operation_stop, fd);
+}
+
+/// @brief Starts waiting for the process to terminate, without a thread
+///
+/// The descriptor is a `pidfd` on the watchdog, which records the status of
+/// the process before terminating, or if the kernel does not support them an
+/// `inotify` descriptor on the information file. Either may become readable
+/// before the process terminates, and procctrl_async_result(struct procctrl_context*,int*)
+/// then returns EAGAIN. The descriptor does not become readable when the `t`
+/// parameter expires; the caller should poll with its own time limit, after
+/// which the result is ETIMEDOUT as for operation_wait().
+///
+/// @return zero if the wait was started, EINVAL for a group of replicas given
+///         by the `N` parameter, ESRCH if there is no process to wait for,
+///         EBUSY if the context has an operation that has not been collected,
+///         otherwise a non-zero error code
+int procctrl_wait_async (
+    struct procctrl_context *context, ///<the context to run the operation with>
+    int *fd ///<receives the descriptor, for procctrl_async_result(struct procctrl_context*,int*)>
+    ) {
+    struct procctrl_context *previous = params_current;
+    struct process_info *info;
+    const char *value;
+    pid_t wdog;
+    int watch, e = 0;
+    *fd = -1;
+    if (context->replica_count && (context->replica_index < 0)) return EINVAL;
+    if (context->async_fn) return EBUSY;
+    params_current = context;
+    // Watch before reading the file, so that no update can be missed
+    watch = process_watch ();
+    info = process_load ();
+    if (!info) {
+        if (watch >= 0) close (watch);
+        params_current = previous;
+        return ESRCH;
+    }
+    if (process_info_get (info, "exit") || process_info_get (info, "signal")) {
+        // Already recorded, so readable straight away
+        context->async_fd = eventfd (1, EFD_CLOEXEC | EFD_NONBLOCK);
+    } else {
+        value = process_info_get (info, "wdog");
+        wdog = value ? (pid_t)strtol (value, NULL, 10) : 0;
+        context->async_fd = (wdog > 0) ? watchdog_open (wdog) : -1;
+        if ((context->async_fd < 0) && (errno == ESRCH)) {
+            // The watchdog has gone; the result is whatever it left
+            context->async_fd = eventfd (1, EFD_CLOEXEC | EFD_NONBLOCK);
+        } else if (context->async_fd < 0) {
+            context->async_fd = watch;
+            watch = -1;
+        }
+    }
+    process_info_free (info);
+    if (watch >= 0) close (watch);
+    if (context->async_fd < 0) {
+        e = errno ? errno : ENOSYS;
+    } else {
+        context->async_fn = operation_wait;
+        context->async_deadline = (PARAM (wait_timeout) < 0) ? 0 : time (NULL) + PARAM (wait_timeout);
+        *fd = context->async_fd;
+    }
+    params_current = previous;
+    return e;
+}
+
+/// @brief Tests if an asynchronous wait has something to collect
+///
+/// @return non-zero if the process has terminated, its watchdog has gone, or
+///         the wait has timed out, zero otherwise
+static int wait_done (
+    struct procctrl_context *context ///<the context with the wait in progress>
+    ) {
+    struct procctrl_context *previous = params_current;
+    struct process_info *info;
+    const char *value;
+    char buffer[4096];
+    int done;
+    // Drain inotify events; reading a pidfd fails harmlessly
+    while (read (context->async_fd, buffer, sizeof (buffer)) > 0);
+    params_current = context;
+    info = process_load ();
+    params_current = previous;
+    if (!info || process_info_get (info, "exit") || process_info_get (info, "signal")) {
+        done = 1;
+    } else {
+        value = process_info_get (info, "wdog");
+        done = value && (kill ((pid_t)strtol (value, NULL, 10), 0) < 0) && (errno == ESRCH);
+    }
+    process_info_free (info);
+    return done || (context->async_deadline && (time (NULL) >= context->async_deadline));
+}
+
+/// @brief Collects the result of an asynchronous operation
+///
+/// This does not block. Once the result has been collected the descriptor is
+/// closed, and the context can be used again.
+///
+/// @return zero if the result was collected, EAGAIN if the operation has not
+///         completed yet, EINVAL if there is no operation to collect,
+///         otherwise a non-zero error code
+int procctrl_async_result (
+    struct procctrl_context *context, ///<the context the operation was started with>
+    int *result ///<receives the result of the operation>
+    ) {
+    uint64_t value;
+    int timeout;
+    if (!context->async_fn) return EINVAL;
+    if (context->async_fn == operation_wait) {
+        if (!wait_done (context)) return EAGAIN;
+        // Collect the status, or ETIMEDOUT, without blocking
+        timeout = context->wait_timeout;
+        context->wait_timeout = 0;
+        *result = run_operation (context, "wait", operation_wait);
+        context->wait_timeout = timeout;
+    } else {
+        if (read (context->async_fd, &value, sizeof (value)) != sizeof (value)) return errno;
+        *result = context->async_result;
+    }
+    close (context->async_fd);
+    context->async_fn = NULL;
+    return 0;
+}
+
+#endif /* ifndef _WIN32 */
@@ -0,0 +1,106 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifndef __inc_procctrl_h
+#define __inc_procctrl_h
+
+/// @file
+/// @brief Process control library
+///
+/// Header file for the library functions published by procctrl.c. A context
+/// is created from command line style arguments, as documented in the `man`
+/// page, and the operations are then run in-process against it.
+///
+/// Each operation runs with the context passed, so different threads can run
+/// operations concurrently with their own contexts. A single context must not
+/// be used by more than one thread at a time.
+///
+/// The asynchronous variants return a descriptor that becomes readable when
+/// the operation may have completed, for use with poll, epoll or any other
+/// event loop. The result is collected, without blocking, with
+/// procctrl_async_result(struct procctrl_context*,int*), and until then the
+/// context must not be used, or freed, and another asynchronous variant
+/// fails with EBUSY.
+///
+/// The asynchronous start and stop run on a worker thread for the duration
+/// of the operation; that is until the process is running, or ready with the
+/// `c` parameter, and until it has been signalled. They should not be used
+/// where a thread per call is too many. The asynchronous wait, which lasts as
+/// long as the process, uses no thread; its descriptor refers to the watchdog
+/// or the information file, and can be readable with the process still
+/// running, when the result is EAGAIN and the caller polls again.
+///
+/// On POSIX the watchdog for a started process is forked from the calling
+/// process and runs there without executing a new image, so it calls
+/// functions, such as malloc, stdio and opendir, that POSIX does not promise
+/// are safe in the child of a multi-threaded process. This is safe with the C
+/// libraries that reset their own locks on fork, such as glibc and musl, but
+/// a multi-threaded caller must not start processes while one of its other
+/// threads could hold a lock the watchdog needs, for example in a malloc
+/// replacement without fork handlers. Such a caller should start processes
+/// before creating its threads, or from a single-threaded helper process.
+
+struct procctrl_context;
+
+/// @brief The size of the text fields of procctrl_query_result
+#define PROCCTRL_QUERY_FIELD 256
+
+/// @brief The state of a process, as written to stdout by the `query`
+///        operation with the `o` parameter
+///
+/// The resources used are totals for the process and all of its descendants.
+/// The text fields are empty if the process was not given that option.
+struct procctrl_query_result {
+    /// @brief The process, or zero if it is not running
+    unsigned pid;
+    /// @brief The number of processes in the tree
+    unsigned processes;
+    /// @brief The number of threads
+    unsigned threads;
+    /// @brief The number of open file descriptors
+    unsigned fds;
+    /// @brief User CPU time, in milliseconds
+    unsigned long long utime;
+    /// @brief System CPU time, in milliseconds
+    unsigned long long stime;
+    /// @brief Resident set size, in bytes
+    unsigned long long rss;
+    /// @brief Proportional set size, in bytes
+    unsigned long long pss;
+    /// @brief Bytes read from storage
+    unsigned long long read_bytes;
+    /// @brief Bytes written to storage
+    unsigned long long write_bytes;
+    /// @brief The number of times the process has been restarted
+    unsigned restarts;
+    /// @brief The CPUs given by the `A` or `a` parameter
+    char cpus[PROCCTRL_QUERY_FIELD];
+    /// @brief The memory policy given by the `m` parameter
+    char mempolicy[PROCCTRL_QUERY_FIELD];
+    /// @brief The nice value given by the `y` parameter
+    char nice[PROCCTRL_QUERY_FIELD];
+    /// @brief The scheduling policy given by the `S` parameter
+    char sched[PROCCTRL_QUERY_FIELD];
+    /// @brief The I/O priority given by the `j` parameter
+    char ioprio[PROCCTRL_QUERY_FIELD];
+};
+
+int procctrl_create (int argc, char **argv, struct procctrl_context **context);
+void procctrl_free (struct procctrl_context *context);
+int procctrl_run (struct procctrl_context *context);
+int procctrl_query (struct procctrl_context *context, struct procctrl_query_result *result);
+int procctrl_start (struct procctrl_context *context);
+int procctrl_stop (struct procctrl_context *context);
+int procctrl_wait (struct procctrl_context *context);
+#ifndef _WIN32
+int procctrl_start_async (struct procctrl_context *context, int *fd);
+int procctrl_stop_async (struct procctrl_context *context, int *fd);
+int procctrl_wait_async (struct procctrl_context *context, int *fd);
+int procctrl_async_result (struct procctrl_context *context, int *result);
+#endif /* ifndef _WIN32 */
+
+#endif /* ifndef __inc_procctrl_h */
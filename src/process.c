@@ -12,6 +12,9 @@
 
 #include "process.h"
 #include "params.h"
+#include "placement.h"
+#include "procfs.h"
+#include "timing.h"
 #ifdef _WIN32
 # define snprintf _snprintf
 #else
@@ -21,20 +24,243 @@
 # include <sys/stat.h>
 # include <unistd.h>
 #endif /* ifndef _WIN32 */
+#ifndef _WIN32
+# include <sys/resource.h>
+# include <sys/time.h>
+# include <sys/wait.h>
+# include <sys/inotify.h>
+# include <poll.h>
+# include <signal.h>
+# include "watchdog.h"
+#endif /* ifndef _WIN32 */
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/// @brief The longest line that can be present in an information file
+/// @brief The initial size of the buffer for a line of an information file
 ///
-/// This value has to be large enough to hold the longest possible command
-/// line plus the "cmd: " prefix or the verify_pid(const char*,pid_t) function
-/// will not work.
+/// Longer lines, such as a long command line or the `leases` of a widely
+/// shared process, grow the buffer as they are read.
 #define MAX_PROCESS_INFO_LINE    256
 
 int _is_running (_WIN32_OR_POSIX (HANDLE, pid_t) process);
 
+/// @brief Reads a process information file
+///
+/// Each `key: value` line of the file is returned as a field in the order
+/// they appear in the file. Lines may be of any length.
+///
+/// The caller must release the fields with process_info_free().
+///
+/// @return the fields, or NULL if the file could not be read or is empty
+struct process_info *process_info_read (
+    const char *path ///<the information file to read>
+    ) {
+    struct process_info *head = NULL, **tail = &head;
+    FILE *info;
+    char *tmp;
+    size_t size = MAX_PROCESS_INFO_LINE;
+    info = fopen (path, "rt");
+    if (!info) return NULL;
+    tmp = (char*)malloc (size);
+    if (tmp) {
+        while (fgets (tmp, (int)size, info)) {
+            struct process_info *field;
+            char *value;
+            size_t len = strlen (tmp);
+            while ((len == size - 1) && (tmp[len - 1] != '\n')) {
+                // The line didn't fit, so read the rest of it
+                tmp = (char*)realloc (tmp, size *= 2);
+                if (!tmp) abort ();
+                if (!fgets (tmp + len, (int)(size - len), info)) break;
+                len += strlen (tmp + len);
+            }
+            value = strchr (tmp, ':');
+            if (!value) continue;
+            *(value++) = 0;
+            if (*value == ' ') value++;
+            value[strcspn (value, "\r\n")] = 0;
+            field = (struct process_info*)malloc (sizeof (struct process_info));
+            if (!field) break;
+            field->key = strdup (tmp);
+            field->value = strdup (value);
+            field->next = NULL;
+            if (!field->key || !field->value) abort ();
+            *tail = field;
+            tail = &field->next;
+        }
+        free (tmp);
+    }
+    fclose (info);
+    return head;
+}
+
+/// @brief Finds a field read from a process information file
+///
+/// @return the field value, or NULL if the field is not present
+const char *process_info_get (
+    const struct process_info *info, ///<the fields to search>
+    const char *key ///<the field name>
+    ) {
+    while (info) {
+        if (!strcmp (info->key, key)) return info->value;
+        info = info->next;
+    }
+    return NULL;
+}
+
+/// @brief Sets a field for a process information file
+///
+/// An existing field with the same name is updated in place, otherwise the
+/// new field is appended.
+///
+/// @return the updated fields
+struct process_info *process_info_set (
+    struct process_info *info, ///<the fields to update, or NULL for none>
+    const char *key, ///<the field name>
+    const char *value ///<the field value>
+    ) {
+    struct process_info **field = &info;
+    while (*field) {
+        if (!strcmp ((*field)->key, key)) {
+            free ((*field)->value);
+            (*field)->value = strdup (value);
+            if (!(*field)->value) abort ();
+            return info;
+        }
+        field = &(*field)->next;
+    }
+    *field = (struct process_info*)malloc (sizeof (struct process_info));
+    if (!*field) abort ();
+    (*field)->key = strdup (key);
+    (*field)->value = strdup (value);
+    (*field)->next = NULL;
+    if (!(*field)->key || !(*field)->value) abort ();
+    return info;
+}
+
+/// @brief Removes a field from a process information file
+///
+/// @return the updated fields
+struct process_info *process_info_remove (
+    struct process_info *info, ///<the fields to update, or NULL for none>
+    const char *key ///<the field name>
+    ) {
+    struct process_info **field = &info;
+    while (*field) {
+        if (!strcmp ((*field)->key, key)) {
+            struct process_info *removed = *field;
+            *field = removed->next;
+            free (removed->key);
+            free (removed->value);
+            free (removed);
+            return info;
+        }
+        field = &(*field)->next;
+    }
+    return info;
+}
+
+/// @brief Writes a process information file
+///
+/// The fields are written to a temporary file which then replaces the
+/// original. Anything reading the information file will either see the
+/// previous or the new content, never a partially written file.
+///
+/// The temporary file name has a `~` suffix. This character is always
+/// escaped in a process identifier so will never clash with another file.
+///
+/// @return zero if successful, otherwise a non-zero error code
+int process_info_write (
+    const char *path, ///<the information file to write>
+    const struct process_info *info ///<the fields to write>
+    ) {
+    char *tmp;
+    FILE *out;
+    int result = 0;
+    tmp = (char*)malloc (strlen (path) + 2);
+    if (!tmp) return _WIN32_OR_POSIX (ERROR_OUTOFMEMORY, ENOMEM);
+    sprintf (tmp, "%s~", path);
+    out = fopen (tmp, "wt");
+    if (out) {
+        while (info) {
+            fprintf (out, *info->value ? "%s: %s\n" : "%s:\n", info->key, info->value);
+            info = info->next;
+        }
+        if (fclose (out)) result = _WIN32_OR_POSIX (GetLastError (), errno);
+#ifdef _WIN32
+        if (!result && !MoveFileEx (tmp, path, MOVEFILE_REPLACE_EXISTING)) result = GetLastError ();
+#else /* ifdef _WIN32 */
+        if (!result && rename (tmp, path)) result = errno;
+#endif /* ifdef _WIN32 */
+        if (result) _WIN32_OR_POSIX (DeleteFile, unlink) (tmp);
+    } else {
+        result = _WIN32_OR_POSIX (GetLastError (), errno);
+    }
+    free (tmp);
+    return result;
+}
+
+/// @brief Releases fields read by process_info_read(const char*)
+void process_info_free (
+    struct process_info *info ///<the fields to release, or NULL for none>
+    ) {
+    while (info) {
+        struct process_info *next = info->next;
+        free (info->key);
+        free (info->value);
+        free (info);
+        info = next;
+    }
+}
+
+/// @brief Formats the current time for an information file
+///
+/// Times are written as seconds since the epoch, with microsecond precision.
+static void timestamp (
+    char *buffer, ///<the buffer to write into>
+    size_t size ///<the size of the buffer>
+    ) {
+#ifdef _WIN32
+    FILETIME ft;
+    ULARGE_INTEGER t;
+    GetSystemTimeAsFileTime (&ft);
+    t.LowPart = ft.dwLowDateTime;
+    t.HighPart = ft.dwHighDateTime;
+    // FILETIME is 100ns intervals since 1601
+    t.QuadPart = t.QuadPart / 10 - 11644473600000000ULL;
+    snprintf (buffer, size, "%llu.%06llu", t.QuadPart / 1000000, t.QuadPart % 1000000);
+#else /* ifdef _WIN32 */
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+    snprintf (buffer, size, "%ld.%06ld", (long)tv.tv_sec, (long)tv.tv_usec);
+#endif /* ifdef _WIN32 */
+}
+
+#ifndef _WIN32
+/// @brief Matches a character from `/proc/<em>pid</em>/cmdline`
+///
+/// The arguments in the `cmdline` file are separated by null characters
+/// where the expected command line has spaces. The end of the expected
+/// command line only matches the null character terminating the last
+/// argument.
+///
+/// @return non-zero if the character matches, advancing the pointer, zero
+///         otherwise
+static int match_char (
+    const char **expected, ///<the next character of the expected command line>
+    char c ///<the character read from the `cmdline` file>
+    ) {
+    if (!**expected) return !c;
+    if ((**expected == c) || ((**expected == ' ') && !c)) {
+        (*expected)++;
+        return 1;
+    }
+    return 0;
+}
+#endif /* ifndef _WIN32 */
+
 /// @brief Checks a PID corresponds to the expected command line
 ///
 /// When a process is spawned, the PID and original command line are written
@@ -61,31 +287,27 @@ static int verify_pid (
 	}
 #else /* ifdef _WIN32 */
     FILE *cmdline;
-    char tmp[32];
     int verified = 0;
-    snprintf (tmp, sizeof (tmp), "/proc/%u/cmdline", process);
-    cmdline = fopen (tmp, "rt");
+    cmdline = procfs_fopen (process, "cmdline");
     if (cmdline) {
         const char *script = command_line;
         const char *no_script = command_line;
         int argc = 0;
         do {
-            char c = fgetc (cmdline);
-            if (feof (cmdline)) break;
+            int c = fgetc (cmdline);
+            // The read fails, rather than reaching the end, if the process
+            // terminates while the file is open
+            if (c == EOF) break;
             if (argc > 0) {
                 if (script) {
-                    if ((*script == c) || ((*script == ' ') && !c)) {
-                        script++;
-                    } else {
+                    if (!match_char (&script, c)) {
                         script = NULL;
                         if (!no_script) break;
                     }
                 }
             }
             if (no_script) {
-                if ((*no_script == c) || ((*no_script == ' ') && !c)) {
-                    no_script++;
-                } else {
+                if (!match_char (&no_script, c)) {
                     no_script = NULL;
                     if (!script) break;
                 }
@@ -102,9 +324,9 @@ static int verify_pid (
 
 /// @brief File handle used to manage the data_dir lock
 #ifdef _WIN32
-static HANDLE _lock_handle = INVALID_HANDLE_VALUE;
+static THREAD_LOCAL HANDLE _lock_handle = INVALID_HANDLE_VALUE;
 #else /* ifdef _WIN32 */
-static int _lock_fd = -1;
+static THREAD_LOCAL int _lock_fd = -1;
 #endif /* ifdef _WIN32 */
 #define _LOCK_VALID _WIN32_OR_POSIX ((_lock_handle != INVALID_HANDLE_VALUE), (_lock_fd != -1))
 
@@ -120,17 +342,18 @@ static int _lock_fd = -1;
 /// The caller must use unlock_data_dir() to release the lock when it is
 /// finished.
 static void lock_data_dir () {
+    double phase = timing_now ();
     size_t size;
     char *path;
 	if (_LOCK_VALID) abort ();
-    size = strlen (data_dir) + 7;
+    size = strlen (PARAM (data_dir)) + 7;
     path = (char*)malloc (size);
     if (!path) abort ();
-    sprintf (path, "%s" _WIN32_OR_POSIX ("\\", "/") ".lock", data_dir);
+    sprintf (path, "%s" _WIN32_OR_POSIX ("\\", "/") ".lock", PARAM (data_dir));
 #ifdef _WIN32
 	_lock_handle = CreateFile (path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
 #else /* ifdef _WIN32 */
-    _lock_fd = open (path, O_WRONLY | O_CREAT);
+    _lock_fd = open (path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
 #endif /* ifdef _WIN32 */
     free (path);
 #ifndef _WIN32
@@ -138,6 +361,7 @@ static void lock_data_dir () {
         flock (_lock_fd, LOCK_EX);
     }
 #endif /* ifdef _WIN32 */
+    timing_record ("lock_wait", phase);
 }
 
 /// @brief Releases the data_dir lock
@@ -145,22 +369,24 @@ static void lock_data_dir () {
 /// See the description for lock_data_dir() for details.
 static void unlock_data_dir () {
 	if (_LOCK_VALID) {
-        char *path;
-        size_t size;
 #ifdef _WIN32
+		char *path;
+		size_t size;
 		CloseHandle (_lock_handle);
 		_lock_handle = INVALID_HANDLE_VALUE;
+		size = strlen (PARAM (data_dir)) + 7;
+		path = (char*)malloc (size);
+		if (!path) abort ();
+		sprintf (path, "%s\\.lock", PARAM (data_dir));
+		DeleteFile (path);
+		free (path);
 #else /* ifdef _WIN32 */
+        // The file is left in place; if it were deleted a process blocked on
+        // the old file and one creating a new file could both claim the lock
         flock (_lock_fd, LOCK_UN);
         close (_lock_fd);
 		_lock_fd = -1;
 #endif /* ifdef _WIN32 */
-        size = strlen (data_dir) + 7;
-        path = (char*)malloc (size);
-        if (!path) abort ();
-        sprintf (path, "%s" _WIN32_OR_POSIX ("\\", "/") ".lock", data_dir);
-		_WIN32_OR_POSIX (DeleteFile, unlink) (path);
-        free (path);
     }
 }
 
@@ -184,6 +410,53 @@ static HANDLE _FindFirstFileAny (const char *pszPath, WIN32_FIND_DATA *wfd) {
 }
 #endif /* ifdef _WIN32 */
 
+/// @brief Tests if a process identifier refers to an active process
+///
+/// @return non-zero if the process is running, zero otherwise
+static int is_active (
+    _WIN32_OR_POSIX (DWORD, pid_t) process ///<the PID to test>
+    ) {
+#ifdef _WIN32
+    HANDLE hProcess = OpenProcess (SYNCHRONIZE, FALSE, process);
+    BOOL bActive;
+    if (hProcess == NULL) return 0;
+    bActive = (WaitForSingleObject (hProcess, 0) == WAIT_TIMEOUT);
+    CloseHandle (hProcess);
+    return bActive;
+#else /* ifdef _WIN32 */
+    return _is_running (process);
+#endif /* ifdef _WIN32 */
+}
+
+/// @brief Tests if housekeeping should keep an information file
+///
+/// A file describing a running process is kept. A file recording the exit
+/// status of a terminated process is kept for as long as the process that
+/// started it is running, so that it can still collect the status. A file
+/// for a process waiting to be restarted, or to be activated by a connection,
+/// is kept for as long as its watchdog is running.
+///
+/// @return non-zero to keep the file, zero to delete it
+static int keep_info (
+    const struct process_info *info ///<the fields read from the file>
+    ) {
+    const char *pid = process_info_get (info, "pid");
+    const char *cmd = process_info_get (info, "cmd");
+    if (!pid || !cmd || !*cmd) return 0;
+    if ((process_info_get (info, "restart") || process_info_get (info, "activation")) && !process_info_get (info, "end")) {
+        const char *wdog = process_info_get (info, "wdog");
+        return wdog && is_active (_WIN32_OR_POSIX ((DWORD), (pid_t))strtol (wdog, NULL, 10));
+    }
+    if (process_info_get (info, "end")) {
+        const char *ppid = process_info_get (info, "ppid");
+        if (!ppid) return 0;
+        return is_active (_WIN32_OR_POSIX ((DWORD), (pid_t))strtol (ppid, NULL, 10));
+    } else {
+        _WIN32_OR_POSIX (DWORD, pid_t) process = _WIN32_OR_POSIX ((DWORD), (pid_t))strtol (pid, NULL, 10);
+        return process && verify_pid (cmd, process);
+    }
+}
+
 /// @brief Cleans up the data folder
 ///
 /// Scans the data folder, checking that any information files correspond to
@@ -194,9 +467,9 @@ static HANDLE _FindFirstFileAny (const char *pszPath, WIN32_FIND_DATA *wfd) {
 int process_housekeep () {
 	_WIN32_OR_POSIX (HANDLE, DIR*) dir;
 	_WIN32_OR_POSIX (WIN32_FIND_DATA, struct dirent*) ent;
-    if (verbose) fprintf (stdout, "Cleaning up data area (%s)\n", data_dir);
+    if (PARAM (verbose)) fprintf (stdout, "Cleaning up data area (%s)\n", PARAM (data_dir));
 #ifdef _WIN32
-	dir = _FindFirstFileAny (data_dir, &ent);
+	dir = _FindFirstFileAny (PARAM (data_dir), &ent);
 	if (dir == INVALID_HANDLE_VALUE) {
 		DWORD err = GetLastError ();
 		if (err == ERROR_FILE_NOT_FOUND) {
@@ -206,7 +479,7 @@ int process_housekeep () {
 		return err;
 	}
 #else /* ifdef _WIN32 */
-    dir = opendir (data_dir);
+    dir = opendir (PARAM (data_dir));
     if (!dir) return ENOENT;
 #endif /* ifdef _WIN32 */
     lock_data_dir ();
@@ -219,14 +492,14 @@ int process_housekeep () {
         char *dirpath, *subdirpath;
         size_t size;
         if (_name (ent)[0] == '.') continue;
-        size = strlen (_name (ent)) + strlen (data_dir) + 2;
+        size = strlen (_name (ent)) + strlen (PARAM (data_dir)) + 2;
         dirpath = (char*)malloc (size);
         if (!dirpath) {
 			_WIN32_OR_POSIX (FindClose, closedir) (dir);
             unlock_data_dir ();
             return _WIN32_OR_POSIX (ERROR_OUTOFMEMORY, ENOMEM);
         }
-        sprintf (dirpath, "%s" _WIN32_OR_POSIX ("\\", "/") "%s", data_dir, _name (ent));
+        sprintf (dirpath, "%s" _WIN32_OR_POSIX ("\\", "/") "%s", PARAM (data_dir), _name (ent));
         if (isdigit (*_name (ent))) {
             _WIN32_OR_POSIX (DWORD, pid_t) ppid = _WIN32_OR_POSIX ((DWORD), (pid_t))strtol (_name (ent), NULL, 10);
 #ifdef _WIN32
@@ -235,7 +508,7 @@ int process_housekeep () {
 #else /* ifdef _WIN32 */
             if (_is_running (ppid) == 0) {
 #endif /* ifdef _WIN32 */
-                if (verbose) fprintf (stdout, "Deleting %s - invalid\n", dirpath);
+                if (PARAM (verbose)) fprintf (stdout, "Deleting %s - invalid\n", dirpath);
 #ifdef _WIN32
 				subdir = _FindFirstFileAny (dirpath, &ent);
 				if (subdir != INVALID_HANDLE_VALUE) {
@@ -293,35 +566,15 @@ int process_housekeep () {
                 size = strlen (_name (ent)) + strlen (dirpath) + 2;
                 subdirpath = (char*)malloc (size);
                 if (subdirpath) {
-                    FILE *info;
-                    char *tmp;
+                    struct process_info *info;
                     sprintf (subdirpath, "%s" _WIN32_OR_POSIX ("\\", "/") "%s", dirpath, _name (ent));
-                    info = fopen (subdirpath, "rt");
-                    if (info) {
-                        tmp = (char*)malloc (MAX_PROCESS_INFO_LINE);
-                        if (tmp) {
-                            _WIN32_OR_POSIX (DWORD, pid_t) process = 0;
-                            char *cmdline = NULL;
-                            while (fgets (tmp, MAX_PROCESS_INFO_LINE, info)) {
-                                if (!strncmp (tmp, "pid: ", 5)) {
-                                    process = _WIN32_OR_POSIX ((DWORD), (pid_t))strtol (tmp + 5, NULL, 10);
-                                } else if (!strncmp (tmp, "cmd: ", 5)) {
-                                    cmdline = strdup (tmp + 5);
-                                    strtok (cmdline, "\r\n");
-                                }
-                            }
-                            if (!cmdline || !process || !verify_pid (cmdline, process)) {
-                                if (verbose) fprintf (stdout, "Deleting %s - invalid\n", subdirpath);
-                                fclose (info);
-                                info = NULL;
-                                _WIN32_OR_POSIX (DeleteFile, unlink) (subdirpath);
-                                files--;
-                            }
-                            if (cmdline) free (cmdline);
-                            free (tmp);
-                        }
-                        if (info) fclose (info);
+                    info = process_info_read (subdirpath);
+                    if (!keep_info (info)) {
+                        if (PARAM (verbose)) fprintf (stdout, "Deleting %s - invalid\n", subdirpath);
+                        _WIN32_OR_POSIX (DeleteFile, unlink) (subdirpath);
+                        files--;
                     }
+                    process_info_free (info);
                     free (subdirpath);
                 }
 #ifdef _WIN32
@@ -331,7 +584,7 @@ int process_housekeep () {
 #endif /* ifdef _WIN32 */
 			_WIN32_OR_POSIX (FindClose, closedir) (subdir);
             if (!files) {
-                if (verbose) fprintf (stdout, "Deleting %s - empty\n", dirpath);
+                if (PARAM (verbose)) fprintf (stdout, "Deleting %s - empty\n", dirpath);
 				_WIN32_OR_POSIX (RemoveDirectory, rmdir) (dirpath);
             }
         }
@@ -390,7 +643,7 @@ static int escape_char (
 /// @return the length of the escaped string
 static size_t process_identifier_len () {
     size_t chars = 0;
-    const char *ptr = process_identifier;
+    const char *ptr = PARAM (process_identifier);
     while (*ptr) {
         if (escape_char (*ptr++)) {
             chars += 3;
@@ -430,7 +683,7 @@ static void copy_process_identifier (
     char *ptr, ///<the buffer to copy into>
     size_t chars ///<the size of the buffer>
     ) {
-    const char *identifier = process_identifier;
+    const char *identifier = PARAM (process_identifier);
     while (*identifier && chars) {
         if (escape_char (*identifier)) {
             if (chars < 3) return;
@@ -457,15 +710,15 @@ static void copy_process_identifier (
 static char *get_process_path (
     int create ///<non-zero to ensure the path exists, zero to not create it>
     ) {
-    size_t buffer_len = strlen (data_dir) + process_identifier_len () + 3;
+    size_t buffer_len = strlen (PARAM (data_dir)) + process_identifier_len () + 3;
     char *path;
     int n;
-    buffer_len += global_identifier ? 6 : pidlen (_WIN32_OR_POSIX (GetProcessId (parent_process), parent_process));
+    buffer_len += PARAM (global_identifier) ? 6 : pidlen (_WIN32_OR_POSIX (GetProcessId (PARAM (parent_process)), PARAM (parent_process)));
     path = (char*)malloc (buffer_len);
     if (!path) abort ();
-    n = global_identifier
-		? snprintf (path, buffer_len, "%s" _WIN32_OR_POSIX ("\\", "/") "%s" _WIN32_OR_POSIX ("\\", "/"), data_dir, "GLOBAL")
-		: snprintf(path, buffer_len, "%s" _WIN32_OR_POSIX("\\", "/") "%u" _WIN32_OR_POSIX("\\", "/"), data_dir, _WIN32_OR_POSIX(GetProcessId(parent_process), parent_process));
+    n = PARAM (global_identifier)
+		? snprintf (path, buffer_len, "%s" _WIN32_OR_POSIX ("\\", "/") "%s" _WIN32_OR_POSIX ("\\", "/"), PARAM (data_dir), "GLOBAL")
+		: snprintf(path, buffer_len, "%s" _WIN32_OR_POSIX("\\", "/") "%u" _WIN32_OR_POSIX("\\", "/"), PARAM (data_dir), _WIN32_OR_POSIX(GetProcessId(PARAM (parent_process)), PARAM (parent_process)));
     if (n < 0) abort ();
     if (create) create_path (path);
     copy_process_identifier (path + n, buffer_len - n);
@@ -480,72 +733,1291 @@ static char *get_process_path (
 ///
 /// @return the PID/HANDLE if found, 0 otherwise
 _WIN32_OR_POSIX (HANDLE, pid_t) process_find () {
+    double phase = timing_now ();
     char *path = get_process_path (0);
-    FILE *info;
+    struct process_info *info;
     _WIN32_OR_POSIX (DWORD, pid_t) pid = 0;
-    if (verbose) fprintf (stdout, "Checking for process at %s\n", path);
+    if (PARAM (verbose)) fprintf (stdout, "Checking for process at %s\n", path);
     lock_data_dir ();
-    info = fopen (path, "rt");
+    info = process_info_read (path);
+    unlock_data_dir ();
     if (info) {
-        char *tmp = (char*)malloc (MAX_PROCESS_INFO_LINE);
-        if (tmp) {
-            char *cmd = NULL;
-            while (fgets (tmp, MAX_PROCESS_INFO_LINE, info)) {
-                if (!strncmp (tmp, "pid: ", 5)) {
-                    pid = (_WIN32_OR_POSIX (DWORD, pid_t))strtol (tmp + 5, NULL, 10);
-                } else if (!strncmp (tmp, "cmd: ", 5)) {
-                    cmd = strdup (tmp + 5);
-                    strtok (cmd, "\r\n");
+        const char *value = process_info_get (info, "pid");
+        const char *cmd = process_info_get (info, "cmd");
+        if (value) pid = (_WIN32_OR_POSIX (DWORD, pid_t))strtol (value, NULL, 10);
+#ifndef _WIN32
+        if (process_info_get (info, "activation")) {
+            // The watchdog stands in for a socket activated process
+            if (!is_active (pid)) pid = 0;
+        } else
+#endif /* ifndef _WIN32 */
+        if (cmd) {
+            if (!verify_pid (cmd, pid)) {
+                if (PARAM (verbose)) fprintf (stdout, "Found PID %u but it's invalid or command line is incorrect\n", pid);
+                pid = 0;
+            }
+        }
+        process_info_free (info);
+    }
+    free (path);
+    timing_record ("find", phase);
+    return _WIN32_OR_POSIX (OpenProcess (PROCESS_QUERY_INFORMATION | PROCESS_TERMINATE | SYNCHRONIZE, FALSE, pid), pid);
+}
+
+/// @brief Reads the information file for the controlled process
+///
+/// Unlike process_find() the file is returned even if the process it
+/// describes is no longer running; for example to retrieve its exit status.
+///
+/// The caller must release the fields with process_info_free().
+///
+/// @return the fields, or NULL if there is no information file
+struct process_info *process_load () {
+    char *path = get_process_path (0);
+    struct process_info *info;
+    lock_data_dir ();
+    info = process_info_read (path);
+    unlock_data_dir ();
+    free (path);
+    return info;
+}
+
+#ifndef _WIN32
+
+/// @brief Reads a PID field from an information file
+///
+/// @return the PID, or zero if the field is missing
+static pid_t pid_field (
+    const struct process_info *info, ///<the fields to read from>
+    const char *key ///<the field name>
+    ) {
+    const char *value = process_info_get (info, key);
+    return value ? (pid_t)strtol (value, NULL, 10) : 0;
+}
+
+/// @brief Generates the path to a hidden file for the process identifier
+///
+/// The start lock, with the suffix `.start`, is held by a `start` operation
+/// from checking for the process until it has been recorded, and any cores
+/// it reserved are listed until then in the file with the suffix `.cores`.
+/// They are hidden files at the top of the data directory,
+/// `.<em>scope</em>-<em>identifier</em><em>suffix</em>`, so that they are
+/// ignored by the housekeeping routine.
+///
+/// The caller must free the allocated string.
+///
+/// @return the generated path
+static char *get_hidden_path (
+    const char *suffix ///<the suffix identifying the file>
+    ) {
+    char *info_path = get_process_path (0);
+    char *scope = info_path + strlen (PARAM (data_dir)) + 1;
+    size_t buffer_len = strlen (info_path) + strlen (suffix) + 2;
+    char *path = (char*)malloc (buffer_len);
+    if (!path) abort ();
+    *strchr (scope, '/') = '-';
+    snprintf (path, buffer_len, "%s/.%s%s", PARAM (data_dir), scope, suffix);
+    free (info_path);
+    return path;
+}
+
+/// @brief Obtains the start lock for the process identifier
+///
+/// Concurrent `start` operations for the same identifier are serialised by
+/// the lock, so that only the first spawns the process. The others block in
+/// flock until it has been recorded; they then find it running.
+///
+/// The lock file is deleted when it is released, so having claimed the lock
+/// the file is checked to still be the one at the path; if not, the lock is
+/// claimed again on a new file.
+///
+/// The caller must use process_unlock_start() to release the lock.
+///
+/// @return the locked file descriptor, or -1 if the lock couldn't be obtained
+int process_lock_start (
+    int *waited ///<set to non-zero if another caller held the lock>
+    ) {
+    double phase = timing_now ();
+    char *path = get_hidden_path (".start");
+    struct stat locked, current;
+    int fd;
+    *waited = 0;
+    do {
+        fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            if (errno != ENOENT) break;
+            create_path (path);
+            fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd < 0) break;
+        }
+        if (flock (fd, LOCK_EX | LOCK_NB)) {
+            if (PARAM (verbose) && !*waited) fprintf (stdout, "Waiting for concurrent start at %s\n", path);
+            *waited = 1;
+            while (flock (fd, LOCK_EX) && (errno == EINTR));
+        }
+        if (!fstat (fd, &locked) && !stat (path, &current)
+         && (locked.st_dev == current.st_dev) && (locked.st_ino == current.st_ino)) break;
+        close (fd);
+    } while (1);
+    free (path);
+    timing_record ("start_wait", phase);
+    return fd;
+}
+
+/// @brief Releases the start lock for the process identifier
+///
+/// See the description for process_lock_start() for details.
+void process_unlock_start (
+    int fd ///<the locked file descriptor>
+    ) {
+    char *path = get_hidden_path (".start");
+    // Deleted while still locked, so a caller blocked on it will try again
+    unlink (path);
+    free (path);
+    close (fd);
+}
+
+/// @brief Adds the CPUs recorded in a file to a mask
+static void add_cpus (
+    const struct process_info *info, ///<the fields read from the file>
+    unsigned long *mask ///<the mask, of PLACEMENT_WORDS words>
+    ) {
+    const char *cpus = process_info_get (info, "cpus");
+    unsigned long add[PLACEMENT_WORDS];
+    size_t w;
+    if (!cpus || placement_list (cpus, add)) return;
+    for (w = 0; w < PLACEMENT_WORDS; w++) {
+        mask[w] |= add[w];
+    }
+}
+
+/// @brief Adds the CPUs held by processes given dedicated cores to a mask
+///
+/// A process given cores by the `A` parameter records them as `cpus`, with
+/// the number as `cores`. It holds them until it terminates, or while its
+/// watchdog waits to restart it, so that the cores are released once the
+/// termination is recorded or the file is deleted by housekeeping. Every
+/// scope is searched, as the cores are shared by every process on the
+/// machine. A reservation by a `start` operation that is still running is
+/// also held; one left by an operation that failed to delete it is deleted.
+///
+/// The caller must hold the data_dir lock.
+static void add_held_cores (
+    const char *own, ///<the reservation of the calling operation, which is skipped>
+    unsigned long *mask ///<the mask, of PLACEMENT_WORDS words>
+    ) {
+    struct dirent *ent, *subent;
+    struct process_info *info;
+    DIR *dir, *subdir;
+    char *path, *subpath;
+    size_t len, size;
+    dir = opendir (PARAM (data_dir));
+    if (!dir) return;
+    while ((ent = readdir (dir)) != NULL) {
+        size = strlen (PARAM (data_dir)) + strlen (ent->d_name) + 2;
+        path = (char*)malloc (size);
+        if (!path) abort ();
+        snprintf (path, size, "%s/%s", PARAM (data_dir), ent->d_name);
+        len = strlen (ent->d_name);
+        if (ent->d_name[0] == '.') {
+            if ((len > 6) && !strcmp (ent->d_name + len - 6, ".cores") && strcmp (path, own)) {
+                info = process_info_read (path);
+                if ((pid_field (info, "pid") > 0) && _is_running (pid_field (info, "pid"))) {
+                    add_cpus (info, mask);
+                } else {
+                    if (PARAM (verbose)) fprintf (stdout, "Deleting %s - invalid\n", path);
+                    unlink (path);
                 }
+                process_info_free (info);
             }
-            if (cmd) {
-                if (!verify_pid (cmd, pid)) {
-                    if (verbose) fprintf (stdout, "Found PID %u but it's invalid or command line is incorrect\n", pid);
-                    pid = 0;
+        } else if ((subdir = opendir (path)) != NULL) {
+            while ((subent = readdir (subdir)) != NULL) {
+                if (subent->d_name[0] == '.') continue;
+                size = strlen (path) + strlen (subent->d_name) + 2;
+                subpath = (char*)malloc (size);
+                if (!subpath) abort ();
+                snprintf (subpath, size, "%s/%s", path, subent->d_name);
+                info = process_info_read (subpath);
+                if (process_info_get (info, "cores") && !process_info_get (info, "end") && keep_info (info)) {
+                    add_cpus (info, mask);
                 }
-                free (cmd);
+                process_info_free (info);
+                free (subpath);
             }
-            free (tmp);
+            closedir (subdir);
         }
-        fclose (info);
+        free (path);
+    }
+    closedir (dir);
+}
+
+/// @brief Reserves dedicated cores for the controlled process
+///
+/// The cores held by other processes, and any CPUs this one cannot run on,
+/// are excluded and the rest chosen from by placement_allocate(). The
+/// choice is written to a reservation file while still holding the data_dir
+/// lock, so that a concurrent `start` operation cannot choose the same
+/// cores before the process is recorded with them by process_save(). The
+/// reservation must then be deleted with process_unreserve_cores().
+///
+/// The caller must free the list of CPUs.
+///
+/// @return zero if successful, EBUSY if there are not enough free cores,
+///         otherwise a non-zero error code
+int process_reserve_cores (
+    int count, ///<the number of cores>
+    char **cpus ///<receives the list of CPUs reserved>
+    ) {
+    unsigned long mask[PLACEMENT_WORDS], held[PLACEMENT_WORDS];
+    struct process_info *info = NULL;
+    char *path = get_hidden_path (".cores");
+    char tmp[32];
+    int result;
+    *cpus = (char*)malloc (PLACEMENT_LIST);
+    if (!*cpus) abort ();
+    memset (held, 0, sizeof (held));
+    placement_unavailable (held);
+    lock_data_dir ();
+    add_held_cores (path, held);
+    result = placement_allocate (count, held, mask);
+    if (!result) result = placement_format (mask, *cpus, PLACEMENT_LIST);
+    if (!result) {
+        snprintf (tmp, sizeof (tmp), "%u", getpid ());
+        info = process_info_set (info, "pid", tmp);
+        info = process_info_set (info, "cpus", *cpus);
+        if (PARAM (verbose)) fprintf (stdout, "Reserving CPUs %s in %s\n", *cpus, path);
+        result = process_info_write (path, info);
     }
     unlock_data_dir ();
+    if (result) {
+        free (*cpus);
+        *cpus = NULL;
+    }
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+/// @brief Deletes the reservation made by process_reserve_cores()
+///
+/// The cores remain held by the process if it was recorded with them.
+void process_unreserve_cores () {
+    char *path = get_hidden_path (".cores");
+    unlink (path);
     free (path);
-    return _WIN32_OR_POSIX (OpenProcess (PROCESS_QUERY_INFORMATION | PROCESS_TERMINATE | SYNCHRONIZE, FALSE, pid), pid);
+}
+
+#endif /* ifndef _WIN32 */
+
+/// @brief Joins the spawn arguments into the command line recorded in a file
+///
+/// The caller must free the allocated string.
+///
+/// @return the command line, or NULL if memory could not be allocated
+static char *spawn_command () {
+    char *cmd;
+    size_t size = 1;
+    int i;
+    for (i = 0; i < PARAM (spawn_argc); i++) {
+        size += strlen (PARAM (spawn_argv)[i]) + 1;
+    }
+    cmd = (char*)malloc (size);
+    if (!cmd) return NULL;
+    *cmd = 0;
+    for (i = 0; i < PARAM (spawn_argc); i++) {
+        if (i) strcat (cmd, " ");
+        strcat (cmd, PARAM (spawn_argv)[i]);
+    }
+    return cmd;
 }
 
 /// @brief Writes an information file for the controlled process
 ///
 /// A process information file is written, overwriting any that already
-/// exists for the controlled process.
+/// exists for the controlled process. If there was one then the `restarts`
+/// count it held is carried over and incremented.
+///
+/// A shared process records the parent as its first leaseholder. A member of
+/// a pool records the pool name, and if it has a health check then a
+/// `pending` health state until the first check has run. A process with an
+/// idle timeout records it as `idle-timeout`, and one placed by the `a` or
+/// `m` parameters records the CPUs as `cpus` and the policy as `mempolicy`.
+/// One given dedicated cores by the `A` parameter also records the number
+/// of them as `cores`. A priority given by the `y`, `S` or `j` parameters is
+/// recorded as `nice`, `sched` or `ioprio`.
 ///
 /// @return zero if successful, otherwise a non-zero error code
 int process_save (
-    _WIN32_OR_POSIX (HANDLE, pid_t) process ///<the controlled process>
+    _WIN32_OR_POSIX (HANDLE, pid_t) process, ///<the controlled process>
+    _WIN32_OR_POSIX (DWORD, pid_t) watchdog ///<the watchdog process supervising it, or zero if none>
     ) {
     char *path;
-    FILE *info;
+    char *cmd;
+    char tmp[32];
+    struct process_info *info = NULL, *previous;
     int result;
+    cmd = spawn_command ();
+    if (!cmd) return _WIN32_OR_POSIX (ERROR_OUTOFMEMORY, ENOMEM);
+    snprintf (tmp, sizeof (tmp), "%u", _WIN32_OR_POSIX (GetProcessId (process), process));
+    info = process_info_set (info, "pid", tmp);
+    info = process_info_set (info, "sid", PARAM (process_identifier));
+    snprintf (tmp, sizeof (tmp), "%u", _WIN32_OR_POSIX (GetProcessId (PARAM (parent_process)), PARAM (parent_process)));
+    info = process_info_set (info, "ppid", tmp);
+    info = process_info_set (info, "cmd", cmd);
+    free (cmd);
+    if (watchdog) {
+        snprintf (tmp, sizeof (tmp), "%u", watchdog);
+        info = process_info_set (info, "wdog", tmp);
+    }
+    timestamp (tmp, sizeof (tmp));
+    info = process_info_set (info, "start", tmp);
+    if (PARAM (shared_lease)) {
+        snprintf (tmp, sizeof (tmp), "%u", PARAM (parent_process));
+        info = process_info_set (info, "leases", tmp);
+    }
+    if (PARAM (idle_timeout)) {
+        snprintf (tmp, sizeof (tmp), "%d", PARAM (idle_timeout));
+        info = process_info_set (info, "idle-timeout", tmp);
+    }
+    if (PARAM (cpu_affinity)) info = process_info_set (info, "cpus", PARAM (cpu_affinity));
+    if (PARAM (core_count)) {
+        snprintf (tmp, sizeof (tmp), "%d", PARAM (core_count));
+        info = process_info_set (info, "cores", tmp);
+    }
+    if (PARAM (nice_value)) info = process_info_set (info, "nice", PARAM (nice_value));
+    if (PARAM (sched_policy)) info = process_info_set (info, "sched", PARAM (sched_policy));
+    if (PARAM (io_priority)) info = process_info_set (info, "ioprio", PARAM (io_priority));
+    if (PARAM (memory_policy)) info = process_info_set (info, "mempolicy", PARAM (memory_policy));
+    if (PARAM (pool_member)) {
+        info = process_info_set (info, "pool", PARAM (pool_name));
+        if (PARAM (health_probe)) info = process_info_set (info, "health", "pending");
+    }
     lock_data_dir ();
     path = get_process_path (1);
-    if (verbose) fprintf (stdout, "Writing state to %s\n", path);
-    info = fopen (path, "wt");
-    if (info) {
-        int i;
-        fprintf (info, "pid: %u\n", _WIN32_OR_POSIX (GetProcessId (process), process));
-        fprintf (info, "sid: %s\n", process_identifier);
-        fprintf (info, "ppid: %u\n", _WIN32_OR_POSIX (GetProcessId (parent_process), parent_process));
-        fprintf (info, "cmd:");
-        for (i = 0; i < spawn_argc; i++) {
-            fprintf (info, " %s", spawn_argv[i]);
-        }
-        fprintf (info, "\n");
-        fclose (info);
+    // Count the restarts if a previous process had the identifier
+    previous = process_info_read (path);
+    if (previous) {
+        const char *restarts = process_info_get (previous, "restarts");
+        snprintf (tmp, sizeof (tmp), "%d", (restarts ? atoi (restarts) : 0) + 1);
+        info = process_info_set (info, "restarts", tmp);
+        process_info_free (previous);
+    }
+    if (PARAM (verbose)) fprintf (stdout, "Writing state to %s\n", path);
+    result = process_info_write (path, info);
+    unlock_data_dir ();
+    free (path);
+    process_info_free (info);
+    return result;
+}
+
+/// @brief Updates a field in the information file for the controlled process
+///
+/// The file is not updated if it no longer describes the process; for
+/// example if another process has since been started with the same
+/// identifier.
+///
+/// @return zero if successful, ESRCH/ERROR_NOT_FOUND if the file does not
+///         describe the process, otherwise a non-zero error code
+int process_update (
+    _WIN32_OR_POSIX (DWORD, pid_t) process, ///<the controlled process>
+    const char *key, ///<the field name>
+    const char *value ///<the field value, or NULL for the current time>
+    ) {
+    char *path;
+    char tmp[32];
+    struct process_info *info;
+    const char *pid;
+    int result;
+    if (!value) {
+        timestamp (tmp, sizeof (tmp));
+        value = tmp;
+    }
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    pid = process_info_get (info, "pid");
+    if (pid && ((_WIN32_OR_POSIX (DWORD, pid_t))strtol (pid, NULL, 10) == process)) {
+        if (PARAM (verbose)) fprintf (stdout, "Setting %s of %u in %s\n", key, process, path);
+        info = process_info_set (info, key, value);
+        result = process_info_write (path, info);
+    } else {
+        result = _WIN32_OR_POSIX (ERROR_NOT_FOUND, ESRCH);
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+#ifndef _WIN32
+
+/// @brief Formats a `struct timeval` for an information file
+static void format_timeval (
+    char *buffer, ///<the buffer to write into>
+    size_t size, ///<the size of the buffer>
+    const struct timeval *tv ///<the time to format>
+    ) {
+    snprintf (buffer, size, "%ld.%06ld", (long)tv->tv_sec, (long)tv->tv_usec);
+}
+
+/// @brief Records the termination of the controlled process
+///
+/// The exit code or terminating signal, the end time and the resource usage
+/// of the process are added to its information file. This is called by the
+/// watchdog after it has reaped the child.
+///
+/// The file is not updated if it no longer describes the process; for
+/// example if another process has since been started with the same
+/// identifier.
+///
+/// @return zero if successful, otherwise a non-zero error code
+int process_exited (
+    pid_t process, ///<the terminated process>
+    int status, ///<the status reported by `wait4`>
+    const struct rusage *usage ///<the resource usage reported by `wait4`, or NULL if not known>
+    ) {
+    char *path;
+    char tmp[32];
+    struct process_info *info;
+    const char *pid;
+    int result;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    pid = process_info_get (info, "pid");
+    if (pid && ((pid_t)strtol (pid, NULL, 10) == process)) {
+        if (WIFSIGNALED (status)) {
+            snprintf (tmp, sizeof (tmp), "%d", WTERMSIG (status));
+            info = process_info_set (info, "signal", tmp);
+        } else {
+            snprintf (tmp, sizeof (tmp), "%d", WEXITSTATUS (status));
+            info = process_info_set (info, "exit", tmp);
+        }
+        timestamp (tmp, sizeof (tmp));
+        info = process_info_set (info, "end", tmp);
+        if (usage) {
+            format_timeval (tmp, sizeof (tmp), &usage->ru_utime);
+            info = process_info_set (info, "utime", tmp);
+            format_timeval (tmp, sizeof (tmp), &usage->ru_stime);
+            info = process_info_set (info, "stime", tmp);
+            snprintf (tmp, sizeof (tmp), "%ld", usage->ru_maxrss);
+            info = process_info_set (info, "maxrss", tmp);
+        }
+        if (PARAM (verbose)) fprintf (stdout, "Recording termination of %u in %s\n", process, path);
+        result = process_info_write (path, info);
+    } else {
+        if (PARAM (verbose)) fprintf (stdout, "Not recording termination of %u; %s has changed\n", process, path);
+        result = ESRCH;
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+/// @brief Records the result of a health check of the controlled process
+///
+/// The health state, the time the check took and the number of consecutive
+/// failed checks are written to the information file.
+///
+/// The file is not updated if it no longer describes the process.
+///
+/// @return zero if successful, ESRCH if the file does not describe the
+///         process or another non-zero error code
+int process_health (
+    pid_t process, ///<the checked process>
+    const char *state, ///<the health state; `starting`, `ok`, `failing` or `unhealthy`>
+    double latency, ///<the time the check took, in seconds>
+    int failures ///<the number of consecutive failed checks>
+    ) {
+    char *path;
+    char tmp[32];
+    struct process_info *info;
+    const char *pid;
+    int result;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    pid = process_info_get (info, "pid");
+    if (pid && ((pid_t)strtol (pid, NULL, 10) == process)) {
+        info = process_info_set (info, "health", state);
+        snprintf (tmp, sizeof (tmp), "%.6f", latency);
+        info = process_info_set (info, "latency", tmp);
+        snprintf (tmp, sizeof (tmp), "%d", failures);
+        info = process_info_set (info, "failures", tmp);
+        result = process_info_write (path, info);
+    } else {
+        result = ESRCH;
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+/// @brief Records that the watchdog has restarted the controlled process
+///
+/// The information file is rewritten to describe the new process, with the
+/// `restarts` count incremented and the fields recording the previous run
+/// removed. Readers see either the previous or the new content.
+///
+/// The file is not updated if it no longer describes the previous process,
+/// or if it has been stopped while waiting to be restarted.
+///
+/// @return zero if successful, ESRCH if the file does not describe the
+///         process, ECANCELED if it has been stopped or another non-zero
+///         error code
+int process_restarted (
+    pid_t previous, ///<the terminated process>
+    pid_t process ///<the process started in its place>
+    ) {
+    static const char *_previous_run[] = { "ready", "restart", "exit", "signal", "end", "utime", "stime", "maxrss", "health", "latency", "failures", NULL };
+    char *path;
+    char tmp[32];
+    struct process_info *info;
+    const char *value;
+    int i, result;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    value = process_info_get (info, "pid");
+    if (!value || ((pid_t)strtol (value, NULL, 10) != previous)) {
+        result = ESRCH;
+    } else if (process_info_get (info, "stop") || process_info_get (info, "watchdog")) {
+        result = ECANCELED;
+    } else {
+        snprintf (tmp, sizeof (tmp), "%u", process);
+        info = process_info_set (info, "pid", tmp);
+        timestamp (tmp, sizeof (tmp));
+        info = process_info_set (info, "start", tmp);
+        value = process_info_get (info, "restarts");
+        snprintf (tmp, sizeof (tmp), "%d", (value ? atoi (value) : 0) + 1);
+        info = process_info_set (info, "restarts", tmp);
+        for (i = 0; _previous_run[i]; i++) {
+            info = process_info_remove (info, _previous_run[i]);
+        }
+        if (PARAM (verbose)) fprintf (stdout, "Recording restart of %u as %u in %s\n", previous, process, path);
+        result = process_info_write (path, info);
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+/// @brief Records the activation of a socket activated process
+///
+/// Until the first connection the watchdog is recorded in place of the
+/// child, with `activation` pending. The child spawned for the connection
+/// replaces it, and the time is recorded as `activated`.
+///
+/// @return zero if successful, ESRCH if the file does not describe the
+///         watchdog waiting for activation, ECANCELED if it is being stopped,
+///         otherwise a non-zero error code
+int process_activated (
+    pid_t watchdog, ///<the watchdog standing in for the child>
+    pid_t process ///<the child spawned>
+    ) {
+    char *path;
+    char tmp[32];
+    struct process_info *info;
+    const char *value;
+    int result;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    value = process_info_get (info, "pid");
+    if (!value || ((pid_t)strtol (value, NULL, 10) != watchdog) || !process_info_get (info, "activation")) {
+        result = ESRCH;
+    } else if (process_info_get (info, "stop") || process_info_get (info, "watchdog")) {
+        result = ECANCELED;
+    } else {
+        snprintf (tmp, sizeof (tmp), "%u", process);
+        info = process_info_set (info, "pid", tmp);
+        timestamp (tmp, sizeof (tmp));
+        info = process_info_set (info, "activated", tmp);
+        info = process_info_remove (info, "activation");
+        info = process_info_remove (info, "ready");
+        if (PARAM (verbose)) fprintf (stdout, "Recording activation of %u in %s\n", process, path);
+        result = process_info_write (path, info);
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+/// @brief Tests if an information file records a terminated process
+///
+/// @return non-zero if the exit status is recorded, zero otherwise
+static int has_exited (
+    const struct process_info *info ///<the fields to test>
+    ) {
+    return process_info_get (info, "exit") || process_info_get (info, "signal");
+}
+
+/// @brief Reads the information file, holding the data_dir lock
+///
+/// @return the fields, or NULL if there is no information file
+static struct process_info *read_locked (
+    const char *path ///<the information file to read>
+    ) {
+    struct process_info *info;
+    lock_data_dir ();
+    info = process_info_read (path);
+    unlock_data_dir ();
+    return info;
+}
+
+/// @brief Rewrites the `leases` field of a shared process
+///
+/// The field lists the PIDs of the leaseholders, separated by spaces. Those
+/// that have terminated are removed as well as the one released, if any.
+///
+/// @return the updated fields
+static struct process_info *update_leases (
+    struct process_info *info, ///<the fields to update>
+    pid_t add, ///<a leaseholder to add, or zero for none>
+    pid_t release, ///<a leaseholder to remove, or zero for none>
+    int *count, ///<receives the number of leaseholders>
+    pid_t *first ///<receives the first leaseholder, or zero if there are none>
+    ) {
+    const char *value = process_info_get (info, "leases");
+    char *leases, *end;
+    size_t size = (value ? strlen (value) : 0) + 16, len = 0;
+    pid_t holder;
+    leases = (char*)malloc (size);
+    if (!leases) abort ();
+    *leases = 0;
+    *count = 0;
+    *first = 0;
+    while (value && *value) {
+        holder = (pid_t)strtol (value, &end, 10);
+        if (end == value) break;
+        value = end;
+        if ((holder <= 0) || (holder == add) || (holder == release) || !_is_running (holder)) continue;
+        len += snprintf (leases + len, size - len, *count ? " %u" : "%u", holder);
+        if (!(*count)++) *first = holder;
+    }
+    if (add) {
+        snprintf (leases + len, size - len, *count ? " %u" : "%u", add);
+        if (!(*count)++) *first = add;
+    }
+    info = *count ? process_info_set (info, "leases", leases) : process_info_remove (info, "leases");
+    free (leases);
+    return info;
+}
+
+/// @brief Adds a leaseholder to a shared process that is already running
+///
+/// Only a process started as shared, whose watchdog follows its leases, can
+/// be leased.
+///
+/// @return zero if successful, ESRCH if the file does not describe a shared
+///         process or it is being stopped, otherwise a non-zero error code
+int process_lease (
+    pid_t process, ///<the shared process>
+    pid_t holder ///<the new leaseholder>
+    ) {
+    struct process_info *info;
+    char *path;
+    pid_t first;
+    int count, result = ESRCH;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    if ((pid_field (info, "pid") == process) && process_info_get (info, "leases") && !has_exited (info)
+     && !process_info_get (info, "stop") && !process_info_get (info, "watchdog")) {
+        info = update_leases (info, holder, 0, &count, &first);
+        if (PARAM (verbose)) fprintf (stdout, "Leasing %u to %u in %s, %d leaseholders\n", process, holder, path, count);
+        result = process_info_write (path, info);
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+/// @brief Marks a handover to a new instance as requested from the watchdog
+///
+/// The test for a restart already in progress and the update are made under
+/// the one lock, so that of concurrent `restart` operations only one
+/// requests the handover.
+///
+/// @return zero if successful, EBUSY if a handover is already requested or
+///         in progress, ESRCH if the file does not describe the process or
+///         it has terminated, otherwise a non-zero error code
+int process_request_handover (
+    pid_t process ///<the process to replace>
+    ) {
+    struct process_info *info;
+    const char *handover;
+    char *path;
+    int result = ESRCH;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    handover = process_info_get (info, "handover");
+    if ((pid_field (info, "pid") != process) || process_info_get (info, "end")) {
+        result = ESRCH;
+    } else if (process_info_get (info, "next") || process_info_get (info, "previous")
+            || (handover && !strcmp (handover, "requested"))) {
+        result = EBUSY;
+    } else {
+        if (PARAM (verbose)) fprintf (stdout, "Requesting handover of %u in %s\n", process, path);
+        info = process_info_set (info, "handover", "requested");
+        result = process_info_write (path, info);
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+/// @brief Releases the lease of a shared process held by a parent
+///
+/// If no leaseholders remain then the process is marked as stopped in the
+/// same update, so that it can no longer be leased by the `start` operation
+/// while the `stop` operation kills it. A process that is not shared is left
+/// unchanged, with no other leaseholders.
+///
+/// @return zero if successful, ESRCH if the file does not describe the
+///         process, otherwise a non-zero error code
+int process_release (
+    pid_t process, ///<the shared process>
+    pid_t holder, ///<the leaseholder>
+    int *remaining ///<receives the number of other leaseholders>
+    ) {
+    struct process_info *info;
+    char *path;
+    char tmp[32];
+    pid_t first;
+    int result = ESRCH;
+    *remaining = 0;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    if ((pid_field (info, "pid") == process) && !process_info_get (info, "leases")) {
         result = 0;
+    } else if (pid_field (info, "pid") == process) {
+        info = update_leases (info, 0, holder, remaining, &first);
+        if (!*remaining) {
+            timestamp (tmp, sizeof (tmp));
+            info = process_info_set (info, "stop", tmp);
+        }
+        if (PARAM (verbose)) fprintf (stdout, "Releasing lease of %u by %u in %s, %d leaseholders\n", process, holder, path, *remaining);
+        result = process_info_write (path, info);
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+/// @brief Finds the leaseholder for the watchdog of a shared process to watch
+///
+/// Leaseholders that have terminated are removed. If none remain then the
+/// process is marked as killed by the watchdog in the same update, so that it
+/// can no longer be leased by the `start` operation.
+///
+/// @return the first remaining leaseholder, or zero if there are none
+pid_t process_leaseholder (
+    pid_t process ///<the shared process>
+    ) {
+    struct process_info *info;
+    char *path;
+    char tmp[32];
+    pid_t first = 0;
+    int count;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    if (pid_field (info, "pid") == process) {
+        info = update_leases (info, 0, 0, &count, &first);
+        if (!count) {
+            timestamp (tmp, sizeof (tmp));
+            info = process_info_set (info, "watchdog", tmp);
+        }
+        process_info_write (path, info);
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return first;
+}
+
+/// @brief Records a use of the controlled process
+///
+/// A process started with an idle timeout by the `I` parameter is stopped by
+/// its watchdog once it hasn't been used for that long. The `start` and
+/// `query` operations call this each time they find the process, and the
+/// watchdog checks the recorded time with process_idle() when its timer
+/// expires, so nothing needs to signal the watchdog.
+///
+/// @return zero if successful, ESRCH if the file does not describe a process
+///         with an idle timeout, otherwise a non-zero error code
+int process_touch (
+    pid_t process ///<the controlled process>
+    ) {
+    struct process_info *info;
+    char *path;
+    char tmp[32];
+    int result = ESRCH;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    if ((pid_field (info, "pid") == process) && process_info_get (info, "idle-timeout") && !has_exited (info)) {
+        timestamp (tmp, sizeof (tmp));
+        info = process_info_set (info, "used", tmp);
+        result = process_info_write (path, info);
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+/// @brief Tests if the controlled process has been idle for its timeout
+///
+/// The process is idle if it has not been used, as recorded by
+/// process_touch(), for the number of seconds given by the `I` parameter and
+/// no leaseholder of a shared process is running. An idle process is marked
+/// as stopped in the same update, so that it is neither leased nor restarted
+/// while the watchdog kills it, and the time recorded as `idle`.
+///
+/// @return zero if the process is idle, EAGAIN if it is not, ESRCH if the
+///         file does not describe the process or it is being stopped,
+///         otherwise a non-zero error code
+int process_idle (
+    pid_t process, ///<the controlled process>
+    int *remaining ///<receives the time in milliseconds until it could next be idle>
+    ) {
+    struct process_info *info;
+    struct timeval now;
+    const char *used;
+    char *path;
+    char tmp[32];
+    pid_t first;
+    double elapsed;
+    int count = 0, result = ESRCH;
+    *remaining = PARAM (idle_timeout) * 1000;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    if ((pid_field (info, "pid") == process) && !has_exited (info)
+     && !process_info_get (info, "stop") && !process_info_get (info, "watchdog")) {
+        used = process_info_get (info, "used");
+        if (!used) used = process_info_get (info, "start");
+        gettimeofday (&now, NULL);
+        elapsed = (now.tv_sec + now.tv_usec / 1e6) - (used ? strtod (used, NULL) : 0.0);
+        if (process_info_get (info, "leases")) info = update_leases (info, 0, 0, &count, &first);
+        if (count) {
+            // Leased, so in use for at least another timeout
+            result = EAGAIN;
+        } else if (elapsed < PARAM (idle_timeout)) {
+            *remaining = (int)((PARAM (idle_timeout) - elapsed) * 1000) + 1;
+            result = EAGAIN;
+        } else {
+            if (PARAM (verbose)) fprintf (stdout, "Process %u in %s unused for %.0fs\n", process, path, elapsed);
+            timestamp (tmp, sizeof (tmp));
+            info = process_info_set (info, "stop", tmp);
+            info = process_info_set (info, "idle", tmp);
+            result = process_info_write (path, info);
+        }
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+/// @brief Deletes the information file of a process stopped for being idle
+///
+/// The file is only deleted if it still describes the process and it was
+/// stopped by process_idle(), so that a process started again with the same
+/// identifier in the meantime is unaffected.
+///
+/// @return zero if successful, ESRCH if the file does not describe the
+///         process or it was not idle, otherwise a non-zero error code
+int process_forget (
+    pid_t process ///<the terminated process>
+    ) {
+    struct process_info *info;
+    char *path;
+    int result = ESRCH;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    if ((pid_field (info, "pid") == process) && process_info_get (info, "idle")) {
+        if (PARAM (verbose)) fprintf (stdout, "Deleting %s\n", path);
+        result = unlink (path) ? errno : 0;
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+/// @brief Tests if a pool member can be claimed
+///
+/// The member must be ready, healthy if it has a health check, not waiting
+/// to be restarted or already claimed, and running the same command line as
+/// the `start` operation claiming it.
+///
+/// @return non-zero if the member can be claimed, zero otherwise
+static int is_claimable (
+    const struct process_info *info, ///<the fields read from the member's file>
+    const char *pool, ///<the pool name>
+    const char *cmd ///<the command line of the `start` operation>
+    ) {
+    const char *value = process_info_get (info, "pool");
+    if (!value || strcmp (value, pool)) return 0;
+    if (!process_info_get (info, "ready")
+     || process_info_get (info, "restart")
+     || process_info_get (info, "stop")
+     || process_info_get (info, "claim-sid")
+     || has_exited (info)) return 0;
+    value = process_info_get (info, "health");
+    if (value && strcmp (value, "ok")) return 0;
+    value = process_info_get (info, "cmd");
+    return value && !strcmp (value, cmd) && verify_pid (cmd, pid_field (info, "pid"));
+}
+
+/// @brief Claims a ready member of a pool as the controlled process
+///
+/// The global scope folder is searched for a member that can be claimed.
+/// Its fields are written to the information file for the controlled process,
+/// without the pool name and with the time it was claimed, and the member's
+/// own file is marked with the identifier it was claimed by. Both are written
+/// while holding the data_dir lock, so a member is only ever claimed once.
+/// The member's watchdog is then signalled with SIGUSR1 to follow the claim
+/// with process_claimed().
+///
+/// @return zero if a member was claimed, EAGAIN if none was ready, otherwise
+///         a non-zero error code
+int process_claim (
+    const char *pool, ///<the pool name>
+    pid_t *process ///<receives the PID of the claimed member>
+    ) {
+    struct process_info *info = NULL, *member = NULL;
+    struct dirent *ent;
+    char *dirpath, *path = NULL, *cmd;
+    char tmp[32];
+    size_t size;
+    DIR *dir;
+    pid_t wdog = 0;
+    int result = EAGAIN;
+    cmd = spawn_command ();
+    if (!cmd) return ENOMEM;
+    size = strlen (PARAM (data_dir)) + 8;
+    dirpath = (char*)malloc (size);
+    if (!dirpath) abort ();
+    snprintf (dirpath, size, "%s/GLOBAL", PARAM (data_dir));
+    lock_data_dir ();
+    dir = opendir (dirpath);
+    if (dir) {
+        while ((ent = readdir (dir)) != NULL) {
+            if (ent->d_name[0] == '.') continue;
+            size = strlen (dirpath) + strlen (ent->d_name) + 2;
+            path = (char*)malloc (size);
+            if (!path) abort ();
+            snprintf (path, size, "%s/%s", dirpath, ent->d_name);
+            member = process_info_read (path);
+            if (is_claimable (member, pool, cmd)) break;
+            process_info_free (member);
+            member = NULL;
+            free (path);
+            path = NULL;
+        }
+        closedir (dir);
+    }
+    if (member) {
+        char *target = get_process_path (1);
+        *process = pid_field (member, "pid");
+        wdog = pid_field (member, "wdog");
+        // The controlled process takes over the member's fields
+        info = process_info_read (path);
+        info = process_info_set (info, "sid", PARAM (process_identifier));
+        snprintf (tmp, sizeof (tmp), "%u", PARAM (parent_process));
+        info = process_info_set (info, "ppid", tmp);
+        info = process_info_remove (info, "pool");
+        timestamp (tmp, sizeof (tmp));
+        info = process_info_set (info, "claimed", tmp);
+        if (PARAM (verbose)) fprintf (stdout, "Claiming %u from %s as %s\n", *process, path, target);
+        result = process_info_write (target, info);
+        if (!result) {
+            // The member's file is kept until its watchdog follows the claim
+            member = process_info_set (member, "claim-sid", PARAM (process_identifier));
+            snprintf (tmp, sizeof (tmp), "%u", PARAM (parent_process));
+            member = process_info_set (member, "claim-ppid", tmp);
+            member = process_info_set (member, "claim-global", PARAM (global_identifier) ? "1" : "0");
+            member = process_info_set (member, "claim-watch", PARAM (watch_parent) ? "1" : "0");
+            result = process_info_write (path, member);
+            if (result) unlink (target);
+        }
+        free (target);
+    }
+    unlock_data_dir ();
+    if (!result && wdog) procfs_signal (wdog, SIGUSR1);
+    process_info_free (info);
+    process_info_free (member);
+    free (path);
+    free (dirpath);
+    free (cmd);
+    return result;
+}
+
+/// @brief Follows the claim of the pool member supervised by this watchdog
+///
+/// If the member's information file records that it was claimed then the
+/// context of the calling thread is changed to the identifier, scope and
+/// parent process it was claimed for, so the watchdog updates the claimed
+/// information file from now on, and the member's file is deleted.
+///
+/// @return zero if the member was claimed, ESRCH if it was not, otherwise a
+///         non-zero error code
+int process_claimed (
+    pid_t process ///<the member process>
+    ) {
+    struct process_info *info;
+    const char *sid, *value;
+    char *path;
+    int result;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    sid = process_info_get (info, "claim-sid");
+    if (sid && (pid_field (info, "pid") == process)) {
+        free ((char*)PARAM (process_identifier));
+        PARAM (process_identifier) = strdup (sid);
+        if (!PARAM (process_identifier)) abort ();
+        PARAM (parent_process) = pid_field (info, "claim-ppid");
+        value = process_info_get (info, "claim-global");
+        PARAM (global_identifier) = value && atoi (value);
+        value = process_info_get (info, "claim-watch");
+        PARAM (watch_parent) = value && atoi (value);
+        PARAM (pool_member) = 0;
+        if (PARAM (verbose)) fprintf (stdout, "Process %u claimed as %s\n", process, PARAM (process_identifier));
+        result = unlink (path) ? errno : 0;
     } else {
-        result = errno;
+        result = ESRCH;
     }
     unlock_data_dir ();
+    process_info_free (info);
     free (path);
     return result;
 }
+
+/// @brief Records a replacement of the controlled process as ready
+///
+/// This is called by the watchdog during a handover for the `restart`
+/// operation. The new process, recorded as `next` while it started, replaces
+/// the old one, which is recorded as `previous` until it has been stopped.
+/// The fields from the previous run are removed as for process_restarted(),
+/// but the new process is recorded as already `ready`.
+///
+/// @return zero if successful, ESRCH if the file does not describe the old
+///         process, ECANCELED if it is being stopped, otherwise a non-zero
+///         error code
+int process_handover (
+    pid_t previous, ///<the process being replaced>
+    pid_t process ///<the process replacing it>
+    ) {
+    static const char *_previous_run[] = { "next", "handover", "restart", "exit", "signal", "end", "utime", "stime", "maxrss", "health", "latency", "failures", NULL };
+    char *path;
+    char tmp[32];
+    struct process_info *info;
+    const char *value;
+    int i, result;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    if ((pid_field (info, "pid") != previous) || (pid_field (info, "next") != process)) {
+        result = ESRCH;
+    } else if (process_info_get (info, "stop") || process_info_get (info, "watchdog")) {
+        result = ECANCELED;
+    } else {
+        snprintf (tmp, sizeof (tmp), "%u", process);
+        info = process_info_set (info, "pid", tmp);
+        snprintf (tmp, sizeof (tmp), "%u", previous);
+        info = process_info_set (info, "previous", tmp);
+        timestamp (tmp, sizeof (tmp));
+        info = process_info_set (info, "start", tmp);
+        info = process_info_set (info, "ready", tmp);
+        value = process_info_get (info, "restarts");
+        snprintf (tmp, sizeof (tmp), "%d", (value ? atoi (value) : 0) + 1);
+        info = process_info_set (info, "restarts", tmp);
+        for (i = 0; _previous_run[i]; i++) {
+            info = process_info_remove (info, _previous_run[i]);
+        }
+        if (PARAM (verbose)) fprintf (stdout, "Recording handover from %u to %u in %s\n", previous, process, path);
+        result = process_info_write (path, info);
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+/// @brief Removes a field from the information file for the controlled process
+///
+/// The file is not updated if it no longer describes the process.
+///
+/// @return zero if successful, ESRCH if the file does not describe the
+///         process, otherwise a non-zero error code
+int process_unset (
+    pid_t process, ///<the controlled process>
+    const char *key ///<the field name>
+    ) {
+    struct process_info *info;
+    char *path;
+    int result = ESRCH;
+    lock_data_dir ();
+    path = get_process_path (0);
+    info = process_info_read (path);
+    if (pid_field (info, "pid") == process) {
+        if (PARAM (verbose)) fprintf (stdout, "Removing %s of %u from %s\n", key, process, path);
+        info = process_info_remove (info, key);
+        result = process_info_write (path, info);
+    }
+    unlock_data_dir ();
+    process_info_free (info);
+    free (path);
+    return result;
+}
+
+/// @brief Opens a descriptor that is readable when information files change
+///
+/// The scope folder of the controlled process is watched with `inotify`, as
+/// by process_wait(), for operations that wait on the watchdog to update the
+/// file. It should be opened before the file is first read, so that no
+/// update can be missed, and drained with `read` after each wake up.
+///
+/// @return the descriptor, or -1 if there is a problem
+int process_watch () {
+    char *path = get_process_path (0);
+    int fd;
+    *strrchr (path, '/') = 0;
+    fd = inotify_init1 (IN_CLOEXEC | IN_NONBLOCK);
+    if ((fd >= 0) && (inotify_add_watch (fd, path, IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE) < 0)) {
+        close (fd);
+        fd = -1;
+    }
+    free (path);
+    return fd;
+}
+
+/// @brief Waits for the controlled process to terminate
+///
+/// The scope folder is watched with `inotify` for the watchdog to record the
+/// termination of the process. The process and its watchdog are also
+/// watched, as `pidfd`s, so that if both terminate without the status being
+/// recorded the wait does not block indefinitely. If the kernel does not
+/// support `pidfd` then they are checked once a second instead.
+///
+/// The caller must release the fields with process_info_free().
+///
+/// @return zero if the process terminated, ETIMEDOUT if it is still running,
+///         ESRCH if there is no such process, ECHILD if the process has
+///         terminated but no status was recorded or another non-zero error
+///         code
+int process_wait (
+    int timeout, ///<the maximum time to wait, in seconds, or -1 for no limit>
+    struct process_info **result ///<receives the fields from the information file>
+    ) {
+    char *path = get_process_path (0);
+    char *dir;
+    struct pollfd fds[3];
+    struct timeval deadline, now;
+    int i, e = 0, polling = 0;
+    *result = NULL;
+    gettimeofday (&deadline, NULL);
+    deadline.tv_sec += timeout;
+    dir = strdup (path);
+    if (!dir) abort ();
+    *strrchr (dir, '/') = 0;
+    fds[0].fd = inotify_init1 (IN_CLOEXEC | IN_NONBLOCK);
+    if ((fds[0].fd >= 0) && (inotify_add_watch (fds[0].fd, dir, IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE) < 0)) {
+        close (fds[0].fd);
+        fds[0].fd = -1;
+    }
+    fds[1].fd = fds[2].fd = -2;
+    if (PARAM (verbose)) fprintf (stdout, "Waiting for process at %s\n", path);
+    do {
+        struct process_info *info = read_locked (path);
+        int alive, wait_ms;
+        if (!info) {
+            e = ESRCH;
+            break;
+        }
+        if (has_exited (info)) {
+            *result = info;
+            break;
+        }
+        if (fds[1].fd == -2) {
+            // Only the PIDs first seen are watched; if the file is rewritten
+            // for a new process that is seen through inotify
+            fds[1].fd = watchdog_open (pid_field (info, "pid"));
+            if ((fds[1].fd < 0) && (errno == ENOSYS)) polling = 1;
+            fds[2].fd = watchdog_open (pid_field (info, "wdog"));
+        }
+        if (polling) {
+            alive = ((pid_field (info, "pid") > 0) && _is_running (pid_field (info, "pid")))
+                 || ((pid_field (info, "wdog") > 0) && _is_running (pid_field (info, "wdog")));
+        } else {
+            alive = (fds[1].fd >= 0) || (fds[2].fd >= 0);
+        }
+        process_info_free (info);
+        if (!alive) {
+            // Nothing is left to record a status; the watchdog may have done
+            // so just before terminating
+            info = read_locked (path);
+            if (has_exited (info)) {
+                *result = info;
+            } else {
+                process_info_free (info);
+                e = ECHILD;
+            }
+            break;
+        }
+        gettimeofday (&now, NULL);
+        if (timeout < 0) {
+            wait_ms = -1;
+        } else {
+            wait_ms = (int)((deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_usec - now.tv_usec) / 1000);
+            if (wait_ms <= 0) {
+                e = ETIMEDOUT;
+                break;
+            }
+        }
+        if ((polling || (fds[0].fd < 0)) && ((wait_ms < 0) || (wait_ms > 1000))) wait_ms = 1000;
+        for (i = 0; i < 3; i++) {
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        if (poll (fds, 3, wait_ms) < 0) {
+            if (errno == EINTR) continue;
+            e = errno;
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            char buffer[4096];
+            while (read (fds[0].fd, buffer, sizeof (buffer)) > 0);
+        }
+        for (i = 1; i < 3; i++) {
+            if (fds[i].revents & POLLIN) {
+                // Terminated; the status should follow from the watchdog
+                close (fds[i].fd);
+                fds[i].fd = -1;
+            }
+        }
+    } while (1);
+    for (i = 0; i < 3; i++) {
+        if (fds[i].fd >= 0) close (fds[i].fd);
+    }
+    free (dir);
+    free (path);
+    return e;
+}
+
+#endif /* ifndef _WIN32 */
@@ -27,8 +27,55 @@
 
 #endif /* ifdef _WIN32 */
 
+/// @brief A field from a process information file
+///
+/// Information files are a sequence of `key: value` lines. The fields are
+/// held in the order read so that a file can be re-written unchanged apart
+/// from any updated values.
+struct process_info {
+    /// @brief The field name
+    char *key;
+    /// @brief The field value
+    char *value;
+    /// @brief The next field in the file, or NULL if this is the last
+    struct process_info *next;
+};
+
+struct process_info *process_info_read (const char *path);
+const char *process_info_get (const struct process_info *info, const char *key);
+struct process_info *process_info_set (struct process_info *info, const char *key, const char *value);
+struct process_info *process_info_remove (struct process_info *info, const char *key);
+int process_info_write (const char *path, const struct process_info *info);
+void process_info_free (struct process_info *info);
+
 int process_housekeep ();
 _WIN32_OR_POSIX (HANDLE, pid_t) process_find ();
-int process_save (_WIN32_OR_POSIX (HANDLE, pid_t) process);
+struct process_info *process_load ();
+int process_save (_WIN32_OR_POSIX (HANDLE, pid_t) process, _WIN32_OR_POSIX (DWORD, pid_t) watchdog);
+int process_update (_WIN32_OR_POSIX (DWORD, pid_t) process, const char *key, const char *value);
+#ifndef _WIN32
+struct rusage;
+int process_activated (pid_t watchdog, pid_t process);
+int process_claim (const char *pool, pid_t *process);
+int process_claimed (pid_t process);
+int process_exited (pid_t process, int status, const struct rusage *usage);
+int process_forget (pid_t process);
+int process_handover (pid_t previous, pid_t process);
+int process_health (pid_t process, const char *state, double latency, int failures);
+int process_idle (pid_t process, int *remaining);
+int process_lease (pid_t process, pid_t holder);
+int process_lock_start (int *waited);
+pid_t process_leaseholder (pid_t process);
+int process_release (pid_t process, pid_t holder, int *remaining);
+int process_request_handover (pid_t process);
+int process_reserve_cores (int count, char **cpus);
+int process_restarted (pid_t previous, pid_t process);
+int process_touch (pid_t process);
+void process_unlock_start (int fd);
+void process_unreserve_cores ();
+int process_unset (pid_t process, const char *key);
+int process_wait (int timeout, struct process_info **result);
+int process_watch ();
+#endif /* ifndef _WIN32 */
 
 #endif /* ifndef __inc_process_h */
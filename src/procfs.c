@@ -0,0 +1,119 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Process table provider
+///
+/// The default provider reads `/proc` and signals with kill(2). Tests and
+/// benchmarks can install a provider rooted at a synthetic table, for
+/// example one built on tmpfs with many thousands of processes or very deep
+/// trees, and a signal function that records the signals rather than sending
+/// them.
+///
+/// A file of the process table is addressed by the process and the name of
+/// the file within its folder. Process zero addresses the root, so files such
+/// as `loadavg` and `self/cmdline` are read with a zero process.
+
+#include "procfs.h"
+#ifndef _WIN32
+# include <errno.h>
+# include <fcntl.h>
+# include <signal.h>
+# include <string.h>
+#endif /* ifndef _WIN32 */
+
+#ifndef _WIN32
+
+/// @brief The default provider, the kernel's process table
+static const struct procfs_provider _procfs_default = { "/proc", kill };
+
+/// @brief The current provider
+static const struct procfs_provider *_procfs = &_procfs_default;
+
+/// @brief Replaces the process table provider
+///
+/// The provider is not copied and must remain valid until it is replaced.
+void procfs_set_provider (
+    const struct procfs_provider *provider ///<the provider to use, or NULL for `/proc`>
+    ) {
+    _procfs = provider ? provider : &_procfs_default;
+}
+
+/// @brief Returns the current process table provider
+const struct procfs_provider *procfs_get_provider () {
+    return _procfs;
+}
+
+/// @brief Builds the path of a file in the process table
+///
+/// @return zero if successful, ENAMETOOLONG if the buffer is too small
+int procfs_path (
+    char *buffer, ///<the buffer to write into, usually PROCFS_PATH characters>
+    size_t size, ///<the size of the buffer>
+    pid_t process, ///<the process, or zero for the root of the table>
+    const char *file ///<the name of the file in the process' folder, or NULL for the folder>
+    ) {
+    int len;
+    if (process) {
+        len = file
+            ? snprintf (buffer, size, "%s/%u/%s", _procfs->root, process, file)
+            : snprintf (buffer, size, "%s/%u", _procfs->root, process);
+    } else {
+        len = file
+            ? snprintf (buffer, size, "%s/%s", _procfs->root, file)
+            : snprintf (buffer, size, "%s", _procfs->root);
+    }
+    return ((len < 0) || ((size_t)len >= size)) ? ENAMETOOLONG : 0;
+}
+
+/// @brief Opens a file in the process table for reading
+///
+/// @return the file descriptor, or -1 if the file could not be opened
+int procfs_open (
+    pid_t process, ///<the process, or zero for the root of the table>
+    const char *file ///<the name of the file in the process' folder>
+    ) {
+    char path[PROCFS_PATH];
+    if (procfs_path (path, sizeof (path), process, file)) return -1;
+    return open (path, O_RDONLY | O_CLOEXEC);
+}
+
+/// @brief Opens a file in the process table as a stream for reading
+///
+/// @return the stream, or NULL if the file could not be opened
+FILE *procfs_fopen (
+    pid_t process, ///<the process, or zero for the root of the table>
+    const char *file ///<the name of the file in the process' folder>
+    ) {
+    char path[PROCFS_PATH];
+    if (procfs_path (path, sizeof (path), process, file)) return NULL;
+    return fopen (path, "rt");
+}
+
+/// @brief Opens a folder in the process table for enumeration
+///
+/// @return the folder, or NULL if it could not be opened
+DIR *procfs_opendir (
+    pid_t process, ///<the process, or zero for the root of the table>
+    const char *file ///<the name of the folder in the process' folder, or NULL for the folder itself>
+    ) {
+    char path[PROCFS_PATH];
+    if (procfs_path (path, sizeof (path), process, file)) return NULL;
+    return opendir (path);
+}
+
+/// @brief Sends a signal to a process in the process table
+///
+/// @return zero if successful, otherwise -1 with errno set
+int procfs_signal (
+    pid_t process, ///<the process to signal>
+    int signal ///<the signal number, or zero to test the process exists>
+    ) {
+    return _procfs->signal (process, signal);
+}
+
+#endif /* ifndef _WIN32 */
@@ -0,0 +1,46 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifndef __inc_procfs_h
+#define __inc_procfs_h
+
+/// @file
+/// @brief Process table provider
+///
+/// Header file for the process table functions published by procfs.c. All
+/// reads of the process table, and the signals sent while walking it, go
+/// through the current provider so that a synthetic table can be used in
+/// place of `/proc`.
+
+#ifndef _WIN32
+
+#include <dirent.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/// @brief The size of the buffer needed for procfs_path(char*,size_t,pid_t,const char*)
+#define PROCFS_PATH 256
+
+/// @brief A source of process table information
+struct procfs_provider {
+    /// @brief The folder laid out as `/proc`, with a sub-folder for each process
+    const char *root;
+    /// @brief Sends a signal to a process, with the semantics of kill(2)
+    int (*signal) (pid_t process, int signal);
+};
+
+void procfs_set_provider (const struct procfs_provider *provider);
+const struct procfs_provider *procfs_get_provider ();
+int procfs_path (char *buffer, size_t size, pid_t process, const char *file);
+int procfs_open (pid_t process, const char *file);
+FILE *procfs_fopen (pid_t process, const char *file);
+DIR *procfs_opendir (pid_t process, const char *file);
+int procfs_signal (pid_t process, int signal);
+
+#endif /* ifndef _WIN32 */
+
+#endif /* ifndef __inc_procfs_h */
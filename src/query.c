@@ -10,32 +10,103 @@
 
 #include "operations.h"
 #include "params.h"
+#include "procctrl.h"
 #include "process.h"
-#ifndef _WIN32
+#include "stats.h"
+#ifdef _WIN32
+# define snprintf _snprintf
+#else /* ifdef _WIN32 */
 # include <errno.h>
-#endif /* ifndef _WIN32 */
+#endif /* ifdef _WIN32 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+/// @brief Copies a field of the information file into a query result
+static void copy_field (
+    char *buffer, ///<the result field, PROCCTRL_QUERY_FIELD characters>
+    const char *value ///<the value, or NULL if not set>
+    ) {
+    snprintf (buffer, PROCCTRL_QUERY_FIELD, "%s", value ? value : "");
+    buffer[PROCCTRL_QUERY_FIELD - 1] = 0;
+}
+
+/// @brief Writes the state of a process to the query result of the context
+static void write_result (
+    _WIN32_OR_POSIX (HANDLE, pid_t) process, ///<the process>
+    const struct process_stats *stats ///<the resources used, with the fields from the information file>
+    ) {
+    struct procctrl_query_result *result = PARAM (query_result);
+    result->pid = _WIN32_OR_POSIX (GetProcessId (process), process);
+    result->processes = stats->processes;
+    result->threads = stats->threads;
+    result->fds = stats->fds;
+    result->utime = stats->utime;
+    result->stime = stats->stime;
+    result->rss = stats->rss;
+    result->pss = stats->pss;
+    result->read_bytes = stats->read_bytes;
+    result->write_bytes = stats->write_bytes;
+    result->restarts = stats->restarts;
+    copy_field (result->cpus, stats->cpus);
+    copy_field (result->mempolicy, stats->mempolicy);
+    copy_field (result->nice, stats->nice);
+    copy_field (result->sched, stats->sched);
+    copy_field (result->ioprio, stats->ioprio);
+}
 
 /// @brief Queries a child process
 ///
 /// Tests if the child process, created by a previous call to the `start`
-/// operation, is still active.
+/// operation, is still active. A query counts as a use of the process for
+/// the idle timeout given by the `I` parameter.
+///
+/// If the `o` parameter requests it then the resources used by the process
+/// and its descendants, the number of times it has been restarted, where it
+/// was placed by the `a` and `m` parameters and the priority it was given by
+/// the `y`, `S` and `j` parameters, are written to stdout. A library caller
+/// can collect them with procctrl_query() instead.
 ///
 /// @return zero if the process is running, ESRCH/ERROR_NOT_FOUND or another
 ///         non-zero error code otherwise
 int operation_query () {
 	_WIN32_OR_POSIX (HANDLE, pid_t) process;
-    if (verbose) fprintf (stdout, "Querying spawned process\n");
+    struct process_stats stats;
+    int e = 0;
+    if (PARAM (verbose)) fprintf (stdout, "Querying spawned process\n");
+    if (PARAM (query_result)) memset (PARAM (query_result), 0, sizeof (struct procctrl_query_result));
     process = process_find ();
     if (process) {
-        if (verbose) fprintf (stdout, "Process %u is running\n", _WIN32_OR_POSIX (GetProcessId (process), process));
+        if (PARAM (verbose)) fprintf (stdout, "Process %u is running\n", _WIN32_OR_POSIX (GetProcessId (process), process));
+#ifndef _WIN32
+        process_touch (process);
+#endif /* ifndef _WIN32 */
+        if (PARAM (query_result) || (PARAM (output_mode) != OUTPUT_STATUS)) {
+            if ((e = stats_gather (process, &stats)) == 0) {
+                struct process_info *info = process_load ();
+                const char *restarts = process_info_get (info, "restarts");
+                if (restarts) stats.restarts = (unsigned)atoi (restarts);
+                stats.cpus = process_info_get (info, "cpus");
+                stats.mempolicy = process_info_get (info, "mempolicy");
+                stats.nice = process_info_get (info, "nice");
+                stats.sched = process_info_get (info, "sched");
+                stats.ioprio = process_info_get (info, "ioprio");
+                if (PARAM (query_result)) {
+                    write_result (process, &stats);
+                } else {
+                    stats_write (stdout, &stats, PARAM (output_mode) == OUTPUT_JSON);
+                }
+                process_info_free (info);
+            } else {
+                fprintf (stderr, "Can't query resources used by %u\n", _WIN32_OR_POSIX (GetProcessId (process), process));
+            }
+        }
 #ifdef _WIN32
 		CloseHandle (process);
 #endif /* ifdef _WIN32 */
-        return 0;
+        return e;
     } else {
-        if (verbose) fprintf (stdout, "No child process is running\n");
+        if (PARAM (verbose)) fprintf (stdout, "No child process is running\n");
 		return _WIN32_OR_POSIX (ERROR_NOT_FOUND, ESRCH);
     }
 }
@@ -0,0 +1,223 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Replica groups
+///
+/// With the `N` parameter an operation on the identifier given by the `k`
+/// parameter acts on a group of replicas instead, each with the identifier
+/// `<em>identifier</em>:<em>index</em>` for an index counting from zero. The
+/// replicas are operated on concurrently, a thread each, so starting a group
+/// takes about as long as starting one of them.
+///
+/// Each replica runs the command with `{i}` in its arguments replaced by the
+/// index, and `{i+<em>n</em>}` by the index plus n; for example to give each
+/// its own port or data folder. The same replacements are made in the values
+/// of the environment variables it inherits, and `PROCCTRL_INDEX` is set.
+
+#include "replica.h"
+#include "params.h"
+#ifndef _WIN32
+# include <errno.h>
+# include <pthread.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// @brief An operation on one replica, running on a thread of its own
+struct _replica {
+    /// @brief The parameters of the replica
+    struct procctrl_context context;
+    /// @brief The operation, from operations.h
+    int (*fn) ();
+    /// @brief The result of the operation
+    int result;
+    /// @brief Non-zero if the thread was created
+    int running;
+    /// @brief The thread running the operation
+    pthread_t thread;
+};
+
+/// @brief Parses a replacement at the start of a string
+///
+/// @return the length of the replacement, or zero if there is none
+static size_t parse_replacement (
+    const char *value, ///<the string, at a possible replacement>
+    long *offset ///<receives the amount added to the index>
+    ) {
+    const char *end = value + 2;
+    if (strncmp (value, "{i", 2)) return 0;
+    *offset = 0;
+    if (*end == '+') {
+        char *digits;
+        *offset = strtol (end + 1, &digits, 10);
+        if ((digits == end + 1) || (*offset < 0)) return 0;
+        end = digits;
+    }
+    if (*end != '}') return 0;
+    return end + 1 - value;
+}
+
+/// @brief Replaces the replica index in a string
+///
+/// Each `{i}` is replaced by the index, and each `{i+<em>n</em>}` by the
+/// index plus n. Any other text is copied unchanged.
+///
+/// The caller must free the allocated string.
+///
+/// @return the string with the index replaced
+char *replica_substitute (
+    const char *value, ///<the string, such as an argument of the command>
+    int index ///<the replica index>
+    ) {
+    size_t size = strlen (value) + 1, len = 0, n;
+    const char *scan;
+    char *result;
+    long offset;
+    // Each replacement becomes at most the digits of a long
+    for (scan = value; *scan; scan++) {
+        if (parse_replacement (scan, &offset)) size += 20;
+    }
+    result = (char*)malloc (size);
+    if (!result) abort ();
+    while (*value) {
+        if ((n = parse_replacement (value, &offset)) != 0) {
+            len += snprintf (result + len, size - len, "%ld", offset + index);
+            value += n;
+        } else {
+            result[len++] = *(value++);
+        }
+    }
+    result[len] = 0;
+    return result;
+}
+
+/// @brief Sets the environment of a replica's command
+///
+/// This is called in the spawned child before it executes the command, so
+/// that the process running the operations is not changed.
+void replica_environ () {
+    extern char **environ;
+    char tmp[16];
+    char *value;
+    int i;
+    if (PARAM (replica_index) < 0) return;
+    snprintf (tmp, sizeof (tmp), "%d", PARAM (replica_index));
+    setenv ("PROCCTRL_INDEX", tmp, 1);
+    for (i = 0; environ[i]; i++) {
+        if (!strstr (environ[i], "{i")) continue;
+        value = replica_substitute (environ[i], PARAM (replica_index));
+        if (strcmp (value, environ[i])) {
+            putenv (value);
+        } else {
+            free (value);
+        }
+    }
+}
+
+/// @brief Body of the thread running an operation on a replica
+static void *run_replica (
+    void *arg ///<the replica>
+    ) {
+    struct _replica *replica = (struct _replica*)arg;
+    params_current = &replica->context;
+    replica->result = replica->fn ();
+    return NULL;
+}
+
+/// @brief Sets the parameters of a replica from the calling context
+static void init_replica (
+    struct _replica *replica, ///<the replica to initialise>
+    int index, ///<the replica index>
+    int (*fn) () ///<the operation>
+    ) {
+    struct procctrl_context *previous = params_current;
+    size_t size = strlen (PARAM (process_identifier)) + 16;
+    char *identifier;
+    char **argv;
+    int i;
+    identifier = (char*)malloc (size);
+    argv = (char**)malloc ((PARAM (spawn_argc) + 1) * sizeof (char*));
+    if (!identifier || !argv) abort ();
+    snprintf (identifier, size, "%s:%d", PARAM (process_identifier), index);
+    for (i = 0; i < PARAM (spawn_argc); i++) {
+        argv[i] = replica_substitute (PARAM (spawn_argv)[i], index);
+    }
+    argv[PARAM (spawn_argc)] = NULL;
+    replica->context = *previous;
+    replica->fn = fn;
+    replica->result = 0;
+    replica->running = 0;
+    params_current = &replica->context;
+    PARAM (process_identifier) = identifier;
+    PARAM (replica_index) = index;
+    PARAM (spawn_argv) = argv;
+    params_current = previous;
+}
+
+/// @brief Releases the parameters allocated by init_replica()
+static void free_replica (
+    struct _replica *replica ///<the replica to release>
+    ) {
+    struct procctrl_context *previous = params_current;
+    int i;
+    params_current = &replica->context;
+    for (i = 0; i < PARAM (spawn_argc); i++) {
+        free (PARAM (spawn_argv)[i]);
+    }
+    free (PARAM (spawn_argv));
+    free ((char*)PARAM (process_identifier));
+    params_current = previous;
+}
+
+#endif /* ifndef _WIN32 */
+
+/// @brief Runs an operation on each replica given by the `N` parameter
+///
+/// The operation runs concurrently for every replica, with the parameters of
+/// the calling context other than the identifier and command, and this
+/// returns once all have completed.
+///
+/// @return zero if the operation succeeded for every replica, EINVAL if no
+///         identifier was given, otherwise the first non-zero result in
+///         index order
+int replica_run (
+    int (*fn) () ///<the operation, from operations.h>
+    ) {
+#ifdef _WIN32
+	fprintf (stderr, "Replicas are not supported on this platform\n");
+	return ERROR_NOT_SUPPORTED;
+#else /* ifdef _WIN32 */
+    struct _replica *replicas;
+    int i, e = 0;
+    if (!PARAM (process_identifier)) {
+        fprintf (stderr, "Replicas need an identifier\n");
+        return EINVAL;
+    }
+    if (PARAM (verbose)) fprintf (stdout, "Running operation on %d replicas of %s\n", PARAM (replica_count), PARAM (process_identifier));
+    replicas = (struct _replica*)malloc (PARAM (replica_count) * sizeof (struct _replica));
+    if (!replicas) abort ();
+    for (i = 0; i < PARAM (replica_count); i++) {
+        init_replica (&replicas[i], i, fn);
+        replicas[i].result = pthread_create (&replicas[i].thread, NULL, run_replica, &replicas[i]);
+        replicas[i].running = !replicas[i].result;
+    }
+    for (i = 0; i < PARAM (replica_count); i++) {
+        if (replicas[i].running) pthread_join (replicas[i].thread, NULL);
+        if (replicas[i].result) {
+            if (PARAM (verbose)) fprintf (stdout, "Replica %d returned %d\n", i, replicas[i].result);
+            if (!e) e = replicas[i].result;
+        }
+        free_replica (&replicas[i]);
+    }
+    free (replicas);
+    return e;
+#endif /* ifdef _WIN32 */
+}
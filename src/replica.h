@@ -0,0 +1,23 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifndef __inc_replica_h
+#define __inc_replica_h
+
+/// @file
+/// @brief Replica groups
+///
+/// Header file for the replica functions published by replica.c, used to run
+/// an operation on each replica given by the `N` parameter.
+
+int replica_run (int (*fn) ());
+#ifndef _WIN32
+char *replica_substitute (const char *value, int index);
+void replica_environ ();
+#endif /* ifndef _WIN32 */
+
+#endif /* ifndef __inc_replica_h */
@@ -0,0 +1,187 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Implements the `restart` operation
+///
+/// The new instance is started by the watchdog rather than by this
+/// operation. The watchdog already holds any listening sockets given by the
+/// `s` parameter, and must be the parent of both instances to reap them.
+/// Without those sockets the new instance could not bind the ports held by
+/// the old one, so a process started without them is not restarted.
+
+#include "operations.h"
+#include "params.h"
+#include "process.h"
+#include "procfs.h"
+#include "trace.h"
+#include "watchdog.h"
+#ifndef _WIN32
+# include <errno.h>
+# include <poll.h>
+# include <signal.h>
+# include <sys/time.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+// From watchdog.c
+int _is_running (pid_t process);
+
+/// @brief Tests the progress of a handover requested from the watchdog
+///
+/// @return zero if the process has been replaced, and the old one stopped,
+///         EINPROGRESS if the handover has not completed, ECANCELED if it
+///         failed, or ESRCH if the process has terminated
+static int handover_state (
+    pid_t previous ///<the process being replaced>
+    ) {
+    struct process_info *info = process_load ();
+    const char *pid = process_info_get (info, "pid");
+    const char *handover = process_info_get (info, "handover");
+    int e;
+    if (!pid || process_info_get (info, "end")) {
+        e = ESRCH;
+    } else if (handover && !strcmp (handover, "failed")) {
+        e = ECANCELED;
+    } else if (((pid_t)strtol (pid, NULL, 10) != previous) && !process_info_get (info, "previous")) {
+        e = 0;
+    } else {
+        e = EINPROGRESS;
+    }
+    process_info_free (info);
+    return e;
+}
+
+/// @brief Waits for the watchdog to complete a handover
+///
+/// The information file is watched with the descriptor from process_watch()
+/// and the watchdog with a `pidfd`, or checked once a second if the kernel
+/// does not support them, so that the wait ends if the watchdog terminates.
+///
+/// @return zero if the process was handed over, ETIMEDOUT if the `t`
+///         parameter elapsed first, ECHILD if the watchdog terminated,
+///         otherwise the error from handover_state()
+static int wait_handover (
+    pid_t previous, ///<the process being replaced>
+    pid_t watchdog, ///<the watchdog of the process>
+    int watch ///<the descriptor from process_watch()>
+    ) {
+    struct pollfd fds[2];
+    struct timeval deadline, now;
+    char buffer[4096];
+    int e, wait_ms;
+    gettimeofday (&deadline, NULL);
+    deadline.tv_sec += PARAM (wait_timeout);
+    fds[0].fd = watch;
+    fds[1].fd = watchdog_open (watchdog);
+    fds[0].revents = fds[1].revents = 0;
+    if (PARAM (verbose)) fprintf (stdout, "Waiting for process %u to be handed over\n", previous);
+    while ((e = handover_state (previous)) == EINPROGRESS) {
+        if ((fds[1].fd >= 0) ? (fds[1].revents & POLLIN) : !_is_running (watchdog)) {
+            // The watchdog may have recorded the outcome just before terminating
+            e = handover_state (previous);
+            if (e == EINPROGRESS) e = ECHILD;
+            break;
+        }
+        if (PARAM (wait_timeout) < 0) {
+            wait_ms = -1;
+        } else {
+            gettimeofday (&now, NULL);
+            wait_ms = (deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_usec - now.tv_usec) / 1000;
+            if (wait_ms <= 0) {
+                e = ETIMEDOUT;
+                break;
+            }
+        }
+        if ((fds[0].fd < 0) || (fds[1].fd < 0)) {
+            if ((wait_ms < 0) || (wait_ms > 1000)) wait_ms = 1000;
+        }
+        fds[0].events = fds[1].events = POLLIN;
+        fds[0].revents = fds[1].revents = 0;
+        if ((poll (fds, 2, wait_ms) < 0) && (errno != EINTR)) {
+            e = errno;
+            break;
+        }
+        if ((fds[0].fd >= 0) && (fds[0].revents & POLLIN)) {
+            while (read (fds[0].fd, buffer, sizeof (buffer)) > 0);
+        }
+    }
+    if (fds[1].fd >= 0) close (fds[1].fd);
+    return e;
+}
+
+#endif /* ifndef _WIN32 */
+
+/// @brief Restarts the child process without closing its listening sockets
+///
+/// The watchdog of the child is asked to start a new instance of the
+/// command, with any listening sockets given by the `s` parameter, while the
+/// old one keeps running. Once the new instance has called execvp, and
+/// passed the health probe given by the `c` parameter if there is one, it
+/// replaces the old one in the information file and the old one is stopped.
+/// This blocks until then, or until the timeout given by the `t` parameter
+/// elapses.
+///
+/// Only a process started with the `s` parameter can be restarted, and one
+/// that has not been activated yet has nothing to restart.
+///
+/// @return zero if successful, ESRCH/ERROR_NOT_FOUND if there is no such
+///         process, EINVAL if it was not started with the `s` parameter,
+///         EBUSY if a restart is already in progress, ECANCELED if
+///         the new instance was not ready and the old one kept, ETIMEDOUT if
+///         the restart did not complete in time, otherwise a non-zero error
+///         code
+int operation_restart () {
+#ifdef _WIN32
+	if (PARAM (verbose)) fprintf (stdout, "Restart is not supported\n");
+	return ERROR_NOT_SUPPORTED;
+#else /* ifdef _WIN32 */
+    struct process_info *info;
+    const char *wdog;
+    pid_t process;
+    int watch, e;
+    if (PARAM (verbose)) fprintf (stdout, "Restarting spawned process\n");
+    process = process_find ();
+    if (!process) {
+        if (PARAM (verbose)) fprintf (stdout, "No process to restart\n");
+        return ESRCH;
+    }
+    // Watch for updates before reading the file, so that none are missed
+    watch = process_watch ();
+    info = process_load ();
+    wdog = process_info_get (info, "wdog");
+    if (process_info_get (info, "activation")) {
+        if (PARAM (verbose)) fprintf (stdout, "Process has not been activated\n");
+        e = 0;
+    } else if (!wdog) {
+        e = ESRCH;
+    } else if (!process_info_get (info, "listen")) {
+        // Without the sockets held by the watchdog the new instance can't
+        // bind the ports the old one holds, and a tcp: probe would pass by
+        // connecting to the old one
+        fprintf (stderr, "Process %u was not started with -s, so can't be restarted\n", process);
+        e = EINVAL;
+    } else if ((e = process_request_handover (process)) == EBUSY) {
+        if (PARAM (verbose)) fprintf (stdout, "Process %u is already being restarted\n", process);
+    } else if (!e) {
+        trace_instant ("restart_request", process, NULL);
+        if (procfs_signal ((pid_t)strtol (wdog, NULL, 10), SIGUSR2)) {
+            e = errno;
+        } else {
+            e = wait_handover (process, (pid_t)strtol (wdog, NULL, 10), watch);
+        }
+    }
+    process_info_free (info);
+    if (watch >= 0) close (watch);
+    return e;
+#endif /* ifdef _WIN32 */
+}
@@ -9,14 +9,30 @@
 /// @brief Implements the `start` operation
 
 #include "operations.h"
+#include "health.h"
 #include "kill.h"
+#include "listen.h"
 #include "params.h"
+#include "placement.h"
+#include "priority.h"
+#include "pool.h"
+#include "procfs.h"
 #include "process.h"
+#include "replica.h"
+#include "timing.h"
+#include "trace.h"
 #include "watchdog.h"
 #ifndef _WIN32
 # include <unistd.h>
+# include <dirent.h>
 # include <errno.h>
+# include <poll.h>
 # include <signal.h>
+# include <sys/resource.h>
+# include <sys/socket.h>
+# include <sys/time.h>
+# include <sys/wait.h>
+# include <time.h>
 #endif
 #include <stdio.h>
 #include <stdlib.h>
@@ -49,32 +65,32 @@ static BOOL is_escape_string (const char *psz) {
 
 static char *create_comspec_command_line () {
 	char *psz;
-	size_t cch = spawn_argc * 3 + 11; // quotes, space between, null terminator and "cmd.exe /c"
+	size_t cch = PARAM (spawn_argc) * 3 + 11; // quotes, space between, null terminator and "cmd.exe /c"
 	int i, j;
-	for (i = 0; i < spawn_argc; i++) {
-		cch += strlen (spawn_argv[i]);
+	for (i = 0; i < PARAM (spawn_argc); i++) {
+		cch += strlen (PARAM (spawn_argv)[i]);
 	}
 	psz = (char*)malloc (cch);
 	if (!psz) return NULL;
 	j = sprintf (psz, "cmd.exe /c");
-	for (i = 0; i < spawn_argc; i++) {
-		j += sprintf (psz + j, is_escape_string (spawn_argv[i]) ? " \"%s\"" : " %s", spawn_argv[i]);
+	for (i = 0; i < PARAM (spawn_argc); i++) {
+		j += sprintf (psz + j, is_escape_string (PARAM (spawn_argv)[i]) ? " \"%s\"" : " %s", PARAM (spawn_argv)[i]);
 	}
 	return psz;
 }
 
 static char *create_command_line () {
 	char *psz;
-	size_t cch = spawn_argc * 3; // quotes, space between, null terminator
+	size_t cch = PARAM (spawn_argc) * 3; // quotes, space between, null terminator
 	int i, j;
-	for (i = 0; i < spawn_argc; i++) {
-		cch += strlen (spawn_argv[i]);
+	for (i = 0; i < PARAM (spawn_argc); i++) {
+		cch += strlen (PARAM (spawn_argv)[i]);
 	}
 	psz = (char*)malloc (cch);
 	if (!psz) return NULL;
-	j = sprintf (psz, is_escape_string (spawn_argv[0]) ? "\"%s\"" : "%s", spawn_argv[0]);
-	for (i = 1; i < spawn_argc; i++) {
-		j += sprintf (psz + j,is_escape_string (spawn_argv[i]) ? " \"%s\"" : " %s", spawn_argv[i]);
+	j = sprintf (psz, is_escape_string (PARAM (spawn_argv)[0]) ? "\"%s\"" : "%s", PARAM (spawn_argv)[0]);
+	for (i = 1; i < PARAM (spawn_argc); i++) {
+		j += sprintf (psz + j,is_escape_string (PARAM (spawn_argv)[i]) ? " \"%s\"" : " %s", PARAM (spawn_argv)[i]);
 	}
 	return psz;
 }
@@ -87,12 +103,12 @@ static BOOL spawn_process (LPPROCESS_INFORMATION lppi) {
 	size_t cch;
 	ZeroMemory (&si, sizeof (si));
 	si.cb = sizeof (si);
-	cch = strlen (spawn_argv[0]);
-	if ((cch > 4) && !stricmp (spawn_argv[0] + cch - 4, ".bat")) {
+	cch = strlen (PARAM (spawn_argv)[0]);
+	if ((cch > 4) && !stricmp (PARAM (spawn_argv)[0] + cch - 4, ".bat")) {
 		pszApplication = getenv ("ComSpec");
 		pszCommandLine = create_comspec_command_line ();
 	} else {
-		pszApplication = spawn_argv[0];
+		pszApplication = PARAM (spawn_argv)[0];
 		pszCommandLine = create_command_line ();
 	}
 	if (!pszCommandLine) {
@@ -106,65 +122,25 @@ static BOOL spawn_process (LPPROCESS_INFORMATION lppi) {
 
 #endif /* ifdef _WIN32 */
 
-#ifndef _WIN32
-/// @brief Waits for the child to call execvp
-///
-/// After the initial fork, the identity of the child does not correspond to
-/// its final identity. This function blocks until the child terminates or its
-/// identity changes.
-///
-/// @return zero if successful, otherwise a non-zero error code
-int _wait_for_execvp (
-    pid_t child ///<the child PID>
-    ) {
-    char tmp[32];
-    FILE *cmdSelf, *cmdChild;
-    int result = EBUSY;
-    if (snprintf (tmp, sizeof (tmp), "/proc/%u/cmdline", child) >= sizeof (tmp)) return ENOMEM;
-    do {
-        cmdSelf = fopen ("/proc/self/cmdline", "rt");
-        if (cmdSelf) {
-            cmdChild = fopen (tmp, "rt");
-            if (cmdChild) {
-                while (!feof (cmdSelf) && !feof (cmdChild)) {
-                    if (fgetc (cmdSelf) != fgetc (cmdChild)) {
-                        // Command lines differ
-                        result = 0;
-                        break;
-                    }
-                }
-                fclose (cmdChild);
-            } else {
-                // Child terminated
-                result = 0;
-            }
-            fclose (cmdSelf);
-        } else {
-            // Internal error; can't get our own command line
-            result = EINVAL;
-        }
-        if (result != EBUSY) return result;
-        sleep (1);
-    } while (1);
-}
-#endif /* ifndef _WIN32 */
+#ifdef _WIN32
 
 static int _fork_watchdog0 (
-	_WIN32_OR_POSIX (HANDLE, pid_t) child,
-	_WIN32_OR_POSIX (HANDLE, pid_t) parent
+	HANDLE child,
+	HANDLE parent
 	) {
     if (watchdog (2, child, parent) == 1) {
-        if (verbose) fprintf (stdout, "Killing child process on parent termination\n");
+        if (PARAM (verbose)) fprintf (stdout, "Killing child process on parent termination\n");
+        process_update (GetProcessId (child), "watchdog", NULL);
+        trace_instant ("watchdog", GetProcessId (child), NULL);
         kill_process (child);
     }
     return 0;
 }
 
 int _fork_watchdog (
-	_WIN32_OR_POSIX (DWORD, pid_t) child,
-	_WIN32_OR_POSIX (DWORD, pid_t) parent
+	DWORD child,
+	DWORD parent
 	) {
-#ifdef _WIN32
 	HANDLE hChild;
 	HANDLE hParent;
 	int nResult;
@@ -179,86 +155,773 @@ int _fork_watchdog (
 		CloseHandle (hParent);
 	} else {
 		// Parent already terminated
-		if (verbose) fprintf (stdout, "Killing child process on parent termination\n");
+		if (PARAM (verbose)) fprintf (stdout, "Killing child process on parent termination\n");
+		process_update (child, "watchdog", NULL);
+		trace_instant ("watchdog", child, NULL);
 		kill_process (hChild);
 		nResult = 0;
 	}
 	CloseHandle (hChild);
 	return nResult;
+}
+
 #else /* ifdef _WIN32 */
-	return _fork_watchdog0 (child, parent);
-#endif /* ifdef _WIN32 */
+
+// From watchdog.c
+int _is_running (pid_t process);
+
+/// @brief The listening sockets of a socket activated process
+///
+/// These are bound by the `start` operation before forking the watchdog,
+/// which keeps them for the child.
+static THREAD_LOCAL int *_listen_fds = NULL;
+/// @brief The number of entries in _listen_fds
+static THREAD_LOCAL int _listen_count = 0;
+
+/// @brief Tests if a descriptor is one of the listening sockets
+///
+/// @return non-zero if it is, zero otherwise
+static int is_listener (
+    int fd ///<the descriptor to test>
+    ) {
+    int i;
+    for (i = 0; i < _listen_count; i++) {
+        if (_listen_fds[i] == fd) return 1;
+    }
+    return 0;
 }
 
-/// @brief Starts the child process
+/// @brief Closes the descriptors inherited by the watchdog
 ///
-/// If there is not already an active process with the symbolic identifier
-/// then a process is spawned. If the parent process must be watched for
-/// termination then an additional watchdog process is also spawned.
+/// Library callers may start processes from several threads at once, so the
+/// watchdog can inherit the `start` operation's end of another watchdog's
+/// channel. Holding it open would stop that watchdog from seeing the channel
+/// close, so everything other than the standard streams and the descriptors
+/// the watchdog uses, including any listening sockets, is closed.
+///
+/// The descriptors are listed from the real `/proc`, not through the procfs
+/// provider, which may describe a synthetic tree rather than this process.
+/// Without `/proc` every possible descriptor is tried instead.
+static void close_inherited (
+    int channel, ///<the watchdog's end of the channel, which is kept>
+    int exec ///<the watchdog's end of the exec socket pair, which is kept>
+    ) {
+    DIR *dir = opendir ("/proc/self/fd");
+    struct dirent *ent;
+    int *fds = NULL, count = 0, size = 0;
+    if (!dir) {
+        long fd, max = sysconf (_SC_OPEN_MAX);
+        for (fd = 3; fd < max; fd++) {
+            if ((fd != channel) && (fd != exec) && !is_listener ((int)fd)) close ((int)fd);
+        }
+        return;
+    }
+    while ((ent = readdir (dir)) != NULL) {
+        int fd;
+        if (ent->d_name[0] == '.') continue;
+        fd = atoi (ent->d_name);
+        if ((fd <= 2) || (fd == channel) || (fd == exec) || (fd == dirfd (dir)) || is_listener (fd)) continue;
+        if (count == size) {
+            size = size ? size * 2 : 16;
+            fds = (int*)realloc (fds, size * sizeof (int));
+            if (!fds) abort ();
+        }
+        fds[count++] = fd;
+    }
+    closedir (dir);
+    while (count > 0) close (fds[--count]);
+    free (fds);
+}
+
+/// @brief Waits for the spawned child to call execvp
+///
+/// The child holds the watchdog's end of the exec socket pair, which is closed
+/// when it calls execvp or terminates, so the `start` operation's end reaches
+/// end of file as soon as the child has its final identity.
+///
+/// This is not static so that it can be used by the unit tests.
 ///
 /// @return zero if successful, otherwise a non-zero error code
-int operation_start () {
+int _wait_for_exec (
+    int exec ///<the `start` operation's end of the exec socket pair>
+    ) {
+    char c;
+    ssize_t n;
+    do {
+        n = read (exec, &c, 1);
+    } while ((n > 0) || ((n < 0) && (errno == EINTR)));
+    return n ? errno : 0;
+}
+
+/// @brief Spawns the child process
+///
+/// The child holds the watchdog's end of the exec socket pair until it calls
+/// execvp. Signals blocked by the watchdog are unblocked in the child, and
+/// any listening sockets passed to it. A replica is given its index in the
+/// environment, and the CPUs, memory policy and priority are set before the
+/// command is executed.
+///
+/// @return the PID of the child, or -1 if it could not be spawned
+static pid_t spawn_child (
+    int exec ///<the watchdog's end of the exec socket pair>
+    ) {
+    pid_t child;
+    sigset_t signals;
+    int e;
+    child = fork ();
+    if (!child) {
+        sigemptyset (&signals);
+        sigprocmask (SIG_SETMASK, &signals, NULL);
+        if (_listen_count) listen_pass (_listen_fds, _listen_count, &exec);
+        replica_environ ();
+        if ((e = placement_apply ()) != 0) {
+            fprintf (stderr, "Couldn't place %s, error %d\n", PARAM (spawn_argv)[0], e);
+            _exit (e);
+        }
+        if ((e = priority_set (0)) != 0) {
+            fprintf (stderr, "Couldn't set the priority of %s, error %d\n", PARAM (spawn_argv)[0], e);
+            _exit (e);
+        }
+        execvp (PARAM (spawn_argv)[0], PARAM (spawn_argv));
+        e = errno;
+        fprintf (stderr, "Couldn't run %s, error %d\n", PARAM (spawn_argv)[0], e);
+        _exit (e);
+    }
+    close (exec);
+    return child;
+}
+
+/// @brief Tests if the child should be restarted
+///
+/// The restart policy, given by the `r` and `R` parameters, is applied. A
+/// child killed by the `stop` operation, or because the parent terminated,
+/// is never restarted.
+///
+/// @return non-zero to restart the child, zero otherwise
+static int should_restart (
+    pid_t child, ///<the terminated child>
+    int status, ///<the status of the child>
+    int restarts ///<the number of restarts already made by this watchdog>
+    ) {
+    struct process_info *info;
+    const char *pid;
+    int restart;
+    if (PARAM (restart_mode) == RESTART_NO) return 0;
+    if ((PARAM (restart_mode) == RESTART_ON_FAILURE) && WIFEXITED (status) && !WEXITSTATUS (status)) return 0;
+    if ((PARAM (restart_limit) >= 0) && (restarts >= PARAM (restart_limit))) {
+        if (PARAM (verbose)) fprintf (stdout, "Not restarting process %u; limit of %d reached\n", child, PARAM (restart_limit));
+        return 0;
+    }
+    info = process_load ();
+    pid = process_info_get (info, "pid");
+    restart = pid && ((pid_t)strtol (pid, NULL, 10) == child)
+        && !process_info_get (info, "stop") && !process_info_get (info, "watchdog");
+    process_info_free (info);
+    return restart;
+}
+
+/// @brief Restarts the child after a delay
+///
+/// While waiting the information file records when the restart was
+/// scheduled, and the `stop` operation cancels it by signalling the watchdog
+/// with SIGTERM, which the caller has blocked. The new child is recorded in
+/// place of the old one once it has called execvp.
+///
+/// @return the PID of the new child, or zero if it was not restarted
+static pid_t restart_child (
+    pid_t child, ///<the terminated child>
+    int attempt, ///<the number of consecutive restarts already made>
+    unsigned *seed ///<the random number state for the backoff>
+    ) {
+    struct timespec timeout;
+    sigset_t signals;
+    char args[32];
+    pid_t process;
+    int delay, exec[2], e;
+    delay = watchdog_backoff (attempt, seed);
+    if (PARAM (verbose)) fprintf (stdout, "Restarting process %u in %dms\n", child, delay);
+    if (process_update (child, "restart", NULL)) return 0;
+    snprintf (args, sizeof (args), "\"delay\":%d", delay);
+    trace_instant ("restart", child, args);
+    timeout.tv_sec = delay / 1000;
+    timeout.tv_nsec = (delay % 1000) * 1000000L;
+    sigemptyset (&signals);
+    sigaddset (&signals, SIGTERM);
+    while ((e = sigtimedwait (&signals, NULL, &timeout)) < 0) {
+        if (errno != EINTR) break;
+    }
+    if (e == SIGTERM) {
+        if (PARAM (verbose)) fprintf (stdout, "Restart of process %u cancelled\n", child);
+        return 0;
+    }
+    if (PARAM (watch_parent) && !_is_running (PARAM (parent_process))) return 0;
+    if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, exec)) return 0;
+    process = spawn_child (exec[1]);
+    if (process == (pid_t)-1) {
+        close (exec[0]);
+        return 0;
+    }
+    _wait_for_exec (exec[0]);
+    close (exec[0]);
+    if ((e = process_restarted (child, process)) != 0) {
+        // Stopped, or replaced by another start, while this one was spawned
+        if (PARAM (verbose)) fprintf (stdout, "Not recording restart of %u, error %d\n", child, e);
+        kill_process (process);
+        waitpid (process, &e, 0);
+        return 0;
+    }
+    if (!PARAM (health_probe)) {
+        // Otherwise it is ready once it passes the probe
+        process_update (process, "ready", NULL);
+        trace_instant ("ready", process, NULL);
+    }
+    return process;
+}
+
+/// @brief Spawns a socket activated child once a connection is waiting
+///
+/// The child replaces the watchdog in the information file once it has
+/// called execvp.
+///
+/// @return the PID of the child, or zero if it was not spawned
+static pid_t activate_child () {
+    pid_t self = getpid (), process;
+    int exec[2], e;
+    if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, exec)) return 0;
+    process = spawn_child (exec[1]);
+    if (process == (pid_t)-1) {
+        close (exec[0]);
+        return 0;
+    }
+    if (PARAM (verbose)) fprintf (stdout, "Child process %u spawned on connection\n", process);
+    _wait_for_exec (exec[0]);
+    close (exec[0]);
+    if ((e = process_activated (self, process)) != 0) {
+        // Stopped while it was spawned
+        if (PARAM (verbose)) fprintf (stdout, "Not recording activation of %u, error %d\n", process, e);
+        kill_process (process);
+        waitpid (process, &e, 0);
+        return 0;
+    }
+    trace_instant ("activated", process, NULL);
+    process_update (process, "ready", NULL);
+    trace_instant ("ready", process, NULL);
+    return process;
+}
+
+/// @brief Waits for a new instance of the child to pass its health probe
+///
+/// Without a probe given by the `c` parameter there is nothing more to wait
+/// for once the instance has called execvp. Otherwise the probe is run every
+/// `i` seconds, and the instance is given as many attempts as the `n`
+/// parameter, not counting those within the `g` parameter's grace period, as
+/// it would be by watchdog_supervise().
+///
+/// @return zero if the instance is ready, ECHILD if it terminated and was
+///         reaped, otherwise the error from the last probe
+static int wait_ready (
+    pid_t process ///<the new instance>
+    ) {
+    struct timespec begun, now;
+    double latency;
+    int e = 0, failures = 0, status;
+    if (!PARAM (health_probe)) return 0;
+    clock_gettime (CLOCK_MONOTONIC, &begun);
+    while (failures < PARAM (health_threshold)) {
+        if (e) poll (NULL, 0, PARAM (monitor_interval) * 1000);
+        if (waitpid (process, &status, WNOHANG) == process) return ECHILD;
+        if ((e = health_run (PARAM (health_probe), PARAM (probe_timeout) * 1000, &latency)) == 0) break;
+        if (PARAM (verbose)) fprintf (stdout, "Health check of %u failed, error %d\n", process, e);
+        clock_gettime (CLOCK_MONOTONIC, &now);
+        if (now.tv_sec - begun.tv_sec >= PARAM (health_grace)) failures++;
+    }
+    return e;
+}
+
+/// @brief Hands the child over to a new instance, for the `restart` operation
+///
+/// The new instance is spawned while the old one is still running, and is
+/// recorded as `next` in the information file. Once it has called execvp,
+/// and passed the health probe if there is one, it is recorded in place of
+/// the old one, which is then killed and reaped. Any listening sockets stay
+/// open in the watchdog throughout, so connections queue rather than being
+/// refused while neither instance is accepting them.
+///
+/// If the new instance is not ready then it is killed instead, and the
+/// handover recorded as failed.
+///
+/// @return the PID of the child to supervise from now on
+static pid_t handover_child (
+    pid_t child ///<the running child>
+    ) {
+    struct rusage usage;
+    char args[32];
+    pid_t process;
+    int exec[2], e, status;
+    if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, exec)) {
+        process_update (child, "handover", "failed");
+        return child;
+    }
+    process = spawn_child (exec[1]);
+    if (process == (pid_t)-1) {
+        close (exec[0]);
+        process_update (child, "handover", "failed");
+        return child;
+    }
+    if (PARAM (verbose)) fprintf (stdout, "Handing process %u over to %u\n", child, process);
+    snprintf (args, sizeof (args), "%u", process);
+    process_update (child, "next", args);
+    _wait_for_exec (exec[0]);
+    close (exec[0]);
+    e = wait_ready (process);
+    if (!e) e = process_handover (child, process);
+    if (e) {
+        // Not ready, or the old instance was stopped in the meantime
+        if (PARAM (verbose)) fprintf (stdout, "Not handing over to %u, error %d\n", process, e);
+        if (e != ECHILD) {
+            kill_process (process);
+            waitpid (process, &status, 0);
+        }
+        process_unset (child, "next");
+        process_update (child, "handover", "failed");
+        return child;
+    }
+    snprintf (args, sizeof (args), "\"previous\":%u", child);
+    trace_instant ("handover", process, args);
+    trace_instant ("ready", process, NULL);
+    kill_process (child);
+    while ((wait4 (child, &status, 0, &usage) < 0) && (errno == EINTR));
+    if (WIFSIGNALED (status)) {
+        snprintf (args, sizeof (args), "\"signal\":%d", WTERMSIG (status));
+    } else {
+        snprintf (args, sizeof (args), "\"exit\":%d", WEXITSTATUS (status));
+    }
+    trace_instant ("exit", child, args);
+    process_unset (process, "previous");
+    return process;
+}
+
+/// @brief Body of the watchdog process
+///
+/// The watchdog spawns the child, so that it is the child's parent and can
+/// collect its exit status, and reports the child's PID to the `start`
+/// operation over the channel. Once the `start` operation has recorded the
+/// child, and closed its end of the channel, the watchdog supervises the
+/// child until it terminates and then records its status. The child is
+/// recorded as ready at that point, or if a health probe was given by the `c`
+/// parameter only once it first passes the probe.
+///
+/// If a restart policy was given then a terminated child may instead be
+/// spawned again, with an increasing delay between consecutive attempts.
+///
+/// If listening sockets were given by the `s` parameter then the watchdog
+/// reports itself in place of the child, and only spawns the child, passing
+/// it the sockets, when the first connection arrives.
+///
+/// The `restart` operation signals the watchdog with SIGUSR2 to hand the
+/// child over to a new instance with handover_child().
+///
+/// @return the exit code for the watchdog process
+int _fork_watchdog (
+    int channel, ///<the watchdog's end of the socket pair shared with the `start` operation>
+    int exec ///<the watchdog's end of the exec socket pair, closed when the child calls execvp>
+    ) {
+    pid_t child, restarted;
+    struct rusage usage;
+    struct timeval started, now;
+    sigset_t signals;
+    char args[32];
+    int status, e, ready, restarts = 0, attempt = 0;
+    unsigned seed;
+    char c;
+    close_inherited (channel, exec);
+    // SIGTERM is only sent to the watchdog to cancel a pending restart, or
+    // stop it waiting for activation, and SIGUSR1 when a pool member is
+    // claimed or a lease released. SIGUSR2 requests a restart.
+    sigemptyset (&signals);
+    sigaddset (&signals, SIGUSR2);
+    if ((PARAM (restart_mode) != RESTART_NO) || _listen_count) sigaddset (&signals, SIGTERM);
+    if (PARAM (pool_member) || PARAM (shared_lease)) sigaddset (&signals, SIGUSR1);
+    sigprocmask (SIG_BLOCK, &signals, NULL);
+    if (_listen_count) {
+        close (exec);
+        child = getpid ();
+    } else {
+        child = spawn_child (exec);
+        if (child == (pid_t)-1) return errno;
+    }
+    if (write (channel, &child, sizeof (child)) == sizeof (child)) {
+        // Block until the child has been recorded
+        while (read (channel, &c, 1) > 0);
+    }
+    close (channel);
+    // A listening watchdog is ready as soon as connections can queue, but a
+    // child with a health probe only once it first passes the probe
+    ready = _listen_count || !PARAM (health_probe);
+    if (ready) {
+        process_update (child, "ready", NULL);
+        trace_instant ("ready", child, NULL);
+    }
+    if (_listen_count) {
+        e = watchdog_activate (_listen_fds, _listen_count, (PARAM (watch_parent) || PARAM (shared_lease)) ? PARAM (parent_process) : 0);
+        child = e ? 0 : activate_child ();
+        if (!child) {
+            // Recorded as killed, in place of the child that was never needed
+            process_exited (getpid (), SIGTERM, NULL);
+            return 0;
+        }
+        if (PARAM (restart_mode) == RESTART_NO) {
+            sigemptyset (&signals);
+            sigaddset (&signals, SIGTERM);
+            sigprocmask (SIG_UNBLOCK, &signals, NULL);
+        }
+    }
+    gettimeofday (&started, NULL);
+    seed = (unsigned)getpid () ^ (unsigned)started.tv_usec;
+    do {
+        e = watchdog_supervise (child, (PARAM (watch_parent) || PARAM (shared_lease)) ? PARAM (parent_process) : 0, &ready, &status, &usage);
+        if (e == EAGAIN) {
+            restarted = handover_child (child);
+            if (restarted != child) {
+                // Which has already passed the probe
+                child = restarted;
+                ready = 1;
+                attempt = 0;
+                gettimeofday (&started, NULL);
+            }
+            continue;
+        }
+        if (e) return e;
+        if (WIFSIGNALED (status)) {
+            snprintf (args, sizeof (args), "\"signal\":%d", WTERMSIG (status));
+        } else {
+            snprintf (args, sizeof (args), "\"exit\":%d", WEXITSTATUS (status));
+        }
+        trace_instant ("exit", child, args);
+        if (!should_restart (child, status, restarts)) break;
+        // A process that ran for a while is restarted promptly again
+        gettimeofday (&now, NULL);
+        if ((now.tv_sec - started.tv_sec) * 1000 >= WATCHDOG_BACKOFF_MAX) attempt = 0;
+        restarted = restart_child (child, attempt++, &seed);
+        if (!restarted) break;
+        child = restarted;
+        ready = !PARAM (health_probe);
+        restarts++;
+        gettimeofday (&started, NULL);
+    } while (1);
+    process_exited (child, status, &usage);
+    // A process stopped for being idle leaves nothing behind
+    if (PARAM (idle_timeout)) process_forget (child);
+    return 0;
+}
+
+/// @brief Waits for a process started concurrently to become ready
+///
+/// The process is ready once the watchdog records it, as for the caller that
+/// started it, which with a health probe given by the `c` parameter is when
+/// it first passes the probe. The information file is watched with the
+/// descriptor from process_watch(), and the process with a `pidfd`, or
+/// checked once a second if the kernel does not support them.
+///
+/// @return zero if the process is ready, ECHILD if it terminated first,
+///         ETIMEDOUT if the `t` parameter elapsed first, otherwise a
+///         non-zero error code
+static int wait_started (
+    pid_t *process ///<the process, updated if it was restarted>
+    ) {
+    struct process_info *info;
+    struct pollfd fds[2];
+    struct timeval deadline, now;
+    char buffer[4096];
+    const char *pid;
+    int e = 0, wait_ms;
+    gettimeofday (&deadline, NULL);
+    deadline.tv_sec += PARAM (wait_timeout);
+    // Watch for updates before reading the file, so that none are missed
+    fds[0].fd = process_watch ();
+    fds[1].fd = watchdog_open (*process);
+    if (PARAM (verbose)) fprintf (stdout, "Waiting for process %u to be ready\n", *process);
+    do {
+        info = process_load ();
+        pid = process_info_get (info, "pid");
+        if (pid) *process = (pid_t)strtol (pid, NULL, 10);
+        if (!pid || process_info_get (info, "end")) {
+            e = ECHILD;
+        } else if (process_info_get (info, "ready")) {
+            e = 0;
+        } else {
+            e = EINPROGRESS;
+        }
+        process_info_free (info);
+        if (e != EINPROGRESS) break;
+        if (PARAM (wait_timeout) < 0) {
+            wait_ms = -1;
+        } else {
+            gettimeofday (&now, NULL);
+            wait_ms = (deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_usec - now.tv_usec) / 1000;
+            if (wait_ms <= 0) {
+                e = ETIMEDOUT;
+                break;
+            }
+        }
+        if ((fds[0].fd < 0) || (fds[1].fd < 0)) {
+            if ((wait_ms < 0) || (wait_ms > 1000)) wait_ms = 1000;
+        }
+        fds[0].events = fds[1].events = POLLIN;
+        fds[0].revents = fds[1].revents = 0;
+        if ((poll (fds, 2, wait_ms) < 0) && (errno != EINTR)) {
+            e = errno;
+            break;
+        }
+        if ((fds[0].fd >= 0) && (fds[0].revents & POLLIN)) {
+            while (read (fds[0].fd, buffer, sizeof (buffer)) > 0);
+        }
+        if ((fds[1].fd >= 0) && (fds[1].revents & POLLIN)) {
+            // Only the first instance is watched; a restarted one, which the
+            // watchdog records, is checked for once a second
+            close (fds[1].fd);
+            fds[1].fd = -1;
+        }
+    } while (1);
+    if (fds[0].fd >= 0) close (fds[0].fd);
+    if (fds[1].fd >= 0) close (fds[1].fd);
+    return e;
+}
+
+#endif /* ifdef _WIN32 */
+
+/// @brief Starts the child process unless it is already running
+///
+/// @return zero if successful, otherwise a non-zero error code
+static int start_process (
+    int waited ///<non-zero if a concurrent start of the identifier was waited for>
+    ) {
+    double phase, traced;
     int e;
 	_WIN32_OR_POSIX (HANDLE, pid_t) process;
-    if (verbose) fprintf (stdout, "Spawning child process\n");
+#ifdef _WIN32
+	PROCESS_INFORMATION pi;
+#else /* ifdef _WIN32 */
+    pid_t watch_process;
+    char *addresses = NULL;
+    int channel[2], exec[2];
+#endif /* ifdef _WIN32 */
     process = process_find ();
+#ifndef _WIN32
+    if (process) process_touch (process);
+    if (process && PARAM (shared_lease) && !process_lease (process, PARAM (parent_process))) {
+        if (PARAM (verbose)) fprintf (stdout, "Process %u already running, leased to %u\n", process, PARAM (parent_process));
+        return 0;
+    }
+    if (process && waited) {
+        if ((e = wait_started (&process)) != 0) {
+            if (PARAM (verbose)) fprintf (stdout, "Process %u started concurrently is not ready, error %d\n", process, e);
+            return e;
+        }
+        if (PARAM (verbose)) fprintf (stdout, "Process %u started concurrently\n", process);
+        return 0;
+    }
+#endif /* ifndef _WIN32 */
     if (process) {
-        if (verbose) fprintf (stdout, "Process %u already running\n", _WIN32_OR_POSIX (GetProcessId (process), process));
+        if (PARAM (verbose)) fprintf (stdout, "Process %u already running\n", _WIN32_OR_POSIX (GetProcessId (process), process));
 #ifdef _WIN32
 		CloseHandle (process);
 #endif /* ifdef _WIN32 */
         return _WIN32_OR_POSIX (ERROR_ALREADY_EXISTS, EALREADY);
-    } else {
+    }
+#ifndef _WIN32
+    if (PARAM (pool_name) && !PARAM (pool_member)) {
+        e = pool_claim ();
+        if (e != EAGAIN) return e;
+        if (PARAM (verbose)) fprintf (stdout, "No ready process in pool %s\n", PARAM (pool_name));
+    }
+#endif /* ifndef _WIN32 */
 #ifdef _WIN32
-		PROCESS_INFORMATION pi;
-		if (!spawn_process (&pi)) {
-			return GetLastError ();
-		} else {
-			if (verbose) fprintf (stdout, "Child process %u spawned\n", pi.dwProcessId);
-			process = pi.hProcess;
+	if (PARAM (listen_spec) || PARAM (core_count)) return ERROR_NOT_SUPPORTED;
+	phase = timing_now ();
+	traced = trace_now ();
+	if (!spawn_process (&pi)) {
+		return GetLastError ();
+	}
+	timing_record ("spawn", phase);
+	trace_complete ("spawn", pi.dwProcessId, traced, NULL);
+	if (PARAM (verbose)) fprintf (stdout, "Child process %u spawned\n", pi.dwProcessId);
+	process = pi.hProcess;
+	CloseHandle (pi.hThread);
+	phase = timing_now ();
+	e = process_save (process, 0);
+	timing_record ("save", phase);
+	if (e) {
+		fprintf (stderr, "Couldn't write process information, error %d\n", e);
+	}
+	if (PARAM (watch_parent)) {
+		char szExecutable[MAX_PATH];
+		char szParams[64];
+		STARTUPINFO si;
+		DWORD watch_process = 0;
+		sprintf (szParams, "procctrl.exe fork watchdog %u %u", GetProcessId (process), GetProcessId (PARAM (parent_process)));
+		ZeroMemory (&si, sizeof (si));
+		si.cb = sizeof (si);
+		if (GetModuleFileName (NULL, szExecutable, sizeof (szExecutable) / sizeof (TCHAR))
+		 && CreateProcess (szExecutable, szParams, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi)) {
+			watch_process = pi.dwProcessId;
+			CloseHandle (pi.hProcess);
 			CloseHandle (pi.hThread);
+		}
+		if (PARAM (verbose)) fprintf (stdout, "Watchdog process %u spawned\n", watch_process);
+	}
+	return 0;
 #else /* ifdef _WIN32 */
-        process = fork ();
-        if (process) {
-            if (process == (pid_t)-1) return errno;
-            if (verbose) fprintf (stdout, "Child process %u spawned\n", process);
-            _wait_for_execvp (process);
-#endif /* ifdef _WIN32 */
-            e = process_save (process);
-            if (e) {
-                fprintf (stderr, "Couldn't write process information, error %d\n", e);
-            }
-            if (watch_parent) {
-#ifdef _WIN32
-				char szExecutable[MAX_PATH];
-				char szParams[64];
-				STARTUPINFO si;
-				PROCESS_INFORMATION pi;
-				DWORD watch_process = 0;
-				sprintf (szParams, "procctrl.exe fork watchdog %u %u", GetProcessId (process), GetProcessId (parent_process));
-				ZeroMemory (&si, sizeof (si));
-				si.cb = sizeof (si);
-				if (GetModuleFileName (NULL, szExecutable, sizeof (szExecutable) / sizeof (TCHAR))
-				 && CreateProcess (szExecutable, szParams, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi)) {
-					watch_process = pi.dwProcessId;
-					CloseHandle (pi.hProcess);
-					CloseHandle (pi.hThread);
-				}
-#else /* ifdef _WIN32 */
-                pid_t watch_process = fork ();
-                if (!watch_process) exit (_fork_watchdog (process, parent_process));
-                if (watch_process == (pid_t)-1) return errno;
+    if (PARAM (core_count)) {
+        char *cpus;
+        if ((e = process_reserve_cores (PARAM (core_count), &cpus)) != 0) {
+            fprintf (stderr, "Couldn't reserve %d cores, error %d\n", PARAM (core_count), e);
+            return e;
+        }
+        if (PARAM (verbose)) fprintf (stdout, "Dedicated CPUs %s\n", cpus);
+        // Applied to the child, and recorded, as if given by the a parameter;
+        // operation_start() puts the caller's list back afterwards
+        PARAM (cpu_affinity) = cpus;
+    }
+    if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel)) return errno;
+    if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, exec)) {
+        e = errno;
+        close (channel[0]);
+        close (channel[1]);
+        return e;
+    }
+    if (PARAM (listen_spec) && ((e = listen_open (PARAM (listen_spec), &_listen_fds, &_listen_count, &addresses)) != 0)) {
+        fprintf (stderr, "Couldn't listen on %s, error %d\n", PARAM (listen_spec), e);
+        close (channel[0]);
+        close (channel[1]);
+        close (exec[0]);
+        close (exec[1]);
+        return e;
+    }
+    fflush (stdout);
+    fflush (stderr);
+    phase = timing_now ();
+    traced = trace_now ();
+    watch_process = fork ();
+    if (!watch_process) {
+        close (channel[0]);
+        close (exec[0]);
+        e = _fork_watchdog (channel[1], exec[1]);
+        // Streams inherited from the caller, such as stdin being read by the
+        // batch operation, share their file offsets with it so must not be
+        // synchronised by exit; only the watchdog's own output is flushed
+        fflush (stdout);
+        fflush (stderr);
+        _exit (e);
+    }
+    e = errno;
+    close (channel[1]);
+    close (exec[1]);
+    if (_listen_count) {
+        // Only the watchdog holds the listening sockets
+        listen_close (_listen_fds, _listen_count);
+        _listen_fds = NULL;
+        _listen_count = 0;
+    }
+    if (watch_process == (pid_t)-1) {
+        close (channel[0]);
+        close (exec[0]);
+        free (addresses);
+        return e;
+    }
+    timing_record ("fork", phase);
+    if (PARAM (verbose)) fprintf (stdout, "Watchdog process %u spawned\n", watch_process);
+    phase = timing_now ();
+    if (read (channel[0], &process, sizeof (process)) != sizeof (process)) {
+        // The watchdog couldn't spawn the child; its exit code is the error
+        close (channel[0]);
+        close (exec[0]);
+        free (addresses);
+        if ((waitpid (watch_process, &e, 0) == watch_process) && WIFEXITED (e) && WEXITSTATUS (e)) return WEXITSTATUS (e);
+        return ECHILD;
+    }
+    timing_record ("spawn", phase);
+    trace_complete ("spawn", process, traced, NULL);
+    if (addresses) {
+        if (PARAM (verbose)) fprintf (stdout, "Watchdog process %u listening on %s\n", process, addresses);
+    } else {
+        if (PARAM (verbose)) fprintf (stdout, "Child process %u spawned\n", process);
+    }
+    phase = timing_now ();
+    traced = trace_now ();
+    _wait_for_exec (exec[0]);
+    close (exec[0]);
+    timing_record ("exec_wait", phase);
+    trace_complete ("exec", process, traced, NULL);
+    phase = timing_now ();
+    e = process_save (process, watch_process);
+    if (!e && addresses) {
+        e = process_update (process, "listen", addresses);
+        if (!e) e = process_update (process, "activation", "pending");
+    }
+    free (addresses);
+    timing_record ("save", phase);
+    if (e) {
+        fprintf (stderr, "Couldn't write process information, error %d\n", e);
+    }
+    // Release the watchdog
+    close (channel[0]);
+    return 0;
 #endif /* ifdef _WIN32 */
-                if (verbose) fprintf (stdout, "Watchdog process %u spawned\n", watch_process);
-            }
-            return 0;
+}
+
+/// @brief Starts the child process
+///
+/// If there is not already an active process with the symbolic identifier
+/// then a process is spawned.
+///
+/// On Windows, if the parent process must be watched for termination then an
+/// additional watchdog process is also spawned.
+///
+/// On other platforms a watchdog process is always spawned, which in turn
+/// spawns the child. This lets it collect the exit status of the child as
+/// well as watching the parent process if required. A process shared by the
+/// `L` parameter that is already running is leased to the parent instead of
+/// failing. If a pool is named by the
+/// `w` parameter then a ready member of it is claimed instead, if there is
+/// one, and a replacement member started.
+///
+/// If listening sockets are given by the `s` parameter then they are bound
+/// before the watchdog is spawned, and the operation returns without waiting
+/// for the child, which the watchdog only spawns on the first connection.
+///
+/// Finding the process already running counts as a use of it for the idle
+/// timeout given by the `I` parameter.
+///
+/// If dedicated cores are requested by the `A` parameter then they are
+/// reserved before the watchdog is spawned, and held by the process from
+/// when it is recorded until it terminates; see process_reserve_cores().
+///
+/// Concurrent starts of the same identifier are single-flight; the first
+/// spawns the process while the others block on its start lock, and then
+/// wait for the process it recorded to be ready, rather than spawning
+/// another, for up to the `t` parameter.
+///
+/// @return zero if successful, otherwise a non-zero error code
+int operation_start () {
 #ifndef _WIN32
-        } else {
-            execvp (spawn_argv[0], spawn_argv);
-            e = errno;
-            fprintf (stderr, "Couldn't run %s, error %d\n", spawn_argv[0], e);
-            return e;
+    const char *affinity = PARAM (cpu_affinity);
+    int lock, waited, e;
 #endif /* ifndef _WIN32 */
-        }
+    if (PARAM (verbose)) fprintf (stdout, "Spawning child process\n");
+#ifdef _WIN32
+	return start_process (0);
+#else /* ifdef _WIN32 */
+    lock = process_lock_start (&waited);
+    e = start_process (waited);
+    if (PARAM (core_count)) {
+        process_unreserve_cores ();
+        // The context may be a shallow copy, such as a pool member's, so the
+        // reserved list is freed rather than the caller's
+        if (PARAM (cpu_affinity) != affinity) free ((char*)PARAM (cpu_affinity));
+        PARAM (cpu_affinity) = affinity;
     }
+    if (lock >= 0) process_unlock_start (lock);
+    return e;
+#endif /* ifdef _WIN32 */
 }
@@ -0,0 +1,233 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Process resource statistics
+
+#include "stats.h"
+#include "params.h"
+#include "parent.h"
+#include "procfs.h"
+#ifndef _WIN32
+# include <dirent.h>
+# include <errno.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// @brief Buffer for reading files from `/proc`, reused between reads
+static THREAD_LOCAL char *_buffer = NULL;
+/// @brief The allocated size of _buffer
+static THREAD_LOCAL size_t _buffer_size = 0;
+
+/// @brief Reads a file from a process' `/proc` folder into _buffer
+///
+/// The whole file is read with as few system calls as possible and the buffer
+/// is grown, and kept, if the file is larger than any read so far.
+///
+/// @return the number of bytes read, or -1 if the file could not be read
+static ssize_t read_proc (
+    pid_t process, ///<the process to read from>
+    const char *file ///<the name of the file in the process' folder>
+    ) {
+    ssize_t len = 0, n;
+    int fd;
+    fd = procfs_open (process, file);
+    if (fd < 0) return -1;
+    do {
+        if ((size_t)len + 1 >= _buffer_size) {
+            _buffer_size = _buffer_size ? _buffer_size * 2 : 4096;
+            _buffer = (char*)realloc (_buffer, _buffer_size);
+            if (!_buffer) abort ();
+        }
+        n = read (fd, _buffer + len, _buffer_size - len - 1);
+        if (n > 0) len += n;
+    } while ((n > 0) || ((n < 0) && (errno == EINTR)));
+    close (fd);
+    if (n < 0) return -1;
+    _buffer[len] = 0;
+    return len;
+}
+
+/// @brief Finds a `name: value` field in _buffer
+///
+/// @return the numeric value of the field, or zero if it is not present
+static unsigned long long read_field (
+    const char *name ///<the field name, including the `:`>
+    ) {
+    const char *ptr;
+    for (ptr = strstr (_buffer, name); ptr; ptr = strstr (ptr + 1, name)) {
+        if ((ptr == _buffer) || (ptr[-1] == '\n')) return strtoull (ptr + strlen (name), NULL, 10);
+    }
+    return 0;
+}
+
+/// @brief Adds the resources used by a single process to the totals
+///
+/// @return zero if the process was read, ESRCH if it has terminated
+static int gather_process (
+    pid_t process, ///<the process to query>
+    struct process_stats *stats ///<the totals to update>
+    ) {
+    unsigned long long utime, stime, size, resident;
+    unsigned threads;
+    const char *ptr;
+    DIR *dir;
+    // CPU time and threads; the command name may contain spaces so skip it
+    if (read_proc (process, "stat") <= 0) return ESRCH;
+    ptr = strrchr (_buffer, ')');
+    if (!ptr || (sscanf (ptr + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %u", &utime, &stime, &threads) != 3)) return ESRCH;
+    stats->processes++;
+    stats->threads += threads;
+    stats->utime += utime * 1000 / sysconf (_SC_CLK_TCK);
+    stats->stime += stime * 1000 / sysconf (_SC_CLK_TCK);
+    // Memory
+    if ((read_proc (process, "statm") > 0) && (sscanf (_buffer, "%llu %llu", &size, &resident) == 2)) {
+        stats->rss += resident * sysconf (_SC_PAGESIZE);
+    }
+    if (read_proc (process, "smaps_rollup") > 0) {
+        stats->pss += read_field ("Pss:") * 1024;
+    }
+    // I/O, which is only readable by the process' owner
+    if (read_proc (process, "io") > 0) {
+        stats->read_bytes += read_field ("read_bytes:");
+        stats->write_bytes += read_field ("write_bytes:");
+    }
+    // File descriptors
+    dir = procfs_opendir (process, "fd");
+    if (dir) {
+        struct dirent *ent;
+        while ((ent = readdir (dir)) != NULL) {
+            if (ent->d_name[0] != '.') stats->fds++;
+        }
+        closedir (dir);
+    }
+    return 0;
+}
+
+#endif /* ifndef _WIN32 */
+
+/// @brief Gathers the resources used by a single process
+///
+/// The descendants of the process are not included.
+///
+/// @return zero if successful, ESRCH if the process is not running, or
+///         another non-zero error code
+int stats_process (
+	_WIN32_OR_POSIX (HANDLE, pid_t) process, ///<the process to query>
+    struct process_stats *stats ///<the totals to populate>
+    ) {
+#ifdef _WIN32
+	return ERROR_NOT_SUPPORTED;
+#else /* ifdef _WIN32 */
+    memset (stats, 0, sizeof (struct process_stats));
+    return gather_process (process, stats);
+#endif /* ifdef _WIN32 */
+}
+
+/// @brief Gathers the resources used by a process tree
+///
+/// The totals include the process and all of its descendants, found in the
+/// same way as kill_process(pid_t) finds them.
+///
+/// @return zero if successful, ESRCH if the process is not running, or
+///         another non-zero error code
+int stats_gather (
+	_WIN32_OR_POSIX (HANDLE, pid_t) process, ///<the process at the head of the tree>
+    struct process_stats *stats ///<the totals to populate>
+    ) {
+#ifdef _WIN32
+	return ERROR_NOT_SUPPORTED;
+#else /* ifdef _WIN32 */
+    struct pid_list *pending;
+    int e;
+    memset (stats, 0, sizeof (struct process_stats));
+    if ((e = gather_process (process, stats)) != 0) return e;
+    pending = get_children (process);
+    while (pending) {
+        struct pid_list *entry = pending, *children;
+        pending = entry->next;
+        if (gather_process (entry->pid, stats) == 0) {
+            children = get_children (entry->pid);
+            if (children) {
+                struct pid_list *last = children;
+                while (last->next) last = last->next;
+                last->next = pending;
+                pending = children;
+            }
+        }
+        free (entry);
+    }
+    return 0;
+#endif /* ifdef _WIN32 */
+}
+
+/// @brief Writes a JSON string value
+///
+/// Quotes, backslashes and control characters are escaped so that any process
+/// identifier can be written.
+void stats_json_string (
+    FILE *out, ///<the stream to write to>
+    const char *str ///<the string to write>
+    ) {
+    fputc ('\"', out);
+    for (; *str; str++) {
+        if ((*str == '\"') || (*str == '\\')) {
+            fprintf (out, "\\%c", *str);
+        } else if ((unsigned char)*str < 0x20) {
+            fprintf (out, "\\u%04x", (unsigned char)*str);
+        } else {
+            fputc (*str, out);
+        }
+    }
+    fputc ('\"', out);
+}
+
+/// @brief Writes resource usage totals
+///
+/// The totals are written either as human readable lines, or as a single line
+/// JSON object. The placement and priority of the process are only written if
+/// it was given them.
+void stats_write (
+    FILE *out, ///<the stream to write to>
+    const struct process_stats *stats, ///<the totals to write>
+    int json ///<non-zero to write JSON, zero for human readable output>
+    ) {
+    if (json) {
+        fprintf (out, "{\"processes\":%u,\"threads\":%u,\"fds\":%u,\"utime\":%llu.%03u,\"stime\":%llu.%03u,\"rss\":%llu,\"pss\":%llu,\"read_bytes\":%llu,\"write_bytes\":%llu,\"restarts\":%u",
+            stats->processes, stats->threads, stats->fds,
+            stats->utime / 1000, (unsigned)(stats->utime % 1000), stats->stime / 1000, (unsigned)(stats->stime % 1000),
+            stats->rss, stats->pss, stats->read_bytes, stats->write_bytes, stats->restarts);
+        if (stats->cpus) fprintf (out, ",\"cpus\":\"%s\"", stats->cpus);
+        if (stats->mempolicy) fprintf (out, ",\"mempolicy\":\"%s\"", stats->mempolicy);
+        if (stats->nice) fprintf (out, ",\"nice\":%s", stats->nice);
+        if (stats->sched) fprintf (out, ",\"sched\":\"%s\"", stats->sched);
+        if (stats->ioprio) fprintf (out, ",\"ioprio\":\"%s\"", stats->ioprio);
+        fprintf (out, "}\n");
+    } else {
+        fprintf (out, "Processes          : %u\n", stats->processes);
+        fprintf (out, "Threads            : %u\n", stats->threads);
+        fprintf (out, "Open files         : %u\n", stats->fds);
+        fprintf (out, "User CPU           : %llu.%03us\n", stats->utime / 1000, (unsigned)(stats->utime % 1000));
+        fprintf (out, "System CPU         : %llu.%03us\n", stats->stime / 1000, (unsigned)(stats->stime % 1000));
+        fprintf (out, "Resident (RSS)     : %llu\n", stats->rss);
+        fprintf (out, "Proportional (PSS) : %llu\n", stats->pss);
+        fprintf (out, "Bytes read         : %llu\n", stats->read_bytes);
+        fprintf (out, "Bytes written      : %llu\n", stats->write_bytes);
+        fprintf (out, "Restarts           : %u\n", stats->restarts);
+        if (stats->cpus) fprintf (out, "CPUs               : %s\n", stats->cpus);
+        if (stats->mempolicy) fprintf (out, "Memory policy      : %s\n", stats->mempolicy);
+        if (stats->nice) fprintf (out, "Nice value         : %s\n", stats->nice);
+        if (stats->sched) fprintf (out, "Scheduling policy  : %s\n", stats->sched);
+        if (stats->ioprio) fprintf (out, "I/O priority       : %s\n", stats->ioprio);
+    }
+    fflush (out);
+}
@@ -0,0 +1,77 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifndef __inc_stats_h
+#define __inc_stats_h
+
+/// @file
+/// @brief Process resource statistics
+///
+/// Header file for the resource usage functions published by stats.c.
+
+#ifdef _WIN32
+
+#include <Windows.h>
+
+#define _WIN32_OR_POSIX(a,b) a
+
+#else /* ifdef _WIN32 */
+
+#include <sys/types.h>
+
+#define _WIN32_OR_POSIX(a,b) b
+
+#endif /* ifdef _WIN32 */
+
+#include <stdio.h>
+
+/// @brief Resource usage totals for a process tree
+struct process_stats {
+    /// @brief The number of processes in the tree
+    unsigned processes;
+    /// @brief The number of threads
+    unsigned threads;
+    /// @brief The number of open file descriptors
+    unsigned fds;
+    /// @brief User CPU time, in milliseconds
+    unsigned long long utime;
+    /// @brief System CPU time, in milliseconds
+    unsigned long long stime;
+    /// @brief Resident set size, in bytes
+    unsigned long long rss;
+    /// @brief Proportional set size, in bytes
+    unsigned long long pss;
+    /// @brief Bytes read from storage
+    unsigned long long read_bytes;
+    /// @brief Bytes written to storage
+    unsigned long long write_bytes;
+    /// @brief The number of times the process has been started again, from
+    ///        its information file rather than the process table
+    unsigned restarts;
+    /// @brief The CPUs the process was started on, from its information
+    ///        file, or NULL if not placed
+    const char *cpus;
+    /// @brief The memory policy the process was started with, from its
+    ///        information file, or NULL if not placed
+    const char *mempolicy;
+    /// @brief The nice value the process was given, from its information
+    ///        file, or NULL if not set
+    const char *nice;
+    /// @brief The scheduling policy the process was given, from its
+    ///        information file, or NULL if not set
+    const char *sched;
+    /// @brief The I/O priority the process was given, from its information
+    ///        file, or NULL if not set
+    const char *ioprio;
+};
+
+int stats_process (_WIN32_OR_POSIX (HANDLE, pid_t) process, struct process_stats *stats);
+int stats_gather (_WIN32_OR_POSIX (HANDLE, pid_t) process, struct process_stats *stats);
+void stats_json_string (FILE *out, const char *str);
+void stats_write (FILE *out, const struct process_stats *stats, int json);
+
+#endif /* ifndef __inc_stats_h */
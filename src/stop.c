@@ -12,6 +12,9 @@
 #include "kill.h"
 #include "params.h"
 #include "process.h"
+#include "procfs.h"
+#include "timing.h"
+#include "trace.h"
 #ifndef _WIN32
 # include <errno.h>
 # include <signal.h>
@@ -19,26 +22,90 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifndef _WIN32
+
+/// @brief Cancels a pending restart of the child process
+///
+/// If the child has terminated and its watchdog is waiting to restart it
+/// then the information file is marked as stopped and the watchdog is
+/// signalled, so that it records the termination instead.
+///
+/// @return zero if a restart was cancelled, ESRCH if there was none pending
+static int cancel_restart () {
+    struct process_info *info = process_load ();
+    const char *pid = process_info_get (info, "pid");
+    const char *wdog = process_info_get (info, "wdog");
+    int e = ESRCH;
+    if (pid && wdog && process_info_get (info, "restart") && !process_info_get (info, "end")) {
+        if (PARAM (verbose)) fprintf (stdout, "Cancelling restart of process %s\n", pid);
+        if (!process_update ((pid_t)strtol (pid, NULL, 10), "stop", NULL)) {
+            trace_instant ("stop_request", (pid_t)strtol (pid, NULL, 10), NULL);
+            e = procfs_signal ((pid_t)strtol (wdog, NULL, 10), SIGTERM) ? errno : 0;
+        }
+    }
+    process_info_free (info);
+    return e;
+}
+
+/// @brief Tells the watchdog of a shared process that a lease was released
+///
+/// The watchdog is signalled with SIGUSR1, so that if it was watching the
+/// parent that released the lease it moves on to another leaseholder.
+///
+/// @return zero if successful, otherwise a non-zero error code
+static int release_lease () {
+    struct process_info *info = process_load ();
+    const char *wdog = process_info_get (info, "wdog");
+    int e = 0;
+    if (wdog && procfs_signal ((pid_t)strtol (wdog, NULL, 10), SIGUSR1)) e = errno;
+    process_info_free (info);
+    return e;
+}
+
+#endif /* ifndef _WIN32 */
+
 /// @brief Stops the child process
 ///
 /// If there is an active process with the symbolic identifier then it is
 /// killed. If there is a watchdog process from the original spawn then that
-/// will also terminate when it detects the child termination.
+/// will also terminate when it detects the child termination. If the watchdog
+/// is waiting to restart the child then the restart is cancelled.
+///
+/// A process shared by the `L` parameter is only killed once the parent has
+/// released its lease and no other leaseholder is running, whether or not
+/// the `L` parameter is given to the `stop` operation.
 ///
 /// @return zero if successful, otherwise a non-zero error code
 int operation_stop () {
 	_WIN32_OR_POSIX (HANDLE, pid_t) process;
-    if (verbose) fprintf (stdout, "Stopping spawned process\n");
+    if (PARAM (verbose)) fprintf (stdout, "Stopping spawned process\n");
     process = process_find ();
 	if (process) {
-        if (verbose) fprintf (stdout, "Killing process %u\n", _WIN32_OR_POSIX (GetProcessId (process), process));
-        int result = kill_process (process);
+        double phase;
+        int result;
+#ifndef _WIN32
+        int remaining;
+        if ((result = process_release (process, PARAM (parent_process), &remaining)) != 0) return result;
+        if (remaining) {
+            if (PARAM (verbose)) fprintf (stdout, "Process %u still leased by %d others\n", process, remaining);
+            return release_lease ();
+        }
+#endif /* ifndef _WIN32 */
+        if (PARAM (verbose)) fprintf (stdout, "Killing process %u\n", _WIN32_OR_POSIX (GetProcessId (process), process));
+        process_update (_WIN32_OR_POSIX (GetProcessId (process), process), "stop", NULL);
+        trace_instant ("stop_request", _WIN32_OR_POSIX (GetProcessId (process), process), NULL);
+        phase = timing_now ();
+        result = kill_process (process);
+        timing_record ("kill", phase);
 #ifdef _WIN32
 		CloseHandle (process);
 #endif /* ifdef _WIN32 */
 		return result;
     } else {
-        if (verbose) fprintf (stdout, "No process to stop\n");
+#ifndef _WIN32
+        if (!cancel_restart ()) return 0;
+#endif /* ifndef _WIN32 */
+        if (PARAM (verbose)) fprintf (stdout, "No process to stop\n");
 		return _WIN32_OR_POSIX (ERROR_NOT_FOUND, ESRCH);
     }
 }
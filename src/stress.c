@@ -0,0 +1,420 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Concurrent stress test of the data folder
+///
+/// Built and run with `make stress`. Many clients are forked, each running a
+/// sequence of procctrl invocations - start, query, stop and housekeeping -
+/// on random identifiers in both the global and the client's local scope,
+/// against a single data folder.
+///
+/// When all of the operations have completed, while the clients are still
+/// running so that their local scopes are valid, the registry is checked:
+///
+///  - every information file can be read and has the required fields
+///  - no temporary files have been left behind
+///  - every file recording a running process matches a live process
+///  - every live process that was started is recorded in a file
+///
+/// A process that is running but not recorded was either started twice for
+/// the same identifier or had its file lost by a racing housekeep.
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#include "process.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/// @brief The operations run by the clients
+static const char *_operations[] = { "start", "query", "stop", "housekeep" };
+
+/// @brief The number of entries in _operations
+#define STRESS_OPERATIONS   4
+
+/// @brief The number of times the registry is checked before reporting a fault
+///
+/// A watchdog may not yet have recorded the termination of a stopped process
+/// when the clients finish so the check is repeated while there are faults.
+#define STRESS_ATTEMPTS     10
+
+/// @brief The result counts for one operation
+struct stress_counts {
+    /// @brief The number of invocations
+    unsigned long calls;
+    /// @brief The number that succeeded
+    unsigned long ok;
+    /// @brief The number that failed with an expected error, for example
+    ///        stopping a process that isn't running
+    unsigned long expected;
+    /// @brief The number that failed with an unexpected error
+    unsigned long errors;
+};
+
+/// @brief The registry faults found by check_registry()
+struct stress_faults {
+    /// @brief Information files that couldn't be read or were missing fields
+    int corrupt;
+    /// @brief Temporary files left behind
+    int temporary;
+    /// @brief Files recording a running process that isn't
+    int stale;
+    /// @brief Live processes not recorded by any file
+    int untracked;
+    /// @brief Live processes recorded by a file
+    int tracked;
+};
+
+/// @brief The procctrl executable
+static const char *_procctrl = "./procctrl";
+
+/// @brief The data folder
+static char _data_dir[16];
+
+/// @brief The argument that identifies processes started by this run
+///
+/// `sleep` accepts a fractional duration so the PID of this process is put
+/// after the decimal point to make the command line unique.
+static char _marker[32];
+
+/// @brief Runs one procctrl invocation and waits for it to complete
+///
+/// @return the exit code, or -1 if it couldn't be run
+static int invoke (
+    int operation, ///<the index of the operation in _operations>
+    int global, ///<non-zero to use the global scope>
+    int identifier ///<the identifier number>
+    ) {
+    char key[24];
+    char *argv[12];
+    int argc = 0, status;
+    pid_t child;
+    snprintf (key, sizeof (key), "stress%d", identifier);
+    argv[argc++] = (char*)_procctrl;
+    argv[argc++] = "-d";
+    argv[argc++] = _data_dir;
+    if (global) argv[argc++] = "-K";
+    argv[argc++] = "-k";
+    if (operation == 3) {
+        // Housekeeping runs before and after any operation; query an
+        // identifier that is never started
+        argv[argc++] = "stress-housekeep";
+        argv[argc++] = "query";
+    } else {
+        argv[argc++] = key;
+        argv[argc++] = (char*)_operations[operation];
+        if (operation == 0) {
+            argv[argc++] = "sleep";
+            argv[argc++] = _marker;
+        }
+    }
+    argv[argc] = NULL;
+    child = fork ();
+    if (child == 0) {
+        int null = open ("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2 (null, STDOUT_FILENO);
+            dup2 (null, STDERR_FILENO);
+            close (null);
+        }
+        execv (_procctrl, argv);
+        _exit (127);
+    }
+    if (child < 0) return -1;
+    if ((waitpid (child, &status, 0) != child) || !WIFEXITED (status)) return -1;
+    return WEXITSTATUS (status);
+}
+
+/// @brief Tests if an exit code is expected for an operation
+///
+/// @return non-zero if the code is a normal outcome under contention
+static int is_expected (
+    int operation, ///<the index of the operation in _operations>
+    int code ///<the exit code>
+    ) {
+    switch (operation) {
+        case 0 : return code == (EALREADY & 0xFF);
+        case 1 :
+        case 2 : return code == (ESRCH & 0xFF);
+        default : return code == (ESRCH & 0xFF);
+    }
+}
+
+/// @brief Body of a client process
+///
+/// Runs the operations, writes the counts to the results pipe and then waits
+/// for the release pipe to be closed before exiting.
+static void client (
+    int operations, ///<the number of operations to run>
+    int identifiers, ///<the number of distinct identifiers>
+    unsigned seed, ///<the random seed>
+    int results, ///<the pipe to write the counts to>
+    int release ///<the pipe that is closed when the client may exit>
+    ) {
+    struct stress_counts counts[STRESS_OPERATIONS];
+    char c;
+    int i;
+    memset (counts, 0, sizeof (counts));
+    for (i = 0; i < operations; i++) {
+        int operation = rand_r (&seed) % STRESS_OPERATIONS;
+        int global = rand_r (&seed) % 2;
+        int code = invoke (operation, global, rand_r (&seed) % identifiers);
+        counts[operation].calls++;
+        if (code == 0) {
+            counts[operation].ok++;
+        } else if (is_expected (operation, code)) {
+            counts[operation].expected++;
+        } else {
+            counts[operation].errors++;
+        }
+    }
+    if (write (results, counts, sizeof (counts)) != sizeof (counts)) _exit (1);
+    close (results);
+    while (read (release, &c, 1) > 0);
+    _exit (0);
+}
+
+/// @brief Tests if a process was started by this run
+///
+/// @return non-zero if the process is a live `sleep` with the marker argument
+static int is_marked (
+    pid_t process ///<the process to test>
+    ) {
+    char path[32], cmdline[64], expected[64];
+    size_t len, expected_len;
+    FILE *in;
+    snprintf (path, sizeof (path), "/proc/%u/cmdline", process);
+    in = fopen (path, "rb");
+    if (!in) return 0;
+    len = fread (cmdline, 1, sizeof (cmdline), in);
+    fclose (in);
+    expected_len = snprintf (expected, sizeof (expected), "sleep%c%s", 0, _marker) + 1;
+    return (len == expected_len) && !memcmp (cmdline, expected, len);
+}
+
+/// @brief Checks the registry against the live processes
+static void check_registry (
+    struct stress_faults *faults ///<receives the faults found>
+    ) {
+    pid_t *recorded = NULL;
+    int count = 0, size = 0, i;
+    DIR *dir, *scope;
+    struct dirent *ent, *file;
+    char path[256];
+    memset (faults, 0, sizeof (*faults));
+    dir = opendir (_data_dir);
+    if (!dir) return;
+    while ((ent = readdir (dir)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        if (snprintf (path, sizeof (path), "%s/%s", _data_dir, ent->d_name) >= (int)sizeof (path)) continue;
+        scope = opendir (path);
+        if (!scope) continue;
+        while ((file = readdir (scope)) != NULL) {
+            struct process_info *info;
+            const char *pid;
+            if (file->d_name[0] == '.') continue;
+            if (snprintf (path, sizeof (path), "%s/%s/%s", _data_dir, ent->d_name, file->d_name) >= (int)sizeof (path)) continue;
+            if (file->d_name[strlen (file->d_name) - 1] == '~') {
+                faults->temporary++;
+                continue;
+            }
+            info = process_info_read (path);
+            pid = process_info_get (info, "pid");
+            if (!pid || !process_info_get (info, "cmd") || !process_info_get (info, "start")) {
+                faults->corrupt++;
+            } else if (!process_info_get (info, "end")) {
+                pid_t process = (pid_t)strtol (pid, NULL, 10);
+                if (is_marked (process)) {
+                    if (count == size) {
+                        size = size ? size * 2 : 64;
+                        recorded = (pid_t*)realloc (recorded, size * sizeof (pid_t));
+                        if (!recorded) abort ();
+                    }
+                    recorded[count++] = process;
+                } else {
+                    faults->stale++;
+                }
+            }
+            process_info_free (info);
+        }
+        closedir (scope);
+    }
+    closedir (dir);
+    dir = opendir ("/proc");
+    if (dir) {
+        while ((ent = readdir (dir)) != NULL) {
+            pid_t process;
+            if (!isdigit (ent->d_name[0])) continue;
+            process = (pid_t)strtol (ent->d_name, NULL, 10);
+            if (!is_marked (process)) continue;
+            for (i = 0; (i < count) && (recorded[i] != process); i++);
+            if (i < count) {
+                faults->tracked++;
+            } else {
+                faults->untracked++;
+            }
+        }
+        closedir (dir);
+    }
+    free (recorded);
+}
+
+/// @brief Terminates every process started by this run
+static void kill_marked () {
+    DIR *dir = opendir ("/proc");
+    struct dirent *ent;
+    if (!dir) return;
+    while ((ent = readdir (dir)) != NULL) {
+        pid_t process;
+        if (!isdigit (ent->d_name[0])) continue;
+        process = (pid_t)strtol (ent->d_name, NULL, 10);
+        if (is_marked (process)) kill (process, SIGTERM);
+    }
+    closedir (dir);
+}
+
+/// @brief Removes a folder and everything in it
+static void remove_dir (
+    const char *path ///<the folder to remove>
+    ) {
+    DIR *dir = opendir (path);
+    struct dirent *ent;
+    struct stat info;
+    if (dir) {
+        while ((ent = readdir (dir)) != NULL) {
+            char *child;
+            if (!strcmp (ent->d_name, ".") || !strcmp (ent->d_name, "..")) continue;
+            child = (char*)malloc (strlen (path) + strlen (ent->d_name) + 2);
+            if (!child) abort ();
+            sprintf (child, "%s/%s", path, ent->d_name);
+            if ((lstat (child, &info) == 0) && S_ISDIR (info.st_mode)) {
+                remove_dir (child);
+            } else {
+                unlink (child);
+            }
+            free (child);
+        }
+        closedir (dir);
+    }
+    rmdir (path);
+}
+
+/// @brief Stress test entry point
+///
+/// Usage: `procctrl_stress [-b procctrl] [-c clients] [-k identifiers] [-n operations] [-s seed]`
+///
+/// @return zero if every invocation and the registry checks passed, otherwise
+///         non-zero
+int main (
+    int argc, ///<the number of command line arguments>
+    char **argv ///<the command line arguments>
+    ) {
+    struct stress_counts totals[STRESS_OPERATIONS], counts[STRESS_OPERATIONS];
+    struct stress_faults faults;
+    int clients = 200, identifiers = 8, operations = 20, i, j, arg, attempt;
+    int results[2], release[2];
+    unsigned long calls = 0, errors = 0;
+    unsigned seed = (unsigned)time (NULL);
+    struct timespec start, end;
+    double elapsed;
+    while ((arg = getopt (argc, argv, "b:c:k:n:s:")) != -1) {
+        switch (arg) {
+            case 'b' : _procctrl = optarg; break;
+            case 'c' : clients = atoi (optarg); break;
+            case 'k' : identifiers = atoi (optarg); break;
+            case 'n' : operations = atoi (optarg); break;
+            case 's' : seed = (unsigned)strtoul (optarg, NULL, 10); break;
+            default :
+                fprintf (stderr, "Usage: %s [-b procctrl] [-c clients] [-k identifiers] [-n operations] [-s seed]\n", argv[0]);
+                return 1;
+        }
+    }
+    if ((clients < 1) || (identifiers < 1) || (operations < 1)) {
+        fprintf (stderr, "Clients, identifiers and operations must be positive\n");
+        return 1;
+    }
+    if (access (_procctrl, X_OK)) {
+        fprintf (stderr, "Can't run %s\n", _procctrl);
+        return 1;
+    }
+    strcpy (_data_dir, "stressXXXXXX");
+    if (!mkdtemp (_data_dir)) {
+        fprintf (stderr, "Couldn't create data directory\n");
+        return 1;
+    }
+    snprintf (_marker, sizeof (_marker), "600.%u", getpid ());
+    fprintf (stdout, "%d clients, %d operations each, %d identifiers, seed %u\n", clients, operations, identifiers, seed);
+    fflush (stdout);
+    if (pipe (results) || pipe (release)) abort ();
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    for (i = 0; i < clients; i++) {
+        pid_t child = fork ();
+        if (child == 0) {
+            close (results[0]);
+            close (release[1]);
+            client (operations, identifiers, seed + i, results[1], release[0]);
+        }
+        if (child < 0) {
+            fprintf (stderr, "Couldn't fork client %d\n", i);
+            clients = i;
+            break;
+        }
+    }
+    close (results[1]);
+    close (release[0]);
+    memset (totals, 0, sizeof (totals));
+    for (i = 0; (i < clients) && (read (results[0], counts, sizeof (counts)) == sizeof (counts)); i++) {
+        for (j = 0; j < STRESS_OPERATIONS; j++) {
+            totals[j].calls += counts[j].calls;
+            totals[j].ok += counts[j].ok;
+            totals[j].expected += counts[j].expected;
+            totals[j].errors += counts[j].errors;
+        }
+    }
+    close (results[0]);
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+    if (i < clients) fprintf (stderr, "Only %d of %d clients reported\n", i, clients);
+    for (j = 0; j < STRESS_OPERATIONS; j++) {
+        fprintf (stdout, "%-10s %8lu calls %8lu ok %8lu expected %8lu errors\n",
+            _operations[j], totals[j].calls, totals[j].ok, totals[j].expected, totals[j].errors);
+        calls += totals[j].calls;
+        errors += totals[j].errors;
+    }
+    fprintf (stdout, "%lu operations in %.2f s: %.1f ops/s\n", calls, elapsed, calls / elapsed);
+    // Check the registry while the clients, and so their local scopes, are
+    // still alive
+    for (attempt = 0; attempt < STRESS_ATTEMPTS; attempt++) {
+        check_registry (&faults);
+        if (!faults.corrupt && !faults.temporary && !faults.stale && !faults.untracked) break;
+        usleep (200000);
+    }
+    fprintf (stdout, "registry: %d running, %d untracked, %d stale, %d corrupt, %d temporary\n",
+        faults.tracked, faults.untracked, faults.stale, faults.corrupt, faults.temporary);
+    // Tidy up
+    kill_marked ();
+    close (release[1]);
+    while (wait (NULL) > 0);
+    remove_dir (_data_dir);
+    if (errors || faults.corrupt || faults.temporary || faults.stale || faults.untracked) {
+        fprintf (stdout, "FAILED\n");
+        return 1;
+    }
+    fprintf (stdout, "PASSED\n");
+    return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "operations.h"
+#include "params.h"
+#include "test_verbose.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <errno.h>
+# include <fcntl.h>
+# include <signal.h>
+# include <sys/wait.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int _operation_batch (FILE *in, FILE *out); // batch.c
+
+#ifndef _WIN32
+
+static char _tmpdir[16];
+
+/// The commands, and the result line expected for each
+static const char *_commands =
+    "# Comments and blank lines are ignored\n"
+    "\n"
+    "-k test start sleep 60\n"
+    "  -k test query\n"
+    "-k \"missing \\\"one\\\"\" query\n"
+    "-k test stop\r\n"
+    "-k test -t 5 wait\n"
+    "-o bad query\n"
+    "batch\n"
+    "-k test query";
+
+/// Commands where the first watchdog exits while the batch is still running
+static const char *_file_commands =
+    "-k first start sleep 0.1\n"
+    "-k second start sleep 1\n"
+    "-k second -t 5 wait\n";
+
+/// Commands where the output of one is framed along with the results
+static const char *_framed_commands =
+    "-k framed start sleep 60\n"
+    "-k framed -o json query\n"
+    "-k framed stop\n"
+    "-k framed -t 5 wait\n";
+
+static void expect_results (FILE *out) {
+    char expected[512];
+    char buffer[512];
+    size_t len;
+    snprintf (expected, sizeof (expected),
+        "command: 1\nresult: 1 0\n"
+        "command: 2\nresult: 2 0\n"
+        "command: 3\nresult: 3 %d\n"
+        "command: 4\nresult: 4 0\n"
+        "command: 5\nresult: 5 %d\n"
+        "command: 6\nresult: 6 %d\n"
+        "command: 7\nresult: 7 %d\n"
+        "command: 8\nresult: 8 %d\n",
+        ESRCH, 128 + SIGTERM, EINVAL, EINVAL, ESRCH);
+    rewind (out);
+    len = fread (buffer, 1, sizeof (buffer) - 1, out);
+    buffer[len] = 0;
+    CU_ASSERT_STRING_EQUAL (buffer, expected);
+}
+
+#endif /* ifndef _WIN32 */
+
+static void init_operation_batch () {
+#ifndef _WIN32
+    int v = PARAM (verbose);
+    strcpy (_tmpdir, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (_tmpdir) != NULL);
+    CU_ASSERT_FATAL (params_v (3, "-d", _tmpdir, "batch") == 0);
+    if (v) _verbose_test ();
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_batch () {
+#ifndef _WIN32
+    char path[64];
+    char buffer[256];
+    char framed[65536];
+    const char *begin, *end;
+    FILE *in, *out;
+    pid_t child;
+    size_t len;
+    int fd, saved, status;
+    CU_ASSERT_FATAL ((in = tmpfile ()) != NULL);
+    CU_ASSERT_FATAL ((out = tmpfile ()) != NULL);
+    fputs (_commands, in);
+    rewind (in);
+    CU_ASSERT (_operation_batch (in, out) == 0);
+    expect_results (out);
+    fclose (in);
+    fclose (out);
+    // Commands read from a file redirected to stdin are only run once; the
+    // watchdogs forked by start keep descriptor 0 open, so must not move its
+    // shared offset when they exit
+    snprintf (path, sizeof (path), "%s/commands", _tmpdir);
+    CU_ASSERT_FATAL ((in = fopen (path, "w")) != NULL);
+    fputs (_file_commands, in);
+    fclose (in);
+    CU_ASSERT_FATAL ((saved = dup (STDIN_FILENO)) >= 0);
+    CU_ASSERT_FATAL ((fd = open (path, O_RDONLY)) >= 0);
+    CU_ASSERT_FATAL (dup2 (fd, STDIN_FILENO) == STDIN_FILENO);
+    close (fd);
+    CU_ASSERT_FATAL ((in = fdopen (STDIN_FILENO, "r")) != NULL);
+    CU_ASSERT_FATAL ((out = tmpfile ()) != NULL);
+    CU_ASSERT (_operation_batch (in, out) == 0);
+    rewind (out);
+    len = fread (buffer, 1, sizeof (buffer) - 1, out);
+    buffer[len] = 0;
+    CU_ASSERT_STRING_EQUAL (buffer, "command: 1\nresult: 1 0\ncommand: 2\nresult: 2 0\ncommand: 3\nresult: 3 0\n");
+    fclose (in);
+    fclose (out);
+    dup2 (saved, STDIN_FILENO);
+    close (saved);
+    unlink (path);
+    // The output of each command is between its command and result lines;
+    // the batch runs in a child so that its stdout can be redirected
+    CU_ASSERT_FATAL ((in = tmpfile ()) != NULL);
+    CU_ASSERT_FATAL ((out = tmpfile ()) != NULL);
+    fputs (_framed_commands, in);
+    rewind (in);
+    fflush (stdout);
+    child = fork ();
+    CU_ASSERT_FATAL (child != (pid_t)-1);
+    if (!child) {
+        dup2 (fileno (out), STDOUT_FILENO);
+        status = _operation_batch (in, stdout);
+        fflush (stdout);
+        _exit (status);
+    }
+    CU_ASSERT (waitpid (child, &status, 0) == child);
+    CU_ASSERT (WIFEXITED (status) && !WEXITSTATUS (status));
+    rewind (out);
+    len = fread (framed, 1, sizeof (framed) - 1, out);
+    framed[len] = 0;
+    CU_ASSERT (!strncmp (framed, "command: 1\n", 11));
+    CU_ASSERT (strstr (framed, "\nresult: 1 0\ncommand: 2\n") != NULL);
+    begin = strstr (framed, "command: 2\n");
+    end = strstr (framed, "result: 2 0\n");
+    CU_ASSERT_FATAL (begin && end && (begin < end));
+    CU_ASSERT ((strchr (begin, '{') != NULL) && (strchr (begin, '{') < end));
+    CU_ASSERT (strchr (end, '{') == NULL);
+    snprintf (buffer, sizeof (buffer), "\nresult: 3 0\ncommand: 4\n");
+    CU_ASSERT (strstr (framed, buffer) != NULL);
+    snprintf (buffer, sizeof (buffer), "\nresult: 4 %d\n", 128 + SIGTERM);
+    CU_ASSERT (strstr (framed, buffer) != NULL);
+    fclose (in);
+    fclose (out);
+    // The context of the batch is unchanged
+    CU_ASSERT (!strcmp (PARAM (operation), "batch"));
+    CU_ASSERT (!strcmp (PARAM (data_dir), _tmpdir));
+    // Tidy up
+    snprintf (path, sizeof (path), "%s/%u/test", _tmpdir, getppid ());
+    unlink (path);
+    snprintf (path, sizeof (path), "%s/%u/first", _tmpdir, getppid ());
+    unlink (path);
+    snprintf (path, sizeof (path), "%s/%u/second", _tmpdir, getppid ());
+    unlink (path);
+    snprintf (path, sizeof (path), "%s/%u/framed", _tmpdir, getppid ());
+    unlink (path);
+    *strrchr (path, '/') = 0;
+    rmdir (path);
+    snprintf (path, sizeof (path), "%s/.lock", _tmpdir);
+    unlink (path);
+    CU_ASSERT (rmdir (_tmpdir) == 0);
+#endif /* ifndef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_batch)
+
+int register_tests_batch () {
+    CU_pSuite pSuite = CU_add_suite ("batch", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "operation_batch [quiet]", test_operation_batch)
+     || !CU_add_test (pSuite, "operation_batch [verbose]", test_operation_batch_verbose)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
@@ -0,0 +1,172 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "operations.h"
+#include "test_verbose.h"
+#include "process.h"
+#include "params.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <sys/wait.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#define EVENTS_PATH     64
+#define EVENTS_BUFFER   4096
+
+// From events.c
+int _events (FILE *out);
+
+static char _tmpdir[16];
+
+static void events_params (const char *timeout, const char *id, const char *parent) {
+    int v = PARAM (verbose);
+    if (parent) {
+        CU_ASSERT_FATAL (params_v (11, "-d", _tmpdir, "-k", id, "-t", timeout, "-p", "-P", parent, "events", "src/example-child-script.sh", "foo") == 0);
+    } else {
+        CU_ASSERT_FATAL (params_v (8, "-d", _tmpdir, "-k", id, "-t", timeout, "events", "src/example-child-script.sh", "foo") == 0);
+    }
+    if (v) _verbose_test ();
+}
+
+/// Runs the events operation, returning everything it wrote
+static void capture_events (char *buffer) {
+    FILE *out = tmpfile ();
+    size_t len;
+    CU_ASSERT_FATAL (out != NULL);
+    CU_ASSERT (_events (out) == 0);
+    rewind (out);
+    len = fread (buffer, 1, EVENTS_BUFFER - 1, out);
+    buffer[len] = 0;
+    fclose (out);
+}
+
+/// Returns the position of an event for a process in the captured output
+static const char *find_event (const char *buffer, const char *event, const char *id) {
+    char match[EVENTS_PATH];
+    const char *line;
+    snprintf (match, sizeof (match), "\"event\":\"%s\",", event);
+    for (line = strstr (buffer, match); line; line = strstr (line + 1, match)) {
+        const char *end = strchr (line, '\n');
+        char *pos;
+        snprintf (match, sizeof (match), "\"id\":\"%s\"", id);
+        pos = strstr (line, match);
+        snprintf (match, sizeof (match), "\"event\":\"%s\",", event);
+        if (pos && (!end || (pos < end))) return line;
+    }
+    return NULL;
+}
+
+static void remove_record (const char *scope, const char *id) {
+    char path[EVENTS_PATH];
+    CU_ASSERT_FATAL (snprintf (path, EVENTS_PATH, "%s/%s/%s", _tmpdir, scope, id) < EVENTS_PATH);
+    unlink (path);
+    *strrchr (path, '/') = 0;
+    rmdir (path);
+}
+
+#endif /* ifndef _WIN32 */
+
+static void init_operation_events () {
+#ifdef _WIN32
+    CU_ASSERT_FATAL (params_v (2, "events", "src\\example-child-script.bat") == 0);
+#else /* ifdef _WIN32 */
+    strcpy (_tmpdir, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (_tmpdir) != NULL);
+    events_params ("0", "test", NULL);
+#endif /* ifdef _WIN32 */
+}
+
+static void do_operation_events () {
+#ifdef _WIN32
+	CU_ASSERT (operation_events () == ERROR_NOT_SUPPORTED);
+#else /* ifdef _WIN32 */
+    struct process_info *info;
+    char buffer[EVENTS_BUFFER];
+    char path[EVENTS_PATH];
+    char scope[16];
+    const char *started, *ready, *killed, *exited;
+    pid_t child;
+    int status;
+    // Nothing has happened yet
+    capture_events (buffer);
+    CU_ASSERT (buffer[0] == 0);
+    // Recorded events are replayed in order
+    CU_ASSERT_FATAL (operation_start () == 0);
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    process_info_free (info);
+    capture_events (buffer);
+    started = find_event (buffer, "started", "test");
+    ready = find_event (buffer, "ready", "test");
+    killed = find_event (buffer, "killed", "test");
+    exited = find_event (buffer, "exited", "test");
+    CU_ASSERT (started && ready && killed && exited);
+    CU_ASSERT ((started < ready) && (ready < killed) && (killed < exited));
+    CU_ASSERT (exited && strstr (exited, "\"signal\":") != NULL);
+    CU_ASSERT (find_event (buffer, "watchdog-fired", "test") == NULL);
+    // Events are reported as they happen; the watchdog kills a process when its starter exits
+    child = fork ();
+    CU_ASSERT_FATAL (child >= 0);
+    if (!child) {
+        snprintf (scope, sizeof (scope), "%u", getpid ());
+        usleep (200000);
+        events_params ("0", "live", scope);
+        _exit (operation_start ());
+    }
+    snprintf (scope, sizeof (scope), "%u", child);
+    events_params ("3", "test", NULL);
+    capture_events (buffer);
+    CU_ASSERT (waitpid (child, &status, 0) == child);
+    CU_ASSERT (WIFEXITED (status) && (WEXITSTATUS (status) == 0));
+    CU_ASSERT (find_event (buffer, "started", "live") != NULL);
+    CU_ASSERT (find_event (buffer, "watchdog-fired", "live") != NULL);
+    CU_ASSERT (find_event (buffer, "exited", "live") != NULL);
+    // Deleting the information is reported
+    child = fork ();
+    CU_ASSERT_FATAL (child >= 0);
+    if (!child) {
+        usleep (200000);
+        remove_record (scope, "live");
+        _exit (0);
+    }
+    events_params ("1", "test", NULL);
+    capture_events (buffer);
+    CU_ASSERT (waitpid (child, &status, 0) == child);
+    CU_ASSERT (find_event (buffer, "housekept", "live") != NULL);
+    CU_ASSERT (find_event (buffer, "housekept", "test") == NULL);
+    snprintf (scope, sizeof (scope), "%u", PARAM (parent_process));
+    remove_record (scope, "test");
+    CU_ASSERT_FATAL (snprintf (path, EVENTS_PATH, "%s/.lock", _tmpdir) < EVENTS_PATH);
+    unlink (path);
+    rmdir (_tmpdir);
+#endif /* ifdef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_events)
+
+int register_tests_events () {
+    CU_pSuite pSuite = CU_add_suite ("events", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "operation_events [quiet]", test_operation_events)
+     || !CU_add_test (pSuite, "operation_events [verbose]", test_operation_events_verbose)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
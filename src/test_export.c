@@ -0,0 +1,139 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "operations.h"
+#include "test_verbose.h"
+#include "process.h"
+#include "params.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <signal.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#define EXPORT_PATH     64
+#define EXPORT_BUFFER   4096
+
+static char _tmpdir[16];
+static char _file[32];
+
+static void export_params () {
+    int v = PARAM (verbose);
+    CU_ASSERT_FATAL (params_v (10, "-d", _tmpdir, "-k", "test", "-f", _file, "-t", "0", "export", "src/example-child-script.sh", "foo") == 0);
+    if (v) _verbose_test ();
+}
+
+/// Reads the exported metrics
+static void read_export (char *buffer) {
+    FILE *in = fopen (_file, "rt");
+    size_t len;
+    CU_ASSERT_FATAL (in != NULL);
+    len = fread (buffer, 1, EXPORT_BUFFER - 1, in);
+    buffer[len] = 0;
+    fclose (in);
+}
+
+/// Tests for a sample in the exported metrics
+static int has_sample (const char *buffer, const char *metric, const char *value) {
+    char sample[EXPORT_PATH * 2];
+    snprintf (sample, sizeof (sample), "%s{scope=\"%u\",id=\"test\"} %s\n", metric, PARAM (parent_process), value);
+    return strstr (buffer, sample) != NULL;
+}
+
+#endif /* ifndef _WIN32 */
+
+static void init_operation_export () {
+#ifdef _WIN32
+    CU_ASSERT_FATAL (params_v (2, "export", "src\\example-child-script.bat") == 0);
+#else /* ifdef _WIN32 */
+    strcpy (_tmpdir, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (_tmpdir) != NULL);
+    snprintf (_file, sizeof (_file), "%s.prom", _tmpdir);
+    export_params ();
+#endif /* ifdef _WIN32 */
+}
+
+static void do_operation_export () {
+#ifdef _WIN32
+	CU_ASSERT (operation_export () == ERROR_NOT_SUPPORTED);
+#else /* ifdef _WIN32 */
+    struct process_info *info;
+    char buffer[EXPORT_BUFFER];
+    char path[EXPORT_PATH];
+    int i;
+    // An empty registry still declares the metrics
+    CU_ASSERT (operation_export () == 0);
+    read_export (buffer);
+    CU_ASSERT (strstr (buffer, "# TYPE procctrl_up gauge\n") == buffer);
+    CU_ASSERT (strstr (buffer, "{") == NULL);
+    CU_ASSERT (!strcmp (buffer + strlen (buffer) - 6, "# EOF\n"));
+    // A running process, started a second time
+    CU_ASSERT_FATAL (operation_start () == 0);
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    process_info_free (info);
+    CU_ASSERT_FATAL (operation_start () == 0);
+    // The watchdog records the ready time once the start operation returns
+    for (i = 0; i < 100; i++) {
+        CU_ASSERT (operation_export () == 0);
+        read_export (buffer);
+        if (strstr (buffer, "procctrl_ready_seconds{")) break;
+        usleep (10000);
+    }
+    CU_ASSERT (has_sample (buffer, "procctrl_up", "1"));
+    CU_ASSERT (has_sample (buffer, "procctrl_restarts_total", "1"));
+    CU_ASSERT (strstr (buffer, "procctrl_ready_seconds{") != NULL);
+    CU_ASSERT (strstr (buffer, "procctrl_resident_memory_bytes{") != NULL);
+    CU_ASSERT (strstr (buffer, "procctrl_exit_status{") == NULL);
+    // The terminated process
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    process_info_free (info);
+    CU_ASSERT (operation_export () == 0);
+    read_export (buffer);
+    CU_ASSERT (has_sample (buffer, "procctrl_up", "0"));
+    snprintf (path, sizeof (path), "%d", 128 + SIGTERM);
+    CU_ASSERT (has_sample (buffer, "procctrl_exit_status", path));
+    CU_ASSERT (strstr (buffer, "procctrl_resident_memory_bytes{") == NULL);
+    // No temporary file is left behind
+    snprintf (path, sizeof (path), "%s~", _file);
+    CU_ASSERT (access (path, F_OK) != 0);
+    // Tidy up
+    unlink (_file);
+    CU_ASSERT_FATAL (snprintf (path, EXPORT_PATH, "%s/%u/test", _tmpdir, PARAM (parent_process)) < EXPORT_PATH);
+    unlink (path);
+    *strrchr (path, '/') = 0;
+    rmdir (path);
+    CU_ASSERT_FATAL (snprintf (path, EXPORT_PATH, "%s/.lock", _tmpdir) < EXPORT_PATH);
+    unlink (path);
+    rmdir (_tmpdir);
+#endif /* ifdef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_export)
+
+int register_tests_export () {
+    CU_pSuite pSuite = CU_add_suite ("export", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "operation_export [quiet]", test_operation_export)
+     || !CU_add_test (pSuite, "operation_export [verbose]", test_operation_export_verbose)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
@@ -0,0 +1,225 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "health.h"
+#include "operations.h"
+#include "params.h"
+#include "process.h"
+#include "test_verbose.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <arpa/inet.h>
+# include <errno.h>
+# include <netinet/in.h>
+# include <poll.h>
+# include <signal.h>
+# include <sys/socket.h>
+# include <sys/wait.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// Listens on an ephemeral port of the loopback interface
+static int listen_local (int *port) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof (addr);
+    int fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    CU_ASSERT_FATAL (fd >= 0);
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    CU_ASSERT_FATAL (bind (fd, (struct sockaddr*)&addr, sizeof (addr)) == 0);
+    CU_ASSERT_FATAL (listen (fd, 4) == 0);
+    CU_ASSERT_FATAL (getsockname (fd, (struct sockaddr*)&addr, &len) == 0);
+    *port = ntohs (addr.sin_port);
+    return fd;
+}
+
+/// Answers one HTTP request with a status line from a child process
+static pid_t serve_http (int fd, const char *response) {
+    pid_t child = fork ();
+    CU_ASSERT_FATAL (child != (pid_t)-1);
+    if (!child) {
+        char buffer[256];
+        int conn = accept (fd, NULL, NULL);
+        if (conn < 0) _exit (1);
+        if (read (conn, buffer, sizeof (buffer)) <= 0) _exit (1);
+        if (write (conn, response, strlen (response)) < 0) _exit (1);
+        close (conn);
+        _exit (0);
+    }
+    return child;
+}
+
+#endif /* ifndef _WIN32 */
+
+static void test_health_run (void) {
+#ifndef _WIN32
+    char probe[64];
+    double latency;
+    pid_t server;
+    int fd, port, status;
+    VERBOSE_WATCH_ALL;
+    CU_ASSERT_FATAL (params_v (0) == 0);
+    fd = listen_local (&port);
+    // TCP connects to a listening port
+    snprintf (probe, sizeof (probe), "tcp:%d", port);
+    CU_ASSERT (health_run (probe, 1000, &latency) == 0);
+    CU_ASSERT ((latency >= 0.0) && (latency < 1.0));
+    close (accept (fd, NULL, NULL));
+    // HTTP accepts success and redirects only
+    snprintf (probe, sizeof (probe), "http:%d/health", port);
+    server = serve_http (fd, "HTTP/1.0 200 OK\r\n\r\n");
+    CU_ASSERT (health_run (probe, 5000, &latency) == 0);
+    CU_ASSERT (waitpid (server, &status, 0) == server);
+    server = serve_http (fd, "HTTP/1.1 503 Service Unavailable\r\n\r\n");
+    CU_ASSERT (health_run (probe, 5000, &latency) == EPROTO);
+    CU_ASSERT (waitpid (server, &status, 0) == server);
+    // A server that never answers times out
+    CU_ASSERT (health_run (probe, 200, &latency) == ETIMEDOUT);
+    CU_ASSERT (latency >= 0.15);
+    close (fd);
+    // Nothing is listening any more
+    snprintf (probe, sizeof (probe), "tcp:%d", port);
+    CU_ASSERT (health_run (probe, 1000, &latency) == ECONNREFUSED);
+    // Commands must exit with zero in time
+    CU_ASSERT (health_run ("cmd:true", 1000, &latency) == 0);
+    CU_ASSERT (health_run ("cmd:exit 3", 1000, &latency) == EPROTO);
+    CU_ASSERT (health_run ("cmd:sleep 5", 200, &latency) == ETIMEDOUT);
+    CU_ASSERT (latency < 1.0);
+    // Bad probes
+    CU_ASSERT (health_run ("udp:53", 1000, &latency) == EINVAL);
+    CU_ASSERT (health_run ("tcp:x", 1000, &latency) == EINVAL);
+    CU_ASSERT (health_run ("http:80x", 1000, &latency) == EINVAL);
+    VERBOSE_SILENT_ALL;
+#endif /* ifndef _WIN32 */
+}
+
+static void init_health_check () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (9, "-c", "cmd:exit 1", "-n", "2", "-k", "health", "start", "sleep", "60") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_health_check () {
+#ifndef _WIN32
+    struct process_info *info;
+    CU_ASSERT_FATAL (operation_start () == 0);
+    // Killed by the watchdog after two failed checks, a second apart
+    CU_ASSERT_FATAL (process_wait (10, &info) == 0);
+    CU_ASSERT (process_info_get (info, "signal") && !strcmp (process_info_get (info, "signal"), "15"));
+    CU_ASSERT (process_info_get (info, "health") && !strcmp (process_info_get (info, "health"), "unhealthy"));
+    CU_ASSERT (process_info_get (info, "failures") && !strcmp (process_info_get (info, "failures"), "2"));
+    CU_ASSERT (process_info_get (info, "latency") != NULL);
+    process_info_free (info);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void init_health_grace () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (11, "-c", "cmd:test -e health-test.flag", "-g", "30", "-n", "1", "-k", "health", "start", "sleep", "60") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_health_grace () {
+#ifndef _WIN32
+    struct process_info *info;
+    const char *value;
+    FILE *out;
+    int i;
+    unlink ("health-test.flag");
+    CU_ASSERT_FATAL (operation_start () == 0);
+    // Failing while it starts up, but neither killed nor ready
+    for (i = 0; i < 50; i++) {
+        info = process_load ();
+        value = process_info_get (info, "health");
+        if (value && !strcmp (value, "starting")) break;
+        process_info_free (info);
+        info = NULL;
+        poll (NULL, 0, 100);
+    }
+    CU_ASSERT_FATAL (info != NULL);
+    CU_ASSERT (process_info_get (info, "ready") == NULL);
+    CU_ASSERT (process_info_get (info, "exit") == NULL);
+    CU_ASSERT (process_info_get (info, "signal") == NULL);
+    CU_ASSERT (process_info_get (info, "failures") && !strcmp (process_info_get (info, "failures"), "0"));
+    process_info_free (info);
+    // Ready once the first probe passes
+    out = fopen ("health-test.flag", "w");
+    CU_ASSERT_FATAL (out != NULL);
+    fclose (out);
+    for (i = 0; i < 50; i++) {
+        info = process_load ();
+        if (process_info_get (info, "ready")) break;
+        process_info_free (info);
+        info = NULL;
+        poll (NULL, 0, 100);
+    }
+    CU_ASSERT_FATAL (info != NULL);
+    CU_ASSERT (process_info_get (info, "health") && !strcmp (process_info_get (info, "health"), "ok"));
+    process_info_free (info);
+    // Failures count from then on, without waiting for the grace period
+    unlink ("health-test.flag");
+    CU_ASSERT_FATAL (process_wait (10, &info) == 0);
+    CU_ASSERT (process_info_get (info, "signal") && !strcmp (process_info_get (info, "signal"), "15"));
+    CU_ASSERT (process_info_get (info, "health") && !strcmp (process_info_get (info, "health"), "unhealthy"));
+    process_info_free (info);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void init_health_hung () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (9, "-c", "cmd:sleep 30", "-C", "20", "-k", "health", "start", "sleep", "60") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_health_hung () {
+#ifndef _WIN32
+    struct process_info *info;
+    CU_ASSERT_FATAL (operation_start () == 0);
+    // The first probe starts after a second, and hangs
+    poll (NULL, 0, 1500);
+    // The watchdog still sees the child terminate at once
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT_FATAL (process_wait (3, &info) == 0);
+    CU_ASSERT (process_info_get (info, "signal") && !strcmp (process_info_get (info, "signal"), "15"));
+    process_info_free (info);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (health_check)
+VERBOSE_AND_QUIET_TEST (health_grace)
+VERBOSE_AND_QUIET_TEST (health_hung)
+
+int register_tests_health () {
+    CU_pSuite pSuite = CU_add_suite ("health", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "health_run", test_health_run)
+     || !CU_add_test (pSuite, "health_check [quiet]", test_health_check)
+     || !CU_add_test (pSuite, "health_check [verbose]", test_health_check_verbose)
+     || !CU_add_test (pSuite, "health_grace [quiet]", test_health_grace)
+     || !CU_add_test (pSuite, "health_grace [verbose]", test_health_grace_verbose)
+     || !CU_add_test (pSuite, "health_hung [quiet]", test_health_hung)
+     || !CU_add_test (pSuite, "health_hung [verbose]", test_health_hung_verbose)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
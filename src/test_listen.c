@@ -0,0 +1,162 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "listen.h"
+#include "operations.h"
+#include "params.h"
+#include "process.h"
+#include "test_verbose.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <arpa/inet.h>
+# include <errno.h>
+# include <netinet/in.h>
+# include <sys/socket.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// The file written by the activated child
+static const char *_activated = "listen-test.out";
+
+/// Reads the address the process is listening on from its information file
+static int listening_port () {
+    struct process_info *info = process_load ();
+    const char *listen = process_info_get (info, "listen");
+    int port = 0;
+    if (listen && strrchr (listen, ':')) port = atoi (strrchr (listen, ':') + 1);
+    process_info_free (info);
+    return port;
+}
+
+/// Connects to a port on the loopback interface
+static int connect_local (int port) {
+    struct sockaddr_in addr;
+    int fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    CU_ASSERT_FATAL (fd >= 0);
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (port);
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    CU_ASSERT (connect (fd, (struct sockaddr*)&addr, sizeof (addr)) == 0);
+    return fd;
+}
+
+#endif /* ifndef _WIN32 */
+
+static void test_listen_open (void) {
+#ifndef _WIN32
+    char *addresses;
+    int *fds, count;
+    VERBOSE_WATCH_ALL;
+    CU_ASSERT_FATAL (params_v (0) == 0);
+    // Ephemeral ports, on the loopback interface by default
+    CU_ASSERT_FATAL (listen_open ("0,127.0.0.1:0", &fds, &count, &addresses) == 0);
+    CU_ASSERT (count == 2);
+    CU_ASSERT (!strncmp (addresses, "127.0.0.1:", 10));
+    CU_ASSERT (strstr (addresses, " 127.0.0.1:") != NULL);
+    free (addresses);
+    listen_close (fds, count);
+    // Bad entries
+    CU_ASSERT (listen_open ("", &fds, &count, &addresses) == EINVAL);
+    CU_ASSERT (listen_open ("0,", &fds, &count, &addresses) == EINVAL);
+    CU_ASSERT (listen_open ("65536", &fds, &count, &addresses) == EINVAL);
+    CU_ASSERT (listen_open ("localhost:80", &fds, &count, &addresses) == EINVAL);
+    CU_ASSERT (count == 0);
+    VERBOSE_SILENT_ALL;
+#endif /* ifndef _WIN32 */
+}
+
+static void init_operation_start_listen () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (9, "-k", "listen", "-s", "0", "--", "start", "sh", "-c", "echo $LISTEN_FDS $LISTEN_PID $$ > listen-test.out; sleep 60; exit 0") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_start_listen () {
+#ifndef _WIN32
+    struct process_info *info;
+    char buffer[64];
+    pid_t watchdog, process;
+    FILE *in;
+    int fd, port, fds, listen_pid, pid, i;
+    unlink (_activated);
+    // Returns with only the watchdog listening
+    CU_ASSERT_FATAL (operation_start () == 0);
+    watchdog = process_find ();
+    CU_ASSERT_FATAL (watchdog != 0);
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "activation") && !strcmp (process_info_get (info, "activation"), "pending"));
+    CU_ASSERT (process_info_get (info, "wdog") && ((pid_t)atoi (process_info_get (info, "wdog")) == watchdog));
+    process_info_free (info);
+    port = listening_port ();
+    CU_ASSERT_FATAL (port != 0);
+    usleep (200000);
+    CU_ASSERT (access (_activated, F_OK) != 0);
+    // A connection spawns the child, passing it the socket
+    fd = connect_local (port);
+    for (i = 0; (i < 50) && ((process = process_find ()) == watchdog); i++) {
+        usleep (100000);
+    }
+    CU_ASSERT_FATAL ((process != 0) && (process != watchdog));
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "activation") == NULL);
+    CU_ASSERT (process_info_get (info, "activated") != NULL);
+    CU_ASSERT (process_info_get (info, "ready") != NULL);
+    process_info_free (info);
+    in = fopen (_activated, "r");
+    CU_ASSERT_FATAL (in != NULL);
+    CU_ASSERT (fgets (buffer, sizeof (buffer), in) != NULL);
+    fclose (in);
+    CU_ASSERT (sscanf (buffer, "%d %d %d", &fds, &listen_pid, &pid) == 3);
+    CU_ASSERT (fds == 1);
+    CU_ASSERT ((listen_pid == pid) && ((pid_t)pid == process));
+    close (fd);
+    // The child is stopped as usual
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    CU_ASSERT (process_info_get (info, "signal") && !strcmp (process_info_get (info, "signal"), "15"));
+    process_info_free (info);
+    // Stopping before a connection closes the sockets instead
+    CU_ASSERT_FATAL (operation_start () == 0);
+    watchdog = process_find ();
+    CU_ASSERT_FATAL (watchdog != 0);
+    port = listening_port ();
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    CU_ASSERT (process_info_get (info, "signal") && !strcmp (process_info_get (info, "signal"), "15"));
+    CU_ASSERT (process_info_get (info, "activated") == NULL);
+    process_info_free (info);
+    CU_ASSERT (process_find () == 0);
+    unlink (_activated);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_start_listen)
+
+int register_tests_listen () {
+    CU_pSuite pSuite = CU_add_suite ("listen", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "listen_open", test_listen_open)
+     || !CU_add_test (pSuite, "operation_start [listen,quiet]", test_operation_start_listen)
+     || !CU_add_test (pSuite, "operation_start [listen,verbose]", test_operation_start_listen_verbose)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
@@ -0,0 +1,123 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "operations.h"
+#include "test_verbose.h"
+#include "process.h"
+#include "params.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#define MONITOR_PATH    64
+#define MONITOR_BUFFER  4096
+// The identifier of the test process as written in the JSON, with its quote escaped
+#define MONITOR_ID      "\"id\":\"te\\\"st\""
+
+// From monitor.c
+int _monitor (FILE *out);
+
+static char _tmpdir[16];
+
+static void monitor_params (const char *timeout) {
+    int v = PARAM (verbose);
+    CU_ASSERT_FATAL (params_v (12, "-d", _tmpdir, "-k", "te\"st", "-o", "json", "-i", "1", "-t", timeout, "monitor", "src/example-child-script.sh", "foo") == 0);
+    if (v) _verbose_test ();
+}
+
+/// Runs the monitor operation, returning the number of reports for the test process
+static int capture_monitor (char *buffer) {
+    FILE *out = tmpfile ();
+    const char *line;
+    size_t len;
+    int count = 0;
+    CU_ASSERT_FATAL (out != NULL);
+    CU_ASSERT (_monitor (out) == 0);
+    rewind (out);
+    len = fread (buffer, 1, MONITOR_BUFFER - 1, out);
+    buffer[len] = 0;
+    fclose (out);
+    for (line = strstr (buffer, MONITOR_ID); line; line = strstr (line + 1, MONITOR_ID)) count++;
+    return count;
+}
+
+#endif /* ifndef _WIN32 */
+
+static void init_operation_monitor () {
+#ifdef _WIN32
+    CU_ASSERT_FATAL (params_v (2, "monitor", "src\\example-child-script.bat") == 0);
+#else /* ifdef _WIN32 */
+    strcpy (_tmpdir, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (_tmpdir) != NULL);
+    monitor_params ("0");
+#endif /* ifdef _WIN32 */
+}
+
+static void do_operation_monitor () {
+#ifdef _WIN32
+	CU_ASSERT (operation_monitor () == ERROR_NOT_SUPPORTED);
+#else /* ifdef _WIN32 */
+    struct process_info *info;
+    char buffer[MONITOR_BUFFER];
+    char path[MONITOR_PATH];
+    int i;
+    // Nothing to report
+    CU_ASSERT (capture_monitor (buffer) == 0);
+    CU_ASSERT (buffer[0] == 0);
+    // The running process is reported with its descendants, once the script
+    // has started them
+    CU_ASSERT_FATAL (operation_start () == 0);
+    for (i = 0; i < 50; i++) {
+        CU_ASSERT (capture_monitor (buffer) == 1);
+        if (strstr (buffer, "\"processes\":2,")) break;
+        usleep (100000);
+    }
+    CU_ASSERT (strstr (buffer, "\"processes\":2,") != NULL);
+    // Reports are repeated at the interval
+    monitor_params ("2");
+    CU_ASSERT (capture_monitor (buffer) == 3);
+    // Terminated processes are not reported
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    process_info_free (info);
+    monitor_params ("0");
+    CU_ASSERT (capture_monitor (buffer) == 0);
+    // Tidy up
+    CU_ASSERT_FATAL (snprintf (path, MONITOR_PATH, "%s/%u/te^22st", _tmpdir, PARAM (parent_process)) < MONITOR_PATH);
+    unlink (path);
+    *strrchr (path, '/') = 0;
+    rmdir (path);
+    CU_ASSERT_FATAL (snprintf (path, MONITOR_PATH, "%s/.lock", _tmpdir) < MONITOR_PATH);
+    unlink (path);
+    rmdir (_tmpdir);
+#endif /* ifdef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_monitor)
+
+int register_tests_monitor () {
+    CU_pSuite pSuite = CU_add_suite ("monitor", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "operation_monitor [quiet]", test_operation_monitor)
+     || !CU_add_test (pSuite, "operation_monitor [verbose]", test_operation_monitor_verbose)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
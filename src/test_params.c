@@ -10,7 +10,6 @@
 #endif /* ifdef HAVE_CONFIG_H */
 #ifdef HAVE_CUNIT_H
 #include "test_units.h"
-#define MODULE_VAR_CONST volatile const
 #include "params.h"
 #include "test_verbose.h"
 #include <CUnit/Basic.h>
@@ -18,6 +17,86 @@
 # include <unistd.h>
 #endif /* ifndef _WIN32 */
 
+static void test_params_A (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for A
+    CU_ASSERT (params_v (1, "-A") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is no dedicated cores
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (core_count) == 0);
+    // Explicit value
+    CU_ASSERT (params_v (2, "-A", "4") == 0);
+    CU_ASSERT (PARAM (core_count) == 4);
+    CU_ASSERT (params_v (2, "-A", "-1") == 0);
+    CU_ASSERT (PARAM (core_count) == 0);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_a (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for a
+    CU_ASSERT (params_v (1, "-a") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+#ifndef _WIN32
+    CU_ASSERT (params_v (2, "-a", "0-") == EINVAL);
+    VERBOSE_STDERR_ONLY;
+    CU_ASSERT (params_v (2, "-a", "3-1") == EINVAL);
+    VERBOSE_STDERR_ONLY;
+    CU_ASSERT (params_v (2, "-a", "1,,2") == EINVAL);
+    VERBOSE_STDERR_ONLY;
+    CU_ASSERT (params_v (2, "-a", "1024") == EINVAL);
+    VERBOSE_STDERR_ONLY;
+#endif /* ifndef _WIN32 */
+    // Default is any CPU
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (cpu_affinity) == NULL);
+    // Explicit value
+    CU_ASSERT (params_v (2, "-a", "0-3,6") == 0);
+    CU_ASSERT_FATAL (PARAM (cpu_affinity) != NULL);
+    CU_ASSERT (!strcmp (PARAM (cpu_affinity), "0-3,6"));
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_C (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for C
+    CU_ASSERT (params_v (1, "-C") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is a second
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (probe_timeout) == 1);
+    // Explicit value
+    CU_ASSERT (params_v (2, "-C", "10") == 0);
+    CU_ASSERT (PARAM (probe_timeout) == 10);
+    CU_ASSERT (params_v (2, "-C", "0") == 0);
+    CU_ASSERT (PARAM (probe_timeout) == 1);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_c (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for c
+    CU_ASSERT (params_v (1, "-c") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    CU_ASSERT (params_v (2, "-c", "udp:53") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is no health checks
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (health_probe) == NULL);
+    // Explicit values
+    CU_ASSERT (params_v (2, "-c", "tcp:8080") == 0);
+    CU_ASSERT_FATAL (PARAM (health_probe) != NULL);
+    CU_ASSERT (!strcmp (PARAM (health_probe), "tcp:8080"));
+    CU_ASSERT (params_v (2, "-c", "http:8080/health") == 0);
+    CU_ASSERT_FATAL (PARAM (health_probe) != NULL);
+    CU_ASSERT (!strcmp (PARAM (health_probe), "http:8080/health"));
+    CU_ASSERT (params_v (2, "-c", "cmd:true") == 0);
+    CU_ASSERT_FATAL (PARAM (health_probe) != NULL);
+    CU_ASSERT (!strcmp (PARAM (health_probe), "cmd:true"));
+    VERBOSE_SILENT_ALL;
+}
+
 static void test_params_d (void) {
     VERBOSE_WATCH_ALL;
     // Expect parameter for d
@@ -26,15 +105,47 @@ static void test_params_d (void) {
     // Default is ~/.procctrl (expanded)
     CU_ASSERT (params_v (0) == 0);
 #ifdef _WIN32
-    CU_ASSERT (data_dir[1] == ':');
-    CU_ASSERT (data_dir[2] == '\\');
+    CU_ASSERT (PARAM (data_dir)[1] == ':');
+    CU_ASSERT (PARAM (data_dir)[2] == '\\');
 #else /* ifdef _WIN32 */
-    CU_ASSERT (data_dir[0] == '/');
+    CU_ASSERT (PARAM (data_dir)[0] == '/');
 #endif /* ifdef _WIN32 */
-    CU_ASSERT (!strcmp (data_dir + strlen (data_dir) - 10, _WIN32_OR_POSIX ("\\", "/") ".procctrl"));
+    CU_ASSERT (!strcmp (PARAM (data_dir) + strlen (PARAM (data_dir)) - 10, _WIN32_OR_POSIX ("\\", "/") ".procctrl"));
     // Explicit value
     CU_ASSERT (params_v (2, "-d", _WIN32_OR_POSIX ("C:\\foo\\bar\\path", "/foo/bar/path")) == 0);
-    CU_ASSERT (!strcmp (data_dir, _WIN32_OR_POSIX ("C:\\foo\\bar\\path", "/foo/bar/path")));
+    CU_ASSERT (!strcmp (PARAM (data_dir), _WIN32_OR_POSIX ("C:\\foo\\bar\\path", "/foo/bar/path")));
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_f (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for f
+    CU_ASSERT (params_v (1, "-f") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is in the working directory
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT_FATAL (PARAM (output_file) != NULL);
+    CU_ASSERT (!strcmp (PARAM (output_file), "procctrl.prom"));
+    // Explicit value
+    CU_ASSERT (params_v (2, "-f", "foo.prom") == 0);
+    CU_ASSERT_FATAL (PARAM (output_file) != NULL);
+    CU_ASSERT (!strcmp (PARAM (output_file), "foo.prom"));
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_g (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for g
+    CU_ASSERT (params_v (1, "-g") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is no grace period
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (health_grace) == 0);
+    // Explicit value
+    CU_ASSERT (params_v (2, "-g", "40") == 0);
+    CU_ASSERT (PARAM (health_grace) == 40);
+    CU_ASSERT (params_v (2, "-g", "-1") == 0);
+    CU_ASSERT (PARAM (health_grace) == 0);
     VERBOSE_SILENT_ALL;
 }
 
@@ -45,10 +156,66 @@ static void test_params_H (void) {
     VERBOSE_STDERR_ONLY;
     // Default is ALL
     CU_ASSERT (params_v (0) == 0);
-    CU_ASSERT (housekeep_mode == HOUSEKEEP_FULL);
+    CU_ASSERT (PARAM (housekeep_mode) == HOUSEKEEP_FULL);
     // Explicit value (getopt short form)
     CU_ASSERT (params_v (1, "-H0") == 0);
-    CU_ASSERT (housekeep_mode == 0);
+    CU_ASSERT (PARAM (housekeep_mode) == 0);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_I (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for I
+    CU_ASSERT (params_v (1, "-I") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is no timeout
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (idle_timeout) == 0);
+    // Explicit value
+    CU_ASSERT (params_v (2, "-I", "600") == 0);
+    CU_ASSERT (PARAM (idle_timeout) == 600);
+    CU_ASSERT (params_v (2, "-I", "-1") == 0);
+    CU_ASSERT (PARAM (idle_timeout) == 0);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_i (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for i
+    CU_ASSERT (params_v (1, "-i") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is every second
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (monitor_interval) == 1);
+    // Explicit value
+    CU_ASSERT (params_v (2, "-i", "5") == 0);
+    CU_ASSERT (PARAM (monitor_interval) == 5);
+    CU_ASSERT (params_v (2, "-i", "0") == 0);
+    CU_ASSERT (PARAM (monitor_interval) == 1);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_j (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for j
+    CU_ASSERT (params_v (1, "-j") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+#ifndef _WIN32
+    CU_ASSERT (params_v (2, "-j", "best-effort:8") == EINVAL);
+    VERBOSE_STDERR_ONLY;
+    CU_ASSERT (params_v (2, "-j", "fast") == EINVAL);
+    VERBOSE_STDERR_ONLY;
+#endif /* ifndef _WIN32 */
+    // Default is the priority of the watchdog
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (io_priority) == NULL);
+    // Explicit values
+    CU_ASSERT (params_v (2, "-j", "idle") == 0);
+    CU_ASSERT_FATAL (PARAM (io_priority) != NULL);
+    CU_ASSERT (!strcmp (PARAM (io_priority), "idle"));
+    CU_ASSERT (params_v (2, "-j", "best-effort:2") == 0);
+    CU_ASSERT_FATAL (PARAM (io_priority) != NULL);
+    CU_ASSERT (!strcmp (PARAM (io_priority), "best-effort:2"));
     VERBOSE_SILENT_ALL;
 }
 
@@ -56,10 +223,10 @@ static void test_params_K (void) {
     VERBOSE_WATCH_ALL;
     // Default is local
     CU_ASSERT (params_v (0) == 0);
-    CU_ASSERT (global_identifier == 0);
+    CU_ASSERT (PARAM (global_identifier) == 0);
     // Set flag
     CU_ASSERT (params_v (1, "-K") == 0);
-    CU_ASSERT (global_identifier != 0);
+    CU_ASSERT (PARAM (global_identifier) != 0);
     VERBOSE_SILENT_ALL;
 }
 
@@ -70,12 +237,118 @@ static void test_params_k (void) {
     VERBOSE_STDERR_ONLY;
     // Default is command line based
     CU_ASSERT (params_v (3, "query", "foo", "bar") == 0);
-	CU_ASSERT_FATAL (process_identifier != NULL);
-    CU_ASSERT (!strcmp (process_identifier, "foo bar"));
+	CU_ASSERT_FATAL (PARAM (process_identifier) != NULL);
+    CU_ASSERT (!strcmp (PARAM (process_identifier), "foo bar"));
     // Explicit value
     CU_ASSERT (params_v (5, "-k", "Test", "query", "foo", "bar") == 0);
-	CU_ASSERT_FATAL (process_identifier != NULL);
-    CU_ASSERT (!strcmp (process_identifier, "Test"));
+	CU_ASSERT_FATAL (PARAM (process_identifier) != NULL);
+    CU_ASSERT (!strcmp (PARAM (process_identifier), "Test"));
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_L (void) {
+    VERBOSE_WATCH_ALL;
+    // Default is not shared
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (shared_lease) == 0);
+    CU_ASSERT (PARAM (global_identifier) == 0);
+    // Set flag, which implies a global identifier
+    CU_ASSERT (params_v (1, "-L") == 0);
+    CU_ASSERT (PARAM (shared_lease) != 0);
+    CU_ASSERT (PARAM (global_identifier) != 0);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_m (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for m
+    CU_ASSERT (params_v (1, "-m") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+#ifndef _WIN32
+    CU_ASSERT (params_v (2, "-m", "local:0") == EINVAL);
+    VERBOSE_STDERR_ONLY;
+    CU_ASSERT (params_v (2, "-m", "bind") == EINVAL);
+    VERBOSE_STDERR_ONLY;
+    // Only one node can be preferred
+    CU_ASSERT (params_v (2, "-m", "preferred:0,1") == EINVAL);
+    VERBOSE_STDERR_ONLY;
+#endif /* ifndef _WIN32 */
+    // Default is the policy of the watchdog
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (memory_policy) == NULL);
+    // Explicit values
+    CU_ASSERT (params_v (2, "-m", "preferred:1") == 0);
+    CU_ASSERT_FATAL (PARAM (memory_policy) != NULL);
+    CU_ASSERT (!strcmp (PARAM (memory_policy), "preferred:1"));
+    CU_ASSERT (params_v (2, "-m", "bind:0-1") == 0);
+    CU_ASSERT_FATAL (PARAM (memory_policy) != NULL);
+    CU_ASSERT (!strcmp (PARAM (memory_policy), "bind:0-1"));
+    CU_ASSERT (params_v (2, "-m", "interleave:0,2") == 0);
+    CU_ASSERT_FATAL (PARAM (memory_policy) != NULL);
+    CU_ASSERT (!strcmp (PARAM (memory_policy), "interleave:0,2"));
+    // Leaves the other placement and priority parameters alone
+    CU_ASSERT (params_v (8, "-y", "5", "-S", "batch", "-j", "idle", "-m", "preferred:0") == 0);
+    CU_ASSERT_FATAL (PARAM (nice_value) != NULL);
+    CU_ASSERT (!strcmp (PARAM (nice_value), "5"));
+    CU_ASSERT_FATAL (PARAM (sched_policy) != NULL);
+    CU_ASSERT (!strcmp (PARAM (sched_policy), "batch"));
+    CU_ASSERT_FATAL (PARAM (io_priority) != NULL);
+    CU_ASSERT (!strcmp (PARAM (io_priority), "idle"));
+    CU_ASSERT_FATAL (PARAM (memory_policy) != NULL);
+    CU_ASSERT (!strcmp (PARAM (memory_policy), "preferred:0"));
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_N (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for N
+    CU_ASSERT (params_v (1, "-N") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is no replicas
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (replica_count) == 0);
+    CU_ASSERT (PARAM (replica_index) == -1);
+    // Explicit value
+    CU_ASSERT (params_v (2, "-N", "8") == 0);
+    CU_ASSERT (PARAM (replica_count) == 8);
+    CU_ASSERT (params_v (2, "-N", "-1") == 0);
+    CU_ASSERT (PARAM (replica_count) == 0);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_n (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for n
+    CU_ASSERT (params_v (1, "-n") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is three failures
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (health_threshold) == 3);
+    // Explicit value
+    CU_ASSERT (params_v (2, "-n", "5") == 0);
+    CU_ASSERT (PARAM (health_threshold) == 5);
+    CU_ASSERT (params_v (2, "-n", "0") == 0);
+    CU_ASSERT (PARAM (health_threshold) == 1);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_o (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for o
+    CU_ASSERT (params_v (1, "-o") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    CU_ASSERT (params_v (2, "-o", "foo") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is status only
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (output_mode) == OUTPUT_STATUS);
+    // Explicit values
+    CU_ASSERT (params_v (2, "-o", "stats") == 0);
+    CU_ASSERT (PARAM (output_mode) == OUTPUT_STATS);
+    CU_ASSERT (params_v (2, "-o", "json") == 0);
+    CU_ASSERT (PARAM (output_mode) == OUTPUT_JSON);
+    CU_ASSERT (params_v (2, "-o", "status") == 0);
+    CU_ASSERT (PARAM (output_mode) == OUTPUT_STATUS);
     VERBOSE_SILENT_ALL;
 }
 
@@ -87,16 +360,16 @@ static void test_params_P (void) {
     // Default is parent ID
     CU_ASSERT (params_v (0) == 0);
 #ifdef _WIN32
-    CU_ASSERT (parent_process != INVALID_HANDLE_VALUE);
+    CU_ASSERT (PARAM (parent_process) != INVALID_HANDLE_VALUE);
 #else /* ifdef _WIN32 */
-    CU_ASSERT (parent_process == getppid ());
+    CU_ASSERT (PARAM (parent_process) == getppid ());
 #endif /* ifdef _WIN32 */
     // Explicit value
     CU_ASSERT (params_v (2, "-P", "1234") == 0);
 #ifdef _WIN32
-	CU_ASSERT ((parent_process == NULL) || (GetProcessId (parent_process) == 1234));
+	CU_ASSERT ((PARAM (parent_process) == NULL) || (GetProcessId (PARAM (parent_process)) == 1234));
 #else /* ifdef _WIN32 */
-    CU_ASSERT (parent_process == 1234);
+    CU_ASSERT (PARAM (parent_process) == 1234);
 #endif /* ifdef _WIN32 */
     VERBOSE_SILENT_ALL;
 }
@@ -105,10 +378,113 @@ static void test_params_p (void) {
     VERBOSE_WATCH_ALL;
     // Default is not to watch
     CU_ASSERT (params_v (0) == 0);
-    CU_ASSERT (watch_parent == 0);
+    CU_ASSERT (PARAM (watch_parent) == 0);
     // Set flag
     CU_ASSERT (params_v (1, "-p") == 0);
-    CU_ASSERT (watch_parent != 0);
+    CU_ASSERT (PARAM (watch_parent) != 0);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_R (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for R
+    CU_ASSERT (params_v (1, "-R") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is no limit
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (restart_limit) == -1);
+    // Explicit value
+    CU_ASSERT (params_v (2, "-R", "5") == 0);
+    CU_ASSERT (PARAM (restart_limit) == 5);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_r (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for r
+    CU_ASSERT (params_v (1, "-r") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    CU_ASSERT (params_v (2, "-r", "foo") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is no restarts
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (restart_mode) == RESTART_NO);
+    // Explicit values
+    CU_ASSERT (params_v (2, "-r", "on-failure") == 0);
+    CU_ASSERT (PARAM (restart_mode) == RESTART_ON_FAILURE);
+    CU_ASSERT (params_v (2, "-r", "always") == 0);
+    CU_ASSERT (PARAM (restart_mode) == RESTART_ALWAYS);
+    CU_ASSERT (params_v (2, "-r", "no") == 0);
+    CU_ASSERT (PARAM (restart_mode) == RESTART_NO);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_S (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for S
+    CU_ASSERT (params_v (1, "-S") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+#ifndef _WIN32
+    CU_ASSERT (params_v (2, "-S", "fifo") == EINVAL);
+    VERBOSE_STDERR_ONLY;
+#endif /* ifndef _WIN32 */
+    // Default is the policy of the watchdog
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (sched_policy) == NULL);
+    // Explicit values
+    CU_ASSERT (params_v (2, "-S", "batch") == 0);
+    CU_ASSERT_FATAL (PARAM (sched_policy) != NULL);
+    CU_ASSERT (!strcmp (PARAM (sched_policy), "batch"));
+    CU_ASSERT (params_v (2, "-S", "idle") == 0);
+    CU_ASSERT_FATAL (PARAM (sched_policy) != NULL);
+    CU_ASSERT (!strcmp (PARAM (sched_policy), "idle"));
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_s (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for s
+    CU_ASSERT (params_v (1, "-s") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is not socket activated
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (listen_spec) == NULL);
+    // Explicit value
+    CU_ASSERT (params_v (2, "-s", "8080,0.0.0.0:8081") == 0);
+    CU_ASSERT_FATAL (PARAM (listen_spec) != NULL);
+    CU_ASSERT (!strcmp (PARAM (listen_spec), "8080,0.0.0.0:8081"));
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_T (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for T
+    CU_ASSERT (params_v (1, "-T") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    CU_ASSERT (params_v (2, "-T", "foo") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is disabled
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (timing_mode) == TIMING_NONE);
+    // Explicit values
+    CU_ASSERT (params_v (2, "-T", "json") == 0);
+    CU_ASSERT (PARAM (timing_mode) == TIMING_JSON);
+    CU_ASSERT (params_v (2, "-T", "log") == 0);
+    CU_ASSERT (PARAM (timing_mode) == TIMING_LOG);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_t (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for t
+    CU_ASSERT (params_v (1, "-t") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is no limit
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (wait_timeout) == -1);
+    // Explicit value
+    CU_ASSERT (params_v (2, "-t", "30") == 0);
+    CU_ASSERT (PARAM (wait_timeout) == 30);
     VERBOSE_SILENT_ALL;
 }
 
@@ -116,14 +492,82 @@ static void test_params_v (void) {
     VERBOSE_WATCH_ALL;
     // Default is not verbose
     CU_ASSERT (params_v (0) == 0);
-    CU_ASSERT (verbose == 0);
+    CU_ASSERT (PARAM (verbose) == 0);
     VERBOSE_SILENT_ALL;
     // Set flag
     CU_ASSERT (params_v (1, "-v") == 0);
-    CU_ASSERT (verbose != 0);
+    CU_ASSERT (PARAM (verbose) != 0);
     VERBOSE_STDOUT_ONLY;
 }
 
+static void test_params_W (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for W
+    CU_ASSERT (params_v (1, "-W") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is one process
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (pool_size) == 1);
+    // Explicit value
+    CU_ASSERT (params_v (2, "-W", "4") == 0);
+    CU_ASSERT (PARAM (pool_size) == 4);
+    CU_ASSERT (params_v (2, "-W", "-1") == 0);
+    CU_ASSERT (PARAM (pool_size) == 0);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_w (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for w
+    CU_ASSERT (params_v (1, "-w") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+    // Default is no pool
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (pool_name) == NULL);
+    CU_ASSERT (PARAM (pool_member) == 0);
+    // Explicit value
+    CU_ASSERT (params_v (2, "-w", "foo") == 0);
+    CU_ASSERT_FATAL (PARAM (pool_name) != NULL);
+    CU_ASSERT (!strcmp (PARAM (pool_name), "foo"));
+    CU_ASSERT (PARAM (pool_member) == 0);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_X (void) {
+    VERBOSE_WATCH_ALL;
+    // Default is disabled
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (trace_enabled) == 0);
+    // Set flag
+    CU_ASSERT (params_v (1, "-X") == 0);
+    CU_ASSERT (PARAM (trace_enabled) != 0);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_params_y (void) {
+    VERBOSE_WATCH_ALL;
+    // Expect parameter for y
+    CU_ASSERT (params_v (1, "-y") == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    VERBOSE_STDERR_ONLY;
+#ifndef _WIN32
+    CU_ASSERT (params_v (2, "-y", "20") == EINVAL);
+    VERBOSE_STDERR_ONLY;
+    CU_ASSERT (params_v (2, "-y", "x") == EINVAL);
+    VERBOSE_STDERR_ONLY;
+#endif /* ifndef _WIN32 */
+    // Default is the nice value of the watchdog
+    CU_ASSERT (params_v (0) == 0);
+    CU_ASSERT (PARAM (nice_value) == NULL);
+    // Explicit values
+    CU_ASSERT (params_v (2, "-y", "10") == 0);
+    CU_ASSERT_FATAL (PARAM (nice_value) != NULL);
+    CU_ASSERT (!strcmp (PARAM (nice_value), "10"));
+    CU_ASSERT (params_v (2, "-y", "-5") == 0);
+    CU_ASSERT_FATAL (PARAM (nice_value) != NULL);
+    CU_ASSERT (!strcmp (PARAM (nice_value), "-5"));
+    VERBOSE_SILENT_ALL;
+}
+
 static void test_params_inval (void) {
     VERBOSE_WATCH_ALL;
     // Unrecognised option
@@ -136,13 +580,37 @@ static void test_params_inval (void) {
 int register_tests_params () {
     CU_pSuite pSuite = CU_add_suite ("params", NULL, NULL);
     if (!pSuite
+     || !CU_add_test (pSuite, "params [A]", test_params_A)
+     || !CU_add_test (pSuite, "params [a]", test_params_a)
+     || !CU_add_test (pSuite, "params [C]", test_params_C)
+     || !CU_add_test (pSuite, "params [c]", test_params_c)
      || !CU_add_test (pSuite, "params [d]", test_params_d)
+     || !CU_add_test (pSuite, "params [f]", test_params_f)
+     || !CU_add_test (pSuite, "params [g]", test_params_g)
      || !CU_add_test (pSuite, "params [H]", test_params_H)
+     || !CU_add_test (pSuite, "params [I]", test_params_I)
+     || !CU_add_test (pSuite, "params [i]", test_params_i)
+     || !CU_add_test (pSuite, "params [j]", test_params_j)
      || !CU_add_test (pSuite, "params [K]", test_params_K)
      || !CU_add_test (pSuite, "params [k]", test_params_k)
+     || !CU_add_test (pSuite, "params [L]", test_params_L)
+     || !CU_add_test (pSuite, "params [m]", test_params_m)
+     || !CU_add_test (pSuite, "params [N]", test_params_N)
+     || !CU_add_test (pSuite, "params [n]", test_params_n)
+     || !CU_add_test (pSuite, "params [o]", test_params_o)
      || !CU_add_test (pSuite, "params [P]", test_params_P)
      || !CU_add_test (pSuite, "params [p]", test_params_p)
+     || !CU_add_test (pSuite, "params [R]", test_params_R)
+     || !CU_add_test (pSuite, "params [r]", test_params_r)
+     || !CU_add_test (pSuite, "params [S]", test_params_S)
+     || !CU_add_test (pSuite, "params [s]", test_params_s)
+     || !CU_add_test (pSuite, "params [T]", test_params_T)
+     || !CU_add_test (pSuite, "params [t]", test_params_t)
      || !CU_add_test (pSuite, "params [v]", test_params_v)
+     || !CU_add_test (pSuite, "params [W]", test_params_W)
+     || !CU_add_test (pSuite, "params [w]", test_params_w)
+     || !CU_add_test (pSuite, "params [X]", test_params_X)
+     || !CU_add_test (pSuite, "params [y]", test_params_y)
      || !CU_add_test (pSuite, "params [?]", test_params_inval)) {
         return CU_get_error ();
     }
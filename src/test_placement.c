@@ -0,0 +1,319 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "operations.h"
+#include "params.h"
+#include "placement.h"
+#include "process.h"
+#include "test_verbose.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <errno.h>
+# include <signal.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// Tests a bit in a placement mask
+static int is_set (const unsigned long *mask, int bit) {
+    return (mask[bit / (8 * sizeof (unsigned long))] & (1UL << (bit % (8 * sizeof (unsigned long))))) != 0;
+}
+
+/// Counts the bits in a placement mask
+static int count_set (const unsigned long *mask) {
+    int i, count = 0;
+    for (i = 0; i < PLACEMENT_MAX; i++) {
+        if (is_set (mask, i)) count++;
+    }
+    return count;
+}
+
+/// Reads a line from the status of a process, without the field name
+static int read_status (pid_t process, const char *field, char *buffer, size_t size) {
+    char path[32], line[256];
+    FILE *in;
+    int found = 0;
+    snprintf (path, sizeof (path), "/proc/%u/status", process);
+    if (!(in = fopen (path, "r"))) return 0;
+    while (!found && fgets (line, sizeof (line), in)) {
+        if (strncmp (line, field, strlen (field)) || (line[strlen (field)] != ':')) continue;
+        snprintf (buffer, size, "%s", line + strlen (field) + 1 + strspn (line + strlen (field) + 1, " \t"));
+        buffer[strcspn (buffer, "\n")] = 0;
+        found = 1;
+    }
+    fclose (in);
+    return found;
+}
+
+/// The synthetic topology folder
+static char _topology[16];
+
+/// The files and folders created in the synthetic topology, in order
+static char _created[128][64];
+
+/// The number of files and folders created in the synthetic topology
+static int _created_count = 0;
+
+/// Writes a file in the synthetic topology, creating the folders to it
+static void write_topology (const char *file, const char *value) {
+    char path[64];
+    FILE *out;
+    char *slash;
+    snprintf (path, sizeof (path), "%s/%s", _topology, file);
+    for (slash = strchr (path + strlen (_topology) + 1, '/'); slash; slash = strchr (slash + 1, '/')) {
+        *slash = 0;
+        if (!mkdir (path, 0755)) strcpy (_created[_created_count++], path);
+        *slash = '/';
+    }
+    out = fopen (path, "w");
+    CU_ASSERT_FATAL (out != NULL);
+    fprintf (out, "%s\n", value);
+    fclose (out);
+    strcpy (_created[_created_count++], path);
+}
+
+/// Deletes the synthetic topology
+static void delete_topology () {
+    while (_created_count > 0) {
+        remove (_created[--_created_count]);
+    }
+    CU_ASSERT (rmdir (_topology) == 0);
+    placement_set_topology (NULL);
+}
+
+/// Builds a mask from a list, for comparison
+static int is_mask (const unsigned long *mask, const char *spec) {
+    unsigned long expected[PLACEMENT_WORDS];
+    CU_ASSERT_FATAL (placement_list (spec, expected) == 0);
+    return !memcmp (mask, expected, sizeof (expected));
+}
+
+#endif /* ifndef _WIN32 */
+
+static void test_placement_list (void) {
+#ifndef _WIN32
+    unsigned long mask[PLACEMENT_WORDS];
+    CU_ASSERT (placement_list ("0-3,6", mask) == 0);
+    CU_ASSERT (count_set (mask) == 5);
+    CU_ASSERT (is_set (mask, 0) && is_set (mask, 3) && is_set (mask, 6));
+    CU_ASSERT (!is_set (mask, 4) && !is_set (mask, 5));
+    CU_ASSERT (placement_list ("1023", mask) == 0);
+    CU_ASSERT ((count_set (mask) == 1) && is_set (mask, 1023));
+    CU_ASSERT (placement_list ("2-2", mask) == 0);
+    CU_ASSERT ((count_set (mask) == 1) && is_set (mask, 2));
+    // Anything else is rejected
+    CU_ASSERT (placement_list ("", mask) == EINVAL);
+    CU_ASSERT (placement_list ("1024", mask) == EINVAL);
+    CU_ASSERT (placement_list ("3-1", mask) == EINVAL);
+    CU_ASSERT (placement_list ("1,", mask) == EINVAL);
+    CU_ASSERT (placement_list ("-1", mask) == EINVAL);
+    CU_ASSERT (placement_list ("1 2", mask) == EINVAL);
+    CU_ASSERT (placement_list ("a", mask) == EINVAL);
+#endif /* ifndef _WIN32 */
+}
+
+static void test_placement_format (void) {
+#ifndef _WIN32
+    unsigned long mask[PLACEMENT_WORDS];
+    char buffer[PLACEMENT_LIST];
+    CU_ASSERT (placement_list ("6,0-3,1,1023,8-9", mask) == 0);
+    CU_ASSERT (placement_format (mask, buffer, sizeof (buffer)) == 0);
+    CU_ASSERT (!strcmp (buffer, "0-3,6,8-9,1023"));
+    CU_ASSERT (placement_list ("0-1023", mask) == 0);
+    CU_ASSERT (placement_format (mask, buffer, sizeof (buffer)) == 0);
+    CU_ASSERT (!strcmp (buffer, "0-1023"));
+    CU_ASSERT (placement_format (mask, buffer, 6) == ERANGE);
+    memset (mask, 0, sizeof (mask));
+    CU_ASSERT (placement_format (mask, buffer, sizeof (buffer)) == 0);
+    CU_ASSERT (!strcmp (buffer, ""));
+#endif /* ifndef _WIN32 */
+}
+
+static void test_placement_memory (void) {
+#ifndef _WIN32
+    unsigned long mask[PLACEMENT_WORDS];
+    int mode, preferred, bind;
+    CU_ASSERT (placement_memory ("preferred:1", &preferred, mask) == 0);
+    CU_ASSERT ((count_set (mask) == 1) && is_set (mask, 1));
+    CU_ASSERT (placement_memory ("bind:0-1", &bind, mask) == 0);
+    CU_ASSERT (count_set (mask) == 2);
+    CU_ASSERT (placement_memory ("interleave:0,2", &mode, mask) == 0);
+    CU_ASSERT (count_set (mask) == 2);
+    CU_ASSERT ((preferred != bind) && (mode != bind) && (mode != preferred));
+    // Anything else is rejected
+    CU_ASSERT (placement_memory ("preferred:0-1", &mode, mask) == EINVAL);
+    CU_ASSERT (placement_memory ("prefer:0", &mode, mask) == EINVAL);
+    CU_ASSERT (placement_memory ("bind", &mode, mask) == EINVAL);
+    CU_ASSERT (placement_memory ("bind:", &mode, mask) == EINVAL);
+    CU_ASSERT (placement_memory (":0", &mode, mask) == EINVAL);
+#endif /* ifndef _WIN32 */
+}
+
+static void test_placement_allocate (void) {
+#ifndef _WIN32
+    unsigned long mask[PLACEMENT_WORDS], unavailable[PLACEMENT_WORDS];
+    char file[64], value[16];
+    int cpu;
+    strcpy (_topology, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (_topology) != NULL);
+    // Four cores of two threads, each pair of cores sharing a cache
+    write_topology ("cpu/online", "0-7");
+    for (cpu = 0; cpu < 8; cpu++) {
+        snprintf (file, sizeof (file), "cpu/cpu%d/topology/thread_siblings_list", cpu);
+        snprintf (value, sizeof (value), "%d,%d", cpu % 4, cpu % 4 + 4);
+        write_topology (file, value);
+        snprintf (file, sizeof (file), "cpu/cpu%d/cache/index0/level", cpu);
+        write_topology (file, "1");
+        snprintf (file, sizeof (file), "cpu/cpu%d/cache/index0/shared_cpu_list", cpu);
+        write_topology (file, value);
+        snprintf (file, sizeof (file), "cpu/cpu%d/cache/index1/level", cpu);
+        write_topology (file, "3");
+        snprintf (file, sizeof (file), "cpu/cpu%d/cache/index1/shared_cpu_list", cpu);
+        write_topology (file, (cpu % 4 < 2) ? "0-1,4-5" : "2-3,6-7");
+    }
+    write_topology ("node/node0/cpulist", "0-7");
+    placement_set_topology (_topology);
+    // Cores are taken with all of their threads
+    memset (unavailable, 0, sizeof (unavailable));
+    CU_ASSERT (placement_allocate (1, unavailable, mask) == 0);
+    CU_ASSERT (is_mask (mask, "0,4"));
+    CU_ASSERT (placement_allocate (4, unavailable, mask) == 0);
+    CU_ASSERT (is_mask (mask, "0-7"));
+    CU_ASSERT (placement_allocate (5, unavailable, mask) == EBUSY);
+    CU_ASSERT (placement_allocate (0, unavailable, mask) == EINVAL);
+    // The cache with the fewest free cores that are enough is used
+    CU_ASSERT (placement_list ("0", unavailable) == 0);
+    CU_ASSERT (placement_allocate (1, unavailable, mask) == 0);
+    CU_ASSERT (is_mask (mask, "1,5"));
+    CU_ASSERT (placement_allocate (2, unavailable, mask) == 0);
+    CU_ASSERT (is_mask (mask, "2-3,6-7"));
+    // A core is not free if any of its threads is taken
+    CU_ASSERT (placement_allocate (4, unavailable, mask) == EBUSY);
+    // Failing a cache, the node is used
+    CU_ASSERT (placement_list ("0,2", unavailable) == 0);
+    CU_ASSERT (placement_allocate (2, unavailable, mask) == 0);
+    CU_ASSERT (is_mask (mask, "1,3,5,7"));
+    delete_topology ();
+#endif /* ifndef _WIN32 */
+}
+
+static void test_operation_start_cores (void) {
+#ifndef _WIN32
+    unsigned long unavailable[PLACEMENT_WORDS];
+    struct process_info *info;
+    char tmpdir[16], cpu[8], path[64];
+    pid_t first;
+    VERBOSE_WATCH_ALL;
+    // A single CPU the tests can run on, so the second start finds none free
+    memset (unavailable, 0, sizeof (unavailable));
+    placement_unavailable (unavailable);
+    for (first = 0; (first < PLACEMENT_MAX - 1) && is_set (unavailable, first); first++);
+    snprintf (cpu, sizeof (cpu), "%d", (int)first);
+    strcpy (_topology, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (_topology) != NULL);
+    write_topology ("cpu/online", cpu);
+    placement_set_topology (_topology);
+    strcpy (tmpdir, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (tmpdir) != NULL);
+    CU_ASSERT_FATAL (params_v (9, "-d", tmpdir, "-A", "1", "-k", "cores-a", "start", "sleep", "60") == 0);
+    CU_ASSERT_FATAL (operation_start () == 0);
+    first = process_find ();
+    CU_ASSERT_FATAL (first != 0);
+    CU_ASSERT (read_status (first, "Cpus_allowed_list", path, sizeof (path)));
+    CU_ASSERT (!strcmp (path, cpu));
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "cpus") && !strcmp (process_info_get (info, "cpus"), cpu));
+    CU_ASSERT (process_info_get (info, "cores") && !strcmp (process_info_get (info, "cores"), "1"));
+    process_info_free (info);
+    // The core is held by the first process
+    CU_ASSERT_FATAL (params_v (9, "-d", tmpdir, "-A", "1", "-k", "cores-b", "start", "sleep", "60") == 0);
+    CU_ASSERT (operation_start () == EBUSY);
+    VERBOSE_STDERR_ONLY;
+    CU_ASSERT (process_find () == 0);
+    // Until it terminates
+    CU_ASSERT_FATAL (params_v (9, "-d", tmpdir, "-A", "1", "-k", "cores-a", "stop", "sleep", "60") == 0);
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    process_info_free (info);
+    CU_ASSERT_FATAL (params_v (9, "-d", tmpdir, "-A", "1", "-k", "cores-b", "start", "sleep", "60") == 0);
+    CU_ASSERT (operation_start () == 0);
+    CU_ASSERT (process_find () != 0);
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    process_info_free (info);
+    // Tidy up
+    snprintf (path, sizeof (path), "%s/%u/cores-a", tmpdir, getppid ());
+    unlink (path);
+    snprintf (path, sizeof (path), "%s/%u/cores-b", tmpdir, getppid ());
+    unlink (path);
+    snprintf (path, sizeof (path), "%s/%u", tmpdir, getppid ());
+    rmdir (path);
+    snprintf (path, sizeof (path), "%s/.lock", tmpdir);
+    unlink (path);
+    CU_ASSERT (rmdir (tmpdir) == 0);
+    delete_topology ();
+    VERBOSE_SILENT_ALL;
+#endif /* ifndef _WIN32 */
+}
+
+static void init_operation_start_placement () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (9, "-a", "0", "-m", "preferred:0", "-k", "placement", "start", "sleep", "60") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_start_placement () {
+#ifndef _WIN32
+    struct process_info *info;
+    char buffer[64];
+    pid_t process;
+    CU_ASSERT_FATAL (operation_start () == 0);
+    process = process_find ();
+    CU_ASSERT_FATAL (process != 0);
+    // The child is placed before it executes the command
+    CU_ASSERT (read_status (process, "Cpus_allowed_list", buffer, sizeof (buffer)));
+    CU_ASSERT (!strcmp (buffer, "0"));
+    // And the placement is recorded
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "cpus") && !strcmp (process_info_get (info, "cpus"), "0"));
+    CU_ASSERT (process_info_get (info, "mempolicy") && !strcmp (process_info_get (info, "mempolicy"), "preferred:0"));
+    process_info_free (info);
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    process_info_free (info);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_start_placement)
+
+int register_tests_placement () {
+    CU_pSuite pSuite = CU_add_suite ("placement", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "placement_list", test_placement_list)
+     || !CU_add_test (pSuite, "placement_format", test_placement_format)
+     || !CU_add_test (pSuite, "placement_memory", test_placement_memory)
+     || !CU_add_test (pSuite, "placement_allocate", test_placement_allocate)
+     || !CU_add_test (pSuite, "operation_start [placement,quiet]", test_operation_start_placement)
+     || !CU_add_test (pSuite, "operation_start [placement,verbose]", test_operation_start_placement_verbose)
+     || !CU_add_test (pSuite, "operation_start [cores]", test_operation_start_cores)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
@@ -0,0 +1,212 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "kill.h"
+#include "operations.h"
+#include "params.h"
+#include "process.h"
+#include "test_verbose.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <poll.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+static char _tmpdir[16];
+
+/// Selects a member of the test pool, keeping the verbose flag
+static void use_member (int slot) {
+    char identifier[32];
+    int v = PARAM (verbose);
+    snprintf (identifier, sizeof (identifier), "pool:test:%d", slot);
+    CU_ASSERT_FATAL (params_v (5, "-d", _tmpdir, "-K", "-k", identifier) == 0);
+    if (v) _verbose_test ();
+}
+
+/// Selects a process claimed from the test pool, keeping the verbose flag
+static void use_claim (const char *identifier, const char *command) {
+    int v = PARAM (verbose);
+    CU_ASSERT_FATAL (params_v (9, "-d", _tmpdir, "-w", "test", "-k", identifier, "start", "sleep", command) == 0);
+    if (v) _verbose_test ();
+}
+
+/// Waits for the member of the pool in a slot to become ready
+static pid_t member_ready (int slot) {
+    struct process_info *info;
+    const char *value;
+    pid_t process = 0;
+    int i;
+    use_member (slot);
+    for (i = 0; !process && (i < 50); i++) {
+        info = process_load ();
+        value = process_info_get (info, "pid");
+        if (value && process_info_get (info, "ready")) process = (pid_t)strtol (value, NULL, 10);
+        process_info_free (info);
+        if (!process) poll (NULL, 0, 100);
+    }
+    return process;
+}
+
+/// Waits for the member's file to be released by its watchdog once claimed
+static void member_released (pid_t process) {
+    struct process_info *info;
+    const char *value;
+    int slot, i, found = 1;
+    for (i = 0; found && (i < 50); i++) {
+        found = 0;
+        for (slot = 0; slot < 3; slot++) {
+            use_member (slot);
+            info = process_load ();
+            value = process_info_get (info, "pid");
+            if (value && ((pid_t)strtol (value, NULL, 10) == process)) found = 1;
+            process_info_free (info);
+        }
+        if (found) poll (NULL, 0, 100);
+    }
+    CU_ASSERT (!found);
+}
+
+/// Stops a process and waits for its watchdog to record the termination
+static void stop_process () {
+    struct process_info *info;
+    pid_t process = process_find ();
+    if (!process) return;
+    kill_process (process);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    CU_ASSERT (process_info_get (info, "signal") && !strcmp (process_info_get (info, "signal"), "15"));
+    process_info_free (info);
+}
+
+/// Deletes the files in a folder of the data directory, and the folder
+static void remove_folder (const char *folder) {
+    char path[64];
+    int slot;
+    for (slot = 0; slot < 4; slot++) {
+        snprintf (path, sizeof (path), "%s/%s/pool:test:%d", _tmpdir, folder, slot);
+        unlink (path);
+        snprintf (path, sizeof (path), "%s/%s/pool^3Atest^3A%d", _tmpdir, folder, slot);
+        unlink (path);
+    }
+    snprintf (path, sizeof (path), "%s/%s/claimed", _tmpdir, folder);
+    unlink (path);
+    snprintf (path, sizeof (path), "%s/%s/fallback", _tmpdir, folder);
+    unlink (path);
+    snprintf (path, sizeof (path), "%s/%s", _tmpdir, folder);
+    rmdir (path);
+}
+
+#endif /* ifndef _WIN32 */
+
+static void init_operation_pool () {
+#ifndef _WIN32
+    strcpy (_tmpdir, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (_tmpdir) != NULL);
+    CU_ASSERT_FATAL (params_v (9, "-d", _tmpdir, "-w", "test", "-W", "2", "pool", "sleep", "60") == 0);
+#else /* ifndef _WIN32 */
+	CU_ASSERT_FATAL (params_v (7, "-w", "test", "-W", "2", "pool", "sleep", "60") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_pool () {
+#ifdef _WIN32
+	CU_ASSERT (operation_pool () == ERROR_NOT_SUPPORTED);
+#else /* ifdef _WIN32 */
+    struct process_info *info;
+    char path[64];
+    pid_t first, second, claimed;
+    int slot, members, v = PARAM (verbose);
+    // Two members are started and become ready
+    CU_ASSERT_FATAL (operation_pool () == 0);
+    first = member_ready (0);
+    second = member_ready (1);
+    CU_ASSERT (first != 0);
+    CU_ASSERT (second != 0);
+    // The pool is already full
+    CU_ASSERT_FATAL (params_v (9, "-d", _tmpdir, "-w", "test", "-W", "2", "pool", "sleep", "60") == 0);
+    if (v) _verbose_test ();
+    CU_ASSERT (operation_pool () == 0);
+    use_member (2);
+    CU_ASSERT (process_load () == NULL);
+    // Claim one of them
+    use_claim ("claimed", "60");
+    CU_ASSERT (operation_start () == 0);
+    claimed = process_find ();
+    CU_ASSERT ((claimed == first) || (claimed == second));
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "claimed") != NULL);
+    CU_ASSERT (process_info_get (info, "pool") == NULL);
+    CU_ASSERT (process_info_get (info, "sid") && !strcmp (process_info_get (info, "sid"), "claimed"));
+    process_info_free (info);
+    // The claimed member leaves the pool, and a replacement is started
+    member_released (claimed);
+    members = 0;
+    for (slot = 0; slot < 3; slot++) {
+        use_member (slot);
+        if (process_find ()) members++;
+    }
+    CU_ASSERT (members == 2);
+    // The watchdog records the termination of the claimed process in its new file
+    use_claim ("claimed", "60");
+    stop_process ();
+    // A different command can't be claimed, so is started
+    use_claim ("fallback", "61");
+    CU_ASSERT (operation_start () == 0);
+    claimed = process_find ();
+    CU_ASSERT (claimed != 0);
+    CU_ASSERT ((claimed != first) && (claimed != second));
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "claimed") == NULL);
+    process_info_free (info);
+    stop_process ();
+    // A member that can't be started fails the operation, rather than each
+    // following slot being tried in turn
+    CU_ASSERT_FATAL (params_v (11, "-d", _tmpdir, "-w", "test", "-W", "3", "-A", "100000", "pool", "sleep", "60") == 0);
+    if (v) _verbose_test ();
+    CU_ASSERT (operation_pool () != 0);
+    members = 0;
+    for (slot = 0; slot < 4; slot++) {
+        use_member (slot);
+        if (process_find ()) members++;
+    }
+    CU_ASSERT (members == 2);
+    // Tidy up
+    for (slot = 0; slot < 3; slot++) {
+        use_member (slot);
+        stop_process ();
+    }
+    remove_folder ("GLOBAL");
+    snprintf (path, sizeof (path), "%u", getppid ());
+    remove_folder (path);
+    snprintf (path, sizeof (path), "%s/.lock", _tmpdir);
+    unlink (path);
+    CU_ASSERT (rmdir (_tmpdir) == 0);
+#endif /* ifdef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_pool)
+
+int register_tests_pool () {
+    CU_pSuite pSuite = CU_add_suite ("pool", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "operation_pool [quiet]", test_operation_pool)
+     || !CU_add_test (pSuite, "operation_pool [verbose]", test_operation_pool_verbose)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
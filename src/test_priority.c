@@ -0,0 +1,176 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "operations.h"
+#include "params.h"
+#include "parent.h"
+#include "priority.h"
+#include "process.h"
+#include "test_verbose.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <errno.h>
+# include <sched.h>
+# include <sys/resource.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// Tests the priority of a process against the values given
+static int has_priority (pid_t process, int nice, const char *policy, const char *io) {
+    int expected_policy, expected_io;
+    CU_ASSERT_FATAL (priority_policy (policy, &expected_policy) == 0);
+    CU_ASSERT_FATAL (priority_io (io, &expected_io) == 0);
+    errno = 0;
+    if ((getpriority (PRIO_PROCESS, process) != nice) || errno) return 0;
+    if (sched_getscheduler (process) != expected_policy) return 0;
+#ifdef SYS_ioprio_get
+    if (syscall (SYS_ioprio_get, 1, process) != expected_io) return 0;
+#endif /* ifdef SYS_ioprio_get */
+    return 1;
+}
+
+/// Waits for the child of a process to be started, returning its PID
+static pid_t wait_child (pid_t process) {
+    struct pid_list *children = NULL;
+    pid_t child = 0;
+    int i;
+    for (i = 0; (i < 50) && !(children = get_children (process)); i++) {
+        usleep (100000);
+    }
+    if (children) child = children->pid;
+    pid_list_free (children);
+    return child;
+}
+
+#endif /* ifndef _WIN32 */
+
+static void test_priority_nice (void) {
+#ifndef _WIN32
+    int value;
+    CU_ASSERT ((priority_nice ("10", &value) == 0) && (value == 10));
+    CU_ASSERT ((priority_nice ("-20", &value) == 0) && (value == -20));
+    CU_ASSERT ((priority_nice ("19", &value) == 0) && (value == 19));
+    // Anything else is rejected
+    CU_ASSERT (priority_nice ("20", &value) == EINVAL);
+    CU_ASSERT (priority_nice ("-21", &value) == EINVAL);
+    CU_ASSERT (priority_nice ("", &value) == EINVAL);
+    CU_ASSERT (priority_nice ("5x", &value) == EINVAL);
+#endif /* ifndef _WIN32 */
+}
+
+static void test_priority_policy (void) {
+#ifndef _WIN32
+    int other, batch, idle;
+    CU_ASSERT (priority_policy ("other", &other) == 0);
+    CU_ASSERT (priority_policy ("batch", &batch) == 0);
+    CU_ASSERT (priority_policy ("idle", &idle) == 0);
+    CU_ASSERT ((other != batch) && (batch != idle) && (idle != other));
+    // Real-time policies are not offered
+    CU_ASSERT (priority_policy ("fifo", &other) == EINVAL);
+    CU_ASSERT (priority_policy ("", &other) == EINVAL);
+#endif /* ifndef _WIN32 */
+}
+
+static void test_priority_io (void) {
+#ifndef _WIN32
+    int value;
+    // The class is in the top bits, as for ioprio_set
+    CU_ASSERT ((priority_io ("idle", &value) == 0) && (value == (3 << 13)));
+    CU_ASSERT ((priority_io ("best-effort", &value) == 0) && (value == ((2 << 13) | 4)));
+    CU_ASSERT ((priority_io ("best-effort:7", &value) == 0) && (value == ((2 << 13) | 7)));
+    CU_ASSERT ((priority_io ("realtime:0", &value) == 0) && (value == (1 << 13)));
+    // Anything else is rejected
+    CU_ASSERT (priority_io ("idle:1", &value) == EINVAL);
+    CU_ASSERT (priority_io ("best-effort:8", &value) == EINVAL);
+    CU_ASSERT (priority_io ("best-effort:", &value) == EINVAL);
+    CU_ASSERT (priority_io ("best-effort:10", &value) == EINVAL);
+    CU_ASSERT (priority_io ("best", &value) == EINVAL);
+#endif /* ifndef _WIN32 */
+}
+
+static void init_operation_priority () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (13, "-y", "10", "-S", "batch", "-j", "idle", "-k", "priority", "--", "start", "sh", "-c", "sleep 60 & wait") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_priority () {
+#ifdef _WIN32
+	CU_ASSERT (operation_priority () == ERROR_NOT_SUPPORTED);
+#else /* ifdef _WIN32 */
+    struct process_info *info;
+    pid_t process, child;
+    // Nothing to change
+    CU_ASSERT (operation_priority () == ESRCH);
+    // The priority is set before the command is executed, and inherited
+    CU_ASSERT_FATAL (operation_start () == 0);
+    process = process_find ();
+    CU_ASSERT_FATAL (process != 0);
+    child = wait_child (process);
+    CU_ASSERT_FATAL (child != 0);
+    CU_ASSERT (has_priority (process, 10, "batch", "idle"));
+    CU_ASSERT (has_priority (child, 10, "batch", "idle"));
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "nice") && !strcmp (process_info_get (info, "nice"), "10"));
+    CU_ASSERT (process_info_get (info, "sched") && !strcmp (process_info_get (info, "sched"), "batch"));
+    CU_ASSERT (process_info_get (info, "ioprio") && !strcmp (process_info_get (info, "ioprio"), "idle"));
+    process_info_free (info);
+    // It can be changed for the whole tree
+    CU_ASSERT_FATAL (params_v (13, "-y", "15", "-S", "idle", "-j", "best-effort:7", "-k", "priority", "--", "priority", "sh", "-c", "sleep 60 & wait") == 0);
+    CU_ASSERT (operation_priority () == 0);
+    CU_ASSERT (has_priority (process, 15, "idle", "best-effort:7"));
+    CU_ASSERT (has_priority (child, 15, "idle", "best-effort:7"));
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "nice") && !strcmp (process_info_get (info, "nice"), "15"));
+    CU_ASSERT (process_info_get (info, "sched") && !strcmp (process_info_get (info, "sched"), "idle"));
+    CU_ASSERT (process_info_get (info, "ioprio") && !strcmp (process_info_get (info, "ioprio"), "best-effort:7"));
+    process_info_free (info);
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    process_info_free (info);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifdef _WIN32 */
+}
+
+static void test_operation_priority_none (void) {
+#ifndef _WIN32
+    VERBOSE_WATCH_ALL;
+    CU_ASSERT_FATAL (params_v (2, "-k", "priority", "priority") == 0);
+    CU_ASSERT (operation_priority () == EINVAL);
+    VERBOSE_STDERR_ONLY;
+    VERBOSE_SILENT_ALL;
+#endif /* ifndef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_priority)
+
+int register_tests_priority () {
+    CU_pSuite pSuite = CU_add_suite ("priority", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "priority_nice", test_priority_nice)
+     || !CU_add_test (pSuite, "priority_policy", test_priority_policy)
+     || !CU_add_test (pSuite, "priority_io", test_priority_io)
+     || !CU_add_test (pSuite, "operation_priority [quiet]", test_operation_priority)
+     || !CU_add_test (pSuite, "operation_priority [verbose]", test_operation_priority_verbose)
+     || !CU_add_test (pSuite, "operation_priority [none]", test_operation_priority_none)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
@@ -0,0 +1,189 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "procctrl.h"
+#include "params.h"
+#include "test_verbose.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <errno.h>
+# include <poll.h>
+# include <pthread.h>
+# include <signal.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_THREADS    4
+
+static void test_procctrl_create (void) {
+    char *bad[] = { "main", "-o", "bad", "query" };
+    char *good[] = { "main", "query", "-v", "-d", "foo" };
+    struct procctrl_context *context;
+    VERBOSE_WATCH_ALL;
+    CU_ASSERT_FATAL (params_v (0) == 0);
+    // Bad parameters
+    context = (struct procctrl_context*)bad;
+    CU_ASSERT (procctrl_create (4, bad, &context) == _WIN32_OR_POSIX (ERROR_INVALID_PARAMETER, EINVAL));
+    CU_ASSERT (context == NULL);
+    VERBOSE_STDERR_ONLY;
+    // The arguments are not modified
+    CU_ASSERT_FATAL (procctrl_create (5, good, &context) == 0);
+    CU_ASSERT (!strcmp (good[1], "query"));
+    CU_ASSERT (!strcmp (good[2], "-v"));
+    VERBOSE_STDOUT_ONLY;
+    // The context of this thread is not modified
+    CU_ASSERT (PARAM (verbose) == 0);
+    CU_ASSERT (PARAM (operation) == NULL);
+    CU_ASSERT (strcmp (PARAM (data_dir), "foo"));
+    procctrl_free (context);
+    VERBOSE_SILENT_ALL;
+}
+
+#ifndef _WIN32
+
+static char _tmpdir[16];
+
+/// Starts, stops and waits for a process using a context of its own
+static void *thread_lifecycle (void *arg) {
+    char id[16], scope[16];
+    char *argv[] = { "main", "-d", _tmpdir, "-P", scope, "-k", id, "-H", "0", "-t", "5", "start", "sleep", "60" };
+    struct procctrl_context *context;
+    struct procctrl_query_result result;
+    long e;
+    snprintf (id, sizeof (id), "test%d", (int)(long)arg);
+    snprintf (scope, sizeof (scope), "%u", getpid ());
+    if ((e = procctrl_create (14, argv, &context)) != 0) return (void*)e;
+    if (((e = procctrl_start (context)) == 0)
+     && ((e = procctrl_query (context, &result)) == 0)
+     && ((e = ((result.pid != 0) && (result.processes == 1)) ? 0 : EINVAL) == 0)
+     && ((e = procctrl_stop (context)) == 0)) {
+        e = procctrl_wait (context) - (128 + SIGTERM);
+    }
+    procctrl_free (context);
+    return (void*)e;
+}
+
+#endif /* ifndef _WIN32 */
+
+static void test_procctrl_threads (void) {
+#ifndef _WIN32
+    pthread_t threads[TEST_THREADS];
+    char path[64];
+    void *result;
+    int i;
+    VERBOSE_WATCH_ALL;
+    CU_ASSERT_FATAL (params_v (0) == 0);
+    strcpy (_tmpdir, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (_tmpdir) != NULL);
+    for (i = 0; i < TEST_THREADS; i++) {
+        CU_ASSERT_FATAL (pthread_create (threads + i, NULL, thread_lifecycle, (void*)(long)i) == 0);
+    }
+    for (i = 0; i < TEST_THREADS; i++) {
+        CU_ASSERT (pthread_join (threads[i], &result) == 0);
+        CU_ASSERT (result == NULL);
+    }
+    // Tidy up
+    for (i = 0; i < TEST_THREADS; i++) {
+        snprintf (path, sizeof (path), "%s/%u/test%d", _tmpdir, getpid (), i);
+        unlink (path);
+    }
+    snprintf (path, sizeof (path), "%s/%u", _tmpdir, getpid ());
+    rmdir (path);
+    snprintf (path, sizeof (path), "%s/.lock", _tmpdir);
+    unlink (path);
+    CU_ASSERT (rmdir (_tmpdir) == 0);
+    VERBOSE_SILENT_ALL;
+#endif /* ifndef _WIN32 */
+}
+
+#ifndef _WIN32
+
+/// Waits for an asynchronous operation to complete, returning its result
+static int poll_result (struct procctrl_context *context, int fd) {
+    struct pollfd pfd;
+    int result = -1, e;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    do {
+        CU_ASSERT_FATAL (poll (&pfd, 1, 10000) == 1);
+    } while ((e = procctrl_async_result (context, &result)) == EAGAIN);
+    CU_ASSERT (e == 0);
+    return result;
+}
+
+#endif /* ifndef _WIN32 */
+
+static void test_procctrl_async (void) {
+#ifndef _WIN32
+    char tmpdir[16], scope[16], path[64];
+    char *argv[] = { "main", "-d", tmpdir, "-P", scope, "-k", "test", "-H", "0", "-t", "1", "start", "sleep", "60" };
+    struct procctrl_context *context;
+    struct pollfd pfd;
+    int fd, other, result;
+    VERBOSE_WATCH_ALL;
+    CU_ASSERT_FATAL (params_v (0) == 0);
+    strcpy (tmpdir, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (tmpdir) != NULL);
+    snprintf (scope, sizeof (scope), "%u", getpid ());
+    CU_ASSERT_FATAL (procctrl_create (14, argv, &context) == 0);
+    // Start completes once the process is running
+    CU_ASSERT_FATAL (procctrl_start_async (context, &fd) == 0);
+    // One operation at a time, until it is collected
+    CU_ASSERT (procctrl_stop_async (context, &other) == EBUSY);
+    CU_ASSERT (poll_result (context, fd) == 0);
+    CU_ASSERT (procctrl_async_result (context, &result) == EINVAL);
+    CU_ASSERT (procctrl_query (context, NULL) == 0);
+    // Nothing to collect while the process runs, and the descriptor is not
+    // readable when the wait times out
+    CU_ASSERT_FATAL (procctrl_wait_async (context, &fd) == 0);
+    CU_ASSERT (procctrl_async_result (context, &result) == EAGAIN);
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    CU_ASSERT (poll (&pfd, 1, 1500) == 0);
+    CU_ASSERT (procctrl_async_result (context, &result) == 0);
+    CU_ASSERT (result == ETIMEDOUT);
+    // Stop completes once the process is signalled, and wait once it exits
+    CU_ASSERT_FATAL (procctrl_stop_async (context, &fd) == 0);
+    CU_ASSERT (poll_result (context, fd) == 0);
+    CU_ASSERT_FATAL (procctrl_wait_async (context, &fd) == 0);
+    CU_ASSERT (poll_result (context, fd) == 128 + SIGTERM);
+    // Nothing left to wait for
+    CU_ASSERT (procctrl_wait_async (context, &fd) == 0);
+    CU_ASSERT (poll_result (context, fd) == 128 + SIGTERM);
+    procctrl_free (context);
+    // Tidy up
+    snprintf (path, sizeof (path), "%s/%u/test", tmpdir, getpid ());
+    unlink (path);
+    *strrchr (path, '/') = 0;
+    rmdir (path);
+    snprintf (path, sizeof (path), "%s/.lock", tmpdir);
+    unlink (path);
+    CU_ASSERT (rmdir (tmpdir) == 0);
+    VERBOSE_SILENT_ALL;
+#endif /* ifndef _WIN32 */
+}
+
+int register_tests_procctrl () {
+    CU_pSuite pSuite = CU_add_suite ("procctrl", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "procctrl_create", test_procctrl_create)
+     || !CU_add_test (pSuite, "procctrl_threads", test_procctrl_threads)
+     || !CU_add_test (pSuite, "procctrl_async", test_procctrl_async)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
@@ -17,7 +17,9 @@
 #include "parent.h"
 #include <CUnit/Basic.h>
 #ifndef _WIN32
+# include <errno.h>
 # include <wait.h>
+# include <sys/socket.h>
 # include <sys/stat.h>
 # include <unistd.h>
 #endif /* ifndef _WIN32 */
@@ -28,7 +30,7 @@
 static _WIN32_OR_POSIX (HANDLE, pid_t) _child = 0;
 
 #ifndef _WIN32
-int _wait_for_execvp (pid_t child);
+int _wait_for_exec (int exec); // start.c
 #endif /* ifndef __WIN32 */
 
 #define _SEP _WIN32_OR_POSIX ("\\", "/")
@@ -49,18 +51,25 @@ static void spawn_example_child_script () {
 		_child = INVALID_HANDLE_VALUE;
 	}
 #else /* ifdef _WIN32 */
+    int exec[2];
+    // The child's end is closed when it calls execvp, as for the watchdog
+    CU_ASSERT_FATAL (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, exec) == 0);
     _child = fork ();
 	if (!_child) {
         const char *args[3];
+        close (exec[0]);
         args[0] = "src/example-child-script.sh";
         args[1] = "foo";
         args[2] = NULL;
         execvp (args[0], (char**)args);
+        _exit (errno);
 	}
+    close (exec[1]);
 #endif /* ifdef _WIN32 */
     CU_ASSERT (_child != _WIN32_OR_POSIX (INVALID_HANDLE_VALUE, (pid_t)-1));
 #ifndef _WIN32
-    CU_ASSERT (_wait_for_execvp (_child) == 0);
+    CU_ASSERT (_wait_for_exec (exec[0]) == 0);
+    close (exec[0]);
 #endif /* ifndef _WIN32 */
 }
 
@@ -86,6 +95,14 @@ static void write_info_file (const char *path, int valid) {
             fprintf (out, "pid: %u\n", 0);
             fprintf (out, "cmd: %s\n", "/bin/bash");
             break;
+        case -5 :
+            // Terminated process; starting process is not running
+            fprintf (out, "pid: %u\n", 1);
+            fprintf (out, "ppid: %u\n", 0);
+            fprintf (out, "cmd: %s\n", "/bin/bash");
+            fprintf (out, "exit: %d\n", 0);
+            fprintf (out, "end: %s\n", "0.000000");
+            break;
         case 1 :
             // Valid PID; spawn child script and use script name
             if (_child == 0) spawn_example_child_script ();
@@ -97,6 +114,14 @@ static void write_info_file (const char *path, int valid) {
             fprintf (out, "pid: %u\n", _WIN32_OR_POSIX (GetCurrentProcessId (), getpid ()));
             fprintf (out, "cmd: %s\n", "./src/unittest");
             break;
+        case 3 :
+            // Terminated process; starting process is running
+            fprintf (out, "pid: %u\n", 1);
+            fprintf (out, "ppid: %u\n", _WIN32_OR_POSIX (GetCurrentProcessId (), getpid ()));
+            fprintf (out, "cmd: %s\n", "/bin/bash");
+            fprintf (out, "exit: %d\n", 0);
+            fprintf (out, "end: %s\n", "0.000000");
+            break;
     }
     fclose (out);
 }
@@ -168,6 +193,11 @@ static void init_process_housekeep () {
     // Create a valid info file in GLOBAL
     CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "GLOBAL" _SEP "valid", tmpdir) < HK_PATH);
     write_info_file (path, 1);
+    // Create terminated process info files in GLOBAL
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "GLOBAL" _SEP "exited", tmpdir) < HK_PATH);
+    write_info_file (path, 3);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "GLOBAL" _SEP "orphaned", tmpdir) < HK_PATH);
+    write_info_file (path, -5);
     // Create a valid info file in invalid PPID
     CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "0" _SEP "test", tmpdir) < HK_PATH);
     write_info_file (path, 2);
@@ -190,23 +220,29 @@ static void do_process_housekeep () {
     // Run the housekeep
     CU_ASSERT (process_housekeep () == 0);
     // Invalid PPID directory should be deleted
-    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "0", data_dir) < HK_PATH);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "0", PARAM (data_dir)) < HK_PATH);
     CU_ASSERT (dir_exists (path) == 0);
     // Other folders remain
-    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "GLOBAL", data_dir) < HK_PATH);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "GLOBAL", PARAM (data_dir)) < HK_PATH);
     CU_ASSERT (dir_exists (path) != 0);
-    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d", data_dir, _WIN32_OR_POSIX (GetProcessId (hParent), getppid ())) < HK_PATH);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d", PARAM (data_dir), _WIN32_OR_POSIX (GetProcessId (hParent), getppid ())) < HK_PATH);
     CU_ASSERT (dir_exists (path) != 0);
     // Invalid info files should be deleted
     for (i = 1; i <= 4; i++) {
-        CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "GLOBAL" _SEP "invalid%d", data_dir, i) < HK_PATH);
+        CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "GLOBAL" _SEP "invalid%d", PARAM (data_dir), i) < HK_PATH);
         CU_ASSERT (file_exists (path) == 0);
     }
     // Other files should be untouched
-    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "GLOBAL" _SEP "valid", data_dir) < HK_PATH);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "GLOBAL" _SEP "valid", PARAM (data_dir)) < HK_PATH);
+    CU_ASSERT (file_exists (path) != 0);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d" _SEP "test", PARAM (data_dir), _WIN32_OR_POSIX (GetProcessId (hParent), getppid ())) < HK_PATH);
     CU_ASSERT (file_exists (path) != 0);
-    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d" _SEP "test", data_dir, _WIN32_OR_POSIX (GetProcessId (hParent), getppid ())) < HK_PATH);
+    // Terminated process status is kept only while its starting process runs
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "GLOBAL" _SEP "orphaned", PARAM (data_dir)) < HK_PATH);
+    CU_ASSERT (file_exists (path) == 0);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "GLOBAL" _SEP "exited", PARAM (data_dir)) < HK_PATH);
     CU_ASSERT (file_exists (path) != 0);
+    _WIN32_OR_POSIX (DeleteFile, unlink) (path);
     // Terminate the child process
     kill_process (_child);
 #ifdef _WIN32
@@ -220,13 +256,15 @@ static void do_process_housekeep () {
     // Run the housekeep
     CU_ASSERT (process_housekeep () == 0);
     // GLOBAL and PPID directories should now be deleted, but HK folder remains
-    CU_ASSERT (dir_exists (data_dir) != 0);
-    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "GLOBAL", data_dir) < HK_PATH);
+    CU_ASSERT (dir_exists (PARAM (data_dir)) != 0);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "GLOBAL", PARAM (data_dir)) < HK_PATH);
     CU_ASSERT (dir_exists (path) == 0);
-    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d", data_dir, _WIN32_OR_POSIX (GetProcessId (hParent), getppid ())) < HK_PATH);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d", PARAM (data_dir), _WIN32_OR_POSIX (GetProcessId (hParent), getppid ())) < HK_PATH);
     CU_ASSERT (dir_exists (path) == 0);
     // Delete the housekeep folder
-    _WIN32_OR_POSIX (RemoveDirectory, rmdir) (data_dir);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP ".lock", PARAM (data_dir)) < HK_PATH);
+    _WIN32_OR_POSIX (DeleteFile, unlink) (path);
+    _WIN32_OR_POSIX (RemoveDirectory, rmdir) (PARAM (data_dir));
     // Run the housekeep
     CU_ASSERT (process_housekeep () == _WIN32_OR_POSIX (ERROR_PATH_NOT_FOUND, ENOENT));
 #ifdef _WIN32
@@ -251,9 +289,9 @@ static void init_process_find () {
 #endif /* ifdef _WIN32 */
     CU_ASSERT (_child == 0);
     CU_ASSERT_FATAL (params_v (4, "-d", tmpdir, "-k", "/Te^st\\") == 0);
-    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d", data_dir, _WIN32_OR_POSIX (GetProcessId (hParent), getppid ())) < HK_PATH);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d", PARAM (data_dir), _WIN32_OR_POSIX (GetProcessId (hParent), getppid ())) < HK_PATH);
 	create_folder (path);
-    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d" _SEP "^%02XTe^%02Xst^%02X", data_dir, _WIN32_OR_POSIX (GetProcessId (hParent), getppid ()), (int)'/' & 0xFF, (int)'^' & 0xFF, (int)'\\' & 0xFF) < HK_PATH);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d" _SEP "^%02XTe^%02Xst^%02X", PARAM (data_dir), _WIN32_OR_POSIX (GetProcessId (hParent), getppid ()), (int)'/' & 0xFF, (int)'^' & 0xFF, (int)'\\' & 0xFF) < HK_PATH);
     write_info_file (path, 1);
 #ifdef _WIN32
 	CloseHandle (hParent);
@@ -261,6 +299,7 @@ static void init_process_find () {
 }
 
 static void do_process_find () {
+    char path[HK_PATH];
 #ifdef _WIN32
 	HANDLE hChild;
 #else /* ifdef _WIN32 */
@@ -291,7 +330,9 @@ static void do_process_find () {
     CU_ASSERT (process_housekeep () == 0);
     // Should not find the child - no info file
     CU_ASSERT (process_find () == 0);
-    _WIN32_OR_POSIX (RemoveDirectory, rmdir) (data_dir);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP ".lock", PARAM (data_dir)) < HK_PATH);
+    _WIN32_OR_POSIX (DeleteFile, unlink) (path);
+    _WIN32_OR_POSIX (RemoveDirectory, rmdir) (PARAM (data_dir));
 }
 
 VERBOSE_AND_QUIET_TEST (process_find)
@@ -313,13 +354,15 @@ static void do_process_save () {
 #ifdef _WIN32
 	HANDLE hParent = get_parent (GetCurrentProcess ());
 #endif /* ifdef _WIN32 */
-    CU_ASSERT (process_save (_WIN32_OR_POSIX (INVALID_HANDLE_VALUE, 1234)) == 0);
-    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d" _SEP "test", data_dir, _WIN32_OR_POSIX (GetProcessId (hParent), getppid ())) < HK_PATH);
+    CU_ASSERT (process_save (_WIN32_OR_POSIX (INVALID_HANDLE_VALUE, 1234), 0) == 0);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d" _SEP "test", PARAM (data_dir), _WIN32_OR_POSIX (GetProcessId (hParent), getppid ())) < HK_PATH);
     CU_ASSERT (file_exists (path) != 0);
     _WIN32_OR_POSIX (DeleteFile, unlink) (path);
-    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d", data_dir, _WIN32_OR_POSIX (GetProcessId (hParent), getppid ())) < HK_PATH);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP "%d", PARAM (data_dir), _WIN32_OR_POSIX (GetProcessId (hParent), getppid ())) < HK_PATH);
     _WIN32_OR_POSIX (RemoveDirectory, rmdir) (path);
-    _WIN32_OR_POSIX (RemoveDirectory, rmdir) (data_dir);
+    CU_ASSERT_FATAL (snprintf (path, HK_PATH, "%s" _SEP ".lock", PARAM (data_dir)) < HK_PATH);
+    _WIN32_OR_POSIX (DeleteFile, unlink) (path);
+    _WIN32_OR_POSIX (RemoveDirectory, rmdir) (PARAM (data_dir));
 #ifdef _WIN32
 	CloseHandle (hParent);
 #endif /* ifdef _WIN32 */
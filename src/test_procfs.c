@@ -0,0 +1,185 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "kill.h"
+#include "params.h"
+#include "parent.h"
+#include "procfs.h"
+#include "test_verbose.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <errno.h>
+# include <signal.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// Synthetic process identifiers, above the kernel's limit so that a signal
+/// sent to the real process table by mistake can't reach anything
+#define PID_BASE    5000000
+
+int _is_running (pid_t process);
+
+static char _root[16];
+static pid_t _signalled[32];
+static int _signals[32];
+static int _signal_count;
+
+/// Records the signal; the process exists if it has a folder in the table
+static int record_signal (pid_t process, int signal) {
+    char path[PROCFS_PATH];
+    struct stat info;
+    if (procfs_path (path, sizeof (path), process, NULL) || stat (path, &info)) {
+        errno = ESRCH;
+        return -1;
+    }
+    if (signal && (_signal_count < 32)) {
+        _signalled[_signal_count] = process;
+        _signals[_signal_count++] = signal;
+    }
+    return 0;
+}
+
+static const struct procfs_provider _synthetic = { _root, record_signal };
+
+/// Adds a process to the synthetic table
+static void add_process (pid_t process, pid_t parent) {
+    char path[PROCFS_PATH];
+    FILE *out;
+    CU_ASSERT_FATAL (procfs_path (path, sizeof (path), process, NULL) == 0);
+    CU_ASSERT_FATAL (mkdir (path, 0755) == 0);
+    CU_ASSERT_FATAL (procfs_path (path, sizeof (path), process, "cwd") == 0);
+    CU_ASSERT_FATAL (mkdir (path, 0755) == 0);
+    CU_ASSERT_FATAL (procfs_path (path, sizeof (path), process, "status") == 0);
+    CU_ASSERT_FATAL ((out = fopen (path, "wt")) != NULL);
+    fprintf (out, "Name:\tsleep\nState:\tS (sleeping)\nPid:\t%u\nPPid:\t%u\n", process, parent);
+    fclose (out);
+}
+
+/// Removes a process from the synthetic table
+static void remove_process (pid_t process) {
+    char path[PROCFS_PATH];
+    procfs_path (path, sizeof (path), process, "status");
+    unlink (path);
+    procfs_path (path, sizeof (path), process, "cwd");
+    rmdir (path);
+    procfs_path (path, sizeof (path), process, NULL);
+    rmdir (path);
+}
+
+/// Builds the table; PID_BASE has children +1 and +2, and +1 has child +3
+static void init_table () {
+    strcpy (_root, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (_root) != NULL);
+    _signal_count = 0;
+    params_v (0);
+    procfs_set_provider (&_synthetic);
+    add_process (PID_BASE, 1);
+    add_process (PID_BASE + 1, PID_BASE);
+    add_process (PID_BASE + 2, PID_BASE);
+    add_process (PID_BASE + 3, PID_BASE + 1);
+}
+
+static void free_table () {
+    int i;
+    for (i = 3; i >= 0; i--) remove_process (PID_BASE + i);
+    rmdir (_root);
+    procfs_set_provider (NULL);
+}
+
+#endif /* ifndef _WIN32 */
+
+static void test_procfs_path (void) {
+#ifndef _WIN32
+    char path[PROCFS_PATH];
+    CU_ASSERT (!strcmp (procfs_get_provider ()->root, "/proc"));
+    CU_ASSERT (procfs_path (path, sizeof (path), 42, "cmdline") == 0);
+    CU_ASSERT (!strcmp (path, "/proc/42/cmdline"));
+    CU_ASSERT (procfs_path (path, sizeof (path), 0, "loadavg") == 0);
+    CU_ASSERT (!strcmp (path, "/proc/loadavg"));
+    CU_ASSERT (procfs_path (path, sizeof (path), 42, NULL) == 0);
+    CU_ASSERT (!strcmp (path, "/proc/42"));
+    CU_ASSERT (procfs_path (path, 12, 42, "cmdline") == ENAMETOOLONG);
+    // The real table
+    CU_ASSERT (procfs_signal (getpid (), 0) == 0);
+    CU_ASSERT (_is_running (getpid ()) != 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void test_procfs_tree (void) {
+#ifndef _WIN32
+    struct pid_list *children, *child;
+    int found = 0;
+    VERBOSE_WATCH_ALL;
+    init_table ();
+    CU_ASSERT (get_parent (PID_BASE + 3) == PID_BASE + 1);
+    CU_ASSERT (get_parent (PID_BASE + 4) == (pid_t)-1);
+    children = get_children (PID_BASE);
+    for (child = children; child; child = child->next) {
+        CU_ASSERT ((child->pid == PID_BASE + 1) || (child->pid == PID_BASE + 2));
+        found++;
+    }
+    CU_ASSERT (found == 2);
+    pid_list_free (children);
+    CU_ASSERT (get_children (PID_BASE + 2) == NULL);
+    // Liveness follows the table
+    CU_ASSERT (_is_running (PID_BASE + 2) != 0);
+    remove_process (PID_BASE + 2);
+    CU_ASSERT (_is_running (PID_BASE + 2) == 0);
+    add_process (PID_BASE + 2, PID_BASE);
+    free_table ();
+    VERBOSE_SILENT_ALL;
+#endif /* ifndef _WIN32 */
+}
+
+static void test_procfs_signal_tree (void) {
+#ifndef _WIN32
+    int i, term = 0, order[4];
+    VERBOSE_WATCH_ALL;
+    init_table ();
+    CU_ASSERT (kill_process (PID_BASE) == 0);
+    // Every process is stopped, terminated and continued
+    CU_ASSERT (_signal_count == 12);
+    // Parents are stopped before their children and terminated after them
+    CU_ASSERT (_signalled[0] == PID_BASE);
+    CU_ASSERT (_signals[0] == SIGSTOP);
+    for (i = 0; i < _signal_count; i++) {
+        if (_signals[i] != SIGTERM) continue;
+        CU_ASSERT_FATAL (term < 4);
+        order[_signalled[i] - PID_BASE] = term++;
+    }
+    CU_ASSERT (term == 4);
+    CU_ASSERT (order[3] < order[1]);
+    CU_ASSERT (order[0] == 3);
+    CU_ASSERT (kill_process (PID_BASE + 4) == ESRCH);
+    free_table ();
+    VERBOSE_SILENT_ALL;
+#endif /* ifndef _WIN32 */
+}
+
+int register_tests_procfs () {
+    CU_pSuite pSuite = CU_add_suite ("procfs", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "procfs_path", test_procfs_path)
+     || !CU_add_test (pSuite, "procfs_tree", test_procfs_tree)
+     || !CU_add_test (pSuite, "procfs_signal_tree", test_procfs_signal_tree)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
@@ -65,7 +65,7 @@ static void do_operation_query () {
     // Initial query fails; info file not written
     CU_ASSERT (operation_query () == _WIN32_OR_POSIX (ERROR_NOT_FOUND, ESRCH));
     // Write the info file and the query succeeds
-    CU_ASSERT (process_save (_child) == 0);
+    CU_ASSERT (process_save (_child, 0) == 0);
     CU_ASSERT (operation_query () == 0);
     // Kill the child and the query fails
     kill_process (_child);
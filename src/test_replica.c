@@ -0,0 +1,140 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "procctrl.h"
+#include "params.h"
+#include "process.h"
+#include "replica.h"
+#include "test_verbose.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <errno.h>
+# include <signal.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_REPLICAS   3
+
+static void test_replica_substitute (void) {
+#ifndef _WIN32
+    char *value;
+    VERBOSE_WATCH_ALL;
+    CU_ASSERT_FATAL (params_v (0) == 0);
+    value = replica_substitute ("--port={i+8000} --data=/tmp/w{i}/{i}", 7);
+    CU_ASSERT (!strcmp (value, "--port=8007 --data=/tmp/w7/7"));
+    free (value);
+    // Anything else is copied
+    value = replica_substitute ("{i {i+} {i+x} {j} {i-1} {}", 7);
+    CU_ASSERT (!strcmp (value, "{i {i+} {i+x} {j} {i-1} {}"));
+    free (value);
+    value = replica_substitute ("{i}{i}{i}{i}{i}{i}{i}{i}{i}{i}{i+99999999}", 123456789);
+    CU_ASSERT (!strcmp (value, "123456789123456789123456789123456789123456789123456789123456789123456789123456789123456789223456788"));
+    free (value);
+    VERBOSE_SILENT_ALL;
+#endif /* ifndef _WIN32 */
+}
+
+#ifndef _WIN32
+
+static char _tmpdir[16];
+static char _scope[16];
+
+/// Runs an operation on the group of replicas, returning its result
+static int run_group (const char *op) {
+    char *argv[] = { "main", "-d", _tmpdir, "-P", _scope, "-k", "replica", "-N", "3", "-H", "0", "-t", "5", "--", (char*)op, "sh", "-c", "echo $PROCCTRL_INDEX {i} {i+8000} $REPLICA_TEST > replica-test-{i}.out; sleep 60; exit 0" };
+    struct procctrl_context *context;
+    int e;
+    CU_ASSERT_FATAL (procctrl_create (18, argv, &context) == 0);
+    e = procctrl_run (context);
+    procctrl_free (context);
+    return e;
+}
+
+/// Reads the file written by a replica
+static int read_replica (int index, char *buffer, size_t size) {
+    char path[32];
+    FILE *in;
+    int found;
+    snprintf (path, sizeof (path), "replica-test-%d.out", index);
+    if (!(in = fopen (path, "r"))) return 0;
+    found = (fgets (buffer, size, in) != NULL) && strchr (buffer, '\n');
+    fclose (in);
+    return found;
+}
+
+#endif /* ifndef _WIN32 */
+
+static void test_procctrl_run_replicas (void) {
+#ifndef _WIN32
+    char buffer[64], expected[64], path[64];
+    int i, j;
+    VERBOSE_WATCH_ALL;
+    CU_ASSERT_FATAL (params_v (0) == 0);
+    strcpy (_tmpdir, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (_tmpdir) != NULL);
+    snprintf (_scope, sizeof (_scope), "%u", getpid ());
+    setenv ("REPLICA_TEST", "data-{i}", 1);
+    // Every replica is started, with its own index
+    CU_ASSERT (run_group ("start") == 0);
+    CU_ASSERT (run_group ("query") == 0);
+    for (i = 0; i < TEST_REPLICAS; i++) {
+        for (j = 0; (j < 50) && !read_replica (i, buffer, sizeof (buffer)); j++) {
+            usleep (100000);
+        }
+        snprintf (expected, sizeof (expected), "%d %d %d data-%d\n", i, i, 8000 + i, i);
+        CU_ASSERT (!strcmp (buffer, expected));
+    }
+    CU_ASSERT (!strcmp (getenv ("REPLICA_TEST"), "data-{i}"));
+    // Each is an ordinary process with a derived identifier
+    CU_ASSERT_FATAL (params_v (6, "-d", _tmpdir, "-P", _scope, "-k", "replica:1") == 0);
+    CU_ASSERT (process_find () != 0);
+    CU_ASSERT_FATAL (params_v (6, "-d", _tmpdir, "-P", _scope, "-k", "replica:3") == 0);
+    CU_ASSERT (process_find () == 0);
+    // Starting again finds them running
+    CU_ASSERT (run_group ("start") == EALREADY);
+    // All are stopped, and waited for
+    CU_ASSERT (run_group ("stop") == 0);
+    CU_ASSERT (run_group ("wait") == 128 + SIGTERM);
+    CU_ASSERT (run_group ("query") != 0);
+    // Tidy up
+    unsetenv ("REPLICA_TEST");
+    for (i = 0; i < TEST_REPLICAS; i++) {
+        snprintf (path, sizeof (path), "replica-test-%d.out", i);
+        unlink (path);
+        snprintf (path, sizeof (path), "%s/%u/replica:%d", _tmpdir, getpid (), i);
+        unlink (path);
+        snprintf (path, sizeof (path), "%s/%u/replica^3A%d", _tmpdir, getpid (), i);
+        unlink (path);
+    }
+    snprintf (path, sizeof (path), "%s/%u", _tmpdir, getpid ());
+    rmdir (path);
+    snprintf (path, sizeof (path), "%s/.lock", _tmpdir);
+    unlink (path);
+    CU_ASSERT (rmdir (_tmpdir) == 0);
+    VERBOSE_SILENT_ALL;
+#endif /* ifndef _WIN32 */
+}
+
+int register_tests_replica () {
+    CU_pSuite pSuite = CU_add_suite ("replica", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "replica_substitute", test_replica_substitute)
+     || !CU_add_test (pSuite, "procctrl_run [replicas]", test_procctrl_run_replicas)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
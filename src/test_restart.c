@@ -0,0 +1,247 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "operations.h"
+#include "params.h"
+#include "process.h"
+#include "test_verbose.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <arpa/inet.h>
+# include <errno.h>
+# include <netinet/in.h>
+# include <signal.h>
+# include <sys/socket.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+/// The file each instance of the child appends to
+static const char *_instances = "restart-test.out";
+
+/// The file that makes the health probe fail
+static const char *_unhealthy = "restart-test.flag";
+
+/// Reads the address the process is listening on from its information file
+static int listening_port () {
+    struct process_info *info = process_load ();
+    const char *listen = process_info_get (info, "listen");
+    int port = 0;
+    if (listen && strrchr (listen, ':')) port = atoi (strrchr (listen, ':') + 1);
+    process_info_free (info);
+    return port;
+}
+
+/// Connects to a port on the loopback interface
+static int connect_local (int port) {
+    struct sockaddr_in addr;
+    int fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    CU_ASSERT_FATAL (fd >= 0);
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (port);
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    CU_ASSERT (connect (fd, (struct sockaddr*)&addr, sizeof (addr)) == 0);
+    return fd;
+}
+
+/// Counts the instances of the child that have run, returning the last PID
+static int instances (pid_t *last) {
+    char buffer[64];
+    FILE *in = fopen (_instances, "r");
+    int count = 0, fds, pid;
+    *last = 0;
+    if (!in) return 0;
+    while (fgets (buffer, sizeof (buffer), in)) {
+        if (sscanf (buffer, "%d %d", &fds, &pid) != 2) continue;
+        CU_ASSERT (fds == 1);
+        *last = (pid_t)pid;
+        count++;
+    }
+    fclose (in);
+    return count;
+}
+
+/// Reads the number of restarts from the information file
+static int restarts () {
+    struct process_info *info = process_load ();
+    const char *value = process_info_get (info, "restarts");
+    int count = value ? atoi (value) : 0;
+    process_info_free (info);
+    return count;
+}
+
+/// Stops the process and checks its termination was recorded
+static void stop_process () {
+    struct process_info *info;
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    CU_ASSERT (process_info_get (info, "signal") && !strcmp (process_info_get (info, "signal"), "15"));
+    process_info_free (info);
+}
+
+#endif /* ifndef _WIN32 */
+
+static void init_operation_restart () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (11, "-k", "restart", "-s", "0", "-t", "10", "--", "restart", "sh", "-c", "echo $LISTEN_FDS $$ >> restart-test.out; sleep 60; exit 0") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_restart () {
+#ifdef _WIN32
+	CU_ASSERT (operation_restart () == ERROR_NOT_SUPPORTED);
+#else /* ifdef _WIN32 */
+    struct process_info *info;
+    pid_t watchdog, first, second, last;
+    int fd, port, count, i;
+    unlink (_instances);
+    // Nothing to restart
+    CU_ASSERT (operation_restart () == ESRCH);
+    // Nor before activation
+    CU_ASSERT_FATAL (operation_start () == 0);
+    watchdog = process_find ();
+    CU_ASSERT_FATAL (watchdog != 0);
+    CU_ASSERT (operation_restart () == 0);
+    CU_ASSERT (process_find () == watchdog);
+    port = listening_port ();
+    CU_ASSERT_FATAL (port != 0);
+    fd = connect_local (port);
+    close (fd);
+    for (i = 0; (i < 50) && ((instances (&first) < 1) || (process_find () == watchdog)); i++) {
+        usleep (100000);
+    }
+    CU_ASSERT_FATAL (first != 0);
+    CU_ASSERT (process_find () == first);
+    count = restarts ();
+    // Only one request for a handover is taken
+    CU_ASSERT (process_request_handover (first) == 0);
+    CU_ASSERT (process_request_handover (first) == EBUSY);
+    CU_ASSERT (operation_restart () == EBUSY);
+    CU_ASSERT (process_unset (first, "handover") == 0);
+    // The new instance inherits the socket, and replaces the old one
+    CU_ASSERT (operation_restart () == 0);
+    for (i = 0; (i < 50) && (instances (&second) < 2); i++) {
+        usleep (100000);
+    }
+    CU_ASSERT ((second != 0) && (second != first));
+    CU_ASSERT (process_find () == second);
+    CU_ASSERT (kill (first, 0) != 0);
+    CU_ASSERT (restarts () == count + 1);
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "ready") != NULL);
+    CU_ASSERT (process_info_get (info, "next") == NULL);
+    CU_ASSERT (process_info_get (info, "previous") == NULL);
+    CU_ASSERT (process_info_get (info, "handover") == NULL);
+    process_info_free (info);
+    // The socket was never closed
+    CU_ASSERT (listening_port () == port);
+    fd = connect_local (port);
+    close (fd);
+    stop_process ();
+    CU_ASSERT (instances (&last) == 2);
+    unlink (_instances);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifdef _WIN32 */
+}
+
+static void init_operation_restart_unhealthy () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (16, "-k", "restart", "-c", "cmd:test ! -e restart-test.flag", "-i", "5", "-n", "1", "-s", "0", "-t", "10", "--", "restart", "sleep", "60") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_restart_unhealthy () {
+#ifndef _WIN32
+    struct process_info *info;
+    pid_t watchdog, process;
+    FILE *out;
+    int count, i;
+    unlink (_unhealthy);
+    CU_ASSERT_FATAL (operation_start () == 0);
+    watchdog = process_find ();
+    CU_ASSERT_FATAL (watchdog != 0);
+    close (connect_local (listening_port ()));
+    for (i = 0; (i < 50) && (process_find () == watchdog); i++) {
+        usleep (100000);
+    }
+    process = process_find ();
+    CU_ASSERT_FATAL ((process != 0) && (process != watchdog));
+    count = restarts ();
+    // The new instance fails its health probe, so the old one is kept
+    out = fopen (_unhealthy, "w");
+    CU_ASSERT_FATAL (out != NULL);
+    fclose (out);
+    CU_ASSERT (operation_restart () == ECANCELED);
+    unlink (_unhealthy);
+    CU_ASSERT (process_find () == process);
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "handover") && !strcmp (process_info_get (info, "handover"), "failed"));
+    CU_ASSERT (process_info_get (info, "next") == NULL);
+    process_info_free (info);
+    CU_ASSERT (restarts () == count);
+    // It can be restarted once healthy
+    CU_ASSERT (operation_restart () == 0);
+    CU_ASSERT ((process_find () != 0) && (process_find () != process));
+    stop_process ();
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void init_operation_restart_unsocketed () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (7, "-k", "restart", "-t", "10", "restart", "sleep", "60") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_restart_unsocketed () {
+#ifndef _WIN32
+    struct process_info *info;
+    pid_t process;
+    CU_ASSERT_FATAL (operation_start () == 0);
+    process = process_find ();
+    CU_ASSERT_FATAL (process != 0);
+    // The new instance couldn't take over the ports, so it isn't started
+    CU_ASSERT (operation_restart () == EINVAL);
+    CU_ASSERT (process_find () == process);
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "handover") == NULL);
+    CU_ASSERT (process_info_get (info, "next") == NULL);
+    process_info_free (info);
+    stop_process ();
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_restart)
+VERBOSE_AND_QUIET_TEST (operation_restart_unhealthy)
+VERBOSE_AND_QUIET_TEST (operation_restart_unsocketed)
+
+int register_tests_restart () {
+    CU_pSuite pSuite = CU_add_suite ("restart", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "operation_restart [quiet]", test_operation_restart)
+     || !CU_add_test (pSuite, "operation_restart [verbose]", test_operation_restart_verbose)
+     || !CU_add_test (pSuite, "operation_restart [unhealthy,quiet]", test_operation_restart_unhealthy)
+     || !CU_add_test (pSuite, "operation_restart [unhealthy,verbose]", test_operation_restart_unhealthy_verbose)
+     || !CU_add_test (pSuite, "operation_restart [unsocketed,quiet]", test_operation_restart_unsocketed)
+     || !CU_add_test (pSuite, "operation_restart [unsocketed,verbose]", test_operation_restart_unsocketed_verbose)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
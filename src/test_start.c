@@ -14,13 +14,18 @@
 #include "params.h"
 #include "test_verbose.h"
 #include "process.h"
+#include "procfs.h"
 #include "kill.h"
 #include <CUnit/Basic.h>
 #ifndef _WIN32
+# include <errno.h>
+# include <poll.h>
+# include <signal.h>
 # include <wait.h>
 # include <unistd.h>
 #endif /* ifndef _WIN32 */
 #include <stdlib.h>
+#include <string.h>
 
 static _WIN32_OR_POSIX (HANDLE, pid_t) _parent = 0;
 
@@ -62,7 +67,7 @@ static void init_operation_start_spawn () {
 static void do_operation_start_spawn () {
     _WIN32_OR_POSIX (HANDLE, pid_t) process;
 #ifndef _WIN32
-    int status;
+    struct process_info *info;
 #endif /* ifndef _WIN32 */
     // First call will start the process
     CU_ASSERT (operation_start () == 0);
@@ -76,7 +81,11 @@ static void do_operation_start_spawn () {
 	CU_ASSERT (WaitForSingleObject (process, 5000) == WAIT_OBJECT_0);
 	CloseHandle (process);
 #else /* ifdef _WIN32 */
-    CU_ASSERT (waitpid (process, &status, 0) == process);
+    // The watchdog reaps the process and records its status
+    CU_ASSERT (process_wait (5, &info) == 0);
+    CU_ASSERT (process_info_get (info, "signal") != NULL);
+    CU_ASSERT (process_info_get (info, "end") != NULL);
+    process_info_free (info);
 #endif /* ifdef _WIN32 */
     CU_ASSERT (process_housekeep () == 0);
 }
@@ -120,13 +129,260 @@ static void do_operation_start_watchdog () {
 
 VERBOSE_AND_QUIET_TEST (operation_start_watchdog)
 
+static void init_operation_start_restart () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (7, "-r", "on-failure", "-R", "2", "start", "src/example-child-script.sh", "foo") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_start_restart () {
+#ifndef _WIN32
+    struct process_info *info;
+    pid_t first, process;
+    int i, restarts;
+    CU_ASSERT_FATAL (operation_start () == 0);
+    first = process_find ();
+    CU_ASSERT_FATAL (first != 0);
+    // The count includes any earlier processes with the identifier
+    info = process_load ();
+    restarts = process_info_get (info, "restarts") ? atoi (process_info_get (info, "restarts")) : 0;
+    process_info_free (info);
+    // Killing the process is a failure, so the watchdog restarts it
+    kill_process (first);
+    for (i = 0; (i < 50) && (((process = process_find ()) == 0) || (process == first)); i++) {
+        usleep (100000);
+    }
+    CU_ASSERT_FATAL ((process != 0) && (process != first));
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "ready") != NULL);
+    CU_ASSERT (process_info_get (info, "restarts") && (atoi (process_info_get (info, "restarts")) == restarts + 1));
+    process_info_free (info);
+    // Stopping it is not, so it is not restarted again
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    CU_ASSERT (process_info_get (info, "signal") && !strcmp (process_info_get (info, "signal"), "15"));
+    CU_ASSERT (process_info_get (info, "restarts") && (atoi (process_info_get (info, "restarts")) == restarts + 1));
+    CU_ASSERT (process_info_get (info, "pid") && ((pid_t)atoi (process_info_get (info, "pid")) == process));
+    process_info_free (info);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_start_restart)
+
+static void init_operation_start_concurrent () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (5, "-k", "concurrent", "start", "sleep", "60") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_start_concurrent () {
+#ifndef _WIN32
+    struct process_info *info;
+    pid_t children[3], found[3], process;
+    int fds[2], lock, waited, status, i;
+    CU_ASSERT_FATAL (pipe (fds) == 0);
+    // Hold the start lock so that every caller is blocked on it
+    lock = process_lock_start (&waited);
+    CU_ASSERT_FATAL (lock >= 0);
+    CU_ASSERT (!waited);
+    fflush (stdout);
+    for (i = 0; i < 3; i++) {
+        children[i] = fork ();
+        CU_ASSERT_FATAL (children[i] != (pid_t)-1);
+        if (!children[i]) {
+            // The inherited descriptor would keep the test's lock held
+            close (lock);
+            close (fds[0]);
+            status = operation_start ();
+            process = process_find ();
+            if (write (fds[1], &process, sizeof (process)) != sizeof (process)) _exit (EIO);
+            _exit (status);
+        }
+    }
+    close (fds[1]);
+    usleep (300000);
+    process_unlock_start (lock);
+    // One of them spawns the process, and the others succeed with it
+    for (i = 0; i < 3; i++) {
+        CU_ASSERT (waitpid (children[i], &status, 0) == children[i]);
+        CU_ASSERT (WIFEXITED (status) && !WEXITSTATUS (status));
+        CU_ASSERT (read (fds[0], &found[i], sizeof (found[i])) == sizeof (found[i]));
+    }
+    close (fds[0]);
+    process = process_find ();
+    CU_ASSERT_FATAL (process != 0);
+    CU_ASSERT ((found[0] == process) && (found[1] == process) && (found[2] == process));
+    // A later start is not concurrent, so still fails
+    CU_ASSERT (operation_start () == EALREADY);
+    kill_process (process);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    process_info_free (info);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_start_concurrent)
+
+static void init_operation_start_concurrent_ready () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (7, "-k", "concurrent", "-c", "cmd:test -e start-test.flag", "start", "sleep", "60") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_start_concurrent_ready () {
+#ifndef _WIN32
+    struct process_info *info;
+    pid_t children[2], found[2], process;
+    FILE *out;
+    int fds[2], lock, waited, status, i, running;
+    unlink ("start-test.flag");
+    CU_ASSERT_FATAL (pipe (fds) == 0);
+    lock = process_lock_start (&waited);
+    CU_ASSERT_FATAL (lock >= 0);
+    fflush (stdout);
+    for (i = 0; i < 2; i++) {
+        children[i] = fork ();
+        CU_ASSERT_FATAL (children[i] != (pid_t)-1);
+        if (!children[i]) {
+            close (lock);
+            close (fds[0]);
+            status = operation_start ();
+            process = process_find ();
+            if (write (fds[1], &process, sizeof (process)) != sizeof (process)) _exit (EIO);
+            _exit (status);
+        }
+    }
+    close (fds[1]);
+    usleep (300000);
+    process_unlock_start (lock);
+    // The one that spawns the process returns, but the other waits for the
+    // process to pass its probe
+    usleep (2000000);
+    for (i = 0, running = 0; i < 2; i++) {
+        if (waitpid (children[i], &status, WNOHANG) == 0) {
+            running++;
+        } else {
+            CU_ASSERT (WIFEXITED (status) && !WEXITSTATUS (status));
+        }
+    }
+    CU_ASSERT (running == 1);
+    out = fopen ("start-test.flag", "w");
+    CU_ASSERT_FATAL (out != NULL);
+    fclose (out);
+    for (i = 0; i < 2; i++) {
+        if (waitpid (children[i], &status, WNOHANG) != 0) continue;
+        CU_ASSERT (waitpid (children[i], &status, 0) == children[i]);
+        CU_ASSERT (WIFEXITED (status) && !WEXITSTATUS (status));
+    }
+    for (i = 0; i < 2; i++) {
+        CU_ASSERT (read (fds[0], &found[i], sizeof (found[i])) == sizeof (found[i]));
+    }
+    close (fds[0]);
+    process = process_find ();
+    CU_ASSERT_FATAL (process != 0);
+    CU_ASSERT ((found[0] == process) && (found[1] == process));
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "ready") != NULL);
+    process_info_free (info);
+    unlink ("start-test.flag");
+    kill_process (process);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    process_info_free (info);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_start_concurrent_ready)
+
+static void init_operation_start_idle () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (8, "-K", "-I", "1", "-k", "idle", "start", "sleep", "60") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_start_idle () {
+#ifndef _WIN32
+    struct process_info *info;
+    pid_t process;
+    int i;
+    CU_ASSERT_FATAL (operation_start () == 0);
+    process = process_find ();
+    CU_ASSERT_FATAL (process != 0);
+    // Each query is a use, putting off the timeout beyond a second
+    for (i = 0; i < 3; i++) {
+        usleep (600000);
+        CU_ASSERT (operation_query () == 0);
+    }
+    info = process_load ();
+    CU_ASSERT (process_info_get (info, "idle-timeout") && !strcmp (process_info_get (info, "idle-timeout"), "1"));
+    CU_ASSERT (process_info_get (info, "used") != NULL);
+    CU_ASSERT (process_info_get (info, "end") == NULL);
+    process_info_free (info);
+    // Once unused the watchdog stops the process and deletes its file
+    for (i = 0; (i < 50) && ((info = process_load ()) != NULL); i++) {
+        process_info_free (info);
+        usleep (100000);
+    }
+    CU_ASSERT (info == NULL);
+    CU_ASSERT (kill (process, 0) != 0);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_start_idle)
+
+static void init_operation_start_inherited () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (5, "-k", "inherited", "start", "sleep", "60") == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_start_inherited () {
+#ifndef _WIN32
+    static const struct procfs_provider empty = { "/nonexistent", kill };
+    struct pollfd fds;
+    struct process_info *info;
+    char c;
+    int pipes[2];
+    CU_ASSERT_FATAL (pipe (pipes) == 0);
+    // The watchdog closes what it inherited even if the process table it
+    // is given describes other processes
+    procfs_set_provider (&empty);
+    CU_ASSERT (operation_start () == 0);
+    procfs_set_provider (NULL);
+    close (pipes[1]);
+    fds.fd = pipes[0];
+    fds.events = POLLIN;
+    CU_ASSERT (poll (&fds, 1, 5000) == 1);
+    CU_ASSERT (read (pipes[0], &c, 1) == 0);
+    close (pipes[0]);
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    process_info_free (info);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_start_inherited)
+
 int register_tests_start () {
     CU_pSuite pSuite = CU_add_suite ("start", NULL, NULL);
     if (!pSuite
      || !CU_add_test (pSuite, "operation_start [spawn,verbose]", test_operation_start_spawn_verbose)
      || !CU_add_test (pSuite, "operation_start [spawn,quiet]", test_operation_start_spawn)
      || !CU_add_test (pSuite, "operation_start [watchdog,verbose]", test_operation_start_watchdog_verbose)
-     || !CU_add_test (pSuite, "operation_start [watchdog,quiet]", test_operation_start_watchdog)) {
+     || !CU_add_test (pSuite, "operation_start [watchdog,quiet]", test_operation_start_watchdog)
+     || !CU_add_test (pSuite, "operation_start [restart,verbose]", test_operation_start_restart_verbose)
+     || !CU_add_test (pSuite, "operation_start [restart,quiet]", test_operation_start_restart)
+     || !CU_add_test (pSuite, "operation_start [concurrent,verbose]", test_operation_start_concurrent_verbose)
+     || !CU_add_test (pSuite, "operation_start [concurrent,quiet]", test_operation_start_concurrent)
+     || !CU_add_test (pSuite, "operation_start [concurrent,ready,verbose]", test_operation_start_concurrent_ready_verbose)
+     || !CU_add_test (pSuite, "operation_start [concurrent,ready,quiet]", test_operation_start_concurrent_ready)
+     || !CU_add_test (pSuite, "operation_start [idle,verbose]", test_operation_start_idle_verbose)
+     || !CU_add_test (pSuite, "operation_start [idle,quiet]", test_operation_start_idle)
+     || !CU_add_test (pSuite, "operation_start [inherited,verbose]", test_operation_start_inherited_verbose)
+     || !CU_add_test (pSuite, "operation_start [inherited,quiet]", test_operation_start_inherited)) {
         return CU_get_error ();
     }
     return 0;
@@ -0,0 +1,125 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "stats.h"
+#include "kill.h"
+#include "params.h"
+#include "test_verbose.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <errno.h>
+# include <wait.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdlib.h>
+#include <string.h>
+
+#define STATS_MEMORY    (16 * 1024 * 1024)
+
+#ifndef _WIN32
+
+/// Creates a child, with a grandchild holding some memory, signalling when ready
+static void _fork_stats_tree (int ready) {
+    char *memory;
+    if (fork () == 0) {
+        memory = (char*)malloc (STATS_MEMORY);
+        if (memory) memset (memory, 1, STATS_MEMORY);
+        // Pass the memory to write so that it is not optimised away
+        if (write (ready, memory ? memory + STATS_MEMORY - 1 : "g", 1) != 1) _exit (1);
+    } else {
+        if (write (ready, "c", 1) != 1) _exit (1);
+    }
+    sleep (30);
+    fprintf (stderr, "Child process %u from %s was NOT killed\n", getpid (), __FUNCTION__);
+    _exit (0);
+}
+
+#endif /* ifndef _WIN32 */
+
+static void test_stats_gather (void) {
+    struct process_stats stats;
+#ifdef _WIN32
+	CU_ASSERT (stats_gather (GetCurrentProcess (), &stats) == ERROR_NOT_SUPPORTED);
+#else /* ifdef _WIN32 */
+    char buffer[2];
+    int ready[2], status;
+    pid_t child;
+    VERBOSE_WATCH_ALL;
+    params_v (0);
+    CU_ASSERT_FATAL (pipe (ready) == 0);
+    child = fork ();
+    CU_ASSERT_FATAL (child >= 0);
+    if (!child) _fork_stats_tree (ready[1]);
+    close (ready[1]);
+    CU_ASSERT (read (ready[0], buffer, 1) == 1);
+    CU_ASSERT (read (ready[0], buffer + 1, 1) == 1);
+    close (ready[0]);
+    // The totals include the grandchild
+    CU_ASSERT (stats_gather (child, &stats) == 0);
+    CU_ASSERT (stats.processes == 2);
+    CU_ASSERT (stats.threads >= 2);
+    CU_ASSERT (stats.fds >= 2);
+    CU_ASSERT (stats.rss >= STATS_MEMORY);
+    // Nothing is found once the tree has terminated
+    kill_process (child);
+    CU_ASSERT (waitpid (child, &status, 0) == child);
+    CU_ASSERT (stats_gather (child, &stats) == ESRCH);
+    VERBOSE_SILENT_ALL;
+#endif /* ifdef _WIN32 */
+}
+
+static void test_stats_write (void) {
+    struct process_stats stats;
+    char buffer[256];
+    FILE *out = tmpfile ();
+    size_t len;
+    CU_ASSERT_FATAL (out != NULL);
+    memset (&stats, 0, sizeof (stats));
+    stats.processes = 2;
+    stats.utime = 1234;
+    stats.rss = 8589934592ULL;
+    stats.restarts = 3;
+    stats_write (out, &stats, 1);
+    rewind (out);
+    len = fread (buffer, 1, sizeof (buffer) - 1, out);
+    buffer[len] = 0;
+    fclose (out);
+    CU_ASSERT (strstr (buffer, "\"processes\":2,") != NULL);
+    CU_ASSERT (strstr (buffer, "\"utime\":1.234,") != NULL);
+    CU_ASSERT (strstr (buffer, "\"stime\":0.000,") != NULL);
+    CU_ASSERT (strstr (buffer, "\"rss\":8589934592,") != NULL);
+    CU_ASSERT (strstr (buffer, "\"restarts\":3}") != NULL);
+    CU_ASSERT ((len > 1) && (buffer[len - 2] == '}') && (buffer[len - 1] == '\n'));
+    // The placement is only written when there is one
+    out = tmpfile ();
+    CU_ASSERT_FATAL (out != NULL);
+    stats.cpus = "0-3";
+    stats.mempolicy = "bind:0";
+    stats_write (out, &stats, 1);
+    rewind (out);
+    len = fread (buffer, 1, sizeof (buffer) - 1, out);
+    buffer[len] = 0;
+    fclose (out);
+    CU_ASSERT (strstr (buffer, "\"restarts\":3,\"cpus\":\"0-3\",\"mempolicy\":\"bind:0\"}") != NULL);
+}
+
+int register_tests_stats () {
+    CU_pSuite pSuite = CU_add_suite ("stats", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "stats_gather", test_stats_gather)
+     || !CU_add_test (pSuite, "stats_write", test_stats_write)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
@@ -16,6 +16,11 @@
 #include "params.h"
 #include <CUnit/Basic.h>
 #ifndef _WIN32
+# include <poll.h>
+# include <signal.h>
+# include <stdio.h>
+# include <string.h>
+# include <unistd.h>
 # include <wait.h>
 #endif /* ifndef _WIN32 */
 
@@ -26,7 +31,7 @@ static void init_operation_stop () {
 static void do_operation_stop () {
     _WIN32_OR_POSIX (HANDLE, pid_t) process;
 #ifndef _WIN32
-    int i;
+    struct process_info *info;
 #endif /* ifndef _WIN32 */
     // Process isn't running
     CU_ASSERT (operation_stop () == _WIN32_OR_POSIX (ERROR_NOT_FOUND, ESRCH));
@@ -39,7 +44,9 @@ static void do_operation_stop () {
 #ifdef _WIN32
 	CU_ASSERT (WaitForSingleObject (process, 5000) == WAIT_OBJECT_0);
 #else /* ifdef _WIN32 */
-	CU_ASSERT (waitpid (process, &i, 0) == process);
+	CU_ASSERT (process_wait (5, &info) == 0);
+	CU_ASSERT (process_info_get (info, "signal") != NULL);
+	process_info_free (info);
 #endif /* ifdef _WIN32 */
     // Process isn't running
     CU_ASSERT (operation_stop () == _WIN32_OR_POSIX (ERROR_NOT_FOUND, ESRCH));
@@ -47,11 +54,172 @@ static void do_operation_stop () {
 
 VERBOSE_AND_QUIET_TEST (operation_stop)
 
+#ifndef _WIN32
+
+/// Creates a process to hold a lease
+static pid_t leaseholder () {
+    pid_t holder = fork ();
+    CU_ASSERT_FATAL (holder != (pid_t)-1);
+    if (!holder) {
+        sleep (60);
+        _exit (0);
+    }
+    return holder;
+}
+
+/// Selects the shared process as leased by a holder, keeping the verbose flag
+static void use_lease (pid_t holder, const char *op) {
+    char parent[16];
+    int v = PARAM (verbose);
+    snprintf (parent, sizeof (parent), "%u", holder);
+    CU_ASSERT_FATAL (params_v (8, "-L", "-k", "lease-test", "-P", parent, op, "sleep", "60") == 0);
+    if (v) _verbose_test ();
+}
+
+/// Selects the shared process without the L parameter, keeping the verbose flag
+static void use_unleased (pid_t caller, const char *op) {
+    char parent[16];
+    int v = PARAM (verbose);
+    snprintf (parent, sizeof (parent), "%u", caller);
+    CU_ASSERT_FATAL (params_v (8, "-K", "-k", "lease-test", "-P", parent, op, "sleep", "60") == 0);
+    if (v) _verbose_test ();
+}
+
+#endif /* ifndef _WIN32 */
+
+static void init_operation_stop_lease () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (0) == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_stop_lease () {
+#ifndef _WIN32
+    struct process_info *info;
+    pid_t first = leaseholder (), second = leaseholder (), process;
+    char expected[32];
+    // The second start leases the process started by the first
+    use_lease (first, "start");
+    CU_ASSERT_FATAL (operation_start () == 0);
+    process = process_find ();
+    CU_ASSERT_FATAL (process != 0);
+    use_lease (second, "start");
+    CU_ASSERT (operation_start () == 0);
+    CU_ASSERT (process_find () == process);
+    info = process_load ();
+    snprintf (expected, sizeof (expected), "%u %u", first, second);
+    CU_ASSERT (process_info_get (info, "leases") && !strcmp (process_info_get (info, "leases"), expected));
+    process_info_free (info);
+    // Releasing the first lease leaves the process running
+    use_lease (first, "stop");
+    CU_ASSERT (operation_stop () == 0);
+    poll (NULL, 0, 200);
+    CU_ASSERT (process_find () == process);
+    // As does a stop without the L parameter by anyone else
+    use_unleased (getpid (), "stop");
+    CU_ASSERT (operation_stop () == 0);
+    poll (NULL, 0, 200);
+    CU_ASSERT (process_find () == process);
+    info = process_load ();
+    snprintf (expected, sizeof (expected), "%u", second);
+    CU_ASSERT (process_info_get (info, "leases") && !strcmp (process_info_get (info, "leases"), expected));
+    process_info_free (info);
+    // It is killed when the last leaseholder terminates
+    kill (second, SIGKILL);
+    waitpid (second, NULL, 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    CU_ASSERT (process_info_get (info, "watchdog") != NULL);
+    CU_ASSERT (process_info_get (info, "signal") != NULL);
+    process_info_free (info);
+    // Or when the last leaseholder releases it, with or without the L parameter
+    use_lease (first, "start");
+    CU_ASSERT_FATAL (operation_start () == 0);
+    CU_ASSERT (process_find () != 0);
+    use_unleased (first, "stop");
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    CU_ASSERT (process_info_get (info, "stop") != NULL);
+    CU_ASSERT (process_info_get (info, "signal") != NULL);
+    process_info_free (info);
+    // Tidy up
+    kill (first, SIGKILL);
+    waitpid (first, NULL, 0);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_stop_lease)
+
+#ifndef _WIN32
+
+/// The number of leaseholders, enough for their PIDs to need a long line
+#define LEASEHOLDERS 64
+
+/// Counts the leaseholders recorded in the information file
+static int leaseholders () {
+    struct process_info *info = process_load ();
+    const char *value = process_info_get (info, "leases");
+    char *end;
+    int count = 0;
+    while (value && *value) {
+        strtol (value, &end, 10);
+        if (end == value) break;
+        value = end;
+        count++;
+    }
+    process_info_free (info);
+    return count;
+}
+
+#endif /* ifndef _WIN32 */
+
+static void init_operation_stop_leases () {
+#ifndef _WIN32
+    CU_ASSERT_FATAL (params_v (0) == 0);
+#endif /* ifndef _WIN32 */
+}
+
+static void do_operation_stop_leases () {
+#ifndef _WIN32
+    struct process_info *info;
+    pid_t holders[LEASEHOLDERS], process;
+    int i;
+    for (i = 0; i < LEASEHOLDERS; i++) {
+        holders[i] = leaseholder ();
+        use_lease (holders[i], "start");
+        CU_ASSERT_FATAL (operation_start () == 0);
+    }
+    process = process_find ();
+    CU_ASSERT_FATAL (process != 0);
+    CU_ASSERT (leaseholders () == LEASEHOLDERS);
+    // Releasing one lease keeps all of the others
+    use_lease (holders[0], "stop");
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (leaseholders () == LEASEHOLDERS - 1);
+    poll (NULL, 0, 200);
+    CU_ASSERT (process_find () == process);
+    // Tidy up
+    for (i = 0; i < LEASEHOLDERS; i++) {
+        kill (holders[i], SIGKILL);
+        waitpid (holders[i], NULL, 0);
+    }
+    CU_ASSERT (process_wait (5, &info) == 0);
+    process_info_free (info);
+    CU_ASSERT (process_housekeep () == 0);
+#endif /* ifndef _WIN32 */
+}
+
+VERBOSE_AND_QUIET_TEST (operation_stop_leases)
+
 int register_tests_stop () {
     CU_pSuite pSuite = CU_add_suite ("stop", NULL, NULL);
     if (!pSuite
      || !CU_add_test (pSuite, "operation_stop [quiet]", test_operation_stop)
-     || !CU_add_test (pSuite, "operation_stop [verbose]", test_operation_stop_verbose)) {
+     || !CU_add_test (pSuite, "operation_stop [verbose]", test_operation_stop_verbose)
+     || !CU_add_test (pSuite, "operation_stop [lease,quiet]", test_operation_stop_lease)
+     || !CU_add_test (pSuite, "operation_stop [lease,verbose]", test_operation_stop_lease_verbose)
+     || !CU_add_test (pSuite, "operation_stop [leases,quiet]", test_operation_stop_leases)
+     || !CU_add_test (pSuite, "operation_stop [leases,verbose]", test_operation_stop_leases_verbose)) {
         return CU_get_error ();
     }
     return 0;
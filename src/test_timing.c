@@ -0,0 +1,100 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "timing.h"
+#include "params.h"
+#include "test_verbose.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TIMING_PATH     64
+#define TIMING_BUFFER   1024
+
+#define _SEP _WIN32_OR_POSIX ("\\", "/")
+
+static void test_timing_report (void) {
+    char tmpdir[16];
+    char path[TIMING_PATH];
+    char buffer[TIMING_BUFFER];
+    const char *phase;
+    double start;
+    FILE *log;
+    size_t len;
+    VERBOSE_WATCH_ALL;
+#ifdef _WIN32
+	snprintf (tmpdir, sizeof (tmpdir), "test%u", GetCurrentProcessId ());
+	CreateDirectory (tmpdir, NULL);
+#else /* ifdef _WIN32 */
+    strcpy (tmpdir, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (tmpdir) != NULL);
+#endif /* ifdef _WIN32 */
+    CU_ASSERT_FATAL (snprintf (path, TIMING_PATH, "%s" _SEP ".timing", tmpdir) < TIMING_PATH);
+    // Nothing is recorded when disabled
+    CU_ASSERT (params_v (3, "-d", tmpdir, "stop") == 0);
+    CU_ASSERT (timing_now () == 0.0);
+    timing_record ("test_disabled", timing_now ());
+    timing_report (0);
+    CU_ASSERT (fopen (path, "rt") == NULL);
+    // Phases are accumulated and appended to the log as a line of JSON
+    CU_ASSERT (params_v (5, "-d", tmpdir, "-T", "log", "stop") == 0);
+    start = timing_now ();
+    CU_ASSERT (start > 0.0);
+    timing_record ("test_phase", start);
+    timing_record ("test_phase", timing_now ());
+    CU_ASSERT (timing_now () >= start);
+    timing_report (3);
+    timing_report (3);
+    log = fopen (path, "rt");
+    CU_ASSERT_FATAL (log != NULL);
+    len = fread (buffer, 1, sizeof (buffer) - 1, log);
+    buffer[len] = 0;
+    fclose (log);
+    CU_ASSERT (buffer[0] == '{');
+    CU_ASSERT (strstr (buffer, "\"operation\":\"stop\",\"result\":3,") != NULL);
+    CU_ASSERT ((phase = strstr (buffer, "\"test_phase\":{\"ms\":")) != NULL);
+    CU_ASSERT (phase && strstr (phase, ",\"count\":2}") != NULL);
+    CU_ASSERT (strstr (buffer, "test_disabled") == NULL);
+    CU_ASSERT (strchr (buffer, '\n') && (strchr (strchr (buffer, '\n') + 1, '\n') == buffer + len - 1));
+    // Phases are not carried over from an operation that wasn't reported
+    timing_record ("test_carried", timing_now ());
+    CU_ASSERT (params_v (3, "-d", tmpdir, "stop") == 0);
+    timing_report (0);
+    CU_ASSERT (params_v (5, "-d", tmpdir, "-T", "log", "stop") == 0);
+    timing_report (0);
+    log = fopen (path, "rt");
+    CU_ASSERT_FATAL (log != NULL);
+    len = fread (buffer, 1, sizeof (buffer) - 1, log);
+    buffer[len] = 0;
+    fclose (log);
+    CU_ASSERT (strstr (buffer, "\"result\":0,") != NULL);
+    CU_ASSERT (strstr (buffer, "test_carried") == NULL);
+    // Tidy up
+    _WIN32_OR_POSIX (DeleteFile, unlink) (path);
+    _WIN32_OR_POSIX (RemoveDirectory, rmdir) (tmpdir);
+    VERBOSE_SILENT_ALL;
+}
+
+int register_tests_timing () {
+    CU_pSuite pSuite = CU_add_suite ("timing", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "timing_report", test_timing_report)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
@@ -0,0 +1,150 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "trace.h"
+#include "operations.h"
+#include "params.h"
+#include "process.h"
+#include "test_verbose.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_PATH      64
+#define TRACE_BUFFER    (TRACE_RECORD_SIZE * 32)
+
+#define _SEP _WIN32_OR_POSIX ("\\", "/")
+
+/// Reads the trace file, returning the number of records
+static int read_trace (const char *path, char *buffer) {
+    FILE *in = fopen (path, "rb");
+    size_t len, header;
+    int i, records;
+    CU_ASSERT_FATAL (in != NULL);
+    len = fread (buffer, 1, TRACE_BUFFER - 1, in);
+    buffer[len] = 0;
+    fclose (in);
+    header = strlen (_WIN32_OR_POSIX ("[\r\n", "[\n"));
+    CU_ASSERT_FATAL (len >= header);
+    CU_ASSERT (!strncmp (buffer, _WIN32_OR_POSIX ("[\r\n", "[\n"), header));
+    // Every record is the same size, a JSON object and a comma padded out to
+    // the end of the line
+    CU_ASSERT ((len - header) % TRACE_RECORD_SIZE == 0);
+    records = (int)((len - header) / TRACE_RECORD_SIZE);
+    for (i = 0; i < records; i++) {
+        const char *record = buffer + header + i * TRACE_RECORD_SIZE;
+        CU_ASSERT (record[0] == '{');
+        CU_ASSERT (record[TRACE_RECORD_SIZE - 1] == '\n');
+        CU_ASSERT (strstr (record, "}},") != NULL);
+        CU_ASSERT (strstr (record, "}},") < record + TRACE_RECORD_SIZE);
+    }
+    return records;
+}
+
+static void test_trace_event (void) {
+    char tmpdir[16];
+    char path[TRACE_PATH];
+    char buffer[TRACE_BUFFER];
+    char *record;
+    double start;
+    VERBOSE_WATCH_ALL;
+#ifdef _WIN32
+	snprintf (tmpdir, sizeof (tmpdir), "test%u", GetCurrentProcessId ());
+	CreateDirectory (tmpdir, NULL);
+#else /* ifdef _WIN32 */
+    strcpy (tmpdir, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (tmpdir) != NULL);
+#endif /* ifdef _WIN32 */
+    CU_ASSERT_FATAL (snprintf (path, TRACE_PATH, "%s" _SEP ".trace", tmpdir) < TRACE_PATH);
+    // Nothing is written when disabled
+    CU_ASSERT (params_v (5, "-d", tmpdir, "-k", "test", "stop") == 0);
+    CU_ASSERT (trace_now () == 0.0);
+    trace_instant ("test_disabled", 0, NULL);
+    CU_ASSERT (fopen (path, "rb") == NULL);
+    // Instant and complete events are appended as fixed size records
+    CU_ASSERT (params_v (6, "-d", tmpdir, "-k", "test\"quoted\"", "-X", "stop") == 0);
+    start = trace_now ();
+    CU_ASSERT (start > 0.0);
+    trace_instant ("test_instant", 42, "\"signal\":15");
+    trace_complete ("test_complete", 0, start, NULL);
+    CU_ASSERT (read_trace (path, buffer) == 2);
+    CU_ASSERT ((record = strstr (buffer, "{\"name\":\"test_instant\",\"cat\":\"procctrl\",\"ph\":\"i\",")) != NULL);
+    CU_ASSERT (record && strstr (record, ",\"args\":{\"id\":\"test\\\"quoted\\\"\",\"process\":42,\"signal\":15}},") != NULL);
+    CU_ASSERT ((record = strstr (buffer, "{\"name\":\"test_complete\",\"cat\":\"procctrl\",\"ph\":\"X\",")) != NULL);
+    CU_ASSERT (record && strstr (record, ",\"dur\":") != NULL);
+    CU_ASSERT (strstr (buffer, "test_disabled") == NULL);
+    // Events that don't fit a record are dropped
+    memset (buffer, 'x', TRACE_RECORD_SIZE);
+    memcpy (buffer, "\"a\":\"", 5);
+    strcpy (buffer + TRACE_RECORD_SIZE - 1, "\"");
+    trace_instant ("test_long", 0, buffer);
+    CU_ASSERT (read_trace (path, buffer) == 2);
+    // Tidy up
+    _WIN32_OR_POSIX (DeleteFile, unlink) (path);
+    _WIN32_OR_POSIX (RemoveDirectory, rmdir) (tmpdir);
+    VERBOSE_SILENT_ALL;
+}
+
+static void test_trace_lifecycle (void) {
+#ifndef _WIN32
+    char tmpdir[16];
+    char path[TRACE_PATH];
+    char buffer[TRACE_BUFFER];
+    struct process_info *info;
+    int records;
+    VERBOSE_WATCH_ALL;
+    strcpy (tmpdir, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (tmpdir) != NULL);
+    CU_ASSERT_FATAL (params_v (7, "-d", tmpdir, "-k", "test", "-X", "start", "src/example-child-script.sh") == 0);
+    // The spawned process, stopped and reaped by the watchdog
+    CU_ASSERT_FATAL (operation_start () == 0);
+    CU_ASSERT (operation_stop () == 0);
+    CU_ASSERT (process_wait (5, &info) == 0);
+    process_info_free (info);
+    CU_ASSERT_FATAL (snprintf (path, TRACE_PATH, "%s/.trace", tmpdir) < TRACE_PATH);
+    records = read_trace (path, buffer);
+    CU_ASSERT (records >= 6);
+    CU_ASSERT (strstr (buffer, "{\"name\":\"spawn\",") != NULL);
+    CU_ASSERT (strstr (buffer, "{\"name\":\"exec\",") != NULL);
+    CU_ASSERT (strstr (buffer, "{\"name\":\"ready\",") != NULL);
+    CU_ASSERT (strstr (buffer, "{\"name\":\"stop_request\",") != NULL);
+    CU_ASSERT (strstr (buffer, "{\"name\":\"signal\",") != NULL);
+    CU_ASSERT (strstr (buffer, "\"signal\":15}},") != NULL);
+    CU_ASSERT (strstr (buffer, "{\"name\":\"exit\",") != NULL);
+    // Tidy up
+    unlink (path);
+    CU_ASSERT_FATAL (snprintf (path, TRACE_PATH, "%s/%u/test", tmpdir, PARAM (parent_process)) < TRACE_PATH);
+    unlink (path);
+    *strrchr (path, '/') = 0;
+    rmdir (path);
+    CU_ASSERT_FATAL (snprintf (path, TRACE_PATH, "%s/.lock", tmpdir) < TRACE_PATH);
+    unlink (path);
+    rmdir (tmpdir);
+    VERBOSE_SILENT_ALL;
+#endif /* ifndef _WIN32 */
+}
+
+int register_tests_trace () {
+    CU_pSuite pSuite = CU_add_suite ("trace", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "trace_event", test_trace_event)
+     || !CU_add_test (pSuite, "trace_lifecycle", test_trace_lifecycle)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
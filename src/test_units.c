@@ -56,12 +56,29 @@ int main (int argc, char **argv) {
     // Initialise CUnit
     if ((e = CU_initialize_registry ()) != CUE_SUCCESS) return e;
     // Add/init all of the suites
+    SUITE (batch)
+    SUITE (events)
+    SUITE (export)
+    SUITE (health)
     SUITE (kill)
+    SUITE (listen)
+    SUITE (monitor)
     SUITE (params)
+    SUITE (placement)
+    SUITE (pool)
+    SUITE (priority)
+    SUITE (procctrl)
     SUITE (process)
+    SUITE (procfs)
     SUITE (query)
+    SUITE (replica)
+    SUITE (restart)
     SUITE (start)
+    SUITE (stats)
     SUITE (stop)
+    SUITE (timing)
+    SUITE (trace)
+    SUITE (wait)
     SUITE (watchdog)
     // Run the tests
     CU_basic_set_mode (CU_BRM_VERBOSE);
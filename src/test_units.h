@@ -8,12 +8,29 @@
 #ifndef __inc_test_units_h
 #define __inc_test_units_h
 
+int register_tests_batch ();
+int register_tests_events ();
+int register_tests_export ();
+int register_tests_health ();
 int register_tests_kill ();
+int register_tests_listen ();
+int register_tests_monitor ();
 int register_tests_params ();
+int register_tests_placement ();
+int register_tests_pool ();
+int register_tests_priority ();
+int register_tests_procctrl ();
 int register_tests_process ();
+int register_tests_procfs ();
 int register_tests_query ();
+int register_tests_replica ();
+int register_tests_restart ();
 int register_tests_start ();
+int register_tests_stats ();
 int register_tests_stop ();
+int register_tests_timing ();
+int register_tests_trace ();
+int register_tests_wait ();
 int register_tests_watchdog ();
 
 #endif /* ifndef __inc_test_units_h */
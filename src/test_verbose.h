@@ -9,6 +9,7 @@
 #define __inc_test_verbose_h
 
 void _verbose_test ();
+void _quiet_test ();
 
 #ifdef _WIN32
 
@@ -52,6 +53,7 @@ void _verbose_test ();
 #define VERBOSE_AND_QUIET_TEST(testcase) \
     static void test_##testcase (void) { \
         VERBOSE_WATCH (stdout); \
+        _quiet_test (); \
         init_##testcase (); \
         do_##testcase (); \
         VERBOSE_SILENT (stdout); \
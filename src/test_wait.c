@@ -0,0 +1,92 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif /* ifdef HAVE_CONFIG_H */
+#ifdef HAVE_CUNIT_H
+#include "test_units.h"
+#include "operations.h"
+#include "test_verbose.h"
+#include "process.h"
+#include "params.h"
+#include "kill.h"
+#include <CUnit/Basic.h>
+#ifndef _WIN32
+# include <signal.h>
+# include <unistd.h>
+#endif /* ifndef _WIN32 */
+#include <stdlib.h>
+
+#define WAIT_PATH   64
+
+#define _SEP _WIN32_OR_POSIX ("\\", "/")
+
+static char _tmpdir[16];
+
+static void wait_params (const char *timeout) {
+    int v = PARAM (verbose);
+    CU_ASSERT_FATAL (params_v (8, "-d", _tmpdir, "-k", "test", "-t", timeout, "wait", _WIN32_OR_POSIX ("src\\example-child-script.bat", "src/example-child-script.sh"), "foo") == 0);
+    if (v) _verbose_test ();
+}
+
+static void init_operation_wait () {
+#ifdef _WIN32
+	snprintf (_tmpdir, sizeof (_tmpdir), "test%u", GetCurrentProcessId ());
+	CreateDirectory (_tmpdir, NULL);
+#else /* ifdef _WIN32 */
+    strcpy (_tmpdir, "testXXXXXX");
+    CU_ASSERT_FATAL (mkdtemp (_tmpdir) != NULL);
+#endif /* ifdef _WIN32 */
+    wait_params ("5");
+}
+
+static void do_operation_wait () {
+    _WIN32_OR_POSIX (HANDLE, pid_t) process;
+    char path[WAIT_PATH];
+    // No process to wait for
+    CU_ASSERT (operation_wait () == _WIN32_OR_POSIX (ERROR_NOT_FOUND, ESRCH));
+    // Start the process; a zero timeout reports it is still running
+    CU_ASSERT (operation_start () == 0);
+    wait_params ("0");
+    CU_ASSERT (operation_wait () == _WIN32_OR_POSIX (WAIT_TIMEOUT, ETIMEDOUT));
+    // Kill the process and the wait will report the signal
+    wait_params ("5");
+    process = process_find ();
+    CU_ASSERT_FATAL (process != 0);
+    kill_process (process);
+#ifdef _WIN32
+	CU_ASSERT (operation_wait () == ERROR_ALERTED);
+	CloseHandle (process);
+#else /* ifdef _WIN32 */
+    CU_ASSERT (operation_wait () == 128 + SIGTERM);
+    // The status remains available after termination
+    CU_ASSERT (operation_wait () == 128 + SIGTERM);
+#endif /* ifdef _WIN32 */
+    // Tidy up
+    CU_ASSERT_FATAL (snprintf (path, WAIT_PATH, "%s" _SEP "%u" _SEP "test", _tmpdir, _WIN32_OR_POSIX (GetProcessId (PARAM (parent_process)), PARAM (parent_process))) < WAIT_PATH);
+    _WIN32_OR_POSIX (DeleteFile, unlink) (path);
+    *strrchr (path, _SEP[0]) = 0;
+    _WIN32_OR_POSIX (RemoveDirectory, rmdir) (path);
+    CU_ASSERT_FATAL (snprintf (path, WAIT_PATH, "%s" _SEP ".lock", _tmpdir) < WAIT_PATH);
+    _WIN32_OR_POSIX (DeleteFile, unlink) (path);
+    _WIN32_OR_POSIX (RemoveDirectory, rmdir) (_tmpdir);
+}
+
+VERBOSE_AND_QUIET_TEST (operation_wait)
+
+int register_tests_wait () {
+    CU_pSuite pSuite = CU_add_suite ("wait", NULL, NULL);
+    if (!pSuite
+     || !CU_add_test (pSuite, "operation_wait [quiet]", test_operation_wait)
+     || !CU_add_test (pSuite, "operation_wait [verbose]", test_operation_wait_verbose)) {
+        return CU_get_error ();
+    }
+    return 0;
+}
+
+#endif /* ifdef HAVE_CUNIT_H */
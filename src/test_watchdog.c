@@ -131,13 +131,29 @@ static void do_watchdog_child () {
 
 VERBOSE_AND_QUIET_TEST (watchdog_child)
 
+static void test_watchdog_backoff (void) {
+#ifndef _WIN32
+    unsigned seed = 1;
+    int attempt, delay, limit = WATCHDOG_BACKOFF_MIN;
+    for (attempt = 0; attempt < 20; attempt++) {
+        delay = watchdog_backoff (attempt, &seed);
+        // The delay doubles, less up to half for jitter, up to the maximum
+        CU_ASSERT (delay <= limit);
+        CU_ASSERT (delay >= limit / 2);
+        if (limit < WATCHDOG_BACKOFF_MAX) limit *= 2;
+        if (limit > WATCHDOG_BACKOFF_MAX) limit = WATCHDOG_BACKOFF_MAX;
+    }
+#endif /* ifndef _WIN32 */
+}
+
 int register_tests_watchdog () {
     CU_pSuite pSuite = CU_add_suite ("watchdog", NULL, NULL);
     if (!pSuite
      || !CU_add_test (pSuite, "watchdog [parent,quiet]", test_watchdog_parent)
      || !CU_add_test (pSuite, "watchdog [parent,verbose]", test_watchdog_parent_verbose)
      || !CU_add_test (pSuite, "watchdog [child,quiet]", test_watchdog_child)
-     || !CU_add_test (pSuite, "watchdog [child,verbose]", test_watchdog_child_verbose)) {
+     || !CU_add_test (pSuite, "watchdog [child,verbose]", test_watchdog_child_verbose)
+     || !CU_add_test (pSuite, "watchdog_backoff", test_watchdog_backoff)) {
         return CU_get_error ();
     }
     return 0;
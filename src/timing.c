@@ -0,0 +1,159 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Per-phase timing instrumentation
+///
+/// Each phase of an operation is timed with a monotonic clock. The time spent
+/// in a phase that occurs more than once, for example waiting for the data
+/// folder lock, is accumulated. The totals are written as a single line of
+/// JSON when the operation completes.
+
+#include "timing.h"
+#include "params.h"
+#ifdef _WIN32
+# define snprintf _snprintf
+#else /* ifdef _WIN32 */
+# include <fcntl.h>
+# include <sys/time.h>
+# include <time.h>
+# include <unistd.h>
+#endif /* ifdef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// @brief The maximum number of distinct phases that can be recorded
+#define MAX_TIMING_PHASES   16
+
+/// @brief The longest JSON line that will be written
+#define MAX_TIMING_LINE     1024
+
+/// @brief The accumulated time for each phase, in the order first recorded
+static THREAD_LOCAL struct {
+    /// @brief The phase name
+    const char *phase;
+    /// @brief The total time spent in the phase, in milliseconds
+    double ms;
+    /// @brief The number of times the phase was recorded
+    unsigned count;
+} _phases[MAX_TIMING_PHASES];
+
+/// @brief The number of entries in _phases
+static THREAD_LOCAL int _phase_count = 0;
+
+/// @brief The time of the first call to timing_now()
+static THREAD_LOCAL double _start = -1.0;
+
+/// @brief Reads the monotonic clock
+///
+/// @return the time in milliseconds from an arbitrary origin, or zero if
+///         timing is disabled
+double timing_now () {
+    double now;
+#ifdef _WIN32
+	LARGE_INTEGER count, frequency;
+#else /* ifdef _WIN32 */
+    struct timespec ts;
+#endif /* ifdef _WIN32 */
+    if (PARAM (timing_mode) == TIMING_NONE) return 0.0;
+#ifdef _WIN32
+	QueryPerformanceCounter (&count);
+	QueryPerformanceFrequency (&frequency);
+	now = (double)count.QuadPart * 1000.0 / (double)frequency.QuadPart;
+#else /* ifdef _WIN32 */
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    now = ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+#endif /* ifdef _WIN32 */
+    if (_start < 0) _start = now;
+    return now;
+}
+
+/// @brief Records the time spent in a phase
+///
+/// The time from `start` until now is added to the total for the phase.
+void timing_record (
+    const char *phase, ///<the phase name, which must be a static string>
+    double start ///<the value of timing_now() at the start of the phase>
+    ) {
+    double elapsed;
+    int i;
+    if (PARAM (timing_mode) == TIMING_NONE) return;
+    elapsed = timing_now () - start;
+    for (i = 0; (i < _phase_count) && strcmp (_phases[i].phase, phase); i++);
+    if (i == _phase_count) {
+        if (_phase_count == MAX_TIMING_PHASES) return;
+        _phases[i].phase = phase;
+        _phases[i].ms = 0.0;
+        _phases[i].count = 0;
+        _phase_count++;
+    }
+    _phases[i].ms += elapsed;
+    _phases[i].count++;
+}
+
+/// @brief Writes the recorded phases
+///
+/// A single line of JSON is written to stderr, or appended to the `.timing`
+/// log in the data folder, depending on the `T` parameter. The line is
+/// written with a single system call so lines from concurrent invocations
+/// are not interleaved. The recorded phases are cleared even if the report is
+/// disabled, so the next operation on this thread starts a new report.
+void timing_report (
+    int result ///<the exit code of the operation>
+    ) {
+    char line[MAX_TIMING_LINE];
+    size_t len;
+    double start = _start;
+    int i, count = _phase_count;
+#ifndef _WIN32
+    struct timeval tv;
+    int fd;
+#endif /* ifndef _WIN32 */
+    _phase_count = 0;
+    _start = -1.0;
+    if (PARAM (timing_mode) == TIMING_NONE) return;
+#ifdef _WIN32
+	len = snprintf (line, sizeof (line), "{\"pid\":%u,\"operation\":\"%s\",\"result\":%d,\"total\":%.3f,\"phases\":{",
+		GetCurrentProcessId (), PARAM (operation) ? PARAM (operation) : "query", result, timing_now () - start);
+#else /* ifdef _WIN32 */
+    gettimeofday (&tv, NULL);
+    len = snprintf (line, sizeof (line), "{\"time\":%ld.%06ld,\"pid\":%u,\"operation\":\"%s\",\"result\":%d,\"total\":%.3f,\"phases\":{",
+        (long)tv.tv_sec, (long)tv.tv_usec, getpid (), PARAM (operation) ? PARAM (operation) : "query", result, timing_now () - start);
+#endif /* ifdef _WIN32 */
+    for (i = 0; (i < count) && (len < sizeof (line)); i++) {
+        len += snprintf (line + len, sizeof (line) - len, "%s\"%s\":{\"ms\":%.3f,\"count\":%u}",
+            i ? "," : "", _phases[i].phase, _phases[i].ms, _phases[i].count);
+    }
+    if (len < sizeof (line)) len += snprintf (line + len, sizeof (line) - len, "}}\n");
+    if (len >= sizeof (line)) return;
+    if (PARAM (timing_mode) == TIMING_LOG) {
+#ifdef _WIN32
+		FILE *log;
+		char path[MAX_PATH];
+		snprintf (path, sizeof (path), "%s\\.timing", PARAM (data_dir));
+		log = fopen (path, "at");
+		if (log) {
+			fputs (line, log);
+			fclose (log);
+		}
+#else /* ifdef _WIN32 */
+        char *path = (char*)malloc (strlen (PARAM (data_dir)) + 9);
+        if (!path) return;
+        sprintf (path, "%s/.timing", PARAM (data_dir));
+        fd = open (path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        free (path);
+        if (fd >= 0) {
+            if (write (fd, line, len) != (ssize_t)len) fprintf (stderr, "Couldn't write timing log\n");
+            close (fd);
+        }
+#endif /* ifdef _WIN32 */
+    } else {
+        fputs (line, stderr);
+        fflush (stderr);
+    }
+}
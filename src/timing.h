@@ -0,0 +1,21 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifndef __inc_timing_h
+#define __inc_timing_h
+
+/// @file
+/// @brief Per-phase timing instrumentation
+///
+/// Header file for the timing functions published by timing.c. These are
+/// no-ops unless enabled with the `T` parameter.
+
+double timing_now ();
+void timing_record (const char *phase, double start);
+void timing_report (int result);
+
+#endif /* ifndef __inc_timing_h */
@@ -0,0 +1,205 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Trace-event timeline
+///
+/// Lifecycle events are appended to the `.trace` file in the data folder in
+/// the Chrome trace event (JSON array) format. Every invocation, and every
+/// watchdog, appends to the same file so the whole timeline of a build can be
+/// loaded into a trace viewer.
+///
+/// Each event is padded to a fixed size record and written with a single
+/// append, so records from concurrent writers are never interleaved and no
+/// lock is needed. The closing `]` of the array is never written; trace
+/// viewers accept the array without it.
+///
+/// The event `pid` is the parent process that defines the identifier scope,
+/// typically the build step, and the `tid` is the procctrl process that wrote
+/// the event.
+
+#include "trace.h"
+#include "params.h"
+#ifdef _WIN32
+# define snprintf _snprintf
+#else /* ifdef _WIN32 */
+# include <errno.h>
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <time.h>
+# include <unistd.h>
+#endif /* ifdef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// @brief The longest identifier written, in escaped characters
+#define MAX_TRACE_IDENTIFIER    64
+
+/// @brief Reads the clock used for event timestamps
+///
+/// The clock is shared by all processes, so events written by different
+/// invocations line up.
+///
+/// @return the time in microseconds from an arbitrary origin, or zero if
+///         tracing is disabled
+double trace_now () {
+#ifdef _WIN32
+	LARGE_INTEGER count, frequency;
+	if (!PARAM (trace_enabled)) return 0.0;
+	QueryPerformanceCounter (&count);
+	QueryPerformanceFrequency (&frequency);
+	return (double)count.QuadPart * 1000000.0 / (double)frequency.QuadPart;
+#else /* ifdef _WIN32 */
+    struct timespec ts;
+    if (!PARAM (trace_enabled)) return 0.0;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+#endif /* ifdef _WIN32 */
+}
+
+/// @brief Copies the process identifier as the content of a JSON string
+///
+/// Long identifiers are truncated so that the record fits its fixed size.
+static void copy_identifier (
+    char *buffer ///<the buffer to write into, at least MAX_TRACE_IDENTIFIER + 1 characters>
+    ) {
+    const char *str = PARAM (process_identifier) ? PARAM (process_identifier) : "";
+    size_t len = 0;
+    for (; *str; str++) {
+        if ((*str == '\"') || (*str == '\\')) {
+            if (len + 2 > MAX_TRACE_IDENTIFIER) break;
+            buffer[len++] = '\\';
+            buffer[len++] = *str;
+        } else if ((unsigned char)*str < 0x20) {
+            if (len + 6 > MAX_TRACE_IDENTIFIER) break;
+            len += sprintf (buffer + len, "\\u%04x", (unsigned char)*str);
+        } else {
+            if (len + 1 > MAX_TRACE_IDENTIFIER) break;
+            buffer[len++] = *str;
+        }
+    }
+    buffer[len] = 0;
+}
+
+#ifndef _WIN32
+
+/// @brief Opens the trace file for appending
+///
+/// If the file does not exist it is created, with the opening `[` of the
+/// array, as a temporary file and linked into place. Only one of several
+/// concurrent creators will succeed, and no other writer can append a record
+/// before the `[`. The data folder is created if it does not exist yet.
+///
+/// @return the file descriptor, or -1 if the file couldn't be opened
+static int open_trace (
+    const char *path ///<the path to the trace file>
+    ) {
+    char *tmp;
+    int fd;
+    fd = open (path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    if ((fd >= 0) || (errno != ENOENT)) return fd;
+    tmp = (char*)malloc (strlen (path) + 16);
+    if (!tmp) return -1;
+    sprintf (tmp, "%s.%u~", path, getpid ());
+    fd = open (tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if ((fd < 0) && (errno == ENOENT) && (mkdir (PARAM (data_dir), 0755) == 0)) {
+        // Events can be recorded before the first process is saved
+        fd = open (tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (fd >= 0) {
+        if ((write (fd, "[\n", 2) != 2) || ((link (tmp, path) != 0) && (errno != EEXIST))) {
+            if (PARAM (verbose)) fprintf (stdout, "Couldn't create trace file %s\n", path);
+        }
+        close (fd);
+        unlink (tmp);
+    }
+    free (tmp);
+    return open (path, O_WRONLY | O_APPEND | O_CLOEXEC);
+}
+
+#endif /* ifndef _WIN32 */
+
+/// @brief Appends a trace event
+static void trace_event (
+    const char *name, ///<the event name>
+    char phase, ///<the event type; 'i' for instant or 'X' for complete>
+    _WIN32_OR_POSIX (DWORD, pid_t) process, ///<the controlled process, or zero if none>
+    double start, ///<the value of trace_now() at the start of the event>
+    double end, ///<the value of trace_now() at the end of a complete event>
+    const char *args ///<additional JSON members for the event arguments, or NULL for none>
+    ) {
+    char record[TRACE_RECORD_SIZE];
+    char id[MAX_TRACE_IDENTIFIER + 1];
+    char *path;
+    size_t len;
+    copy_identifier (id);
+    if (phase == 'X') {
+        len = snprintf (record, sizeof (record), "{\"name\":\"%s\",\"cat\":\"procctrl\",\"ph\":\"X\",\"ts\":%.0f,\"dur\":%.0f,",
+            name, start, end - start);
+    } else {
+        len = snprintf (record, sizeof (record), "{\"name\":\"%s\",\"cat\":\"procctrl\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.0f,",
+            name, start);
+    }
+    if (len < sizeof (record)) {
+        len += snprintf (record + len, sizeof (record) - len, "\"pid\":%u,\"tid\":%u,\"args\":{\"id\":\"%s\"",
+            _WIN32_OR_POSIX (GetProcessId (PARAM (parent_process)), PARAM (parent_process)), _WIN32_OR_POSIX (GetCurrentProcessId (), getpid ()), id);
+    }
+    if (process && (len < sizeof (record))) len += snprintf (record + len, sizeof (record) - len, ",\"process\":%u", process);
+    if (args && (len < sizeof (record))) len += snprintf (record + len, sizeof (record) - len, ",%s", args);
+    if (len < sizeof (record)) len += snprintf (record + len, sizeof (record) - len, "}},");
+    if (len >= sizeof (record) - 1) {
+        if (PARAM (verbose)) fprintf (stdout, "Trace event %s is too long\n", name);
+        return;
+    }
+    memset (record + len, ' ', sizeof (record) - 1 - len);
+    record[sizeof (record) - 1] = '\n';
+    path = (char*)malloc (strlen (PARAM (data_dir)) + 8);
+    if (!path) return;
+    sprintf (path, "%s" _WIN32_OR_POSIX ("\\", "/") ".trace", PARAM (data_dir));
+#ifdef _WIN32
+	{
+		HANDLE file = CreateFile (path, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		DWORD written;
+		if (file != INVALID_HANDLE_VALUE) {
+			if (GetLastError () != ERROR_ALREADY_EXISTS) WriteFile (file, "[\r\n", 3, &written, NULL);
+			WriteFile (file, record, sizeof (record), &written, NULL);
+			CloseHandle (file);
+		}
+	}
+#else /* ifdef _WIN32 */
+    {
+        int fd = open_trace (path);
+        if (fd >= 0) {
+            if (write (fd, record, sizeof (record)) != (ssize_t)sizeof (record)) fprintf (stderr, "Couldn't write trace event\n");
+            close (fd);
+        }
+    }
+#endif /* ifdef _WIN32 */
+    free (path);
+}
+
+/// @brief Appends an instant event to the trace file
+void trace_instant (
+    const char *name, ///<the event name>
+    _WIN32_OR_POSIX (DWORD, pid_t) process, ///<the controlled process, or zero if none>
+    const char *args ///<additional JSON members for the event arguments, or NULL for none>
+    ) {
+    if (!PARAM (trace_enabled)) return;
+    trace_event (name, 'i', process, trace_now (), 0.0, args);
+}
+
+/// @brief Appends a complete event, with a duration, to the trace file
+void trace_complete (
+    const char *name, ///<the event name>
+    _WIN32_OR_POSIX (DWORD, pid_t) process, ///<the controlled process, or zero if none>
+    double start, ///<the value of trace_now() at the start of the event>
+    const char *args ///<additional JSON members for the event arguments, or NULL for none>
+    ) {
+    if (!PARAM (trace_enabled)) return;
+    trace_event (name, 'X', process, start, trace_now (), args);
+}
@@ -0,0 +1,38 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+#ifndef __inc_trace_h
+#define __inc_trace_h
+
+/// @file
+/// @brief Trace-event timeline
+///
+/// Header file for the trace functions published by trace.c. These are
+/// no-ops unless enabled with the `X` parameter.
+
+#ifdef _WIN32
+
+#include <Windows.h>
+
+#define _WIN32_OR_POSIX(a,b) a
+
+#else /* ifdef _WIN32 */
+
+#include <sys/types.h>
+
+#define _WIN32_OR_POSIX(a,b) b
+
+#endif /* ifdef _WIN32 */
+
+/// @brief The size of each record in the trace file, including the separator
+#define TRACE_RECORD_SIZE   256
+
+double trace_now ();
+void trace_instant (const char *name, _WIN32_OR_POSIX (DWORD, pid_t) process, const char *args);
+void trace_complete (const char *name, _WIN32_OR_POSIX (DWORD, pid_t) process, double start, const char *args);
+
+#endif /* ifndef __inc_trace_h */
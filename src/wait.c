@@ -0,0 +1,94 @@
+/*
+ * Process control utility
+ *
+ * Copyright 2014 by Andrew Ian William Griffin <griffin@beerdragon.co.uk>
+ * Released under the GNU General Public License.
+ */
+
+/// @file
+/// @brief Implements the `wait` operation
+
+#include "operations.h"
+#include "params.h"
+#include "process.h"
+#ifndef _WIN32
+# include <errno.h>
+#endif /* ifndef _WIN32 */
+#include <stdio.h>
+#include <stdlib.h>
+
+/// @brief Waits for a child process to terminate
+///
+/// Blocks until the child process, created by a previous call to the `start`
+/// operation, terminates or the timeout given by the `t` parameter elapses.
+/// If the process has already terminated, and its status is still recorded,
+/// this returns immediately.
+///
+/// The status is returned using the same convention as a shell; the exit
+/// code of the process if it exited normally, or 128 plus the signal number
+/// if it was killed by a signal.
+///
+/// @return the status of the process, ETIMEDOUT/WAIT_TIMEOUT if it is still
+///         running, ESRCH/ERROR_NOT_FOUND if there is no such process or
+///         another non-zero error code
+int operation_wait () {
+#ifdef _WIN32
+	HANDLE process;
+	DWORD dwExitCode;
+	int result;
+    if (PARAM (verbose)) fprintf (stdout, "Waiting for spawned process\n");
+	process = process_find ();
+	if (!process) {
+		if (PARAM (verbose)) fprintf (stdout, "No child process is running\n");
+		return ERROR_NOT_FOUND;
+	}
+	switch (WaitForSingleObject (process, (PARAM (wait_timeout) < 0) ? INFINITE : PARAM (wait_timeout) * 1000)) {
+	case WAIT_OBJECT_0 :
+		if (GetExitCodeProcess (process, &dwExitCode)) {
+			if (PARAM (verbose)) fprintf (stdout, "Process exited with code %u\n", dwExitCode);
+			result = (int)dwExitCode;
+		} else {
+			result = GetLastError ();
+		}
+		break;
+	case WAIT_TIMEOUT :
+		if (PARAM (verbose)) fprintf (stdout, "Process is still running\n");
+		result = WAIT_TIMEOUT;
+		break;
+	default :
+		result = GetLastError ();
+		break;
+	}
+	CloseHandle (process);
+	return result;
+#else /* ifdef _WIN32 */
+    struct process_info *info;
+    const char *value;
+    int result;
+    if (PARAM (verbose)) fprintf (stdout, "Waiting for spawned process\n");
+    result = process_wait (PARAM (wait_timeout), &info);
+    switch (result) {
+        case 0 :
+            if ((value = process_info_get (info, "signal")) != NULL) {
+                if (PARAM (verbose)) fprintf (stdout, "Process terminated by signal %s\n", value);
+                result = 128 + atoi (value);
+            } else {
+                value = process_info_get (info, "exit");
+                if (PARAM (verbose)) fprintf (stdout, "Process exited with code %s\n", value);
+                result = atoi (value);
+            }
+            process_info_free (info);
+            break;
+        case ETIMEDOUT :
+            if (PARAM (verbose)) fprintf (stdout, "Process is still running\n");
+            break;
+        case ESRCH :
+            if (PARAM (verbose)) fprintf (stdout, "No child process is running\n");
+            break;
+        case ECHILD :
+            if (PARAM (verbose)) fprintf (stdout, "Process terminated without recording its status\n");
+            break;
+    }
+    return result;
+#endif /* ifdef _WIN32 */
+}
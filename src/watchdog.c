@@ -9,14 +9,28 @@
 /// @brief Process termination watchdog
 
 #include "watchdog.h"
+#include "health.h"
+#include "kill.h"
 #include "params.h"
+#include "procfs.h"
+#include "process.h"
+#include "trace.h"
 #ifdef _WIN32
 # include <Windows.h>
 # define _WIN32_OR_POSIX(a,b) a
 #else /* ifdef _WIN32 */
+# include <errno.h>
+# include <poll.h>
+# include <signal.h>
+# include <stdint.h>
 # include <wait.h>
 # include <unistd.h>
+# include <sys/resource.h>
+# include <sys/signalfd.h>
 # include <sys/stat.h>
+# include <sys/syscall.h>
+# include <sys/timerfd.h>
+# include <time.h>
 # define _WIN32_OR_POSIX(a,b) b
 #endif /* ifdef _WIN32 */
 #include <stdarg.h>
@@ -39,8 +53,8 @@ int _is_running (
 	if ((process == NULL) || (process == INVALID_HANDLE_VALUE)) return 0;
 	return WaitForSingleObject (process, 0) == WAIT_TIMEOUT;
 #else /* ifdef _WIN32 */
-    char tmp[32];
-    if ((kill (process, 0) == 0) && (snprintf (tmp, sizeof (tmp), "/proc/%u/cwd", process) < 32)) {
+    char tmp[PROCFS_PATH];
+    if ((procfs_signal (process, 0) == 0) && (procfs_path (tmp, sizeof (tmp), process, "cwd") == 0)) {
         struct stat info;
         if (stat (tmp, &info) == 0) {
             if (S_ISDIR (info.st_mode)) {
@@ -71,7 +85,7 @@ int _watchdog0_v (
     for (i = 0; i < count; i++) {
 		_WIN32_OR_POSIX (HANDLE, pid_t) process = va_arg (processes, _WIN32_OR_POSIX (HANDLE, pid_t));
         if (_is_running (process)) continue;
-        if (verbose) fprintf (stdout, "Process %u is no longer valid\n", _WIN32_OR_POSIX (GetProcessId (process), process));
+        if (PARAM (verbose)) fprintf (stdout, "Process %u is no longer valid\n", _WIN32_OR_POSIX (GetProcessId (process), process));
         return i;
     }
     return -1;
@@ -96,7 +110,7 @@ int watchdog (
     ) {
     int i;
     va_list processes;
-    if (verbose) {
+    if (PARAM (verbose)) {
         va_start (processes, count);
         for (i = 0; i < count; i++) {
             fprintf (stdout, "Watching process %u for termination\n", _WIN32_OR_POSIX (GetProcessId (va_arg (processes, HANDLE)), va_arg (processes, pid_t)));
@@ -111,3 +125,343 @@ int watchdog (
 		_WIN32_OR_POSIX (Sleep (1000), sleep (1));
     } while (1);
 }
+
+#ifndef _WIN32
+
+/// @brief Opens a file descriptor referring to a process
+///
+/// The descriptor (a Linux `pidfd`) becomes readable when the process
+/// terminates, allowing termination to be waited for with `poll` instead of
+/// checking the process periodically.
+///
+/// @return the file descriptor, or -1 if there is a problem. errno is set to
+///         ENOSYS if the kernel does not support `pidfd`.
+int watchdog_open (
+    pid_t process ///<the process to open>
+    ) {
+    if (process <= 0) {
+        errno = ESRCH;
+        return -1;
+    }
+#ifdef SYS_pidfd_open
+    return (int)syscall (SYS_pidfd_open, process, 0);
+#else /* ifdef SYS_pidfd_open */
+    errno = ENOSYS;
+    return -1;
+#endif /* ifdef SYS_pidfd_open */
+}
+
+/// @brief Changes the parent process watched by watchdog_supervise()
+static void watch_process (
+    struct pollfd *fd, ///<the descriptor watching the parent>
+    pid_t parent ///<the parent to watch, or zero for none>
+    ) {
+    if (fd->fd >= 0) close (fd->fd);
+    fd->fd = parent ? watchdog_open (parent) : -1;
+    fd->revents = 0;
+    if (PARAM (verbose) && parent) fprintf (stdout, "Watching process %u for termination\n", parent);
+}
+
+/// @brief Sets a `timerfd` to expire once after a delay
+static void arm_timer (
+    int fd, ///<the timer>
+    int delay ///<the delay in milliseconds>
+    ) {
+    struct itimerspec timeout;
+    timeout.it_interval.tv_sec = 0;
+    timeout.it_interval.tv_nsec = 0;
+    timeout.it_value.tv_sec = delay / 1000;
+    timeout.it_value.tv_nsec = (delay % 1000) * 1000000L;
+    timerfd_settime (fd, 0, &timeout, NULL);
+}
+
+/// @brief Kills the child because its parent, or last leaseholder, terminated
+static void kill_orphan (
+    pid_t child ///<the spawned child>
+    ) {
+    if (PARAM (verbose)) fprintf (stdout, "Killing child process on parent termination\n");
+    // process_leaseholder() has already recorded it for a shared process
+    if (!PARAM (shared_lease)) process_update (child, "watchdog", NULL);
+    trace_instant ("watchdog", child, NULL);
+    kill_process (child);
+}
+
+/// @brief Supervises a spawned child until it terminates
+///
+/// The child, and optionally a parent process, are watched for termination.
+/// If the parent terminates first then the child is killed. When the child
+/// terminates it is reaped with `wait4` and its status and resource usage
+/// returned to the caller.
+///
+/// The processes are watched with `pidfd`s if the kernel supports them,
+/// otherwise they are checked once a second.
+///
+/// If a health check was given by the `c` parameter then it is run every `i`
+/// seconds, scheduled with a `timerfd` in the same loop. The probe doesn't
+/// block; its socket, or the `pidfd` of its command, is polled in the same
+/// loop until it completes or the `C` parameter's time limit passes, so a hung
+/// child doesn't hold up anything else. A child that fails
+/// as many consecutive checks as the `n` parameter is killed; the restart
+/// policy then applies as for any other failure. A child that is not yet
+/// ready is recorded as ready when it first passes a check, and its failures
+/// are not counted until then while within the `g` parameter's grace period.
+///
+/// A member of a pool is claimed by the `start` operation signalling the
+/// watchdog with SIGUSR1, which the caller must have blocked, and read from
+/// a `signalfd` in the same loop. The watchdog then follows the claim with
+/// process_claimed() and watches the parent it was claimed for, if required.
+///
+/// A process shared by the `L` parameter is kept for as long as any of its
+/// leaseholders is running. The first is watched in place of the parent, and
+/// when it terminates, or the `stop` operation releases its lease and sends
+/// SIGUSR1, the watchdog moves on to the next with process_leaseholder().
+///
+/// If an idle timeout was given by the `I` parameter then a second `timerfd`
+/// expires once the child could have been unused for that long. Uses are
+/// recorded in the information file rather than signalled, so the timer is
+/// only set again, for the time remaining, if process_idle() finds a later
+/// use or a running leaseholder. An idle child is killed, and is not
+/// restarted.
+///
+/// The `restart` operation signals the watchdog with SIGUSR2, which the
+/// caller must also have blocked, and is read from a third `signalfd`. The
+/// child is left running for the caller to hand over to a new instance.
+///
+/// @return zero if the child was reaped, EAGAIN if a restart was requested,
+///         otherwise a non-zero error code
+int watchdog_supervise (
+    pid_t child, ///<the spawned child, which must be a child of this process>
+    pid_t parent, ///<the parent to watch, or zero for none>
+    int *ready, ///<non-zero if the child has been recorded as ready, updated>
+    int *status, ///<receives the status of the child>
+    struct rusage *usage ///<receives the resource usage of the child>
+    ) {
+    struct pollfd fds[7];
+    struct health_probe probe;
+    struct timespec begun, now;
+    sigset_t signals;
+    int i, e = 0, failures = 0, started = *ready, probing = -1, timeout;
+    clock_gettime (CLOCK_MONOTONIC, &begun);
+    fds[0].fd = watchdog_open (child);
+    fds[1].fd = parent ? watchdog_open (parent) : -1;
+    fds[2].fd = PARAM (health_probe) ? timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK) : -1;
+    if (fds[2].fd >= 0) {
+        struct itimerspec interval;
+        interval.it_interval.tv_sec = interval.it_value.tv_sec = PARAM (monitor_interval);
+        interval.it_interval.tv_nsec = interval.it_value.tv_nsec = 0;
+        timerfd_settime (fds[2].fd, 0, &interval, NULL);
+    }
+    sigemptyset (&signals);
+    sigaddset (&signals, SIGUSR1);
+    fds[3].fd = (PARAM (pool_member) || PARAM (shared_lease)) ? signalfd (-1, &signals, SFD_CLOEXEC | SFD_NONBLOCK) : -1;
+    fds[4].fd = PARAM (idle_timeout) ? timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK) : -1;
+    if (fds[4].fd >= 0) arm_timer (fds[4].fd, PARAM (idle_timeout) * 1000);
+    sigemptyset (&signals);
+    sigaddset (&signals, SIGUSR2);
+    fds[5].fd = signalfd (-1, &signals, SFD_CLOEXEC | SFD_NONBLOCK);
+    fds[6].fd = -1;
+    for (i = 0; i < 7; i++) {
+        fds[i].revents = 0;
+    }
+    if (PARAM (verbose)) {
+        fprintf (stdout, "Watching process %u for termination\n", child);
+        if (parent) fprintf (stdout, "Watching process %u for termination\n", parent);
+    }
+    do {
+        pid_t terminated = wait4 (child, status, WNOHANG, usage);
+        if (terminated == child) break;
+        if (terminated == (pid_t)-1) {
+            if (errno == EINTR) continue;
+            e = errno;
+            break;
+        }
+        if (parent && ((fds[1].fd >= 0) ? (fds[1].revents & POLLIN) : !_is_running (parent))) {
+            parent = PARAM (shared_lease) ? process_leaseholder (child) : 0;
+            if (!parent) kill_orphan (child);
+            watch_process (&fds[1], parent);
+        }
+        if (fds[2].revents & POLLIN) {
+            uint64_t expirations;
+            if (read (fds[2].fd, &expirations, sizeof (expirations)) < 0) expirations = 0;
+            // A probe still running from the last interval is left to finish
+            if (probing != EINPROGRESS) probing = health_start (&probe, PARAM (health_probe), PARAM (probe_timeout) * 1000);
+        } else if (probing == EINPROGRESS) {
+            probing = health_continue (&probe);
+        }
+        if ((probing >= 0) && (probing != EINPROGRESS)) {
+            clock_gettime (CLOCK_MONOTONIC, &now);
+            i = health_check (child, probing, probe.latency, &failures, &started, now.tv_sec - begun.tv_sec < PARAM (health_grace));
+            probing = -1;
+            if (started && !*ready) {
+                process_update (child, "ready", NULL);
+                trace_instant ("ready", child, NULL);
+                *ready = 1;
+            }
+            if (i) {
+                if (PARAM (verbose)) fprintf (stdout, "Killing unhealthy child process\n");
+                trace_instant ("unhealthy", child, NULL);
+                kill_process (child);
+                close (fds[2].fd);
+                fds[2].fd = -1;
+            }
+        }
+        if (fds[3].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            if (read (fds[3].fd, &info, sizeof (info)) < 0) info.ssi_signo = 0;
+            if (PARAM (pool_member)) {
+                if (process_claimed (child) == 0) {
+                    trace_instant ("claimed", child, NULL);
+                    if (PARAM (watch_parent)) {
+                        parent = PARAM (parent_process);
+                        watch_process (&fds[1], parent);
+                    }
+                }
+            } else if (parent) {
+                // A lease has been released
+                pid_t holder = process_leaseholder (child);
+                if (!holder) kill_orphan (child);
+                if (holder != parent) watch_process (&fds[1], parent = holder);
+            }
+        }
+        if (fds[4].revents & POLLIN) {
+            uint64_t expirations;
+            int idle, remaining;
+            if (read (fds[4].fd, &expirations, sizeof (expirations)) < 0) expirations = 0;
+            idle = process_idle (child, &remaining);
+            if (idle == EAGAIN) {
+                arm_timer (fds[4].fd, remaining);
+            } else {
+                if (!idle) {
+                    if (PARAM (verbose)) fprintf (stdout, "Killing idle child process\n");
+                    trace_instant ("idle", child, NULL);
+                    kill_process (child);
+                }
+                close (fds[4].fd);
+                fds[4].fd = -1;
+            }
+        }
+        if (fds[5].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            if (read (fds[5].fd, &info, sizeof (info)) < 0) info.ssi_signo = 0;
+            if (PARAM (verbose)) fprintf (stdout, "Restart of child process %u requested\n", child);
+            e = EAGAIN;
+            break;
+        }
+        for (i = 0; i < 6; i++) {
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        timeout = ((fds[0].fd < 0) || (parent && (fds[1].fd < 0))) ? 1000 : -1;
+        fds[6].fd = -1;
+        fds[6].revents = 0;
+        if (probing == EINPROGRESS) {
+            fds[6].fd = probe.fd;
+            fds[6].events = probe.events;
+            i = health_timeout (&probe);
+            if ((timeout < 0) || (i < timeout)) timeout = i;
+        }
+        if ((poll (fds, 7, timeout) < 0) && (errno != EINTR)) {
+            e = errno;
+            break;
+        }
+    } while (1);
+    // The child may have terminated just after being claimed
+    if (PARAM (pool_member)) process_claimed (child);
+    if (probing == EINPROGRESS) health_cancel (&probe);
+    for (i = 0; i < 6; i++) {
+        if (fds[i].fd >= 0) close (fds[i].fd);
+    }
+    return e;
+}
+
+/// @brief Waits for a connection to one of the listening sockets
+///
+/// This is used by the watchdog of a socket activated process, standing in
+/// for the child until it is needed. The sockets are only polled, so the
+/// connection stays queued for the child to accept.
+///
+/// The `stop` operation kills the watchdog in place of the child with
+/// SIGTERM, which the caller must have blocked, and is read from a
+/// `signalfd`. A parent is watched, or the leaseholders of a shared process
+/// followed, as for watchdog_supervise().
+///
+/// @return zero when a connection is waiting, ECANCELED if the watchdog was
+///         killed, ESRCH if the parent terminated, otherwise a non-zero
+///         error code
+int watchdog_activate (
+    const int *listeners, ///<the listening sockets>
+    int count, ///<the number of listening sockets>
+    pid_t parent ///<the parent to watch, or zero for none>
+    ) {
+    struct pollfd *fds;
+    sigset_t signals;
+    pid_t self = getpid ();
+    int i, e = 0, ready = 0;
+    fds = (struct pollfd*)malloc ((count + 2) * sizeof (struct pollfd));
+    if (!fds) abort ();
+    fds[0].fd = parent ? watchdog_open (parent) : -1;
+    sigemptyset (&signals);
+    sigaddset (&signals, SIGTERM);
+    fds[1].fd = signalfd (-1, &signals, SFD_CLOEXEC | SFD_NONBLOCK);
+    for (i = 0; i < count; i++) {
+        fds[i + 2].fd = listeners[i];
+    }
+    for (i = 0; i < count + 2; i++) {
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+    if (PARAM (verbose) && parent) fprintf (stdout, "Watching process %u for termination\n", parent);
+    do {
+        if (parent && ((fds[0].fd >= 0) ? (fds[0].revents & POLLIN) : !_is_running (parent))) {
+            parent = PARAM (shared_lease) ? process_leaseholder (self) : 0;
+            if (!parent) {
+                if (PARAM (verbose)) fprintf (stdout, "Closing listening sockets on parent termination\n");
+                if (!PARAM (shared_lease)) process_update (self, "watchdog", NULL);
+                trace_instant ("watchdog", self, NULL);
+                e = ESRCH;
+                break;
+            }
+            watch_process (&fds[0], parent);
+        }
+        if (fds[1].revents & POLLIN) {
+            if (PARAM (verbose)) fprintf (stdout, "Closing listening sockets\n");
+            e = ECANCELED;
+            break;
+        }
+        for (i = 2; i < count + 2; i++) {
+            if (fds[i].revents & POLLIN) ready = 1;
+        }
+        if (ready) break;
+        for (i = 0; i < count + 2; i++) {
+            fds[i].revents = 0;
+        }
+        if ((poll (fds, count + 2, (parent && (fds[0].fd < 0)) ? 1000 : -1) < 0) && (errno != EINTR)) {
+            e = errno;
+            break;
+        }
+    } while (1);
+    if (fds[0].fd >= 0) close (fds[0].fd);
+    if (fds[1].fd >= 0) close (fds[1].fd);
+    free (fds);
+    return e;
+}
+
+/// @brief Calculates the delay before restarting a process
+///
+/// The delay doubles with each consecutive attempt, from WATCHDOG_BACKOFF_MIN
+/// up to WATCHDOG_BACKOFF_MAX milliseconds. A random delay of up to half of
+/// that is subtracted, so that processes which failed together, for example
+/// because of a shared dependency, don't all restart at the same moment.
+///
+/// @return the delay in milliseconds
+int watchdog_backoff (
+    int attempt, ///<the number of consecutive restarts already made>
+    unsigned *seed ///<the random number state>
+    ) {
+    int delay = WATCHDOG_BACKOFF_MIN;
+    while ((attempt-- > 0) && (delay < WATCHDOG_BACKOFF_MAX)) delay *= 2;
+    if (delay > WATCHDOG_BACKOFF_MAX) delay = WATCHDOG_BACKOFF_MAX;
+    return delay - rand_r (seed) % (delay / 2 + 1);
+}
+
+#endif /* ifndef _WIN32 */
@@ -11,6 +11,25 @@
 /// @file
 /// @brief Process termination watchdog
 
+#ifndef _WIN32
+#include <sys/types.h>
+struct rusage;
+#endif /* ifndef _WIN32 */
+
+/// @brief The delay before the first restart of a process, in milliseconds
+#define WATCHDOG_BACKOFF_MIN    100
+/// @brief The longest delay before restarting a process, in milliseconds
+///
+/// A process that ran for at least this long before terminating is restarted
+/// after the shortest delay again.
+#define WATCHDOG_BACKOFF_MAX    30000
+
 int watchdog (int count, ...);
+#ifndef _WIN32
+int watchdog_open (pid_t process);
+int watchdog_activate (const int *listeners, int count, pid_t parent);
+int watchdog_supervise (pid_t child, pid_t parent, int *ready, int *status, struct rusage *usage);
+int watchdog_backoff (int attempt, unsigned *seed);
+#endif /* ifndef _WIN32 */
 
 #endif /* ifndef __inc_watchdog_h */